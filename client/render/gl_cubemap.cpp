@@ -27,6 +27,7 @@ GNU General Public License for more details.
 #include "gl_debug.h"
 #include "gl_viewport.h"
 #include "gl_unit_cube.h"
+#include "gl_spatial.h"
 
 static word g_shaderFilterSpecularIBL;
 
@@ -40,6 +41,21 @@ void R_InitCubemapShaders()
 	g_shaderFilterSpecularIBL = GL_FindShader("common/ibl_filter_specular", "common/ibl_filter_specular", "common/ibl_filter_specular");
 }
 
+static float CubemapDistance( const Vector &origin, const Vector &pos )
+{
+	return VectorDistance( origin, pos );
+}
+
+static float CubemapDistanceSqr( const Vector &origin, const Vector &pos )
+{
+	return ( origin - pos ).LengthSqr();
+}
+
+static bool CubemapInFrontOfPlane( int index, const void *context )
+{
+	return PlaneDiff( world->cubemaps[index].origin, (const mplane_t *)context ) >= 0.0f;
+}
+
 /*
 =================
 CL_FindNearestCubeMap
@@ -49,24 +65,15 @@ find the nearest cubemap for a given point
 */
 void CL_FindNearestCubeMap( const Vector &pos, mcubemap_t **result )
 {
-	if( !result ) return;
+	int	index;
 
-	float maxDist = 99999.0f;
-	*result = NULL;
+	if( !result ) return;
 
-	for( int i = 0; i < world->num_cubemaps; i++ )
+	if( R_SpatialFindNearest( &world->cubemaptree, pos, 1, &index, 99999.0f, CubemapDistance ))
 	{
-		mcubemap_t *check = &world->cubemaps[i];
-		float dist = VectorDistance( check->origin, pos );
-
-		if( dist < maxDist )
-		{
-			*result = check;
-			maxDist = dist;
-		}
+		*result = &world->cubemaps[index];
 	}
-
-	if( !*result )
+	else
 	{
 		// this may happens if map
 		// doesn't have any cubemaps
@@ -83,11 +90,10 @@ find the nearest cubemap on front of plane
 */
 void CL_FindNearestCubeMapForSurface( const Vector &pos, const msurface_t *surf, mcubemap_t **result )
 {
-	if( !result ) return;
+	mplane_t	plane;
+	int	index;
 
-	float maxDist = 99999.0f;
-	mplane_t plane;
-	*result = NULL;
+	if( !result ) return;
 
 	plane = *surf->plane;
 
@@ -97,20 +103,12 @@ void CL_FindNearestCubeMapForSurface( const Vector &pos, const msurface_t *surf,
 		plane.dist = -plane.dist;
 	}
 
-	for( int i = 0; i < world->num_cubemaps; i++ )
+	if( R_SpatialFindNearest( &world->cubemaptree, pos, 1, &index, 99999.0f, CubemapDistance, CubemapInFrontOfPlane, &plane ))
 	{
-		mcubemap_t *check = &world->cubemaps[i];
-		float dist = VectorDistance( check->origin, pos );
-
-		if( dist < maxDist && PlaneDiff( check->origin, &plane ) >= 0.0f )
-		{
-			*result = check;
-			maxDist = dist;
-		}
+		*result = &world->cubemaps[index];
+		return;
 	}
 
-	if( *result ) return;
-
 	// fallback to default method
 	CL_FindNearestCubeMap( pos, result );
 }
@@ -119,56 +117,25 @@ void CL_FindNearestCubeMapForSurface( const Vector &pos, const msurface_t *surf,
 =================
 CL_FindTwoNearestCubeMap
 
-find the two nearest cubemaps for a given point
+find the two nearest cubemaps for a given point,
+results that are not found keep their old values
 =================
 */
 void CL_FindTwoNearestCubeMap( const Vector &pos, mcubemap_t **result1, mcubemap_t **result2 )
 {
+	int	indexes[2];
+	int	count;
+
 	if( !result1 || !result2 )
 		return;
-#if 0
-	// faster, but not reliable
-	float maxDist1 = 999999.0f;
-	float maxDist2 = 999999.0f;
-	*result1 = *result2 = NULL;
 
-	for( int i = 0; i < world->num_cubemaps; i++ )
-	{
-		mcubemap_t *check = &world->cubemaps[i];
-		float dist = VectorDistance( check->origin, pos );
+	count = R_SpatialFindNearest( &world->cubemaptree, pos, 2, indexes, 999999.0f, CubemapDistanceSqr );
 
-		if( dist < maxDist1 )
-		{
-			*result1 = check;
-			maxDist1 = dist;
-		}
-		else if( dist < maxDist2 && dist > maxDist1 )
-		{
-			*result2 = check;
-			maxDist2 = dist;
-		}
-	}
-#else
-	// slower 2x, but reliable
-	float distances[2] = { 999999.f, 999999.f };
-	mcubemap_t **results[2] = { result1, result2 };
-	for (int j = 0; j < 2; ++j)
-	{
-		for (int i = 0; i < world->num_cubemaps; i++)
-		{
-			mcubemap_t *check = &world->cubemaps[i];
-			float dist = (check->origin - pos).LengthSqr();
-			if (dist < distances[j])
-			{
-				if (j < 1 || check != *results[j - 1])
-				{
-					*results[j] = check;
-					distances[j] = dist;
-				}
-			}
-		}
-	}
-#endif
+	if( count > 0 )
+		*result1 = &world->cubemaps[indexes[0]];
+
+	if( count > 1 )
+		*result2 = &world->cubemaps[indexes[1]];
 
 	if( !*result1 )
 	{
@@ -190,6 +157,8 @@ void CL_FindTwoNearestCubeMap( const Vector &pos, mcubemap_t **result1, mcubemap
 CL_FindTwoNearestCubeMapForSurface
 
 find the two nearest cubemaps on front of plane
+the second pick depends on scan order so this stays
+a linear scan, it only runs when surfaces are linked
 =================
 */
 void CL_FindTwoNearestCubeMapForSurface( const Vector &pos, const msurface_t *surf, mcubemap_t **result1, mcubemap_t **result2 )
@@ -330,6 +299,7 @@ void Mod_FreeCubemaps()
 	world->build_default_cubemap = false;
 	world->loading_cubemaps = false;
 	world->num_cubemaps = 0;
+	Mod_FreeSpatialTree(&world->cubemaptree);
 }
 
 /*
@@ -749,6 +719,16 @@ void Mod_LoadCubemaps(const byte *base, const dlump_t *l)
 		GL_CreateCubemap(in, out, i);
 	}
 
+	mspatialitem_t *items = (mspatialitem_t *)Mem_Alloc(Q_max(count, 1) * sizeof(mspatialitem_t));
+	for (int i = 0; i < count; i++)
+	{
+		VectorCopy(world->cubemaps[i].origin, items[i].origin);
+		items[i].radius = 0.0f;
+		items[i].index = i;
+	}
+	Mod_BuildSpatialTree(&world->cubemaptree, items, count);
+	Mem_Free(items);
+
 	// user request for disable autorebuild
 	//if (gEngfuncs.CheckParm("-noautorebuildcubemaps", NULL))
 	//{
@@ -22,6 +22,11 @@ GNU General Public License for more details.
 #include "gl_grass.h"
 #include "gl_cvars.h"
 
+#define CULLBENCH_DEFAULT_ITERATIONS	1000
+
+static int	cullbench_iterations;
+static int	cullbench_frame = -1;
+
 /*
 =============
 R_CullModel
@@ -235,3 +240,93 @@ bool R_CullNodeTopView( mnode_t *node )
 
 	return ( fabs( delta.x ) > size.x ) || ( fabs( delta.y ) > size.y );
 }
+
+/*
+=================
+R_BenchmarkCullBoxes
+
+replays every box list culled during one frame
+=================
+*/
+void R_BenchmarkCullBoxes( const CFrustum *frustum, const float *const mins[3], const float *const maxs[3], int count )
+{
+	CUtlArray<uint32_t>	visible;
+	double		start, scalar_time, batch_time;
+	int		numvisible = 0;
+	int		mismatches = 0;
+
+	if( !cullbench_iterations )
+		return;
+
+	if( cullbench_frame == -1 )
+	{
+		cullbench_frame = tr.realframecount;
+	}
+	else if( cullbench_frame != tr.realframecount )
+	{
+		cullbench_iterations = 0;
+		cullbench_frame = -1;
+		return;
+	}
+
+	if( count <= 0 )
+		return;
+
+	visible.SetCount(( count + 31 ) >> 5 );
+
+	start = Sys_DoubleTime();
+	for( int i = 0; i < cullbench_iterations; i++ )
+	{
+		numvisible = 0;
+
+		for( int j = 0; j < count; j++ )
+		{
+			if( !frustum->CullBoxFast( Vector( mins[0][j], mins[1][j], mins[2][j] ), Vector( maxs[0][j], maxs[1][j], maxs[2][j] )))
+				numvisible++;
+		}
+	}
+	scalar_time = Sys_DoubleTime() - start;
+
+	start = Sys_DoubleTime();
+	for( int i = 0; i < cullbench_iterations; i++ )
+		frustum->CullBoxList( mins, maxs, count, visible.Base() );
+	batch_time = Sys_DoubleTime() - start;
+
+	for( int j = 0; j < count; j++ )
+	{
+		bool culled = frustum->CullBoxFast( Vector( mins[0][j], mins[1][j], mins[2][j] ), Vector( maxs[0][j], maxs[1][j], maxs[2][j] ));
+
+		if( culled == ( FBitSet( visible[j >> 5], BIT( j & 31 )) != 0 ))
+			mismatches++;
+	}
+
+	if( mismatches )
+		Msg( "^1Error:^7 world leafs: batch culling differs from CullBoxFast on %i boxes\n", mismatches );
+
+	Msg( "world leafs: %i boxes, %i visible, scalar %.2f Mbox/s, batch %.2f Mbox/s\n", count, numvisible,
+		count * cullbench_iterations / Q_max( scalar_time, 1e-9 ) * 1e-6,
+		count * cullbench_iterations / Q_max( batch_time, 1e-9 ) * 1e-6 );
+}
+
+/*
+=================
+R_CullBench_f
+
+=================
+*/
+static void R_CullBench_f( void )
+{
+	int	iterations = CULLBENCH_DEFAULT_ITERATIONS;
+
+	if( CMD_ARGC() > 1 )
+		iterations = Q_max( 1, Q_atoi( CMD_ARGV( 1 )));
+
+	Msg( "capturing culled leafs of the next frame, %i iterations\n", iterations );
+	cullbench_iterations = iterations;
+	cullbench_frame = -1;
+}
+
+void R_InitCulling( void )
+{
+	ADD_COMMAND( "r_cullbench", R_CullBench_f );
+}
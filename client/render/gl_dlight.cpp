@@ -682,75 +682,229 @@ static float LightIntensityInBox( mworldlight_t *wl, const Vector &mid, const Ve
 
 /*
 =================
-R_FindWorldLights
+R_WorldLightReach
 
-search for lights that potentially can lit bbox
+how far a light can lit anything, LightIntensityAtPoint returns
+zero beyond that. Negative for lights that can reach everywhere
 =================
 */
-void R_FindWorldLights( const Vector &origin, const Vector &mins, const Vector &maxs, byte lights[MAXDYNLIGHTS], bool skipZ )
+static float R_WorldLightReach( const mworldlight_t *wl )
 {
-	mworldlight_t *wl = world->worldlights;
-	Vector absmin = origin + mins;
-	Vector absmax = origin + maxs;
-	vec2_t indexes[32];
-	int count = 0;
+	float	reach;
 
-	for( int i = 0; i < world->numworldlights; i++, wl++ )
+	switch( wl->emittype )
 	{
-		if( !Mod_BoxVisible( absmin, absmax, wl->pvs ))
-			continue;
+	case emit_spotlight:
+	case emit_point:
+		reach = wl->radius;
+		break;
+	case emit_surface:
+		// inverse square falloff drops below the 4e-3 cutoff
+		reach = sqrt( wl->intensity.MaxCoord() / 4e-3 );
+		break;
+	default:
+		return -1.0f;
+	}
+
+	// catch NaN and infinity
+	if( !( reach < 1e30f ))
+		return -1.0f;
 
-		float ratio = LightIntensityInBox( wl, origin, mins, maxs, skipZ );
+	// falloff distance never drops below one unit, plus a margin for rounding
+	return Q_max( reach, 1.0f ) * 1.01f + 1.0f;
+}
 
-		// no light contribution?
-		if( ratio <= 0.0f ) continue;
+/*
+=================
+R_BuildWorldLightTree
 
-		Vector add = wl->intensity * ratio;
-		float illum = add.MaxCoord();
-//Msg( "#%i, type %d, illum %.5f, intensity %g %g %g\n", i, wl->emittype, illum, wl->intensity[0], wl->intensity[1], wl->intensity[2] );
-		if( illum <= 4e-3 )
-			continue;
+put worldlights into spatial tree and collect
+the lights that can reach every world leaf
+=================
+*/
+void R_BuildWorldLightTree( void )
+{
+	CUtlArray<word>	candidates;
+	mspatialitem_t	*items;
+	int		*list, *offsets;
+	int		i, j, count;
 
-		if( count >= ARRAYSIZE( indexes ) / 2 )
-			break;
+	R_FreeWorldLightTree();
 
-		indexes[count][0] = i;
-		indexes[count][1] = illum;
+	if( world->numworldlights <= 0 )
+		return;
+
+	items = (mspatialitem_t *)Mem_Alloc( world->numworldlights * sizeof( mspatialitem_t ));
+
+	for( i = count = 0; i < world->numworldlights; i++ )
+	{
+		mworldlight_t *wl = &world->worldlights[i];
+
+		// too dark to pass R_FindWorldLights anywhere
+		if( wl->intensity.MaxCoord() <= 4e-3 )
+			continue;
+
+		VectorCopy( wl->origin, items[count].origin );
+		items[count].radius = R_WorldLightReach( wl );
+		items[count].index = i;
 		count++;
 	}
 
-	memset( lights, 255, sizeof( byte ) * MAXDYNLIGHTS );
-get_next_light:
-	float maxIllum = 0.0;
-	int ignored = -1;
-	int light = 255;
+	Mod_BuildSpatialTree( &world->lighttree, items, count );
+	Mem_Free( items );
 
-	for( int i = 0; i < count; i++ )
+	list = (int *)Mem_Alloc( world->numworldlights * sizeof( int ));
+	offsets = (int *)Mem_Alloc( world->numleafs * sizeof( int ));
+
+	for( i = 0; i < world->numleafs; i++ )
 	{
-		if( indexes[i][0] == -1.0f )
-			continue;
+		mleaf_t *leaf = &worldmodel->leafs[i];
+		Vector mins( leaf->minmaxs[0], leaf->minmaxs[1], leaf->minmaxs[2] );
+		Vector maxs( leaf->minmaxs[3], leaf->minmaxs[4], leaf->minmaxs[5] );
 
-		// skylight has a maximum priority
-		if( indexes[i][1] > maxIllum )
-		{
-			maxIllum = indexes[i][1];
-			light = indexes[i][0];
-			ignored = i;
-		}
+		count = R_SpatialFindInBox( &world->lighttree, mins, maxs, list, world->numworldlights );
+		offsets[i] = candidates.Count();
+
+		for( j = 0; j < count; j++ )
+			candidates.AddToTail( (word)list[j] );
+		world->leafs[i].num_candidatelights = count;
 	}
 
-	if( ignored == -1 )
-		return;
+	if( candidates.Count() > 0 )
+	{
+		world->candidatelights = (word *)Mem_Alloc( candidates.Count() * sizeof( word ));
+		memcpy( world->candidatelights, candidates.Base(), candidates.Count() * sizeof( word ));
+	}
 
+	for( i = 0; i < world->numleafs; i++ )
+		world->leafs[i].candidate_lights = world->candidatelights + offsets[i];
+
+	ALERT( at_aiconsole, "%i worldlight candidates for %i leafs\n", candidates.Count(), world->numleafs );
+
+	Mem_Free( offsets );
+	Mem_Free( list );
+}
+
+/*
+=================
+R_FreeWorldLightTree
+
+=================
+*/
+void R_FreeWorldLightTree( void )
+{
+	Mod_FreeSpatialTree( &world->lighttree );
+
+	if( world->candidatelights )
+		Mem_Free( world->candidatelights );
+	world->candidatelights = NULL;
+
+	for( int i = 0; world->leafs && i < world->numleafs; i++ )
+	{
+		world->leafs[i].candidate_lights = NULL;
+		world->leafs[i].num_candidatelights = 0;
+	}
+}
+
+typedef struct
+{
+	int		indexes[16];
+	float		illum[16];
+	int		count;
+} boxlights_t;
+
+/*
+=================
+R_AddBoxLight
+
+returns false when there is no room for more lights
+=================
+*/
+static bool R_AddBoxLight( boxlights_t *box, int index, const Vector &origin, const Vector &absmin, const Vector &absmax, const Vector &mins, const Vector &maxs, bool skipZ )
+{
+	mworldlight_t *wl = &world->worldlights[index];
 	int i;
-	for( i = 0; i < MAXDYNLIGHTS && lights[i] != 255; i++ );
 
-	if( i < MAXDYNLIGHTS )
-		lights[i] = light;	// nearest light for surf
+	if( !Mod_BoxVisible( absmin, absmax, wl->pvs ))
+		return true;
+
+	float ratio = LightIntensityInBox( wl, origin, mins, maxs, skipZ );
+
+	// no light contribution?
+	if( ratio <= 0.0f ) return true;
+
+	Vector add = wl->intensity * ratio;
+	float illum = add.MaxCoord();
+
+	if( illum <= 4e-3 )
+		return true;
+
+	if( box->count >= (int)ARRAYSIZE( box->indexes ))
+		return false;
+
+	// brightest first, equal lights keep index order
+	for( i = box->count; i > 0 && box->illum[i - 1] < illum; i-- )
+	{
+		box->indexes[i] = box->indexes[i - 1];
+		box->illum[i] = box->illum[i - 1];
+	}
+
+	box->indexes[i] = index;
+	box->illum[i] = illum;
+	box->count++;
+
+	return true;
+}
+
+/*
+=================
+R_FindWorldLights
+
+search for lights that potentially can lit bbox
+=================
+*/
+void R_FindWorldLights( const Vector &origin, const Vector &mins, const Vector &maxs, byte lights[MAXDYNLIGHTS], bool skipZ )
+{
+	static CUtlArray<int> list;
+	Vector absmin = origin + mins;
+	Vector absmax = origin + maxs;
+	boxlights_t box;
+	int i, count;
+
+	memset( lights, 255, sizeof( byte ) * MAXDYNLIGHTS );
+	box.count = 0;
+
+	if( world->numworldlights <= 0 )
+		return;
 
-	indexes[ignored][0] = -1;	// this light is handled
+	mleaf_t *leaf = Mod_PointInLeaf( origin, worldmodel->nodes );
+	int leafnum = leaf - worldmodel->leafs;
+
+	// candidates of a leaf are only valid for points inside of it
+	if( leafnum > 0 && leafnum < world->numleafs
+		&& origin.x >= leaf->minmaxs[0] && origin.y >= leaf->minmaxs[1] && origin.z >= leaf->minmaxs[2]
+		&& origin.x <= leaf->minmaxs[3] && origin.y <= leaf->minmaxs[4] && origin.z <= leaf->minmaxs[5] )
+	{
+		mextraleaf_t *eleaf = &world->leafs[leafnum];
+
+		for( i = 0; i < eleaf->num_candidatelights; i++ )
+		{
+			if( !R_AddBoxLight( &box, eleaf->candidate_lights[i], origin, absmin, absmax, mins, maxs, skipZ ))
+				break;
+		}
+	}
+	else
+	{
+		list.SetCount( world->numworldlights );
+		count = R_SpatialFindInBox( &world->lighttree, origin, origin, list.Base(), world->numworldlights );
+
+		for( i = 0; i < count; i++ )
+		{
+			if( !R_AddBoxLight( &box, list[i], origin, absmin, absmax, mins, maxs, skipZ ))
+				break;
+		}
+	}
 
-//	if( count > (int)cv_deferred_maxlights->value && i == (int)cv_deferred_maxlights->value )
-//		Msg( "skipped light %i intensity %g, type %d\n", light, maxIllum, world->worldlights[light].emittype );
-	goto get_next_light;	
+	for( i = 0; i < box.count && i < MAXDYNLIGHTS; i++ )
+		lights[i] = box.indexes[i];	// nearest light for surf
 }
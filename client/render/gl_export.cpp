@@ -29,6 +29,9 @@ GNU General Public License for more details.
 #include "gl_debug.h"
 #include "imgui_manager.h"
 #include "r_weather.h"
+#include "gl_sort.h"
+#include "gl_rpart.h"
+#include "gl_jobs.h"
 
 #define MAX_RESERVED_UNIFORMS		22	// while MAX_LIGHTSTYLES 64
 #define PROJ_SIZE			64
@@ -1051,6 +1054,11 @@ bool GL_Init( void )
 	R_InitWeather();
 	DecalsInit();
 	R_GrassInit();
+	R_InitDrawListSort();
+	R_InitCulling();
+	R_InitSpatialTree();
+	g_pParticles.Init();
+	R_InitJobs();
 
 	return true;
 }
@@ -1064,6 +1072,7 @@ void GL_Shutdown( void )
 {
 	int	i;
 
+	R_ShutdownJobs();
 	g_StudioRenderer.DestroyAllModelInstances();
 	g_StudioRenderer.FreeStudioCacheVL();
 	g_StudioRenderer.FreeStudioCacheFL();
@@ -21,6 +21,7 @@ GNU General Public License for more details.
 #include "gl_shader.h"
 #include "gl_cvars.h"
 #include "gl_debug.h"
+#include "gl_sort.h"
 #include <utlarray.h>
 #include <vector>
 #include <stringlib.h>
@@ -862,22 +863,15 @@ void R_SetGrassUniforms( word hProgram, grass_t *grass )
 
 /*
 =================
-R_SortGrassMeshes
+R_GrassSortKey
 
 sort by texture
 =================
 */
-static int R_SortGrassMeshes( struct grass_s *const *pa, struct grass_s *const *pb )
+static uint64_t R_GrassSortKey( struct grass_s *const *entry )
 {
-	grass_t *a = (grass_t *)*pa;
-	grass_t *b = (grass_t *)*pb;
-
-	if( a->texture > b->texture )
-		return -1;
-	if( a->texture < b->texture )
-		return 1;
-
-	return 0;
+	// descending texture order
+	return (uint64_t)( 0xFF - (*entry)->texture );
 }
 
 /*
@@ -912,7 +906,7 @@ void R_RenderGrassOnList( void )
 
 	// sorting list to reduce shader switches
 	if( !CVAR_TO_BOOL( cv_nosort ))
-		RI->frame.grass_list.Sort( R_SortGrassMeshes );
+		R_SortDrawList( RI->frame.grass_list, R_GrassSortKey, "grass" );
 
 	for( int i = 0; i < RI->frame.grass_list.Count(); i++ )
 	{
@@ -981,7 +975,7 @@ void R_DrawLightForGrass( CDynLight *pl )
 
 	// sorting list to reduce shader switches
 	if( !CVAR_TO_BOOL( cv_nosort ))
-		RI->frame.light_grass.Sort( R_SortGrassMeshes );
+		R_SortDrawList( RI->frame.light_grass, R_GrassSortKey, "light grass" );
 
 	for( int i = 0; i < RI->frame.light_grass.Count(); i++ )
 	{
@@ -1059,7 +1053,7 @@ void R_RenderShadowGrassOnList( void )
 
 	// sorting list to reduce shader switches
 	if( !CVAR_TO_BOOL( cv_nosort ))
-		RI->frame.grass_list.Sort( R_SortGrassMeshes );
+		R_SortDrawList( RI->frame.grass_list, R_GrassSortKey, "grass" );
 
 	for( int i = 0; i < RI->frame.grass_list.Count(); i++ )
 	{
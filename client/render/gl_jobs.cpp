@@ -0,0 +1,197 @@
+/*
+gl_jobs.cpp - worker threads for the independent per-frame tasks
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "hud.h"
+#include "utils.h"
+#include "gl_jobs.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+typedef struct
+{
+	std::mutex		mutex;
+	std::condition_variable	wake;		// signalled when new pass is started
+	std::condition_variable	done;		// signalled when last worker is finished
+	pfnJobItem		func;
+	void			*context;
+	int			count;
+	int			numactive;	// threads allowed to take items in this pass
+	std::atomic<int>		next;		// first item that nobody has taken yet
+	int			generation;	// incremented for each pass
+	int			numbusy;		// workers which are still in the pass
+	bool			shutdown;
+	std::thread		workers[MAX_JOB_THREADS - 1];
+	int			numworkers;
+} jobpool_t;
+
+static jobpool_t		*jobs;
+static cvar_t		*r_jobs;
+
+/*
+=================
+R_RunJobItems
+
+=================
+*/
+static void R_RunJobItems( int thread )
+{
+	int	item;
+
+	while(( item = jobs->next.fetch_add( 1, std::memory_order_relaxed )) < jobs->count )
+		jobs->func( jobs->context, item, thread );
+}
+
+/*
+=================
+R_JobWorker
+
+=================
+*/
+static void R_JobWorker( int thread )
+{
+	int	generation = 0;
+
+	while( 1 )
+	{
+		{
+			std::unique_lock<std::mutex> lock( jobs->mutex );
+			jobs->wake.wait( lock, [&]() { return jobs->shutdown || jobs->generation != generation; });
+
+			if( jobs->shutdown )
+				return;
+
+			generation = jobs->generation;
+		}
+
+		if( thread < jobs->numactive )
+			R_RunJobItems( thread );
+
+		std::lock_guard<std::mutex> lock( jobs->mutex );
+
+		if( --jobs->numbusy == 0 )
+			jobs->done.notify_one();
+	}
+}
+
+/*
+=================
+R_InitJobs
+
+=================
+*/
+void R_InitJobs( void )
+{
+	if( jobs ) return;
+
+	r_jobs = CVAR_REGISTER( "r_jobs", "0", FCVAR_ARCHIVE );
+
+	jobs = new jobpool_t;
+	jobs->func = NULL;
+	jobs->context = NULL;
+	jobs->count = 0;
+	jobs->numactive = 0;
+	jobs->next = 0;
+	jobs->generation = 0;
+	jobs->numbusy = 0;
+	jobs->shutdown = false;
+	jobs->numworkers = bound( 1, (int)std::thread::hardware_concurrency(), MAX_JOB_THREADS ) - 1;
+
+	for( int i = 0; i < jobs->numworkers; i++ )
+		jobs->workers[i] = std::thread( R_JobWorker, i + 1 );
+
+	ALERT( at_aiconsole, "R_InitJobs: %i worker threads\n", jobs->numworkers );
+}
+
+/*
+=================
+R_ShutdownJobs
+
+=================
+*/
+void R_ShutdownJobs( void )
+{
+	if( !jobs ) return;
+
+	{
+		std::lock_guard<std::mutex> lock( jobs->mutex );
+		jobs->shutdown = true;
+	}
+
+	jobs->wake.notify_all();
+
+	for( int i = 0; i < jobs->numworkers; i++ )
+		jobs->workers[i].join();
+
+	delete jobs;
+	jobs = NULL;
+}
+
+/*
+=================
+R_JobThreadCount
+
+=================
+*/
+int R_JobThreadCount( void )
+{
+	if( !jobs ) return 1;
+
+	// r_jobs 0 is all of the cores
+	if( r_jobs->value <= 0.0f )
+		return jobs->numworkers + 1;
+
+	return bound( 1, (int)r_jobs->value, jobs->numworkers + 1 );
+}
+
+/*
+=================
+R_RunJobs
+
+=================
+*/
+void R_RunJobs( pfnJobItem pfnItem, void *context, int count )
+{
+	int	numthreads = R_JobThreadCount();
+
+	if( count <= 0 )
+		return;
+
+	if( numthreads <= 1 || count == 1 )
+	{
+		for( int i = 0; i < count; i++ )
+			pfnItem( context, i, 0 );
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( jobs->mutex );
+		jobs->func = pfnItem;
+		jobs->context = context;
+		jobs->count = count;
+		jobs->numactive = numthreads;
+		jobs->next = 0;
+		jobs->numbusy = jobs->numworkers;
+		jobs->generation++;
+	}
+
+	jobs->wake.notify_all();
+
+	// main thread works too
+	R_RunJobItems( 0 );
+
+	std::unique_lock<std::mutex> lock( jobs->mutex );
+	jobs->done.wait( lock, []() { return jobs->numbusy == 0; });
+}
@@ -0,0 +1,31 @@
+/*
+gl_jobs.h - worker threads for the independent per-frame tasks
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#pragma once
+
+#define MAX_JOB_THREADS		8	// including the main thread
+
+// thread is in range [0, R_JobThreadCount()), main thread is always 0
+typedef void (*pfnJobItem)( void *context, int item, int thread );
+
+void R_InitJobs( void );
+void R_ShutdownJobs( void );
+
+// how many threads may execute a single pass, for per-thread scratch
+int R_JobThreadCount( void );
+
+// calls pfnItem for every item in [0, count) and returns when all of them are done.
+// Items run in any order and on any thread, so they must not touch the engine or GL.
+// Passes are not reentrant, don't start a new one from inside the item
+void R_RunJobs( pfnJobItem pfnItem, void *context, int count );
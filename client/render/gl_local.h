@@ -796,6 +796,8 @@ bool R_CullModel( cl_entity_t *e, const Vector &mins, const Vector &maxs );
 int R_CullSurface( msurface_t *surf, const Vector &vieworg, CFrustum *frustum, int clipFlags = 0 );
 bool R_CullBrushModel( cl_entity_t *e );
 bool R_CullNodeTopView( mnode_t *node );
+void R_BenchmarkCullBoxes( const CFrustum *frustum, const float *const mins[3], const float *const maxs[3], int count );
+void R_InitCulling( void );
 
 #define R_CullBox( mins, maxs )		( RI->view.frustum.CullBoxFast( mins, maxs ))
 #define R_CullSphere( centre, radius )		( RI->view.frustum.CullSphere( centre, radius ))
@@ -833,6 +835,8 @@ void R_LightmapCoords( struct mstudiosurface_t *surf, const Vector &vec, const V
 CDynLight *CL_AllocDlight( int key );
 void R_SetupLightParams( CDynLight *pl, const Vector &origin, const Vector &angles, float radius, float fov, int type, int flags = 0 );
 void R_FindWorldLights( const Vector &origin, const Vector &mins, const Vector &maxs, byte lights[MAXDYNLIGHTS], bool skipZ = false );
+void R_BuildWorldLightTree( void );
+void R_FreeWorldLightTree( void );
 void R_LightForStudio( const Vector &point, mstudiolight_t *light, bool ambient );
 void R_PointAmbientFromLeaf( const Vector &point, mstudiolight_t *light );
 void R_LightForSky( const Vector &point, mstudiolight_t *light );
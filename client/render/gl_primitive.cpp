@@ -26,11 +26,18 @@ GNU General Public License for more details.
 
 void CSolidEntry :: SetRenderPrimitive( const Vector verts[4], const Vector4D &color, TextureHandle texture, int rendermode )
 {
-	m_bDrawType = DRAWTYPE_QUAD;
-	m_iStartVertex = RI->frame.primverts.Count();
+	int startVertex = RI->frame.primverts.Count();
 
 	for( int i = 0; i < 4; i++ )
 		RI->frame.primverts.AddToTail( verts[i] );
+	SetRenderPrimitive( startVertex, color, texture, rendermode );
+}
+
+// vertexes are already in the frame heap
+void CSolidEntry :: SetRenderPrimitive( int startVertex, const Vector4D &color, TextureHandle texture, int rendermode )
+{
+	m_bDrawType = DRAWTYPE_QUAD;
+	m_iStartVertex = startVertex;
 	m_iColor = PackRGBA( color.x * 255, color.y * 255, color.z * 255, color.w * 255 );
 	m_iRenderMode = rendermode;
 	m_hTexture = texture;
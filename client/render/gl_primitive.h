@@ -30,6 +30,7 @@ class CSolidEntry
 {
 public:
 	void SetRenderPrimitive( const Vector verts[4], const Vector4D &color, TextureHandle texture, int rendermode );
+	void SetRenderPrimitive( int startVertex, const Vector4D &color, TextureHandle texture, int rendermode );
 	void SetRenderSurface( msurface_t *surface, word hProgram );
 	void SetRenderMesh( struct vbomesh_t *mesh, word hProgram );
 	virtual bool IsTranslucent( void ) { return false; }
@@ -51,6 +52,7 @@ public:
 
 	uint32_t m_hProgram;			// handle to glsl program (may be 0)
 	TextureHandle	m_hTexture;	// texture for primitive (OpenGL texture handle)
+	uint64_t		m_iSortKey;	// packed render state, see R_SortDrawList
 
 	union
 	{
@@ -250,7 +250,7 @@ void R_MarkWorldVisibleFaces( model_t *model )
 	float		maxdist = 0.0f;
 	msurface_t	**mark;
 	mleaf_t		*leaf;
-	int			i, j;
+	int			i, j, count;
 	const bool  skipCulling = CVAR_TO_BOOL(r_nocull);
 
 	ZoneScoped;
@@ -260,48 +260,72 @@ void R_MarkWorldVisibleFaces( model_t *model )
 
 	if( !model ) return; // just clear visibility and out
 
+	float *mins[3] = { world->cullbounds, world->cullbounds + world->numleafs, world->cullbounds + world->numleafs * 2 };
+	float *maxs[3] = { world->cullbounds + world->numleafs * 3, world->cullbounds + world->numleafs * 4, world->cullbounds + world->numleafs * 5 };
+
+	// gather the leafs in PVS to cull them all at once,
 	// always skip the leaf 0, because is outside leaf
-	for( i = 1, leaf = &model->leafs[1]; i < model->numleafs + 1; i++, leaf++ )
+	for( i = 1, count = 0, leaf = &model->leafs[1]; i < model->numleafs + 1; i++, leaf++ )
 	{
-		mextraleaf_t *eleaf = LEAF_INFO( leaf, model );	// named like personal vaporisers manufacturer he-he
+		if( !CHECKVISBIT( RI->view.pvsarray, leaf->cluster ) || ( !leaf->efrags && !leaf->nummarksurfaces ))
+			continue;
+
+		mextraleaf_t *eleaf = LEAF_INFO( leaf, model );
 
-		if( CHECKVISBIT( RI->view.pvsarray, leaf->cluster ) && ( leaf->efrags || leaf->nummarksurfaces ))
+		for( j = 0; j < 3; j++ )
 		{
-			if( !skipCulling && RI->view.frustum.CullBoxFast( eleaf->mins, eleaf->maxs ))
-				continue;
+			mins[j][count] = eleaf->mins[j];
+			maxs[j][count] = eleaf->maxs[j];
+		}
+
+		world->cullleafs[count++] = i;
+	}
 
-			// do additional culling in dev_overview mode
-			if( FBitSet( RI->params, RP_DRAW_OVERVIEW ) && R_CullNodeTopView( (mnode_t *)leaf ))
-				continue;
+	if( skipCulling )
+		memset( world->cullmask, 0xFF, (( count + 31 ) >> 5 ) * sizeof( uint32_t ));
+	else RI->view.frustum.CullBoxList( mins, maxs, count, world->cullmask );
 
-			// deal with model fragments in this leaf
-			if( leaf->efrags && RP_NORMALPASS( ))
-				STORE_EFRAGS( &leaf->efrags, tr.realframecount );
+	R_BenchmarkCullBoxes( &RI->view.frustum, mins, maxs, count );
 
-			if( leaf->contents == CONTENTS_EMPTY )
-			{
-				// unrolled for speedup reasons
-				RI->view.visMins[0] = Q_min( RI->view.visMins[0], eleaf->mins[0] );
-				RI->view.visMaxs[0] = Q_max( RI->view.visMaxs[0], eleaf->maxs[0] );
-				RI->view.visMins[1] = Q_min( RI->view.visMins[1], eleaf->mins[1] );
-				RI->view.visMaxs[1] = Q_max( RI->view.visMaxs[1], eleaf->maxs[1] );
-				RI->view.visMins[2] = Q_min( RI->view.visMins[2], eleaf->mins[2] );
-				RI->view.visMaxs[2] = Q_max( RI->view.visMaxs[2], eleaf->maxs[2] );
-			}
+	for( i = 0; i < count; i++ )
+	{
+		if( !FBitSet( world->cullmask[i >> 5], BIT( i & 31 )))
+			continue;
+
+		leaf = &model->leafs[world->cullleafs[i]];
+		mextraleaf_t *eleaf = LEAF_INFO( leaf, model );	// named like personal vaporisers manufacturer he-he
+
+		// do additional culling in dev_overview mode
+		if( FBitSet( RI->params, RP_DRAW_OVERVIEW ) && R_CullNodeTopView( (mnode_t *)leaf ))
+			continue;
+
+		// deal with model fragments in this leaf
+		if( leaf->efrags && RP_NORMALPASS( ))
+			STORE_EFRAGS( &leaf->efrags, tr.realframecount );
+
+		if( leaf->contents == CONTENTS_EMPTY )
+		{
+			// unrolled for speedup reasons
+			RI->view.visMins[0] = Q_min( RI->view.visMins[0], eleaf->mins[0] );
+			RI->view.visMaxs[0] = Q_max( RI->view.visMaxs[0], eleaf->maxs[0] );
+			RI->view.visMins[1] = Q_min( RI->view.visMins[1], eleaf->mins[1] );
+			RI->view.visMaxs[1] = Q_max( RI->view.visMaxs[1], eleaf->maxs[1] );
+			RI->view.visMins[2] = Q_min( RI->view.visMins[2], eleaf->mins[2] );
+			RI->view.visMaxs[2] = Q_max( RI->view.visMaxs[2], eleaf->maxs[2] );
+		}
 
-			r_stats.c_world_leafs++;
+		r_stats.c_world_leafs++;
 
-			if( leaf->nummarksurfaces )
+		if( leaf->nummarksurfaces )
+		{
+			for( j = 0, mark = leaf->firstmarksurface; j < leaf->nummarksurfaces; j++, mark++ )
 			{
-				for( j = 0, mark = leaf->firstmarksurface; j < leaf->nummarksurfaces; j++, mark++ )
-				{
-					msurface_t *surf = *mark;
+				msurface_t *surf = *mark;
 
-					// construct grass and update leaf bounds
-					if( surf->info->grasscount && RP_NORMALPASS( ))
-						R_PrecacheGrass( surf, eleaf );
-					SETVISBIT( RI->view.visfaces, *mark - model->surfaces );
-				}
+				// construct grass and update leaf bounds
+				if( surf->info->grasscount && RP_NORMALPASS( ))
+					R_PrecacheGrass( surf, eleaf );
+				SETVISBIT( RI->view.visfaces, *mark - model->surfaces );
 			}
 		}
 	}
@@ -575,6 +599,9 @@ static void R_SetupViewCache( const ref_viewpass_t *rvp )
 			// we can add muzzleflashes here
 			R_RunViewmodelEvents();
 
+			// pose studio models on the job threads
+			R_SetupStudioBones();
+
 			// brush faces not added here!
 			// only marks as visible in RI->view.visfaces array
 			for( i = 0; i < tr.num_draw_entities; i++ )
@@ -25,33 +25,248 @@ GNU General Public License for more details.
 #include "event_api.h"
 #include "triangleapi.h"
 #include "gl_sprite.h"
+#include "simd4.h"
+
+#define PARTBENCH_DEFAULT_COUNT	MAX_PARTICLES
+#define PARTBENCH_ITERATIONS		100
 
 CQuakePartSystem	g_pParticles;
 
-bool CQuakePart :: Evaluate( float gravity )
+static inline Vector LoadVector( const float v[3][MAX_PARTICLES], int index )
 {
-	Vector org, org2, org3, vel;
+	return Vector( v[0][index], v[1][index], v[2][index] );
+}
 
-	float time = ( tr.time - m_flTime );
-	float time2 = time * time;
+static inline void StoreVector( float v[3][MAX_PARTICLES], int index, const Vector &vec )
+{
+	v[0][index] = vec.x;
+	v[1][index] = vec.y;
+	v[2][index] = vec.z;
+}
 
-	float curAlpha = m_flAlpha + m_flAlphaVelocity * time;
-	float curRadius = m_flRadius + m_flRadiusVelocity * time;
-	float curLength = m_flLength + m_flLengthVelocity * time;
+/*
+=================
+CQuakePartPool :: Alloc
 
-	if( curAlpha <= 0.0f || curRadius <= 0.0f || curLength <= 0.0f )
+=================
+*/
+int CQuakePartPool :: Alloc( void )
+{
+	if( m_iNumParticles >= MAX_PARTICLES )
+		return -1;
+	return m_iNumParticles++;
+}
+
+/*
+=================
+CQuakePartPool :: Remove
+
+keeps the pool packed, order of particles is not preserved
+=================
+*/
+void CQuakePartPool :: Remove( int index )
+{
+	int last = --m_iNumParticles;
+
+	if( index == last )
+		return;
+
+	for( int j = 0; j < 3; j++ )
 	{
-		// faded out
-		return false;
+		m_flOrigin[j][index] = m_flOrigin[j][last];
+		m_flVelocity[j][index] = m_flVelocity[j][last];
+		m_flAccel[j][index] = m_flAccel[j][last];
+		m_flColor[j][index] = m_flColor[j][last];
+		m_flColorVelocity[j][index] = m_flColorVelocity[j][last];
+		m_flLastOrg[j][index] = m_flLastOrg[j][last];
+		m_flCurOrigin[j][index] = m_flCurOrigin[j][last];
+		m_flCurColor[j][index] = m_flCurColor[j][last];
+		m_flStretchOrg[j][index] = m_flStretchOrg[j][last];
+	}
+
+	m_flAlpha[index] = m_flAlpha[last];
+	m_flAlphaVelocity[index] = m_flAlphaVelocity[last];
+	m_flRadius[index] = m_flRadius[last];
+	m_flRadiusVelocity[index] = m_flRadiusVelocity[last];
+	m_flLength[index] = m_flLength[last];
+	m_flLengthVelocity[index] = m_flLengthVelocity[last];
+	m_flRotation[index] = m_flRotation[last];
+	m_flBounceFactor[index] = m_flBounceFactor[last];
+	m_flTime[index] = m_flTime[last];
+	m_hTexture[index] = m_hTexture[last];
+	m_iFlags[index] = m_iFlags[last];
+	m_flCurAlpha[index] = m_flCurAlpha[last];
+	m_flCurRadius[index] = m_flCurRadius[last];
+	m_flCurLength[index] = m_flCurLength[last];
+	m_bFaded[index] = m_bFaded[last];
+}
+
+/*
+=================
+CQuakePartPool :: SetParticle
+
+=================
+*/
+void CQuakePartPool :: SetParticle( int index, const CQuakePart *src, TextureHandle texture, int flags, float time )
+{
+	StoreVector( m_flOrigin, index, src->m_vecOrigin );
+	StoreVector( m_flVelocity, index, src->m_vecVelocity );
+	StoreVector( m_flAccel, index, src->m_vecAccel );
+	StoreVector( m_flColor, index, src->m_vecColor );
+	StoreVector( m_flColorVelocity, index, src->m_vecColorVelocity );
+
+	// stretched particles without history are drawn towards the spawn point
+	StoreVector( m_flLastOrg, index, src->m_vecOrigin );
+
+	m_flAlpha[index] = src->m_flAlpha;
+	m_flAlphaVelocity[index] = src->m_flAlphaVelocity;
+	m_flRadius[index] = src->m_flRadius;
+	m_flRadiusVelocity[index] = src->m_flRadiusVelocity;
+	m_flLength[index] = src->m_flLength;
+	m_flLengthVelocity[index] = src->m_flLengthVelocity;
+	m_flRotation[index] = src->m_flRotation;
+	m_flBounceFactor[index] = src->m_flBounceFactor;
+	m_flTime[index] = time;
+	m_hTexture[index] = texture;
+	m_iFlags[index] = flags;
+}
+
+/*
+=================
+CQuakePartPool :: Integrate
+
+evaluates origin, color, alpha, radius and length of all
+particles for given time, four at once. Lanes past the
+last particle compute garbage that nobody reads
+=================
+*/
+void CQuakePartPool :: Integrate( float time, float gravity )
+{
+	simd4_t	curTime = Simd4Splat( time );
+	simd4_t	zGravity = Simd4Splat( gravity );
+	simd4_t	zero = Simd4Splat( 0.0f );
+
+	for( int i = 0; i < m_iNumParticles; i += 4 )
+	{
+		simd4_t t = Simd4Sub( curTime, Simd4Load( &m_flTime[i] ));
+		simd4_t t2 = Simd4Mul( t, t );
+
+		simd4_t alpha = Simd4Add( Simd4Load( &m_flAlpha[i] ), Simd4Mul( Simd4Load( &m_flAlphaVelocity[i] ), t ));
+		simd4_t radius = Simd4Add( Simd4Load( &m_flRadius[i] ), Simd4Mul( Simd4Load( &m_flRadiusVelocity[i] ), t ));
+		simd4_t length = Simd4Add( Simd4Load( &m_flLength[i] ), Simd4Mul( Simd4Load( &m_flLengthVelocity[i] ), t ));
+
+		Simd4Store( &m_flCurAlpha[i], alpha );
+		Simd4Store( &m_flCurRadius[i], radius );
+		Simd4Store( &m_flCurLength[i], length );
+
+		int faded = Simd4Mask( Simd4Or( Simd4Or( Simd4CmpLE( alpha, zero ), Simd4CmpLE( radius, zero )), Simd4CmpLE( length, zero )));
+
+		for( int j = 0; j < 4; j++ )
+			m_bFaded[i + j] = ( faded >> j ) & 1;
+
+		for( int j = 0; j < 3; j++ )
+		{
+			simd4_t accel = Simd4Mul( Simd4Load( &m_flAccel[j][i] ), t2 );
+
+			// gravity affects only vertical acceleration
+			if( j == 2 ) accel = Simd4Mul( accel, zGravity );
+
+			simd4_t org = Simd4Add( Simd4Add( Simd4Load( &m_flOrigin[j][i] ), Simd4Mul( Simd4Load( &m_flVelocity[j][i] ), t )), accel );
+			simd4_t color = Simd4Add( Simd4Load( &m_flColor[j][i] ), Simd4Mul( Simd4Load( &m_flColorVelocity[j][i] ), t ));
+
+			Simd4Store( &m_flCurOrigin[j][i], org );
+			Simd4Store( &m_flCurColor[j][i], color );
+		}
 	}
+}
 
-	Vector curColor = m_vecColor + m_vecColorVelocity * time;
+/*
+=================
+CQuakePartPool :: BuildQuad
 
-	org.x = m_vecOrigin.x + m_vecVelocity.x * time + m_vecAccel.x * time2;
-	org.y = m_vecOrigin.y + m_vecVelocity.y * time + m_vecAccel.y * time2;
-	org.z = m_vecOrigin.z + m_vecVelocity.z * time + m_vecAccel.z * time2 * gravity;
+=================
+*/
+void CQuakePartPool :: BuildQuad( int index, const Vector &vieworg, const Vector &vforward, const Vector &vleft, const Vector &vup, Vector verts[4] ) const
+{
+	Vector org = LoadVector( m_flCurOrigin, index );
+	float curRadius = m_flCurRadius[index];
+	float curLength = m_flCurLength[index];
+	Vector axis[3];
 
-	if( FBitSet( m_iFlags, FPART_UNDERWATER ))
+	if( curRadius == 1.0f )
+	{
+		// hack a scale up to keep quake particles from disapearing
+		float scale = DotProduct( org - vieworg, vforward );
+		if( scale >= 20.0f ) curRadius = 1.0f + scale * 0.004f;
+	}
+
+	if( curLength != 1.0f )
+	{
+		// find orientation vectors
+		axis[0] = vieworg - org;
+		axis[1] = LoadVector( m_flStretchOrg, index ) - org;
+		axis[2] = CrossProduct( axis[0], axis[1] );
+
+		axis[1] = axis[1].Normalize();
+		axis[2] = axis[2].Normalize();
+
+		Vector org3 = org + ( axis[1] * -curLength );
+		axis[2] *= m_flRadius[index];
+
+		// setup vertexes
+		verts[0] = org3 - axis[2];
+		verts[1] = org3 + axis[2];
+		verts[2] = org + axis[2];
+		verts[3] = org - axis[2];
+	}
+	else
+	{
+		if( m_flRotation[index] )
+		{
+			// Rotate it around its normal
+			RotatePointAroundVector( axis[1], vforward, vleft, m_flRotation[index] );
+			axis[2] = CrossProduct( vforward, axis[1] );
+
+			// Scale the axes by radius
+			axis[1] *= curRadius;
+			axis[2] *= curRadius;
+		}
+		else
+		{
+			// scale the axes by radius
+			axis[1] = vleft * curRadius;
+			axis[2] = vup * curRadius;
+		}
+
+		verts[0] = org + axis[1] - axis[2];
+		verts[1] = org + axis[1] + axis[2];
+		verts[2] = org - axis[1] + axis[2];
+		verts[3] = org - axis[1] - axis[2];
+	}
+}
+
+/*
+=================
+CQuakePartSystem :: EvaluateParticle
+
+handles the particle flags after integration,
+returns false if particle should be removed
+=================
+*/
+bool CQuakePartSystem :: EvaluateParticle( int index, float gravity )
+{
+	CQuakePartPool *pool = &m_Pool;
+	int flags = pool->m_iFlags[index];
+
+	if( pool->m_bFaded[index] )
+		return false; // faded out
+
+	Vector org = LoadVector( pool->m_flCurOrigin, index );
+	Vector org2 = LoadVector( pool->m_flLastOrg, index );
+	Vector curColor = LoadVector( pool->m_flCurColor, index );
+	float curRadius = pool->m_flCurRadius[index];
+
+	if( FBitSet( flags, FPART_UNDERWATER ))
 	{
 		// underwater particle
 		org2 = Vector( org.x, org.y, org.z + curRadius );
@@ -65,115 +280,118 @@ bool CQuakePart :: Evaluate( float gravity )
 		}
 	}
 
-	if( FBitSet( m_iFlags, FPART_FRICTION ))
+	if( FBitSet( flags, FPART_FRICTION ))
 	{
 		// water friction affected particle
 		int contents = POINT_CONTENTS( org );
 
 		if( contents <= CONTENTS_WATER && contents >= CONTENTS_LAVA )
 		{
-			// add friction		
+			float scale = 1.0f;
+
+			// add friction
 			switch( contents )
 			{
 			case CONTENTS_WATER:
-				m_vecVelocity *= 0.25f;
-				m_vecAccel *= 0.25f;
+				scale = 0.25f;
 				break;
 			case CONTENTS_SLIME:
-				m_vecVelocity *= 0.20f;
-				m_vecAccel *= 0.20f;
+				scale = 0.20f;
 				break;
 			case CONTENTS_LAVA:
-				m_vecVelocity *= 0.10f;
-				m_vecAccel *= 0.10f;
+				scale = 0.10f;
 				break;
 			}
-			
-			// don't add friction again
-			m_iFlags &= ~FPART_FRICTION;
-			curLength = 1.0f;
-				
-			// reset
-			m_flTime = tr.time;
-			m_vecColor = curColor;
-			m_flAlpha = curAlpha;
-			m_flRadius = curRadius;
-			m_vecOrigin = org;
 
-			// don't stretch
-			m_iFlags &= ~FPART_STRETCH;
-			m_flLengthVelocity = 0.0f;
-			m_flLength = curLength;
+			StoreVector( pool->m_flVelocity, index, LoadVector( pool->m_flVelocity, index ) * scale );
+			StoreVector( pool->m_flAccel, index, LoadVector( pool->m_flAccel, index ) * scale );
+
+			// don't add friction again, don't stretch
+			flags &= ~(FPART_FRICTION|FPART_STRETCH);
+
+			// reset
+			pool->m_flTime[index] = tr.time;
+			StoreVector( pool->m_flColor, index, curColor );
+			pool->m_flAlpha[index] = pool->m_flCurAlpha[index];
+			pool->m_flRadius[index] = curRadius;
+			StoreVector( pool->m_flOrigin, index, org );
+			pool->m_flLengthVelocity[index] = 0.0f;
+			pool->m_flLength[index] = pool->m_flCurLength[index] = 1.0f;
 		}
 	}
 
-	if( FBitSet( m_iFlags, FPART_BOUNCE ))
+	if( FBitSet( flags, FPART_BOUNCE ))
 	{
 		// bouncy particle
 		pmtrace_t pmtrace;
 		gEngfuncs.pEventAPI->EV_SetTraceHull( 2 );
-		gEngfuncs.pEventAPI->EV_PlayerTrace( m_vecLastOrg, org, PM_STUDIO_IGNORE, -1, &pmtrace );
+		gEngfuncs.pEventAPI->EV_PlayerTrace( LoadVector( pool->m_flLastOrg, index ), org, PM_STUDIO_IGNORE, -1, &pmtrace );
 
 		if( pmtrace.fraction != 1.0f )
 		{
+			Vector velocity = LoadVector( pool->m_flVelocity, index );
+			Vector accel = LoadVector( pool->m_flAccel, index );
+			Vector vel;
+
 			// reflect velocity
-			time = tr.time - (tr.frametime + tr.frametime * pmtrace.fraction);
-			time = (time - m_flTime);
+			float time = tr.time - (tr.frametime + tr.frametime * pmtrace.fraction);
+			time = (time - pool->m_flTime[index]);
 
-			vel.x = m_vecVelocity.x;
-			vel.y = m_vecVelocity.y;
-			vel.z = m_vecVelocity.z + m_vecAccel.z * gravity * time;
+			vel.x = velocity.x;
+			vel.y = velocity.y;
+			vel.z = velocity.z + accel.z * gravity * time;
 
 			float d = DotProduct( vel, pmtrace.plane.normal ) * 2.0f;
-			m_vecVelocity = vel - pmtrace.plane.normal * d;
-			m_vecVelocity *= bound( 0.0f, m_flBounceFactor, 1.0f );
+			velocity = vel - pmtrace.plane.normal * d;
+			velocity *= bound( 0.0f, pool->m_flBounceFactor[index], 1.0f );
 
 			// check for stop or slide along the plane
-			if( pmtrace.plane.normal.z > 0.0f && m_vecVelocity.z < 1.0f )
+			if( pmtrace.plane.normal.z > 0.0f && velocity.z < 1.0f )
 			{
 				if( pmtrace.plane.normal.z >= 0.7f )
 				{
-					m_vecVelocity = g_vecZero;
-					m_vecAccel = g_vecZero;
-					m_iFlags &= ~FPART_BOUNCE;
+					velocity = g_vecZero;
+					accel = g_vecZero;
+					flags &= ~FPART_BOUNCE;
 				}
 				else
 				{
 					// FIXME: check for new plane or free fall
-					float dot = DotProduct( m_vecVelocity, pmtrace.plane.normal );
-					m_vecVelocity += ( pmtrace.plane.normal * -dot );
+					float dot = DotProduct( velocity, pmtrace.plane.normal );
+					velocity += ( pmtrace.plane.normal * -dot );
 
-					dot = DotProduct( m_vecAccel, pmtrace.plane.normal );
-					m_vecAccel += ( pmtrace.plane.normal * -dot );
+					dot = DotProduct( accel, pmtrace.plane.normal );
+					accel += ( pmtrace.plane.normal * -dot );
 				}
 			}
 
+			StoreVector( pool->m_flVelocity, index, velocity );
+			StoreVector( pool->m_flAccel, index, accel );
 			org = pmtrace.endpos;
-			curLength = 1.0f;
-
-			// reset
-			m_flTime = tr.time;
-			m_vecColor = curColor;
-			m_flAlpha = curAlpha;
-			m_flRadius = curRadius;
-			m_vecOrigin = org;
 
 			// don't stretch
-			m_iFlags &= ~FPART_STRETCH;
-			m_flLengthVelocity = 0.0f;
-			m_flLength = curLength;
+			flags &= ~FPART_STRETCH;
+
+			// reset
+			pool->m_flTime[index] = tr.time;
+			StoreVector( pool->m_flColor, index, curColor );
+			pool->m_flAlpha[index] = pool->m_flCurAlpha[index];
+			pool->m_flRadius[index] = curRadius;
+			StoreVector( pool->m_flOrigin, index, org );
+			pool->m_flLengthVelocity[index] = 0.0f;
+			pool->m_flLength[index] = pool->m_flCurLength[index] = 1.0f;
 		}
 	}
-	
+
 	// save current origin if needed
-	if( FBitSet( m_iFlags, ( FPART_BOUNCE|FPART_STRETCH )))
+	if( FBitSet( flags, ( FPART_BOUNCE|FPART_STRETCH )))
 	{
-		org2 = m_vecLastOrg;
-		m_vecLastOrg = org;
+		org2 = LoadVector( pool->m_flLastOrg, index );
+		StoreVector( pool->m_flLastOrg, index, org );
 	}
 
 	// vertex lit particle
-	if( FBitSet( m_iFlags, FPART_VERTEXLIGHT ))
+	if( FBitSet( flags, FPART_VERTEXLIGHT ))
 	{
 		Vector light;
 		// gather static lighting
@@ -189,158 +407,105 @@ bool CQuakePart :: Evaluate( float gravity )
 		curColor *= light;	// multiply to diffuse
 	}
 
-	if( FBitSet( m_iFlags, FPART_INSTANT ))
+	if( FBitSet( flags, FPART_INSTANT ))
 	{
 		// instant particle
-		m_flAlphaVelocity = 0.0f;
-		m_flAlpha = 0.0f;
+		pool->m_flAlphaVelocity[index] = 0.0f;
+		pool->m_flAlpha[index] = 0.0f;
 	}
 
-	if( curRadius == 1.0f )
-	{
-		float scale = 0.0f;
+	pool->m_iFlags[index] = flags;
+	StoreVector( pool->m_flCurOrigin, index, org );
+	StoreVector( pool->m_flCurColor, index, curColor );
+	StoreVector( pool->m_flStretchOrg, index, org2 );
 
-		// hack a scale up to keep quake particles from disapearing
-		scale += (org.x - GetVieworg().x) * GetVForward().x;
-		scale += (org.y - GetVieworg().y) * GetVForward().y;
-		scale += (org.z - GetVieworg().z) * GetVForward().z;
-		if( scale >= 20.0f ) curRadius = 1.0f + scale * 0.004f;
-	}
-
-	Vector axis[3], verts[4];
-	Vector absmin, absmax;
-
-	// prepare to draw
-	if( curLength != 1.0f )
-	{
-		// find orientation vectors
-		axis[0] = GetVieworg() - org;
-		axis[1] = org2 - org;
-		axis[2] = CrossProduct( axis[0], axis[1] );
-
-		axis[1] = axis[1].Normalize();
-		axis[2] = axis[2].Normalize();
+	return true;
+}
 
-		// find normal
-		axis[0] = CrossProduct( axis[1], axis[2] );
-		axis[0] = axis[0].Normalize();
+CQuakePartSystem :: CQuakePartSystem( void )
+{
+	m_Pool.Clear();
+}
 
-		org3 = org + ( axis[1] * -curLength );
-		axis[2] *= m_flRadius;
+CQuakePartSystem :: ~CQuakePartSystem( void )
+{
+}
 
-		// setup vertexes
-		verts[0] = org3 - axis[2];
-		verts[1] = org3 + axis[2];
-		verts[2] = org + axis[2];
-		verts[3] = org - axis[2];
-	}
-	else
-	{
-		if( m_flRotation )
-		{
-			// Rotate it around its normal
-			RotatePointAroundVector( axis[1], GetVForward(), GetVLeft(), m_flRotation );
-			axis[2] = CrossProduct( GetVForward(), axis[1] );
+/*
+=================
+R_PartBench_f
 
-			// the normal should point at the viewer
-			axis[0] = -GetVForward();
+runs a synthetic pool through integration and
+vertex generation, nothing is traced or drawn
+=================
+*/
+static void R_PartBench_f( void )
+{
+	int count = PARTBENCH_DEFAULT_COUNT;
+	CUtlArray<Vector> verts;
+	double start, integrate_time, vertex_time;
+	CQuakePart src;
 
-			// Scale the axes by radius
-			axis[1] *= curRadius;
-			axis[2] *= curRadius;
-		}
-		else
-		{
-			// the normal should point at the viewer
-			axis[0] = -GetVForward();
+	if( CMD_ARGC() > 1 )
+		count = bound( 1, Q_atoi( CMD_ARGV( 1 )), MAX_PARTICLES );
 
-			// scale the axes by radius
-			axis[1] = GetVLeft() * curRadius;
-			axis[2] = GetVUp() * curRadius;
-		}
+	CQuakePartPool *pool = new CQuakePartPool;
+	pool->Clear();
 
-		verts[0] = org + axis[1] - axis[2];
-		verts[1] = org + axis[1] + axis[2];
-		verts[2] = org - axis[1] + axis[2];
-		verts[3] = org - axis[1] - axis[2];
+	for( int i = 0; i < count; i++ )
+	{
+		src.m_vecOrigin = Vector( RANDOM_FLOAT( -512, 512 ), RANDOM_FLOAT( -512, 512 ), RANDOM_FLOAT( -512, 512 ));
+		src.m_vecVelocity = Vector( RANDOM_FLOAT( -100, 100 ), RANDOM_FLOAT( -100, 100 ), RANDOM_FLOAT( -100, 100 ));
+		src.m_vecAccel = Vector( 0, 0, -120 );
+		src.m_vecColor = Vector( 1.0f, 0.5f, 0.25f );
+		src.m_vecColorVelocity = Vector( -0.1f, -0.1f, -0.1f );
+		src.m_flAlpha = 1.0f;
+		src.m_flAlphaVelocity = -0.01f;	// alive during whole run
+		src.m_flRadius = RANDOM_FLOAT( 1, 4 );
+		src.m_flRadiusVelocity = 0.0f;
+		src.m_flLength = ( i & 1 ) ? 1.0f : 8.0f;
+		src.m_flLengthVelocity = 0.0f;
+		src.m_flRotation = ( i & 2 ) ? RANDOM_LONG( 0, 360 ) : 0;
+		src.m_flBounceFactor = 0.0f;
+
+		pool->SetParticle( pool->Alloc(), &src, TextureHandle::Null(), 0, 0.0f );
+		StoreVector( pool->m_flStretchOrg, i, src.m_vecOrigin - src.m_vecVelocity * 0.1f );
 	}
 
-	ClearBounds( absmin, absmax );
-	for( int i = 0; i < 4; i++ )
-		AddPointToBounds( verts[i], absmin, absmax );
-#if 0
-	GL_Blend( GL_TRUE );
-
-	if( FBitSet( m_iFlags, FPART_ADDITIVE ))
-		pglBlendFunc( GL_SRC_ALPHA, GL_ONE );
-	else pglBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+	verts.SetCount( count * 4 );
 
-	// draw the particle
-	GL_Bind( GL_TEXTURE0, m_hTexture );
+	Vector vieworg( 0, 0, 0 ), vforward( 1, 0, 0 ), vleft( 0, 1, 0 ), vup( 0, 0, 1 );
 
-	pglTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+	start = Sys_DoubleTime();
+	for( int j = 0; j < PARTBENCH_ITERATIONS; j++ )
+		pool->Integrate( j * 0.01f, 0.016f );
+	integrate_time = Sys_DoubleTime() - start;
 
-	if( FBitSet( m_iFlags, FPART_ADDITIVE ))
-		pglColor4f( 1.0f, 1.0f, 1.0f, curAlpha );
-	else pglColor4f( curColor.x, curColor.y, curColor.z, curAlpha );
-
-	pglBegin( GL_QUADS );
-		pglTexCoord2f( 0.0f, 1.0f );
-		pglVertex3fv( verts[0] );
-
-		pglTexCoord2f( 0.0f, 0.0f );
-		pglVertex3fv( verts[1] );
-
-		pglTexCoord2f( 1.0f, 0.0f );
-		pglVertex3fv( verts[2] );
-
-		pglTexCoord2f( 1.0f, 1.0f );
-		pglVertex3fv( verts[3] );
-	pglEnd();
-#else
-	CTransEntry entry;
-	Vector4D partColor;
-	int rendermode;
-
-	if( FBitSet( m_iFlags, FPART_ADDITIVE ))
+	start = Sys_DoubleTime();
+	for( int j = 0; j < PARTBENCH_ITERATIONS; j++ )
 	{
-		partColor = Vector4D( 1.0f, 1.0f, 1.0f, curAlpha );
-		rendermode = kRenderTransAdd;
-	}
-	else
-	{
-		partColor = Vector4D( curColor.x, curColor.y, curColor.z, curAlpha );
-		rendermode = kRenderTransTexture;
+		for( int i = 0; i < count; i++ )
+			pool->BuildQuad( i, vieworg, vforward, vleft, vup, &verts[i * 4] );
 	}
+	vertex_time = Sys_DoubleTime() - start;
 
-	entry.SetRenderPrimitive( verts, partColor, m_hTexture, rendermode);
-	entry.ComputeViewDistance( absmin, absmax );
-	RI->frame.trans_list.AddToTail( entry );
-#endif
-	return true;
-}
+	delete pool;
 
-CQuakePartSystem :: CQuakePartSystem( void )
-{
-	memset( m_pParticles, 0, sizeof( CQuakePart ) * MAX_PARTICLES );
+	integrate_time *= 1000.0 / PARTBENCH_ITERATIONS;
+	vertex_time *= 1000.0 / PARTBENCH_ITERATIONS;
 
-	m_pFreeParticles = m_pParticles;
-	m_pActiveParticles = NULL;
+	Msg( "%i particles: integrate %.4f ms, vertexes %.4f ms, %.0f particles/ms\n", count, integrate_time, vertex_time,
+		count / Q_max( integrate_time + vertex_time, 1e-6 ));
 }
 
-CQuakePartSystem :: ~CQuakePartSystem( void )
+void CQuakePartSystem :: Init( void )
 {
+	ADD_COMMAND( "r_partbench", R_PartBench_f );
 }
 
 void CQuakePartSystem :: Clear( void )
 {
-	m_pFreeParticles = m_pParticles;
-	m_pActiveParticles = NULL;
-
-	for( int i = 0; i < MAX_PARTICLES; i++ )
-		m_pParticles[i].pNext = &m_pParticles[i+1];
-
-	m_pParticles[MAX_PARTICLES-1].pNext = NULL;
+	m_Pool.Clear();
 
 	m_pAllowParticles = CVAR_REGISTER( "cl_particles", "1", FCVAR_ARCHIVE );
 	m_pParticleLod = CVAR_REGISTER( "cl_particle_lod", "0", FCVAR_ARCHIVE );
@@ -787,41 +952,8 @@ bool CQuakePartSystem :: ParsePartInfo( CQuakePartInfo *info, char *&pfile )
 	return true;
 }
 
-void CQuakePartSystem :: FreeParticle( CQuakePart *pCur )
-{
-	pCur->pNext = m_pFreeParticles;
-	m_pFreeParticles = pCur;
-}
-
-CQuakePart *CQuakePartSystem :: AllocParticle( void )
-{
-	CQuakePart *pCur;
-
-	if( !m_pFreeParticles )
-	{
-		ALERT( at_console, "Overflow %d particles\n", MAX_PARTICLES );
-		return NULL;
-	}
-
-	if( m_pParticleLod->value > 1.0f )
-	{
-		if( !( RANDOM_LONG( 0, 1 ) % (int)m_pParticleLod->value ))
-			return NULL;
-	}
-
-	pCur = m_pFreeParticles;
-	m_pFreeParticles = pCur->pNext;
-	pCur->pNext = m_pActiveParticles;
-	m_pActiveParticles = pCur;
-
-	return pCur;
-}
-	
 void CQuakePartSystem :: Update( void )
 {
-	CQuakePart *pCur, *pNext;
-	CQuakePart *pActive = NULL, *pTail = NULL;
-
 	if( !m_pAllowParticles->value )
 		return;
 
@@ -832,69 +964,75 @@ void CQuakePartSystem :: Update( void )
 
 	float gravity = tr.frametime * tr.gravity;
 
-	for( pCur = m_pActiveParticles; pCur != NULL; pCur = pNext )
+	m_Pool.Integrate( tr.time, gravity );
+
+	// removed particle is replaced by the last one, which is already evaluated
+	for( int i = m_Pool.Count() - 1; i >= 0; i-- )
 	{
-		// grab next now, so if the particle is freed we still have it
-		pNext = pCur->pNext;
+		if( !EvaluateParticle( i, gravity ))
+			m_Pool.Remove( i );
+	}
 
-		if( !pCur->Evaluate( gravity ))
-		{
-			FreeParticle( pCur );
-			continue;
-		}
+	int numParticles = m_Pool.Count();
+
+	if( !numParticles )
+		return;
+
+	// write all quads straight into the frame vertex heap
+	int firstVertex = RI->frame.primverts.AddMultipleToTail( numParticles * 4 );
+	Vector *verts = &RI->frame.primverts[firstVertex];
+	CTransEntry entry;
+
+	for( int i = 0; i < numParticles; i++, verts += 4 )
+	{
+		Vector absmin, absmax;
+		Vector4D partColor;
+		int rendermode;
 
-		pCur->pNext = NULL;
+		m_Pool.BuildQuad( i, GetVieworg(), GetVForward(), GetVLeft(), GetVUp(), verts );
 
-		if( !pTail )
+		ClearBounds( absmin, absmax );
+		for( int j = 0; j < 4; j++ )
+			AddPointToBounds( verts[j], absmin, absmax );
+
+		if( FBitSet( m_Pool.m_iFlags[i], FPART_ADDITIVE ))
 		{
-			pActive = pTail = pCur;
+			partColor = Vector4D( 1.0f, 1.0f, 1.0f, m_Pool.m_flCurAlpha[i] );
+			rendermode = kRenderTransAdd;
 		}
 		else
 		{
-			pTail->pNext = pCur;
-			pTail = pCur;
+			Vector curColor = LoadVector( m_Pool.m_flCurColor, i );
+			partColor = Vector4D( curColor.x, curColor.y, curColor.z, m_Pool.m_flCurAlpha[i] );
+			rendermode = kRenderTransTexture;
 		}
-	}
 
-	m_pActiveParticles = pActive;
+		entry.SetRenderPrimitive( firstVertex + i * 4, partColor, m_Pool.m_hTexture[i], rendermode );
+		entry.ComputeViewDistance( absmin, absmax );
+		RI->frame.trans_list.AddToTail( entry );
+	}
 }
 
 bool CQuakePartSystem :: AddParticle( CQuakePart *src, TextureHandle texture, int flags )
 {
 	if( !src ) return false;
 
-	CQuakePart *dst = AllocParticle();
-
-	if( !dst ) return false;
-
-	if (texture != TextureHandle::Null()) {
-		dst->m_hTexture = texture;
+	if( m_Pool.Count() >= MAX_PARTICLES )
+	{
+		ALERT( at_console, "Overflow %d particles\n", MAX_PARTICLES );
+		return false;
 	}
-	else {
-		dst->m_hTexture = m_hDefaultParticle;
+
+	if( m_pParticleLod->value > 1.0f )
+	{
+		if( !( RANDOM_LONG( 0, 1 ) % (int)m_pParticleLod->value ))
+			return false;
 	}
 
-	dst->m_flTime = tr.time;
-	dst->m_iFlags = flags;
-
-	dst->m_vecOrigin = src->m_vecOrigin;
-	dst->m_vecVelocity = src->m_vecVelocity;
-	dst->m_vecAccel = src->m_vecAccel; 
-	dst->m_vecColor = src->m_vecColor;
-	dst->m_vecColorVelocity = src->m_vecColorVelocity;
-	dst->m_flAlpha = src->m_flAlpha;
-
-	dst->m_flRadius = src->m_flRadius;
-	dst->m_flLength = src->m_flLength;
-	dst->m_flRotation = src->m_flRotation;
-	dst->m_flAlphaVelocity = src->m_flAlphaVelocity;
-	dst->m_flRadiusVelocity = src->m_flRadiusVelocity;
-	dst->m_flLengthVelocity = src->m_flLengthVelocity;
-	dst->m_flBounceFactor = src->m_flBounceFactor;
-
-	// needs to save old origin
-	if( FBitSet( flags, ( FPART_BOUNCE|FPART_FRICTION )))
-		dst->m_vecLastOrg = dst->m_vecOrigin;
+	if( texture == TextureHandle::Null())
+		texture = m_hDefaultParticle;
+
+	m_Pool.SetParticle( m_Pool.Alloc(), src, texture, flags, tr.time );
 
 	return true;
 }
@@ -20,7 +20,7 @@ GNU General Public License for more details.
 #include "randomrange.h"
 #include "texture_handle.h"
 
-#define MAX_PARTICLES		8192
+#define MAX_PARTICLES		8192	// must be multiple of 4 for simd integration
 #define MAX_PARTINFOS		256	// various types of part-system
 
 // built-in particle-system flags
@@ -33,12 +33,11 @@ GNU General Public License for more details.
 #define FPART_ADDITIVE		(1<<6)
 #define FPART_NOTWATER		(1<<7)	// don't spawn in water
 
+// spawn parameters of a single particle
 class CQuakePart
 {
 public:
-	Vector		m_vecOrigin;	// position for current frame
-	Vector		m_vecLastOrg;	// position from previous frame
-
+	Vector		m_vecOrigin;	// spawn position
 	Vector		m_vecVelocity;	// linear velocity
 	Vector		m_vecAccel;
 	Vector		m_vecColor;
@@ -51,14 +50,50 @@ public:
 	float		m_flLengthVelocity;
 	float		m_flRotation;	// texture ROLL angle
 	float		m_flBounceFactor;
+};
 
-	CQuakePart	*pNext;		// linked list
-	TextureHandle	m_hTexture;
-
-	float		m_flTime;
-	int			m_iFlags;
-
-	bool		Evaluate( float gravity );
+// alive particles stored as arrays of components, packed at the front
+// so integration runs four particles at once over contiguous memory
+class CQuakePartPool
+{
+public:
+	void		Clear( void ) { m_iNumParticles = 0; }
+	int		Count( void ) const { return m_iNumParticles; }
+	int		Alloc( void );		// returns -1 when pool is full
+	void		Remove( int index );	// last particle takes the place
+	void		SetParticle( int index, const CQuakePart *src, TextureHandle texture, int flags, float time );
+	void		Integrate( float time, float gravity );
+	void		BuildQuad( int index, const Vector &vieworg, const Vector &vforward, const Vector &vleft, const Vector &vup, Vector verts[4] ) const;
+
+	// state at spawn or last reset
+	float		m_flOrigin[3][MAX_PARTICLES];
+	float		m_flVelocity[3][MAX_PARTICLES];
+	float		m_flAccel[3][MAX_PARTICLES];
+	float		m_flColor[3][MAX_PARTICLES];
+	float		m_flColorVelocity[3][MAX_PARTICLES];
+	float		m_flAlpha[MAX_PARTICLES];
+	float		m_flAlphaVelocity[MAX_PARTICLES];
+	float		m_flRadius[MAX_PARTICLES];
+	float		m_flRadiusVelocity[MAX_PARTICLES];
+	float		m_flLength[MAX_PARTICLES];
+	float		m_flLengthVelocity[MAX_PARTICLES];
+	float		m_flRotation[MAX_PARTICLES];
+	float		m_flBounceFactor[MAX_PARTICLES];
+	float		m_flTime[MAX_PARTICLES];
+	float		m_flLastOrg[3][MAX_PARTICLES];	// position from previous frame
+	TextureHandle	m_hTexture[MAX_PARTICLES];
+	int		m_iFlags[MAX_PARTICLES];
+
+	// state for current frame, written by Integrate
+	float		m_flCurOrigin[3][MAX_PARTICLES];
+	float		m_flCurColor[3][MAX_PARTICLES];
+	float		m_flCurAlpha[MAX_PARTICLES];
+	float		m_flCurRadius[MAX_PARTICLES];
+	float		m_flCurLength[MAX_PARTICLES];
+	float		m_flStretchOrg[3][MAX_PARTICLES];	// tail of stretched particle
+	byte		m_bFaded[MAX_PARTICLES];
+private:
+	int		m_iNumParticles;
 };
 
 enum
@@ -99,9 +134,7 @@ public:
 
 class CQuakePartSystem
 {
-	CQuakePart	*m_pActiveParticles;
-	CQuakePart	*m_pFreeParticles;
-	CQuakePart	m_pParticles[MAX_PARTICLES];
+	CQuakePartPool	m_Pool;
 
 	CQuakePartInfo	m_pPartInfo[MAX_PARTINFOS];
 	int		m_iNumPartInfo;
@@ -118,10 +151,10 @@ public:
 			CQuakePartSystem( void );
 	virtual		~CQuakePartSystem( void );
 
+	void		Init( void );
 	void		Clear( void );
 	void		Update( void );
-	void		FreeParticle( CQuakePart *pCur );
-	CQuakePart	*AllocParticle( void );
+	bool		EvaluateParticle( int index, float gravity );
 	bool		AddParticle(CQuakePart *src, TextureHandle texture, int flags = 0);
 	void		ParsePartInfos( const char *filename );
 	bool		ParsePartInfo( CQuakePartInfo *info, char *&pfile );
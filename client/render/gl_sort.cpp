@@ -0,0 +1,222 @@
+/*
+gl_sort.cpp - stable radix sorting of draw lists by packed state keys
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "hud.h"
+#include "utils.h"
+#include "gl_local.h"
+#include "gl_sort.h"
+
+#define SORT_RADIX_BITS		8
+#define SORT_RADIX_SIZE		(1 << SORT_RADIX_BITS)
+#define SORT_RADIX_PASSES		(64 / SORT_RADIX_BITS)
+#define SORT_INSERTION_LIMIT		32	// lists this short are cheaper to sort in place
+
+#define SORTBENCH_DEFAULT_ITERATIONS	100
+
+static CUtlArray<sortkey_t>	sort_keys;
+static int		sortbench_iterations;	// pending benchmark, 0 when idle
+static int		sortbench_frame = -1;	// frame that captures the draw lists
+
+/*
+=================
+R_AllocSortKeys
+
+=================
+*/
+sortkey_t *R_AllocSortKeys( int count )
+{
+	if( sort_keys.Count() < count * 2 )
+		sort_keys.SetCount( count * 2 );
+	return sort_keys.Base();
+}
+
+/*
+=================
+R_InsertionSortKeys
+
+=================
+*/
+static void R_InsertionSortKeys( sortkey_t *keys, int count )
+{
+	for( int i = 1; i < count; i++ )
+	{
+		sortkey_t	cur = keys[i];
+		int	j = i - 1;
+
+		while( j >= 0 && keys[j].key > cur.key )
+		{
+			keys[j + 1] = keys[j];
+			j--;
+		}
+		keys[j + 1] = cur;
+	}
+}
+
+/*
+=================
+R_RadixSortKeys
+
+one scatter per byte of the key, bytes that are the same
+for every key (unused shader or entity bits) are skipped
+=================
+*/
+void R_RadixSortKeys( sortkey_t *keys, sortkey_t *temp, int count )
+{
+	uint	histogram[SORT_RADIX_PASSES][SORT_RADIX_SIZE];
+	sortkey_t	*src = keys;
+	sortkey_t	*dst = temp;
+
+	if( count <= SORT_INSERTION_LIMIT )
+	{
+		R_InsertionSortKeys( keys, count );
+		return;
+	}
+
+	memset( histogram, 0, sizeof( histogram ));
+
+	for( int i = 0; i < count; i++ )
+	{
+		uint64_t	key = keys[i].key;
+
+		for( int pass = 0; pass < SORT_RADIX_PASSES; pass++ )
+			histogram[pass][(key >> (pass * SORT_RADIX_BITS)) & (SORT_RADIX_SIZE - 1)]++;
+	}
+
+	for( int pass = 0; pass < SORT_RADIX_PASSES; pass++ )
+	{
+		int	shift = pass * SORT_RADIX_BITS;
+		uint	*counts = histogram[pass];
+		uint	offset = 0;
+
+		// all keys share this byte, order is unchanged
+		if( counts[(src[0].key >> shift) & (SORT_RADIX_SIZE - 1)] == (uint)count )
+			continue;
+
+		for( int i = 0; i < SORT_RADIX_SIZE; i++ )
+		{
+			uint	num = counts[i];
+			counts[i] = offset;
+			offset += num;
+		}
+
+		for( int i = 0; i < count; i++ )
+			dst[counts[(src[i].key >> shift) & (SORT_RADIX_SIZE - 1)]++] = src[i];
+
+		sortkey_t *swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if( src != keys )
+		memcpy( keys, src, count * sizeof( sortkey_t ));
+}
+
+/*
+=================
+R_CompareSortKeys
+
+=================
+*/
+static int R_CompareSortKeys( const void *a, const void *b )
+{
+	const sortkey_t *ka = (const sortkey_t *)a;
+	const sortkey_t *kb = (const sortkey_t *)b;
+
+	if( ka->key > kb->key )
+		return 1;
+	if( ka->key < kb->key )
+		return -1;
+	return 0;
+}
+
+/*
+=================
+R_BenchmarkSortKeys
+
+replays every list sorted during one frame
+=================
+*/
+void R_BenchmarkSortKeys( const sortkey_t *keys, int count, const char *name )
+{
+	CUtlArray<sortkey_t>	work, temp;
+	double		start, qsort_time, radix_time;
+
+	if( !sortbench_iterations )
+		return;
+
+	if( sortbench_frame == -1 )
+	{
+		sortbench_frame = tr.realframecount;
+	}
+	else if( sortbench_frame != tr.realframecount )
+	{
+		sortbench_iterations = 0;
+		sortbench_frame = -1;
+		return;
+	}
+
+	work.SetCount( count );
+	temp.SetCount( count );
+
+	start = Sys_DoubleTime();
+	for( int i = 0; i < sortbench_iterations; i++ )
+	{
+		memcpy( work.Base(), keys, count * sizeof( sortkey_t ));
+		qsort( work.Base(), count, sizeof( sortkey_t ), R_CompareSortKeys );
+	}
+	qsort_time = Sys_DoubleTime() - start;
+
+	start = Sys_DoubleTime();
+	for( int i = 0; i < sortbench_iterations; i++ )
+	{
+		memcpy( work.Base(), keys, count * sizeof( sortkey_t ));
+		R_RadixSortKeys( work.Base(), temp.Base(), count );
+	}
+	radix_time = Sys_DoubleTime() - start;
+
+	for( int i = 1; i < count; i++ )
+	{
+		if( work[i - 1].key > work[i].key || ( work[i - 1].key == work[i].key && work[i - 1].index > work[i].index ))
+		{
+			Msg( "^1Error:^7 %s: radix sort is out of order at %i\n", name, i );
+			break;
+		}
+	}
+
+	Msg( "%s: %i entries, qsort %.4f ms, radix %.4f ms\n", name, count,
+		qsort_time * 1000.0 / sortbench_iterations, radix_time * 1000.0 / sortbench_iterations );
+}
+
+/*
+=================
+R_SortBench_f
+
+=================
+*/
+static void R_SortBench_f( void )
+{
+	int	iterations = SORTBENCH_DEFAULT_ITERATIONS;
+
+	if( CMD_ARGC() > 1 )
+		iterations = Q_max( 1, Q_atoi( CMD_ARGV( 1 )));
+
+	Msg( "capturing draw lists of the next frame, %i iterations\n", iterations );
+	sortbench_iterations = iterations;
+	sortbench_frame = -1;
+}
+
+void R_InitDrawListSort( void )
+{
+	ADD_COMMAND( "r_sortbench", R_SortBench_f );
+}
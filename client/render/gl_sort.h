@@ -0,0 +1,67 @@
+/*
+gl_sort.h - stable radix sorting of draw lists by packed state keys
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#pragma once
+#include "utlarray.h"
+#include <stdint.h>
+
+typedef struct
+{
+	uint64_t		key;
+	int		index;	// position in the unsorted list
+} sortkey_t;
+
+// returns scratch storage for 2 * count keys, valid until the next call
+sortkey_t *R_AllocSortKeys( int count );
+
+// stable LSD radix sort by key, temp must hold count entries
+void R_RadixSortKeys( sortkey_t *keys, sortkey_t *temp, int count );
+
+// times qsort against the radix sort on a captured list when r_sortbench is pending
+void R_BenchmarkSortKeys( const sortkey_t *keys, int count, const char *name );
+
+void R_InitDrawListSort( void );
+
+/*
+=================
+R_SortDrawList
+
+sorts list by ascending keys, entries with equal keys keep their order
+=================
+*/
+template< class T >
+void R_SortDrawList( CUtlArray<T> &list, uint64_t (*pfnSortKey)( const T *entry ), const char *name )
+{
+	static CUtlArray<T>	scratch;
+	int		count = list.Count();
+
+	if( count <= 1 )
+		return;
+
+	sortkey_t *keys = R_AllocSortKeys( count );
+
+	for( int i = 0; i < count; i++ )
+	{
+		keys[i].key = pfnSortKey( &list[i] );
+		keys[i].index = i;
+	}
+
+	R_BenchmarkSortKeys( keys, count, name );
+	R_RadixSortKeys( keys, keys + count, count );
+
+	scratch.CopyArray( list.Base(), count );
+
+	for( int i = 0; i < count; i++ )
+		list[i] = scratch[keys[i].index];
+}
@@ -0,0 +1,556 @@
+/*
+gl_spatial.cpp - bounding volume tree for cubemap and worldlight searches
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "hud.h"
+#include "utils.h"
+#include <mathlib.h>
+#include "gl_spatial.h"
+
+static int CompareItemsX( const void *a, const void *b )
+{
+	float	d = ((const mspatialitem_t *)a)->origin[0] - ((const mspatialitem_t *)b)->origin[0];
+	return ( d < 0.0f ) ? -1 : ( d > 0.0f ) ? 1 : 0;
+}
+
+static int CompareItemsY( const void *a, const void *b )
+{
+	float	d = ((const mspatialitem_t *)a)->origin[1] - ((const mspatialitem_t *)b)->origin[1];
+	return ( d < 0.0f ) ? -1 : ( d > 0.0f ) ? 1 : 0;
+}
+
+static int CompareItemsZ( const void *a, const void *b )
+{
+	float	d = ((const mspatialitem_t *)a)->origin[2] - ((const mspatialitem_t *)b)->origin[2];
+	return ( d < 0.0f ) ? -1 : ( d > 0.0f ) ? 1 : 0;
+}
+
+static int CompareIndexes( const void *a, const void *b )
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+=================
+Mod_BuildSpatialNode_r
+
+median split on the widest axis of item origins
+=================
+*/
+static void Mod_BuildSpatialNode_r( mspatialtree_t *tree, int nodenum, int firstitem, int numitems )
+{
+	mspatialnode_t	*node = &tree->nodes[nodenum];
+	mspatialitem_t	*items = tree->items + firstitem;
+	Vector		omins, omaxs;
+	int		i, axis;
+
+	ClearBounds( node->mins, node->maxs );
+	ClearBounds( omins, omaxs );
+
+	for( i = 0; i < numitems; i++ )
+	{
+		Vector	radius( items[i].radius, items[i].radius, items[i].radius );
+
+		AddPointToBounds( items[i].origin - radius, node->mins, node->maxs );
+		AddPointToBounds( items[i].origin + radius, node->mins, node->maxs );
+		AddPointToBounds( items[i].origin, omins, omaxs );
+	}
+
+	node->firstitem = firstitem;
+	node->numitems = numitems;
+
+	if( numitems <= SPATIAL_LEAF_ITEMS )
+	{
+		node->firstchild = -1;
+		return;
+	}
+
+	Vector	size = omaxs - omins;
+
+	if( size.x >= size.y && size.x >= size.z )
+		axis = 0;
+	else if( size.y >= size.z )
+		axis = 1;
+	else axis = 2;
+
+	switch( axis )
+	{
+	case 0: qsort( items, numitems, sizeof( *items ), CompareItemsX ); break;
+	case 1: qsort( items, numitems, sizeof( *items ), CompareItemsY ); break;
+	case 2: qsort( items, numitems, sizeof( *items ), CompareItemsZ ); break;
+	}
+
+	node->firstchild = tree->numnodes;
+	tree->numnodes += 2;
+
+	Mod_BuildSpatialNode_r( tree, node->firstchild + 0, firstitem, numitems / 2 );
+	Mod_BuildSpatialNode_r( tree, node->firstchild + 1, firstitem + numitems / 2, numitems - numitems / 2 );
+}
+
+/*
+=================
+Mod_BuildSpatialTree
+
+=================
+*/
+void Mod_BuildSpatialTree( mspatialtree_t *tree, const mspatialitem_t *items, int count )
+{
+	int	i, numbounded = 0;
+
+	Mod_FreeSpatialTree( tree );
+
+	if( count <= 0 )
+		return;
+
+	for( i = 0; i < count; i++ )
+	{
+		if( items[i].radius >= 0.0f )
+			numbounded++;
+	}
+
+	tree->numunbounded = count - numbounded;
+
+	if( tree->numunbounded > 0 )
+		tree->unbounded = (int *)Mem_Alloc( tree->numunbounded * sizeof( int ));
+
+	if( numbounded > 0 )
+	{
+		tree->items = (mspatialitem_t *)Mem_Alloc( numbounded * sizeof( mspatialitem_t ));
+		tree->nodes = (mspatialnode_t *)Mem_Alloc( numbounded * 2 * sizeof( mspatialnode_t ));
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		if( items[i].radius >= 0.0f )
+			tree->items[tree->numitems++] = items[i];
+		else tree->unbounded[i - tree->numitems] = items[i].index;
+	}
+
+	if( tree->numitems > 0 )
+	{
+		tree->numnodes = 1;
+		Mod_BuildSpatialNode_r( tree, 0, 0, tree->numitems );
+	}
+}
+
+/*
+=================
+Mod_FreeSpatialTree
+
+=================
+*/
+void Mod_FreeSpatialTree( mspatialtree_t *tree )
+{
+	if( tree->nodes )
+		Mem_Free( tree->nodes );
+
+	if( tree->items )
+		Mem_Free( tree->items );
+
+	if( tree->unbounded )
+		Mem_Free( tree->unbounded );
+
+	memset( tree, 0, sizeof( *tree ));
+}
+
+/*
+=================
+R_SpatialNodeDistance
+
+distance to the nearest point of node, never
+greater than the distance to any item inside
+=================
+*/
+static float R_SpatialNodeDistance( const mspatialnode_t *node, const Vector &pos, pfnSpatialDistance pfnDistance )
+{
+	Vector	point;
+
+	for( int i = 0; i < 3; i++ )
+		point[i] = bound( node->mins[i], pos[i], node->maxs[i] );
+
+	return pfnDistance( point, pos );
+}
+
+/*
+=================
+R_SpatialFindNearest
+
+unbounded items are not searched
+=================
+*/
+int R_SpatialFindNearest( const mspatialtree_t *tree, const Vector &pos, int numresults, int *results, float maxDist,
+	pfnSpatialDistance pfnDistance, pfnSpatialFilter pfnFilter, const void *context )
+{
+	float	bestdist[SPATIAL_MAX_NEAREST];
+	int	bestindex[SPATIAL_MAX_NEAREST];
+	int	stack[SPATIAL_STACK_SIZE];
+	int	i, j, numbest = 0;
+	int	stackpos = 0;
+
+	numresults = Q_min( numresults, SPATIAL_MAX_NEAREST );
+
+	if( !tree->numnodes || numresults <= 0 )
+		return 0;
+
+	stack[stackpos++] = 0;
+
+	while( stackpos > 0 )
+	{
+		const mspatialnode_t *node = &tree->nodes[stack[--stackpos]];
+		float limit = ( numbest == numresults ) ? bestdist[numbest - 1] : maxDist;
+
+		if( R_SpatialNodeDistance( node, pos, pfnDistance ) > limit )
+			continue;
+
+		if( node->firstchild != -1 )
+		{
+			const mspatialnode_t *child = &tree->nodes[node->firstchild];
+			float dist0 = R_SpatialNodeDistance( &child[0], pos, pfnDistance );
+			float dist1 = R_SpatialNodeDistance( &child[1], pos, pfnDistance );
+
+			// the nearest child goes on top
+			if( dist0 <= dist1 )
+			{
+				stack[stackpos++] = node->firstchild + 1;
+				stack[stackpos++] = node->firstchild + 0;
+			}
+			else
+			{
+				stack[stackpos++] = node->firstchild + 0;
+				stack[stackpos++] = node->firstchild + 1;
+			}
+			continue;
+		}
+
+		const mspatialitem_t *item = &tree->items[node->firstitem];
+
+		for( i = 0; i < node->numitems; i++, item++ )
+		{
+			if( pfnFilter && !pfnFilter( item->index, context ))
+				continue;
+
+			float dist = pfnDistance( item->origin, pos );
+
+			if( !( dist < maxDist ))
+				continue;
+
+			// find the slot, equal distances are ordered by index
+			for( j = numbest; j > 0; j-- )
+			{
+				if( bestdist[j - 1] < dist || ( bestdist[j - 1] == dist && bestindex[j - 1] < item->index ))
+					break;
+			}
+
+			if( j >= numresults )
+				continue;
+
+			if( numbest < numresults )
+				numbest++;
+
+			for( int k = numbest - 1; k > j; k-- )
+			{
+				bestdist[k] = bestdist[k - 1];
+				bestindex[k] = bestindex[k - 1];
+			}
+
+			bestdist[j] = dist;
+			bestindex[j] = item->index;
+		}
+	}
+
+	for( i = 0; i < numbest; i++ )
+		results[i] = bestindex[i];
+
+	return numbest;
+}
+
+/*
+=================
+R_SpatialFindInBox
+
+=================
+*/
+int R_SpatialFindInBox( const mspatialtree_t *tree, const Vector &mins, const Vector &maxs, int *results, int maxresults )
+{
+	int	stack[SPATIAL_STACK_SIZE];
+	int	i, count = 0;
+	int	stackpos = 0;
+
+	if( tree->numnodes > 0 )
+		stack[stackpos++] = 0;
+
+	while( stackpos > 0 )
+	{
+		const mspatialnode_t *node = &tree->nodes[stack[--stackpos]];
+
+		if( !BoundsIntersect( mins, maxs, node->mins, node->maxs ))
+			continue;
+
+		if( node->firstchild != -1 )
+		{
+			stack[stackpos++] = node->firstchild + 0;
+			stack[stackpos++] = node->firstchild + 1;
+			continue;
+		}
+
+		const mspatialitem_t *item = &tree->items[node->firstitem];
+
+		for( i = 0; i < node->numitems; i++, item++ )
+		{
+			if( CalcSqrDistanceToAABB( mins, maxs, item->origin ) > item->radius * item->radius )
+				continue;
+
+			if( count < maxresults )
+				results[count++] = item->index;
+		}
+	}
+
+	for( i = 0; i < tree->numunbounded && count < maxresults; i++ )
+		results[count++] = tree->unbounded[i];
+
+	qsort( results, count, sizeof( int ), CompareIndexes );
+
+	return count;
+}
+
+/*
+==============================================================================
+
+SEARCH TEST
+
+r_spatialtest builds trees over synthetic layouts and checks
+every search against a brute force pass over the same items
+==============================================================================
+*/
+#define SPATIALTEST_DEFAULT_LAYOUTS	64
+#define SPATIALTEST_QUERIES		256
+#define SPATIALTEST_MAX_ITEMS		512
+
+static float SpatialTestDistance( const Vector &item, const Vector &pos )
+{
+	return VectorDistance( item, pos );
+}
+
+static float SpatialTestDistanceSqr( const Vector &item, const Vector &pos )
+{
+	return ( item - pos ).LengthSqr();
+}
+
+static bool SpatialTestFilter( int index, const void *context )
+{
+	return ( index % *(const int *)context ) != 0;
+}
+
+/*
+=================
+R_SpatialTestLayout
+
+scatter, tight clusters, a coarse grid full of equal
+distances and a line, some items reach everything
+=================
+*/
+static int R_SpatialTestLayout( int layout, mspatialitem_t *items )
+{
+	int	i, count = RANDOM_LONG( 1, SPATIALTEST_MAX_ITEMS );
+	Vector	center[8];
+
+	for( i = 0; i < 8; i++ )
+		center[i] = Vector( RANDOM_FLOAT( -1024, 1024 ), RANDOM_FLOAT( -1024, 1024 ), RANDOM_FLOAT( -1024, 1024 ));
+
+	for( i = 0; i < count; i++ )
+	{
+		mspatialitem_t	*item = &items[i];
+		Vector		origin;
+
+		switch( layout % 4 )
+		{
+		case 0:
+			origin = Vector( RANDOM_FLOAT( -1024, 1024 ), RANDOM_FLOAT( -1024, 1024 ), RANDOM_FLOAT( -1024, 1024 ));
+			break;
+		case 1:
+			origin = center[i & 7] + Vector( RANDOM_FLOAT( -8, 8 ), RANDOM_FLOAT( -8, 8 ), RANDOM_FLOAT( -8, 8 ));
+			break;
+		case 2:
+			origin = Vector( RANDOM_LONG( -2, 2 ) * 64, RANDOM_LONG( -2, 2 ) * 64, RANDOM_LONG( -1, 1 ) * 64 );
+			break;
+		default:
+			origin = Vector( RANDOM_FLOAT( -1024, 1024 ), 0, 0 );
+			break;
+		}
+
+		VectorCopy( origin, item->origin );
+		item->radius = ( RANDOM_LONG( 0, 9 ) == 0 ) ? -1.0f : RANDOM_FLOAT( 0, 256 );
+		item->index = i;
+	}
+
+	return count;
+}
+
+static int R_SpatialTestNearest( const mspatialitem_t *items, int count, const Vector &pos, int numresults, int *results,
+	float maxDist, pfnSpatialDistance pfnDistance, pfnSpatialFilter pfnFilter, const void *context )
+{
+	float	bestdist[SPATIAL_MAX_NEAREST];
+	int	numbest = 0;
+
+	numresults = Q_min( numresults, SPATIAL_MAX_NEAREST );
+
+	for( int i = 0; i < count; i++ )
+	{
+		if( items[i].radius < 0.0f || ( pfnFilter && !pfnFilter( items[i].index, context )))
+			continue;
+
+		float	dist = pfnDistance( items[i].origin, pos );
+		int	j;
+
+		if( !( dist < maxDist ))
+			continue;
+
+		for( j = numbest; j > 0; j-- )
+		{
+			if( bestdist[j - 1] < dist || ( bestdist[j - 1] == dist && results[j - 1] < items[i].index ))
+				break;
+		}
+
+		if( j >= numresults )
+			continue;
+
+		if( numbest < numresults )
+			numbest++;
+
+		for( int k = numbest - 1; k > j; k-- )
+		{
+			bestdist[k] = bestdist[k - 1];
+			results[k] = results[k - 1];
+		}
+
+		bestdist[j] = dist;
+		results[j] = items[i].index;
+	}
+
+	return numbest;
+}
+
+static int R_SpatialTestInBox( const mspatialitem_t *items, int count, const Vector &mins, const Vector &maxs, int *results )
+{
+	int	numresults = 0;
+
+	// items are in index order already
+	for( int i = 0; i < count; i++ )
+	{
+		if( items[i].radius >= 0.0f && CalcSqrDistanceToAABB( mins, maxs, items[i].origin ) > items[i].radius * items[i].radius )
+			continue;
+
+		results[numresults++] = items[i].index;
+	}
+
+	return numresults;
+}
+
+static bool R_SpatialTestCompare( const int *test, int numtest, const int *expected, int numexpected )
+{
+	if( numtest != numexpected )
+		return false;
+
+	return !memcmp( test, expected, numtest * sizeof( int ));
+}
+
+/*
+=================
+R_SpatialTest_f
+
+=================
+*/
+static void R_SpatialTest_f( void )
+{
+	int		layouts = SPATIALTEST_DEFAULT_LAYOUTS;
+	mspatialtree_t	tree;
+	mspatialitem_t	*items;
+	int		*test, *expected;
+	int		numnearest = 0, numbox = 0;
+	int		mismatches = 0;
+
+	if( CMD_ARGC() > 1 )
+		layouts = Q_max( 1, Q_atoi( CMD_ARGV( 1 )));
+
+	memset( &tree, 0, sizeof( tree ));
+	items = (mspatialitem_t *)Mem_Alloc( SPATIALTEST_MAX_ITEMS * sizeof( mspatialitem_t ));
+	test = (int *)Mem_Alloc( SPATIALTEST_MAX_ITEMS * sizeof( int ));
+	expected = (int *)Mem_Alloc( SPATIALTEST_MAX_ITEMS * sizeof( int ));
+
+	for( int layout = 0; layout < layouts; layout++ )
+	{
+		int count = R_SpatialTestLayout( layout, items );
+
+		Mod_BuildSpatialTree( &tree, items, count );
+
+		for( int q = 0; q < SPATIALTEST_QUERIES; q++ )
+		{
+			Vector		pos, mins, maxs, size;
+			pfnSpatialDistance	pfnDistance;
+			pfnSpatialFilter	pfnFilter;
+			int		numtest, numexpected;
+			int		numresults, modulo;
+			float		maxDist;
+
+			// queries right at the items hit the equal distances
+			if( q & 1 )
+				pos = items[RANDOM_LONG( 0, count - 1 )].origin;
+			else pos = Vector( RANDOM_FLOAT( -1200, 1200 ), RANDOM_FLOAT( -1200, 1200 ), RANDOM_FLOAT( -1200, 1200 ));
+
+			numresults = RANDOM_LONG( 1, SPATIAL_MAX_NEAREST );
+			pfnDistance = ( q & 2 ) ? SpatialTestDistanceSqr : SpatialTestDistance;
+			pfnFilter = ( q & 4 ) ? SpatialTestFilter : NULL;
+			maxDist = ( q & 8 ) ? RANDOM_FLOAT( 0, 512 ) : 999999.0f;
+			modulo = RANDOM_LONG( 2, 4 );
+
+			numtest = R_SpatialFindNearest( &tree, pos, numresults, test, maxDist, pfnDistance, pfnFilter, &modulo );
+			numexpected = R_SpatialTestNearest( items, count, pos, numresults, expected, maxDist, pfnDistance, pfnFilter, &modulo );
+			numnearest++;
+
+			if( !R_SpatialTestCompare( test, numtest, expected, numexpected ))
+			{
+				if( !mismatches )
+					Msg( "^1Error:^7 layout %i: nearest %i at (%g %g %g) differs from brute force, %i and %i items\n", layout, numresults, pos.x, pos.y, pos.z, numtest, numexpected );
+				mismatches++;
+			}
+
+			// point boxes and large ones
+			size = ( q & 16 ) ? g_vecZero : Vector( RANDOM_FLOAT( 0, 512 ), RANDOM_FLOAT( 0, 512 ), RANDOM_FLOAT( 0, 512 ));
+			mins = pos - size;
+			maxs = pos + size;
+
+			numtest = R_SpatialFindInBox( &tree, mins, maxs, test, count );
+			numexpected = R_SpatialTestInBox( items, count, mins, maxs, expected );
+			numbox++;
+
+			if( !R_SpatialTestCompare( test, numtest, expected, numexpected ))
+			{
+				if( !mismatches )
+					Msg( "^1Error:^7 layout %i: box at (%g %g %g) differs from brute force, %i and %i items\n", layout, pos.x, pos.y, pos.z, numtest, numexpected );
+				mismatches++;
+			}
+		}
+	}
+
+	Mod_FreeSpatialTree( &tree );
+	Mem_Free( items );
+	Mem_Free( test );
+	Mem_Free( expected );
+
+	Msg( "spatial tree: %i layouts, %i nearest and %i box queries, %i mismatches\n", layouts, numnearest, numbox, mismatches );
+}
+
+void R_InitSpatialTree( void )
+{
+	ADD_COMMAND( "r_spatialtest", R_SpatialTest_f );
+}
@@ -0,0 +1,61 @@
+/*
+gl_spatial.h - bounding volume tree for cubemap and worldlight searches
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#pragma once
+
+#define SPATIAL_LEAF_ITEMS		4	// items per tree leaf
+#define SPATIAL_STACK_SIZE		64
+#define SPATIAL_MAX_NEAREST		4	// max results of nearest search
+
+// item is a sphere, negative radius reaches everything
+typedef struct
+{
+	vec3_t		origin;
+	float		radius;
+	int		index;	// caller's item number
+} mspatialitem_t;
+
+typedef struct
+{
+	vec3_t		mins, maxs;
+	int		firstchild;	// -1 for leafs
+	int		firstitem;
+	int		numitems;
+} mspatialnode_t;
+
+typedef struct
+{
+	mspatialnode_t	*nodes;
+	int		numnodes;
+	mspatialitem_t	*items;		// bounded items, ordered by leafs
+	int		numitems;
+	int		*unbounded;	// items with negative radius
+	int		numunbounded;
+} mspatialtree_t;
+
+// metric for nearest search, must not decrease when a coordinate of item moves away from pos
+typedef float (*pfnSpatialDistance)( const Vector &item, const Vector &pos );
+typedef bool (*pfnSpatialFilter)( int index, const void *context );
+
+void Mod_BuildSpatialTree( mspatialtree_t *tree, const mspatialitem_t *items, int count );
+void Mod_FreeSpatialTree( mspatialtree_t *tree );
+
+// up to numresults items with smallest distance below maxDist, ties go to lower index
+int R_SpatialFindNearest( const mspatialtree_t *tree, const Vector &pos, int numresults, int *results, float maxDist,
+	pfnSpatialDistance pfnDistance, pfnSpatialFilter pfnFilter = NULL, const void *context = NULL );
+
+// items which sphere touches the box, sorted by index
+int R_SpatialFindInBox( const mspatialtree_t *tree, const Vector &mins, const Vector &maxs, int *results, int maxresults );
+
+void R_InitSpatialTree( void );
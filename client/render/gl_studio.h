@@ -187,9 +187,42 @@ private:
 	// Interpolate model position and angles and set up matrices
 	void StudioSetUpTransform( void );
 
+	struct ModelInstance_t;
+
+	// animation state of entity grabbed on the main thread, enough to pose the model on any thread
+	struct BoneJob_t
+	{
+		ModelInstance_t	*inst;
+		int		modelhandle;	// inst may move while new instances are allocated
+		studiohdr_t	*hdr;
+		int		sequence;
+		float		cycle;
+		int		gaitsequence;	// 0 when there is no gait
+		float		gaitcycle;
+		byte		mouthopen;
+		bool		compatible;
+		double		time;
+		Vector		origin;
+		Vector		angles;
+	};
+
 	// Set up model bone positions
 	void StudioSetupBones( void );	
 
+	// Interpolate and latch animation state, returns false when cached bones are still valid
+	bool StudioPrepareBones( BoneJob_t *job );
+
+	// Blend sequences into local bone transforms, safe to call from the jobs
+	static void StudioAnimateBones( CStudioBoneSetup *setup, const BoneJob_t *job, CIKContext *pIK, Vector pos[], Vector4D q[] );
+
+	// Concat local transforms into the bones and GLSL arrays, safe to call from the jobs
+	static void StudioBuildBones( const BoneJob_t *job, const Vector pos[], const Vector4D q[] );
+
+	static void StudioBoneJob( void *context, int item, int thread );
+
+	// Transform and bones for AddStudioModelToDrawList, false if entity can't be posed
+	bool StudioComputeBones( void );
+
 	// External simulation for bones
 	void StudioCalcBonesExternal( Vector pos[], Vector4D q[] );
 
@@ -198,7 +231,7 @@ private:
 
 	void AddBlendSequence( int oldseq, int newseq, float prevframe, bool gaitseq = false );
 
-	void BlendSequence( Vector pos[], Vector4D q[], mstudioblendseq_t *pseqblend );
+	static void BlendSequence( CStudioBoneSetup *setup, const BoneJob_t *job, CIKContext *pIK, Vector pos[], Vector4D q[], mstudioblendseq_t *pseqblend );
 
 	void UpdateIKLocks( CIKContext *pIK );
 
@@ -406,6 +439,7 @@ private:
 		GLfloat			m_glmatrix[16];
 
 		unsigned int		cached_frame;			// to avoid compute bones more than once per frame
+		unsigned int		posed_frame;			// bones were computed ahead by StudioSetupBonesForList
 		unsigned int		visframe;				// model is visible this frame
 	};
 
@@ -437,6 +471,9 @@ private:
 	// keep model instances for each entity
 	CUtlLinkedList< ModelInstance_t, int32_t > m_ModelInstances;
 
+	// entities which are posed by the jobs this frame
+	CUtlArray< BoneJob_t >	m_BoneJobs;
+
 	// decal stuff
 	bool ComputePoseToDecal( const Vector &vecStart, const Vector &vecEnd );
 	void AddDecalToModel( DecalBuildInfo_t& buildInfo );
@@ -528,7 +565,7 @@ private:
 	static void CreateIndexBuffer( vbomesh_t *pOut, unsigned int *arrayelems );
 	static void BindIndexBuffer( vbomesh_t *pOut );
 
-	static int SortSolidMeshes( const CSolidEntry *a, const CSolidEntry *b );
+	static uint64_t SolidMeshSortKey( const CSolidEntry *entry );
 
 	unsigned int ComputeAttribFlags( int numbones, bool has_bumpmap, bool has_boneweights, bool has_vertexlight, bool has_lightmap );
 	unsigned int SelectMeshLoader( int numbones, bool has_bumpmap, bool has_boneweights, bool has_vertexlight, bool has_lightmap );
@@ -591,6 +628,10 @@ private:
 public:
 	void	DestroyAllModelInstances( void );
 
+	void	StudioSetupBonesForList( void );
+
+	void	StudioBoneBenchmark( const char *modelname, int count );
+
 	int	StudioGetBounds( cl_entity_t *e, Vector bounds[2] );
 	int	StudioGetBounds( CSolidEntry *entry, Vector bounds[2] );
 	int	StudioGetBounds( CSolidEntry *entry, CBoundingBox &bounds );
@@ -719,6 +760,12 @@ inline void R_RenderDebugStudioList( bool bViewModel )
 	g_StudioRenderer.RenderDebugStudioList( bViewModel );
 }
 
+inline void R_SetupStudioBones( void )
+{
+	ZoneScoped;
+	g_StudioRenderer.StudioSetupBonesForList();
+}
+
 inline void R_AddStudioToDrawList( cl_entity_t *e, bool update = false )
 {
 	g_StudioRenderer.AddStudioModelToDrawList( e, update );
@@ -30,26 +30,30 @@ GNU General Public License for more details.
 #include "gl_shader.h"
 #include "gl_world.h"
 #include "gl_cvars.h"
+#include "gl_sort.h"
+#include "gl_jobs.h"
+#include "simd4.h"
 #include "visualizer/debug_visualizer.h"
 
 #define LIGHT_INTERP_UPDATE	0.1f
 #define LIGHT_INTERP_FACTOR	(1.0f / LIGHT_INTERP_UPDATE)
 
+#define BONEBENCH_ITERATIONS		20
+
+// bone setup for each job thread, main thread uses m_boneSetup outside of jobs
+static CBaseBoneSetup	bonejob_setup[MAX_JOB_THREADS];
+
 /*
 =================
-SortSolidMeshes
+SolidMeshSortKey
 
 sort by shaders to reduce state switches
 =================
 */
-int CStudioModelRenderer :: SortSolidMeshes( const CSolidEntry *a, const CSolidEntry *b )
+uint64_t CStudioModelRenderer :: SolidMeshSortKey( const CSolidEntry *entry )
 {
-	if( a->m_hProgram > b->m_hProgram )
-		return -1;
-	if( a->m_hProgram < b->m_hProgram )
-		return 1;
-
-	return 0;
+	// descending program order
+	return (uint64_t)( 0xFFFF - ( entry->m_hProgram & 0xFFFF ));
 }
 
 /*
@@ -761,21 +765,39 @@ void CStudioModelRenderer :: StudioFxTransform( cl_entity_t *ent, matrix3x4 &tra
 	}
 }
 
-void CStudioModelRenderer :: BlendSequence( Vector pos[], Vector4D q[], mstudioblendseq_t *pseqblend )
+/*
+====================
+StudioGaitBoneWeights
+
+legs are animated by gait sequence, body by main sequence
+====================
+*/
+static void StudioGaitBoneWeights( const studiohdr_t *phdr, float weights[] )
+{
+	mstudiobone_t *pbones = (mstudiobone_t *)((byte *)phdr + phdr->boneindex);
+	bool copy = true;
+
+	for( int i = 0; i < phdr->numbones; i++)
+	{
+		if( !Q_strcmp( pbones[i].name, "Bip01 Spine" ))
+			copy = false;
+		else if( !Q_strcmp( pbones[pbones[i].parent].name, "Bip01 Pelvis" ))
+			copy = true;
+		weights[i] = (copy) ? 1.0f : 0.0f;
+	}
+}
+
+void CStudioModelRenderer :: BlendSequence( CStudioBoneSetup *setup, const BoneJob_t *job, CIKContext *pIK, Vector pos[], Vector4D q[], mstudioblendseq_t *pseqblend )
 {
 	float m_flGaitBoneWeights[MAXSTUDIOBONES];
-	CIKContext *pIK = NULL;
 
 	// to prevent division by zero
 	if( pseqblend->fadeout <= 0.0f )
 		pseqblend->fadeout = 0.2f;
 
-	if( m_boneSetup.GetNumIKChains( ))
-		pIK = &m_pModelInstance->m_ik;
-
-	if( pseqblend->blendtime && ( pseqblend->blendtime + pseqblend->fadeout > tr.time ) && ( pseqblend->sequence < m_pStudioHeader->numseq ))
+	if( pseqblend->blendtime && ( pseqblend->blendtime + pseqblend->fadeout > job->time ) && ( pseqblend->sequence < job->hdr->numseq ))
 	{
-		float	s = 1.0f - (tr.time - pseqblend->blendtime) / pseqblend->fadeout;
+		float	s = 1.0f - (job->time - pseqblend->blendtime) / pseqblend->fadeout;
 
 		if( s > 0 && s <= 1.0 )
 		{
@@ -790,23 +812,12 @@ void CStudioModelRenderer :: BlendSequence( Vector pos[], Vector4D q[], mstudiob
 
 		if( pseqblend->gaitseq )
 		{
-			mstudiobone_t *pbones = (mstudiobone_t *)((byte *)m_pStudioHeader + m_pStudioHeader->boneindex);
-			bool copy = true;
-
-			for( int i = 0; i < m_pStudioHeader->numbones; i++)
-			{
-				if( !Q_strcmp( pbones[i].name, "Bip01 Spine" ))
-					copy = false;
-				else if( !Q_strcmp( pbones[pbones[i].parent].name, "Bip01 Pelvis" ))
-					copy = true;
-				m_flGaitBoneWeights[i] = (copy) ? 1.0f : 0.0f;
-			}
-
-			m_boneSetup.SetBoneWeights( m_flGaitBoneWeights ); // install weightlist for gait sequence
+			StudioGaitBoneWeights( job->hdr, m_flGaitBoneWeights );
+			setup->SetBoneWeights( m_flGaitBoneWeights ); // install weightlist for gait sequence
 		}
 
-		m_boneSetup.AccumulatePose( pIK, pos, q, pseqblend->sequence, pseqblend->cycle, s );
-		m_boneSetup.SetBoneWeights( NULL ); // back to default rules
+		setup->AccumulatePose( pIK, pos, q, pseqblend->sequence, pseqblend->cycle, s );
+		setup->SetBoneWeights( NULL ); // back to default rules
 	}
 }
 
@@ -1198,22 +1209,76 @@ void CStudioModelRenderer :: StudioCalcBonesExternal( Vector pos[], Vector4D q[]
 
 /*
 ====================
-StudioSetupBones
+StudioConcatTransforms
 
+same as matrix3x4::ConcatTransforms but with columns in simd lanes
 ====================
 */
-void CStudioModelRenderer :: StudioSetupBones( void )
+static void StudioConcatTransforms( const matrix3x4 &in1, const matrix3x4 &in2, matrix3x4 &out )
+{
+	const float	*m = in1;
+	simd4_t		col0 = Simd4Set( m[0], m[1], m[2], 0.0f );
+	simd4_t		col1 = Simd4Set( m[3], m[4], m[5], 0.0f );
+	simd4_t		col2 = Simd4Set( m[6], m[7], m[8], 0.0f );
+	simd4_t		col3 = Simd4Set( m[9], m[10], m[11], 0.0f );
+	float		result[4];
+
+	for( int i = 0; i < 4; i++ )
+	{
+		simd4_t r = Simd4Add( Simd4Add( Simd4Mul( col0, Simd4Splat( in2[i][0] )), Simd4Mul( col1, Simd4Splat( in2[i][1] ))), Simd4Mul( col2, Simd4Splat( in2[i][2] )));
+
+		if( i == 3 ) r = Simd4Add( r, col3 );
+		Simd4Store( result, r );
+
+		out[i][0] = result[0];
+		out[i][1] = result[1];
+		out[i][2] = result[2];
+	}
+}
+
+/*
+====================
+StudioConvertBones
+
+convert bones into compacted GLSL array
+====================
+*/
+static void StudioConvertBones( int numbones, bool has_boneweights, const mposetobone_t *m, matrix3x4 bones[], Vector4D glbones[], Vector4D quat[], Vector pos[] )
+{
+	if( has_boneweights )
+	{
+		for( int i = 0; i < numbones; i++ )
+		{
+			matrix3x4 out;
+
+			StudioConcatTransforms( bones[i], m->posetobone[i], out );
+			out.CopyToArray4x3( &glbones[i*3] );
+			quat[i] = out.GetQuaternion();
+			pos[i] = out.GetOrigin();
+		}
+	}
+	else
+	{
+		for( int i = 0; i < numbones; i++ )
+		{
+			bones[i].CopyToArray4x3( &glbones[i*3] );
+			quat[i] = bones[i].GetQuaternion();
+			pos[i] = bones[i].GetOrigin();
+		}
+	}
+}
+
+/*
+====================
+StudioPrepareBones
+
+everything that touches entity or engine
+====================
+*/
+bool CStudioModelRenderer :: StudioPrepareBones( BoneJob_t *job )
 {
-	float		adj[MAXSTUDIOCONTROLLERS];
 	cl_entity_t	*e = RI->currententity;	// for more readability
-	CIKContext	*pIK = NULL;
-	mstudioboneinfo_t	*pboneinfo;
 	mstudioseqdesc_t	*pseqdesc;
-	matrix3x4		bonematrix;
-	mstudiobone_t	*pbones;
-
-	static Vector	pos[MAXSTUDIOBONES];
-	static Vector4D	q[MAXSTUDIOBONES];
 
 	if( e->curstate.sequence < 0 || e->curstate.sequence >= m_pStudioHeader->numseq ) 
 	{
@@ -1221,7 +1286,7 @@ void CStudioModelRenderer :: StudioSetupBones( void )
 		ALERT( at_aiconsole, "StudioSetupBones: sequence %i/%i out of range for model %s\n",
 		sequence, m_pStudioHeader->numseq, RI->currentmodel->name );
 		e->curstate.sequence = 0;
-    }
+	}
 
 	pseqdesc = (mstudioseqdesc_t *)((byte *)m_pStudioHeader + m_pStudioHeader->seqindex) + e->curstate.sequence;
 	float f = StudioEstimateFrame( pseqdesc );
@@ -1230,94 +1295,109 @@ void CStudioModelRenderer :: StudioSetupBones( void )
 	StudioInterpolatePoseParams( e, dadt );
 
 	if( CheckBoneCache( f )) 
-		return; // using a cached bones no need transformations
+		return false; // using a cached bones no need transformations
 
-	if( m_boneSetup.GetNumIKChains( ))
-	{
-		if( FBitSet( e->curstate.effects, EF_NOINTERP ))
-			m_pModelInstance->m_ik.ClearTargets();
-		m_pModelInstance->m_ik.Init( &m_boneSetup, StudioGetAngles(), StudioGetOrigin(), tr.time, tr.realframecount );
-		pIK = &m_pModelInstance->m_ik;
-	}
-
-	float cycle = f / m_boneSetup.LocalMaxFrame( e->curstate.sequence );
+	job->cycle = f / m_boneSetup.LocalMaxFrame( e->curstate.sequence );
 	StudioInterpolateControllers( e, dadt );
-
-	m_boneSetup.InitPose( pos, q );
-	m_boneSetup.UpdateRealTime( tr.time );
-	if( CVAR_TO_BOOL( m_pCvarCompatible ))
-		m_boneSetup.CalcBoneAdj( adj, m_pModelInstance->m_controller, e->mouth.mouthopen );
-	m_boneSetup.AccumulatePose( pIK, pos, q, e->curstate.sequence, cycle, 1.0 );
 	m_pModelInstance->lerp.frame = f;
 
-	pbones = (mstudiobone_t *)((byte *)m_pStudioHeader + m_pStudioHeader->boneindex);
-	pboneinfo = (mstudioboneinfo_t *)((byte *)m_pStudioHeader + m_pStudioHeader->boneindex + m_pStudioHeader->numbones * sizeof( mstudiobone_t ));
-
 	if( e->curstate.gaitsequence < 0 || e->curstate.gaitsequence >= m_pStudioHeader->numseq ) 
 		e->curstate.gaitsequence = 0;
 
-	// calc gait animation
+	job->gaitcycle = 0.0f;
+
 	if( e->curstate.gaitsequence != 0 )
 	{
-		float m_flGaitBoneWeights[MAXSTUDIOBONES];
-		bool copy = true;
-
-		for( int i = 0; i < m_pStudioHeader->numbones; i++)
-		{
-			if( !Q_strcmp( pbones[i].name, "Bip01 Spine" ))
-				copy = false;
-			else if( !Q_strcmp( pbones[pbones[i].parent].name, "Bip01 Pelvis" ))
-				copy = true;
-			m_flGaitBoneWeights[i] = (copy) ? 1.0f : 0.0f;
-		}
-
 		pseqdesc = (mstudioseqdesc_t *)((byte *)m_pStudioHeader + m_pStudioHeader->seqindex) + e->curstate.gaitsequence;
 		f = StudioEstimateGaitFrame( pseqdesc );
 
 		// convert gaitframe to cycle
-		cycle = f / m_boneSetup.LocalMaxFrame( e->curstate.gaitsequence );
-
-		m_boneSetup.SetBoneWeights( m_flGaitBoneWeights ); // install weightlist for gait sequence
-		m_boneSetup.AccumulatePose( pIK, pos, q, e->curstate.gaitsequence, cycle, 1.0 );
-		m_boneSetup.SetBoneWeights( NULL ); // back to default rules
+		job->gaitcycle = f / m_boneSetup.LocalMaxFrame( e->curstate.gaitsequence );
 		m_pModelInstance->lerp.gaitframe = f;
 	}
 
-	// run blends from previous sequences
-	for( int i = 0; i < MAX_SEQBLENDS; i++ )
-		BlendSequence( pos, q, &m_pModelInstance->m_seqblend[i] );
+	job->inst = m_pModelInstance;
+	job->modelhandle = e->modelhandle;
+	job->hdr = m_pStudioHeader;
+	job->sequence = e->curstate.sequence;
+	job->gaitsequence = e->curstate.gaitsequence;
+	job->mouthopen = e->mouth.mouthopen;
+	job->compatible = CVAR_TO_BOOL( m_pCvarCompatible );
+	job->time = tr.time;
+	job->origin = StudioGetOrigin();
+	job->angles = StudioGetAngles();
 
-	CIKContext auto_ik;
-	auto_ik.Init( &m_boneSetup, StudioGetAngles(), StudioGetOrigin(), 0.0f, 0 );
-	m_boneSetup.CalcAutoplaySequences( &auto_ik, pos, q );
-	if( !CVAR_TO_BOOL( m_pCvarCompatible ))
-		m_boneSetup.CalcBoneAdj( pos, q, m_pModelInstance->m_controller, e->mouth.mouthopen );
+	return true;
+}
 
-	byte	boneComputed[MAXSTUDIOBONES];
+/*
+====================
+StudioAnimateBones
 
-	memset( boneComputed, 0, sizeof( boneComputed ));
+====================
+*/
+void CStudioModelRenderer :: StudioAnimateBones( CStudioBoneSetup *setup, const BoneJob_t *job, CIKContext *pIK, Vector pos[], Vector4D q[] )
+{
+	ModelInstance_t	*inst = job->inst;
+	float		adj[MAXSTUDIOCONTROLLERS];
 
-	// don't calculate IK on ragdolls
-	if( pIK != NULL )
+	setup->InitPose( pos, q );
+	setup->UpdateRealTime( job->time );
+	if( job->compatible )
+		setup->CalcBoneAdj( adj, inst->m_controller, job->mouthopen );
+	setup->AccumulatePose( pIK, pos, q, job->sequence, job->cycle, 1.0 );
+
+	// calc gait animation
+	if( job->gaitsequence != 0 )
 	{
-		UpdateIKLocks( pIK );
-		pIK->UpdateTargets( pos, q, m_pModelInstance->m_pbones, boneComputed );
-		CalculateIKLocks( pIK );
-		pIK->SolveDependencies( pos, q, m_pModelInstance->m_pbones, boneComputed );
+		float m_flGaitBoneWeights[MAXSTUDIOBONES];
+
+		StudioGaitBoneWeights( job->hdr, m_flGaitBoneWeights );
+		setup->SetBoneWeights( m_flGaitBoneWeights ); // install weightlist for gait sequence
+		setup->AccumulatePose( pIK, pos, q, job->gaitsequence, job->gaitcycle, 1.0 );
+		setup->SetBoneWeights( NULL ); // back to default rules
 	}
 
-	StudioCalcBonesExternal( pos, q );
+	// run blends from previous sequences
+	for( int i = 0; i < MAX_SEQBLENDS; i++ )
+		BlendSequence( setup, job, pIK, pos, q, &inst->m_seqblend[i] );
 
-	for( int i = 0; i < m_pStudioHeader->numbones; i++ ) 
+	CIKContext auto_ik;
+	auto_ik.Init( setup, job->angles, job->origin, 0.0f, 0 );
+	setup->CalcAutoplaySequences( &auto_ik, pos, q );
+	if( !job->compatible )
+		setup->CalcBoneAdj( pos, q, inst->m_controller, job->mouthopen );
+}
+
+/*
+====================
+StudioBuildBones
+
+====================
+*/
+void CStudioModelRenderer :: StudioBuildBones( const BoneJob_t *job, const Vector pos[], const Vector4D q[] )
+{
+	ModelInstance_t	*inst = job->inst;
+	studiohdr_t	*phdr = job->hdr;
+	mstudioboneinfo_t	*pboneinfo;
+	matrix3x4		bonematrix;
+	mstudiobone_t	*pbones;
+
+	pbones = (mstudiobone_t *)((byte *)phdr + phdr->boneindex);
+	pboneinfo = (mstudioboneinfo_t *)((byte *)phdr + phdr->boneindex + phdr->numbones * sizeof( mstudiobone_t ));
+
+	for( int i = 0; i < phdr->numbones; i++ ) 
 	{
 		// animate all non-simulated bones
-		if( CalcProceduralBone( m_pStudioHeader, i, m_pModelInstance->m_pbones ))
+		if( CalcProceduralBone( phdr, i, inst->m_pbones ))
 			continue;
 
 		// initialize bonematrix
 		bonematrix = matrix3x4( pos[i], q[i] );
 
-		if( FBitSet( pbones[i].flags, BONE_JIGGLE_PROCEDURAL ) && FBitSet( m_pStudioHeader->flags, STUDIO_HAS_BONEINFO ))
+		const matrix3x4 &parent = ( pbones[i].parent == -1 ) ? inst->m_protationmatrix : inst->m_pbones[pbones[i].parent];
+
+		if( FBitSet( pbones[i].flags, BONE_JIGGLE_PROCEDURAL ) && FBitSet( phdr->flags, STUDIO_HAS_BONEINFO ))
 		{
 			// Physics-based "jiggle" bone
 			// Bone is assumed to be along the Z axis
@@ -1326,60 +1406,254 @@ void CStudioModelRenderer :: StudioSetupBones( void )
 			// compute desired bone orientation
 			matrix3x4 goalMX;
 
-			if (pbones[i].parent == -1) {
-				goalMX = m_pModelInstance->m_protationmatrix.ConcatTransforms(bonematrix);
-			}
-			else {
-				goalMX = m_pModelInstance->m_pbones[pbones[i].parent].ConcatTransforms(bonematrix);
-			}
+			StudioConcatTransforms( parent, bonematrix, goalMX );
 
 			// get jiggle properties from QC data
-			mstudiojigglebone_t *jiggleInfo = (mstudiojigglebone_t *)((byte *)m_pStudioHeader + pboneinfo[i].procindex);
-			if (!m_pModelInstance->m_pJiggleBones) {
-				m_pModelInstance->m_pJiggleBones = new CJiggleBones;
+			mstudiojigglebone_t *jiggleInfo = (mstudiojigglebone_t *)((byte *)phdr + pboneinfo[i].procindex);
+			if (!inst->m_pJiggleBones) {
+				inst->m_pJiggleBones = new CJiggleBones;
 			}
 
 			// do jiggle physics
 			if (pboneinfo[i].proctype == STUDIO_PROC_JIGGLE) {
-				m_pModelInstance->m_pJiggleBones->BuildJiggleTransformations(i, tr.time, jiggleInfo, goalMX, m_pModelInstance->m_pbones[i]);
+				inst->m_pJiggleBones->BuildJiggleTransformations(i, job->time, jiggleInfo, goalMX, inst->m_pbones[i]);
 			}
 			else {
-				m_pModelInstance->m_pbones[i] = goalMX; // fallback
+				inst->m_pbones[i] = goalMX; // fallback
 			}
 		}
 		else
 		{
-			if (pbones[i].parent == -1) {
-				m_pModelInstance->m_pbones[i] = m_pModelInstance->m_protationmatrix.ConcatTransforms(bonematrix);
-			}
-			else {
-				m_pModelInstance->m_pbones[i] = m_pModelInstance->m_pbones[pbones[i].parent].ConcatTransforms(bonematrix);
-			}
+			StudioConcatTransforms( parent, bonematrix, inst->m_pbones[i] );
 		}
 	}
 
-	// convert bones into compacted GLSL array
-	mposetobone_t *m = m_pModelInstance->m_pModel->poseToBone;
-	bool has_boneweights = FBitSet(m_pStudioHeader->flags, STUDIO_HAS_BONEWEIGHTS) != 0;
-	if (has_boneweights)
+	StudioConvertBones( phdr->numbones, FBitSet( phdr->flags, STUDIO_HAS_BONEWEIGHTS ) != 0, inst->m_pModel->poseToBone,
+		inst->m_pbones, inst->m_glstudiobones, inst->m_studioquat, inst->m_studiopos );
+}
+
+/*
+====================
+StudioSetupBones
+
+====================
+*/
+void CStudioModelRenderer :: StudioSetupBones( void )
+{
+	cl_entity_t	*e = RI->currententity;	// for more readability
+	CIKContext	*pIK = NULL;
+	Vector		pos[MAXSTUDIOBONES];
+	Vector4D		q[MAXSTUDIOBONES];
+	BoneJob_t		job;
+
+	if( !StudioPrepareBones( &job ))
+		return; // using a cached bones no need transformations
+
+	if( m_boneSetup.GetNumIKChains( ))
 	{
-		for( int i = 0; i < m_pStudioHeader->numbones; i++ )
-		{
-			matrix3x4 out = m_pModelInstance->m_pbones[i].ConcatTransforms( m->posetobone[i] );
-			out.CopyToArray4x3( &m_pModelInstance->m_glstudiobones[i*3] );
-			m_pModelInstance->m_studioquat[i] = out.GetQuaternion();
-			m_pModelInstance->m_studiopos[i] = out.GetOrigin();
-		}
+		if( FBitSet( e->curstate.effects, EF_NOINTERP ))
+			m_pModelInstance->m_ik.ClearTargets();
+		m_pModelInstance->m_ik.Init( &m_boneSetup, job.angles, job.origin, tr.time, tr.realframecount );
+		pIK = &m_pModelInstance->m_ik;
 	}
-	else
+
+	StudioAnimateBones( &m_boneSetup, &job, pIK, pos, q );
+
+	byte	boneComputed[MAXSTUDIOBONES];
+
+	memset( boneComputed, 0, sizeof( boneComputed ));
+
+	// don't calculate IK on ragdolls
+	if( pIK != NULL )
 	{
-		for( int i = 0; i < m_pStudioHeader->numbones; i++ )
-		{
-			m_pModelInstance->m_pbones[i].CopyToArray4x3( &m_pModelInstance->m_glstudiobones[i*3] );
-			m_pModelInstance->m_studioquat[i] = m_pModelInstance->m_pbones[i].GetQuaternion();
-			m_pModelInstance->m_studiopos[i] = m_pModelInstance->m_pbones[i].GetOrigin();
-		}
+		UpdateIKLocks( pIK );
+		pIK->UpdateTargets( pos, q, m_pModelInstance->m_pbones, boneComputed );
+		CalculateIKLocks( pIK );
+		pIK->SolveDependencies( pos, q, m_pModelInstance->m_pbones, boneComputed );
+	}
+
+	StudioCalcBonesExternal( pos, q );
+	StudioBuildBones( &job, pos, q );
+}
+
+/*
+====================
+StudioBoneJob
+
+====================
+*/
+void CStudioModelRenderer :: StudioBoneJob( void *context, int item, int thread )
+{
+	const BoneJob_t	*job = (const BoneJob_t *)context + item;
+	CBaseBoneSetup	*setup = &bonejob_setup[thread];
+	Vector		pos[MAXSTUDIOBONES];
+	Vector4D		q[MAXSTUDIOBONES];
+
+	setup->SetStudioPointers( job->hdr, job->inst->m_poseparameter );
+	StudioAnimateBones( setup, job, NULL, pos, q );
+	StudioBuildBones( job, pos, q );
+}
+
+/*
+====================
+StudioSetupBonesForList
+
+pose visible studio entities on the job threads before they
+are added to draw list. Entities which need IK, external bones,
+extra sequence groups or a parent are left to StudioSetupBones
+====================
+*/
+void CStudioModelRenderer :: StudioSetupBonesForList( void )
+{
+	BoneJob_t	job;
+
+	if( R_JobThreadCount() <= 1 )
+		return;
+
+	m_BoneJobs.RemoveAll();
+
+	for( int i = 0; i < tr.num_draw_entities; i++ )
+	{
+		cl_entity_t *e = tr.draw_entities[i];
+
+		if( !e->model || e->model->type != mod_studio )
+			continue;
+
+		RI->currententity = e;
+		RI->currentmodel = e->model;
+
+		// same checks as AddStudioModelToDrawList
+		if( !StudioSetEntity( e ) || !StudioComputeBBox( ))
+			continue;
+
+		if( !Mod_CheckBoxVisible( m_pModelInstance->absmin, m_pModelInstance->absmax ))
+			continue;
+
+		if( R_CullModel( RI->currententity, m_pModelInstance->absmin, m_pModelInstance->absmax ))
+			continue;
+
+		if( m_pModelInstance->cached_frame == tr.realframecount || m_pModelInstance->posed_frame == tr.realframecount )
+			continue;
+
+		if( RP_LOCALCLIENT( RI->currententity ) && !FBitSet( RI->params, RP_THIRDPERSON ))
+			continue;
+
+		if( RI->currententity->curstate.movetype == MOVETYPE_FOLLOW && RI->currententity->curstate.aiment > 0 )
+			continue;
+
+		if( m_boneSetup.GetNumIKChains() || m_pModelInstance->m_bExternalBones || m_pStudioHeader->numseqgroups > 1 )
+			continue;
+
+		StudioSetUpTransform( );
+		m_pModelInstance->posed_frame = tr.realframecount;
+
+		if( StudioPrepareBones( &job ))
+			m_BoneJobs.AddToTail( job );
+	}
+
+	RI->currententity = NULL;
+	RI->currentmodel = NULL;
+
+	for( int i = 0; i < m_BoneJobs.Count(); i++ )
+		m_BoneJobs[i].inst = &m_ModelInstances[m_BoneJobs[i].modelhandle];
+
+	R_RunJobs( StudioBoneJob, m_BoneJobs.Base(), m_BoneJobs.Count() );
+}
+
+/*
+====================
+StudioBoneBenchmark
+
+poses copies of model without drawing, first on the
+main thread and then through the jobs
+====================
+*/
+void CStudioModelRenderer :: StudioBoneBenchmark( const char *modelname, int count )
+{
+	CUtlArray<BoneJob_t>	jobs;
+	CUtlArray<int>	sequences;
+	double		start, serial_time, jobs_time;
+
+	model_t *model = IEngineStudio.Mod_ForName( modelname, false );
+	studiohdr_t *phdr = model ? (studiohdr_t *)IEngineStudio.Mod_Extradata( model ) : NULL;
+
+	if( !phdr || model->type != mod_studio )
+	{
+		Msg( "r_bonebench: %s is not a studio model\n", modelname );
+		return;
+	}
+
+	// animations from other files are loaded through the engine
+	for( int i = 0; i < phdr->numseq; i++ )
+	{
+		mstudioseqdesc_t *pseqdesc = (mstudioseqdesc_t *)((byte *)phdr + phdr->seqindex) + i;
+		if( pseqdesc->seqgroup == 0 )
+			sequences.AddToTail( i );
+	}
+
+	if( !sequences.Count( ))
+	{
+		Msg( "r_bonebench: %s has no sequences in base group\n", modelname );
+		return;
+	}
+
+	ModelInstance_t *instances = new ModelInstance_t[count];
+	jobs.SetCount( count );
+
+	for( int i = 0; i < count; i++ )
+	{
+		ModelInstance_t *inst = &instances[i];
+		BoneJob_t *job = &jobs[i];
+
+		inst->m_pModel = model;
+		inst->m_pJiggleBones = NULL;
+		memset( inst->m_controller, 127, sizeof( inst->m_controller ));
+		memset( inst->m_seqblend, 0, sizeof( inst->m_seqblend ));
+		m_boneSetup.SetStudioPointers( phdr, inst->m_poseparameter );
+		m_boneSetup.CalcDefaultPoseParameters( inst->m_poseparameter );
+
+		// spread copies over the grid, each one plays some other sequence
+		job->inst = inst;
+		job->modelhandle = INVALID_HANDLE;
+		job->hdr = phdr;
+		job->sequence = sequences[i % sequences.Count()];
+		job->cycle = ( i * 0.137f ) - (int)( i * 0.137f );
+		job->gaitsequence = 0;
+		job->gaitcycle = 0.0f;
+		job->mouthopen = 0;
+		job->compatible = CVAR_TO_BOOL( m_pCvarCompatible );
+		job->time = tr.time;
+		job->origin = Vector(( i % 32 ) * 64.0f, ( i / 32 ) * 64.0f, 0.0f );
+		job->angles = Vector( 0.0f, ( i * 45 ) % 360, 0.0f );
+		inst->m_protationmatrix = matrix3x4( job->origin, job->angles );
+	}
+
+	start = Sys_DoubleTime();
+	for( int j = 0; j < BONEBENCH_ITERATIONS; j++ )
+	{
+		for( int i = 0; i < count; i++ )
+			StudioBoneJob( jobs.Base(), i, 0 );
 	}
+	serial_time = Sys_DoubleTime() - start;
+
+	start = Sys_DoubleTime();
+	for( int j = 0; j < BONEBENCH_ITERATIONS; j++ )
+		R_RunJobs( StudioBoneJob, jobs.Base(), count );
+	jobs_time = Sys_DoubleTime() - start;
+
+	for( int i = 0; i < count; i++ )
+	{
+		if( instances[i].m_pJiggleBones )
+			delete instances[i].m_pJiggleBones;
+	}
+
+	delete [] instances;
+
+	serial_time *= 1000.0 / BONEBENCH_ITERATIONS;
+	jobs_time *= 1000.0 / BONEBENCH_ITERATIONS;
+
+	Msg( "%i x %s (%i bones): serial %.3f ms, %i threads %.3f ms, %.1f poses/ms\n", count, model->name, phdr->numbones,
+		serial_time, R_JobThreadCount(), jobs_time, count / Q_max( jobs_time, 1e-6 ));
 }
 
 /*
@@ -2300,6 +2574,38 @@ void CStudioModelRenderer :: AddBodyPartToDrawList( studiohdr_t *phdr, mbodypart
 		AddMeshToDrawList( phdr, &pSubModel->meshes[i], lightpass );
 }
 
+/*
+=================
+StudioComputeBones
+
+=================
+*/
+bool CStudioModelRenderer :: StudioComputeBones( void )
+{
+	StudioSetUpTransform( );
+
+	if( RI->currententity->curstate.movetype == MOVETYPE_FOLLOW && RI->currententity->curstate.aiment > 0 )
+	{
+		cl_entity_t *parent = gEngfuncs.GetEntityByIndex( RI->currententity->curstate.aiment );
+		if( parent != NULL && parent->modelhandle != INVALID_HANDLE )
+		{
+			ModelInstance_t *inst = &m_ModelInstances[parent->modelhandle];
+			StudioMergeBones( m_pModelInstance->m_protationmatrix, m_pModelInstance->m_pbones, inst->m_pbones, RI->currentmodel, parent->model );
+			StudioConvertBones( m_pStudioHeader->numbones, FBitSet( m_pStudioHeader->flags, STUDIO_HAS_BONEWEIGHTS ) != 0, m_pModelInstance->m_pModel->poseToBone,
+				m_pModelInstance->m_pbones, m_pModelInstance->m_glstudiobones, m_pModelInstance->m_studioquat, m_pModelInstance->m_studiopos );
+		}
+		else
+		{
+			ALERT( at_error, "FollowEntity: %i with model %s has missed parent!\n",
+			RI->currententity->index, RI->currentmodel->name );
+			return false;
+		}
+	}
+	else StudioSetupBones( );
+
+	return true;
+}
+
 /*
 =================
 AddStudioModelToDrawList
@@ -2336,47 +2642,9 @@ void CStudioModelRenderer :: AddStudioModelToDrawList( cl_entity_t *e, bool upda
 
 	if( m_pModelInstance->cached_frame != tr.realframecount )
 	{
-		StudioSetUpTransform( );
-
-		if( RI->currententity->curstate.movetype == MOVETYPE_FOLLOW && RI->currententity->curstate.aiment > 0 )
-		{
-			cl_entity_t *parent = gEngfuncs.GetEntityByIndex( RI->currententity->curstate.aiment );
-			if( parent != NULL && parent->modelhandle != INVALID_HANDLE )
-			{
-				ModelInstance_t *inst = &m_ModelInstances[parent->modelhandle];
-				StudioMergeBones( m_pModelInstance->m_protationmatrix, m_pModelInstance->m_pbones, inst->m_pbones, RI->currentmodel, parent->model );
-
-				mposetobone_t *m = m_pModelInstance->m_pModel->poseToBone;
-
-				// convert bones into compacted GLSL array
-				if (has_boneweights)
-				{
-					for( int i = 0; i < m_pStudioHeader->numbones; i++ )
-					{
-						matrix3x4 out = m_pModelInstance->m_pbones[i].ConcatTransforms( m->posetobone[i] );
-						out.CopyToArray4x3( &m_pModelInstance->m_glstudiobones[i*3] );
-						m_pModelInstance->m_studioquat[i] = out.GetQuaternion();
-						m_pModelInstance->m_studiopos[i] = out.GetOrigin();
-					}
-				}
-				else
-				{
-					for( int i = 0; i < m_pStudioHeader->numbones; i++ )
-					{
-						m_pModelInstance->m_pbones[i].CopyToArray4x3( &m_pModelInstance->m_glstudiobones[i*3] );
-						m_pModelInstance->m_studioquat[i] = m_pModelInstance->m_pbones[i].GetQuaternion();
-						m_pModelInstance->m_studiopos[i] = m_pModelInstance->m_pbones[i].GetOrigin();
-					}
-				}
-			}
-			else
-			{
-				ALERT( at_error, "FollowEntity: %i with model %s has missed parent!\n",
-				RI->currententity->index, RI->currentmodel->name );
-				return;
-			}
-		}
-		else StudioSetupBones( );
+		// bones could be already computed by StudioSetupBonesForList
+		if( m_pModelInstance->posed_frame != tr.realframecount && !StudioComputeBones( ))
+			return;
 
 		// calc attachments only once per frame
 		StudioCalcAttachments( m_pModelInstance->m_pbones );
@@ -2403,28 +2671,8 @@ void CStudioModelRenderer :: AddStudioModelToDrawList( cl_entity_t *e, bool upda
 
 			StudioMergeBones( m_pModelInstance->m_protationmatrix, m_pModelInstance->m_pwpnbones, m_pModelInstance->m_pbones, pweaponmodel, RI->currentmodel );
 
-			mposetobone_t *m = pweaponmodel->poseToBone;
-
-			// convert bones into compacted GLSL array
-			if (has_boneweights)
-			{
-				for( int i = 0; i < m_pStudioHeader->numbones; i++ )
-				{
-					matrix3x4 out = m_pModelInstance->m_pwpnbones[i].ConcatTransforms( m->posetobone[i] );
-					out.CopyToArray4x3( &m_pModelInstance->m_glweaponbones[i*3] );
-					m_pModelInstance->m_weaponquat[i] = out.GetQuaternion();
-					m_pModelInstance->m_weaponpos[i] = out.GetOrigin();
-				}
-			}
-			else
-			{
-				for( int i = 0; i < m_pStudioHeader->numbones; i++ )
-				{
-					m_pModelInstance->m_pwpnbones[i].CopyToArray4x3( &m_pModelInstance->m_glweaponbones[i*3] );
-					m_pModelInstance->m_weaponquat[i] = m_pModelInstance->m_pwpnbones[i].GetQuaternion();
-					m_pModelInstance->m_weaponpos[i] = m_pModelInstance->m_pwpnbones[i].GetOrigin();
-				}
-			}
+			StudioConvertBones( m_pStudioHeader->numbones, has_boneweights, pweaponmodel->poseToBone, m_pModelInstance->m_pwpnbones,
+				m_pModelInstance->m_glweaponbones, m_pModelInstance->m_weaponquat, m_pModelInstance->m_weaponpos );
 
 			m_pStudioHeader = (studiohdr_t *)IEngineStudio.Mod_Extradata( RI->currentmodel );
 		}
@@ -2719,7 +2967,7 @@ void CStudioModelRenderer :: DrawLightForMeshList( CDynLight *pl )
 
 	// sorting list to reduce shader switches
 	if( !CVAR_TO_BOOL( cv_nosort ))
-		RI->frame.light_meshes.Sort( SortSolidMeshes );
+		R_SortDrawList( RI->frame.light_meshes, SolidMeshSortKey, "light meshes" );
 
 	pglAlphaFunc( GL_GEQUAL, 0.5f );
 	RI->currententity = NULL;
@@ -3644,7 +3892,7 @@ void CStudioModelRenderer :: RenderSolidStudioList( void )
 
 	// sorting list to reduce shader switches
 	if( !CVAR_TO_BOOL( cv_nosort ))
-		RI->frame.solid_meshes.Sort( SortSolidMeshes );
+		R_SortDrawList( RI->frame.solid_meshes, SolidMeshSortKey, "solid meshes" );
 
 	RI->currententity = NULL;
 	RI->currentmodel = NULL;
@@ -34,6 +34,9 @@ GNU General Public License for more details.
 #include <vector>
 #include <algorithm>
 
+#define BONEBENCH_DEFAULT_COUNT	100
+#define BONEBENCH_MAX_COUNT		1024
+
 // Global engine <-> studio model rendering code interface
 engine_studio_api_t IEngineStudio;
 
@@ -86,6 +89,13 @@ void CBaseBoneSetup :: debugMsg( char *szFmt, ... )
 
 mstudioanim_t *CBaseBoneSetup :: GetAnimSourceData( mstudioseqdesc_t *pseqdesc )
 {
+	// base group is a part of header, it's the only case that is safe for jobs
+	if( pseqdesc->seqgroup == 0 )
+	{
+		mstudioseqgroup_t *pseqgroup = (mstudioseqgroup_t *)((byte *)m_pStudioHeader + m_pStudioHeader->seqgroupindex);
+		return (mstudioanim_t *)((byte *)m_pStudioHeader + pseqgroup->data + pseqdesc->animindex);
+	}
+
 	return g_StudioRenderer.StudioGetAnim( RI->currentmodel, pseqdesc );
 }
 
@@ -112,6 +122,28 @@ Init
 
 ====================
 */
+/*
+====================
+R_BoneBench_f
+
+====================
+*/
+static void R_BoneBench_f( void )
+{
+	int count = BONEBENCH_DEFAULT_COUNT;
+
+	if( CMD_ARGC() < 2 )
+	{
+		Msg( "Usage: r_bonebench <modelname> [count]\n" );
+		return;
+	}
+
+	if( CMD_ARGC() > 2 )
+		count = bound( 1, Q_atoi( CMD_ARGV( 2 )), BONEBENCH_MAX_COUNT );
+
+	g_StudioRenderer.StudioBoneBenchmark( CMD_ARGV( 1 ), count );
+}
+
 void CStudioModelRenderer :: Init( void )
 {
 	// Set up some variables shared with engine
@@ -123,6 +155,8 @@ void CStudioModelRenderer :: Init( void )
 	m_pCvarCompatible		= CVAR_REGISTER( "r_studio_compatible", "1", FCVAR_ARCHIVE );
 	m_pCvarLodScale		= CVAR_REGISTER( "cl_lod_scale", "5.0", FCVAR_ARCHIVE );
 	m_pCvarLodBias		= CVAR_REGISTER( "cl_lod_bias", "0", FCVAR_ARCHIVE );
+
+	ADD_COMMAND( "r_bonebench", R_BoneBench_f );
 }
 
 /*
@@ -416,6 +450,7 @@ void CStudioModelRenderer :: ClearInstanceData( bool create )
 	m_pModelInstance->m_DecalCount = 0;
 	m_pModelInstance->m_bExternalBones = false;
 	m_pModelInstance->cached_frame = -1;
+	m_pModelInstance->posed_frame = -1;
 	m_pModelInstance->visframe = -1;
 	m_pModelInstance->radius = 0.0f;
 	m_pModelInstance->info_flags = 0;
@@ -23,6 +23,7 @@ GNU General Public License for more details.
 #include "gl_export.h"
 #include "gl_local.h"
 #include "gl_cubemap.h"
+#include "gl_spatial.h"
 
 // world features
 #define WORLD_HAS_MOVIES	BIT( 0 )
@@ -93,6 +94,9 @@ typedef struct mextraleaf_s
 
 	mworldlight_t	*direct_lights;
 	int		num_directlights;
+
+	word		*candidate_lights;	// worldlights that can reach this leaf, sorted by index
+	int		num_candidatelights;
 } mextraleaf_t;
 
 struct BmodelInstance_t
@@ -130,6 +134,11 @@ typedef struct
 	int		totalleafs;	// full leaf counting
 	int		numleafs;		// [submodels[0].visleafs + 1]
 
+	// scratch for the batch culling of leafs in PVS
+	float		*cullbounds;	// [6][numleafs] mins and maxs by axis
+	int		*cullleafs;	// [numleafs] leaf number of each box
+	uint32_t		*cullmask;	// [(numleafs + 31) / 32] visible boxes
+
 	material_t	*materials;	// [worldmodel->numtextures]
 
 	int		numleaflights;
@@ -137,6 +146,8 @@ typedef struct
 
 	int		numworldlights;
 	mworldlight_t	*worldlights;
+	mspatialtree_t	lighttree;	// worldlights by reach
+	word		*candidatelights;	// storage of leaf candidate lists
 
 	dvertnorm_t	*surfnormals;	// is not NULL here a indexed normals
 	dnormal_t		*normals;
@@ -145,6 +156,7 @@ typedef struct
 	mcubemap_t	cubemaps[MAX_MAP_CUBEMAPS];
 	mcubemap_t	defaultCubemap;
 	int		num_cubemaps;
+	mspatialtree_t	cubemaptree;
 
 	terrain_t		*terrains;
 	unsigned int	num_terrains;
@@ -27,6 +27,7 @@ GNU General Public License for more details.
 #include "gl_cvars.h"
 #include "vertex_fmt.h"
 #include "brush_material.h"
+#include "gl_sort.h"
 
 static gl_world_t	worlddata;
 gl_world_t *world = &worlddata;
@@ -314,6 +315,9 @@ static void Mod_SetupLeafExtradata( const dlump_t *l, const dlump_t *vis, const
 	world->numleafs = worldmodel->numleafs + 1; // world leafs + outside common leaf 
 	world->leafs = out = (mextraleaf_t *)Mem_Alloc( sizeof( mextraleaf_t ) * world->numleafs );
 	world->totalleafs = l->filelen / sizeof( *in ); // keep the total leaf counting
+	world->cullbounds = (float *)Mem_Alloc( sizeof( float ) * 6 * world->numleafs );
+	world->cullleafs = (int *)Mem_Alloc( sizeof( int ) * world->numleafs );
+	world->cullmask = (uint32_t *)Mem_Alloc( sizeof( uint32_t ) * (( world->numleafs + 31 ) >> 5 ));
 
 	for( int i = 0; i < world->numleafs; i++, in++, out++ )
 	{
@@ -2074,6 +2078,7 @@ static void Mod_LoadWorld( model_t *mod, const byte *buf )
 		}
 
 		Mod_SetupLeafLights();
+		R_BuildWorldLightTree();
 	}
 
 	// mark surfaces for world features
@@ -2142,6 +2147,7 @@ static void Mod_LoadWorld( model_t *mod, const byte *buf )
 static void Mod_FreeWorld( model_t *mod )
 {
 	Mod_FreeCubemaps();
+	R_FreeWorldLightTree();
 
 	// destroy VBO & VAO
 	Mod_DeleteBufferObject();
@@ -2150,6 +2156,18 @@ static void Mod_FreeWorld( model_t *mod )
 		Mem_Free( world->leafs );
 	world->leafs = NULL;
 
+	if( world->cullbounds )
+		Mem_Free( world->cullbounds );
+	world->cullbounds = NULL;
+
+	if( world->cullleafs )
+		Mem_Free( world->cullleafs );
+	world->cullleafs = NULL;
+
+	if( world->cullmask )
+		Mem_Free( world->cullmask );
+	world->cullmask = NULL;
+
 	if( world->vertexes )
 		Mem_Free( world->vertexes );
 	world->vertexes = NULL;
@@ -2408,6 +2426,28 @@ void R_MarkVisibleLights( byte lights[MAXDYNLIGHTS] )
 		SETVISBIT( RI->view.vislight, lights[i] );
 }
 
+/*
+=================
+R_SurfaceSortKey
+
+packs the state R_RenderSolidBrushList switches on into one key,
+most expensive switch in the highest bits
+=================
+*/
+static uint64_t R_SurfaceSortKey( msurface_t *surf )
+{
+	mextrasurf_t	*es = surf->info;
+	uint64_t		key;
+
+	key = (uint64_t)(es->forwardScene[0].GetHandle() & 0xFFF) << 52;
+	key |= (uint64_t)(es->forwardScene[1].GetHandle() & 0xFFF) << 40;
+	key |= (uint64_t)(surf->texinfo->texture->gl_texturenum & 0xFFFF) << 24;
+	key |= (uint64_t)(es->lightmaptexturenum & 0xFF) << 16;
+	key |= (uint64_t)(es->parent ? es->parent->index & 0xFFFF : 0);
+
+	return key;
+}
+
 /*
 =================
 R_AddSurfaceToDrawList
@@ -2433,6 +2473,7 @@ bool R_AddSurfaceToDrawList( msurface_t *surf, drawlist_t drawlist_type )
 		R_MarkVisibleLights( es->lights );
 
 		entry_s.SetRenderSurface( surf, hProgram );
+		entry_s.m_iSortKey = R_SurfaceSortKey( surf );
 		RI->frame.solid_faces.AddToTail( entry_s );
 		break;
 	case DRAWLIST_TRANS:
@@ -2461,6 +2502,7 @@ bool R_AddSurfaceToDrawList( msurface_t *surf, drawlist_t drawlist_type )
 			return false;
 		hProgram = Mod_ShaderSceneDepth( surf );
 		entry_s.SetRenderSurface( surf, hProgram );
+		entry_s.m_iSortKey = R_SurfaceSortKey( surf );
 		RI->frame.solid_faces.AddToTail( entry_s );
 		break;
 	case DRAWLIST_LIGHT:
@@ -2877,57 +2919,13 @@ void R_SetSurfaceUniforms( word hProgram, msurface_t *surface, bool force )
 
 /*
 =================
-R_SortSolidBrushFaces
+R_SolidBrushFaceKey
 
 =================
 */
-static int R_SortSolidBrushFaces( const CSolidEntry *a, const CSolidEntry *b )
+static uint64_t R_SolidBrushFaceKey( const CSolidEntry *entry )
 {
-	msurface_t	*surf1, *surf2;
-	mextrasurf_t	*esrf1, *esrf2;
-
-	surf1 = a->m_pSurf;
-	surf2 = b->m_pSurf;
-	esrf1 = surf1->info;
-	esrf2 = surf2->info;
-
-	if( esrf1->forwardScene[0].GetHandle() > esrf2->forwardScene[0].GetHandle() )
-		return 1;
-
-	if( esrf1->forwardScene[0].GetHandle() < esrf2->forwardScene[0].GetHandle() )
-		return -1;
-
-	if( esrf1->forwardScene[1].GetHandle() > esrf2->forwardScene[1].GetHandle() )
-		return 1;
-
-	if( esrf1->forwardScene[1].GetHandle() < esrf2->forwardScene[1].GetHandle() )
-		return -1;
-
-	if( surf1->texinfo->texture->gl_texturenum > surf2->texinfo->texture->gl_texturenum )
-		return 1;
-
-	if( surf1->texinfo->texture->gl_texturenum < surf2->texinfo->texture->gl_texturenum )
-		return -1;
-
-	if( esrf1->lightmaptexturenum > esrf2->lightmaptexturenum )
-		return 1;
-
-	if( esrf1->lightmaptexturenum < esrf2->lightmaptexturenum )
-		return -1;
-
-	if( esrf1->parent > esrf2->parent )
-		return 1;
-
-	if( esrf1->parent < esrf2->parent )
-		return -1;
-
-	//if( esrf1->parent->hCachedMatrix > esrf2->parent->hCachedMatrix )
-	//	return 1;
-
-	//if( esrf1->parent->hCachedMatrix < esrf2->parent->hCachedMatrix )
-	//	return -1;
-
-	return 0;
+	return entry->m_iSortKey;
 }
 
 /*
@@ -3183,7 +3181,7 @@ void R_RenderSolidBrushList( void )
 	if( !RI->frame.solid_faces.Count() )
 		return;
 
-	RI->frame.solid_faces.Sort( R_SortSolidBrushFaces );
+	R_SortDrawList( RI->frame.solid_faces, R_SolidBrushFaceKey, "solid faces" );
 	GL_DEBUG_SCOPE();
 	GL_Blend( GL_FALSE );
 	GL_AlphaTest( GL_FALSE );
@@ -22,6 +22,9 @@ GNU General Public License for more details.
 #include "bs_defs.h"
 #include "ikcontext.h"
 #include "iksolver.h"
+#include "simd4.h"
+
+#define BONE_BATCH		4	// bones per simd batch
 
 //-----------------------------------------------------------------------------
 // Purpose: return a sub frame rotation for a single bone
@@ -337,16 +340,14 @@ mstudioanim_t *CStudioBoneSetup :: FetchAnimation( mstudioseqdesc_t *pseqdesc, i
 //-----------------------------------------------------------------------------
 mstudioanimdesc_t *CStudioBoneSetup :: FetchAnimDesc( mstudioseqdesc_t *pseqdesc, int animation )
 {
-	static mstudioanimdesc_t baseDesc; // for backward compatibility
-
 	if( pseqdesc->animdescindex <= 0 || pseqdesc->animdescindex >= m_pStudioHeader->length )
 	{
-		Q_strncpy( baseDesc.label, pseqdesc->label, sizeof( baseDesc.label ));
-		baseDesc.numframes = pseqdesc->numframes;
-		baseDesc.flags = pseqdesc->flags;
-		baseDesc.fps = pseqdesc->fps;
+		Q_strncpy( m_baseAnimDesc.label, pseqdesc->label, sizeof( m_baseAnimDesc.label ));
+		m_baseAnimDesc.numframes = pseqdesc->numframes;
+		m_baseAnimDesc.flags = pseqdesc->flags;
+		m_baseAnimDesc.fps = pseqdesc->fps;
 
-		return &baseDesc;
+		return &m_baseAnimDesc;
 	}
 
 	mstudioanimdesc_t *panimdesc = (mstudioanimdesc_t *)((byte *)m_pStudioHeader + pseqdesc->animdescindex);
@@ -389,6 +390,202 @@ void CStudioBoneSetup :: CalcAnimation( Vector pos[], Vector4D q[], mstudioseqde
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: load one component of four bones into the lanes
+//-----------------------------------------------------------------------------
+static inline simd4_t GatherBones( const Vector4D q[], const int bone[BONE_BATCH], int c )
+{
+	return Simd4Set( q[bone[0]][c], q[bone[1]][c], q[bone[2]][c], q[bone[3]][c] );
+}
+
+static inline simd4_t GatherBones( const Vector pos[], const int bone[BONE_BATCH], int c )
+{
+	return Simd4Set( pos[bone[0]][c], pos[bone[1]][c], pos[bone[2]][c], pos[bone[3]][c] );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: QuaternionAlign for four bones, lanes with BONE_FIXED_ALIGNMENT are left as is
+//-----------------------------------------------------------------------------
+static inline void AlignBones( const simd4_t p[4], simd4_t q[4], const mstudiobone_t *pbone, const int bone[BONE_BATCH] )
+{
+	simd4_t	a = Simd4Splat( 0.0f );
+	simd4_t	b = Simd4Splat( 0.0f );
+	int	c;
+
+	for( c = 0; c < 4; c++ )
+	{
+		simd4_t d = Simd4Sub( p[c], q[c] );
+		simd4_t e = Simd4Add( p[c], q[c] );
+		a = Simd4Add( a, Simd4Mul( d, d ));
+		b = Simd4Add( b, Simd4Mul( e, e ));
+	}
+
+	simd4_t noalign = Simd4CmpGT( Simd4Set( FBitSet( pbone[bone[0]].flags, BONE_FIXED_ALIGNMENT ) ? 1.0f : 0.0f,
+		FBitSet( pbone[bone[1]].flags, BONE_FIXED_ALIGNMENT ) ? 1.0f : 0.0f,
+		FBitSet( pbone[bone[2]].flags, BONE_FIXED_ALIGNMENT ) ? 1.0f : 0.0f,
+		FBitSet( pbone[bone[3]].flags, BONE_FIXED_ALIGNMENT ) ? 1.0f : 0.0f ), Simd4Splat( 0.0f ));
+	simd4_t flip = Simd4AndNot( Simd4CmpGT( a, b ), noalign );
+
+	for( c = 0; c < 4; c++ )
+		q[c] = Simd4Select( flip, Simd4Mul( q[c], Simd4Splat( -1.0f )), q[c] );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: InterpolateOrigin for four bones, result goes to pos1
+//-----------------------------------------------------------------------------
+static inline void InterpolateBones( Vector pos1[], const Vector pos2[], const int bone[BONE_BATCH], simd4_t t )
+{
+	float	org[3][4];
+
+	for( int c = 0; c < 3; c++ )
+	{
+		simd4_t start = GatherBones( pos1, bone, c );
+		simd4_t end = GatherBones( pos2, bone, c );
+		Simd4Store( org[c], Simd4Add( start, Simd4Mul( t, Simd4Sub( end, start ))));
+	}
+
+	for( int j = 0; j < BONE_BATCH; j++ )
+		pos1[bone[j]] = Vector( org[0][j], org[1][j], org[2][j] );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: QuaternionBlend and InterpolateOrigin over the list of bones,
+//	  four bones at once. Gives the same results as the per-bone code
+//-----------------------------------------------------------------------------
+static void BlendBoneList( Vector4D q1[], Vector pos1[], const Vector4D q2[], const Vector pos2[], const mstudiobone_t *pbone, const int list[], int count, float s )
+{
+	simd4_t	sclp = Simd4Splat( 1.0f - s );
+	simd4_t	sclq = Simd4Splat( s );
+	int	i = 0;
+
+	for( ; i + BONE_BATCH <= count; i += BONE_BATCH )
+	{
+		const int	*bone = &list[i];
+		simd4_t	p[4], q[4], qt[4];
+		float	out[4][4];
+		int	c;
+
+		for( c = 0; c < 4; c++ )
+		{
+			p[c] = GatherBones( q1, bone, c );
+			q[c] = GatherBones( q2, bone, c );
+		}
+
+		AlignBones( p, q, pbone, bone );
+
+		for( c = 0; c < 4; c++ )
+			qt[c] = Simd4Add( Simd4Mul( sclp, p[c] ), Simd4Mul( sclq, q[c] ));
+
+		// Vector4D::Normalize, zero length stays unnormalized
+		simd4_t len = Simd4Sqrt( Simd4Add( Simd4Add( Simd4Add( Simd4Mul( qt[0], qt[0] ), Simd4Mul( qt[1], qt[1] )), Simd4Mul( qt[2], qt[2] )), Simd4Mul( qt[3], qt[3] )));
+		simd4_t zero = Simd4CmpLE( len, Simd4Splat( 0.0f ));
+		simd4_t ilen = Simd4Div( Simd4Splat( 1.0f ), len );
+
+		for( c = 0; c < 4; c++ )
+			Simd4Store( out[c], Simd4Select( zero, qt[c], Simd4Mul( qt[c], ilen )));
+
+		for( int j = 0; j < BONE_BATCH; j++ )
+			q1[bone[j]] = Vector4D( out[0][j], out[1][j], out[2][j], out[3][j] );
+
+		InterpolateBones( pos1, pos2, bone, sclq );
+	}
+
+	for( ; i < count; i++ )
+	{
+		int k = list[i];
+
+		if( FBitSet( pbone[k].flags, BONE_FIXED_ALIGNMENT ))
+			QuaternionBlendNoAlign( q1[k], q2[k], s, q1[k] );
+		else QuaternionBlend( q1[k], q2[k], s, q1[k] );
+		InterpolateOrigin( pos1[k], pos2[k], pos1[k], s );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: QuaternionSlerp and InterpolateOrigin over the list of bones with
+//	  per-bone weights. Alignment, dot products and blending are done for four
+//	  bones at once, the angles are computed per lane the same way as in
+//	  QuaternionSlerpNoAlign. Nearly opposite quaternions go to the scalar code
+//-----------------------------------------------------------------------------
+static void SlerpBoneList( Vector4D q1[], Vector pos1[], const Vector4D q2[], const Vector pos2[], const mstudiobone_t *pbone, const int list[], const float weight[], int count )
+{
+	int	i = 0;
+
+	for( ; i + BONE_BATCH <= count; i += BONE_BATCH )
+	{
+		const int	*bone = &list[i];
+		const float	*t = &weight[i];
+		float	cosom[4], sclp[4], sclq[4];
+		float	out[4][4];
+		simd4_t	p[4], q[4];
+		int	c, j, opposite = 0;
+
+		for( c = 0; c < 4; c++ )
+		{
+			p[c] = GatherBones( q1, bone, c );
+			q[c] = GatherBones( q2, bone, c );
+		}
+
+		AlignBones( p, q, pbone, bone );
+
+		simd4_t dot = Simd4Add( Simd4Add( Simd4Add( Simd4Mul( p[0], q[0] ), Simd4Mul( p[1], q[1] )), Simd4Mul( p[2], q[2] )), Simd4Mul( p[3], q[3] ));
+		Simd4Store( cosom, dot );
+
+		for( j = 0; j < BONE_BATCH; j++ )
+		{
+			if(( 1.0f + cosom[j] ) > 0.000001f )
+			{
+				if(( 1.0f - cosom[j] ) > 0.000001f )
+				{
+					float omega = acos( cosom[j] );
+					float sinom = sin( omega );
+					sclp[j] = sin( (1.0f - t[j]) * omega ) / sinom;
+					sclq[j] = sin( t[j] * omega ) / sinom;
+				}
+				else
+				{
+					sclp[j] = 1.0f - t[j];
+					sclq[j] = t[j];
+				}
+			}
+			else
+			{
+				SetBits( opposite, BIT( j ));
+				sclp[j] = sclq[j] = 0.0f;
+			}
+		}
+
+		simd4_t a = Simd4Load( sclp );
+		simd4_t b = Simd4Load( sclq );
+
+		for( c = 0; c < 4; c++ )
+			Simd4Store( out[c], Simd4Add( Simd4Mul( a, p[c] ), Simd4Mul( b, q[c] )));
+
+		for( j = 0; j < BONE_BATCH; j++ )
+		{
+			int k = bone[j];
+
+			if( !FBitSet( opposite, BIT( j )))
+				q1[k] = Vector4D( out[0][j], out[1][j], out[2][j], out[3][j] );
+			else if( FBitSet( pbone[k].flags, BONE_FIXED_ALIGNMENT ))
+				QuaternionSlerpNoAlign( q1[k], q2[k], t[j], q1[k] );
+			else QuaternionSlerp( q1[k], q2[k], t[j], q1[k] );
+		}
+
+		InterpolateBones( pos1, pos2, bone, Simd4Load( t ));
+	}
+
+	for( ; i < count; i++ )
+	{
+		int k = list[i];
+
+		if( FBitSet( pbone[k].flags, BONE_FIXED_ALIGNMENT ))
+			QuaternionSlerpNoAlign( q1[k], q2[k], weight[i], q1[k] );
+		else QuaternionSlerp( q1[k], q2[k], weight[i], q1[k] );
+		InterpolateOrigin( pos1[k], pos2[k], pos1[k], weight[i] );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Inter-animation blend.  Assumes both types are identical.
 //	  blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
@@ -417,16 +614,16 @@ void CStudioBoneSetup :: BlendBones( Vector4D q1[], Vector pos1[], mstudioseqdes
 		return;
 	}
 
+	int	list[MAXSTUDIOBONES];
+	int	count = 0;
+
 	for( i = 0; i < m_pStudioHeader->numbones; i++ )
 	{
 		if( pweight[i] > 0.0f )
-		{
-			if( FBitSet( pbone[i].flags, BONE_FIXED_ALIGNMENT ))
-				QuaternionBlendNoAlign( q1[i], q2[i], s, q1[i] );
-			else QuaternionBlend( q1[i], q2[i], s, q1[i] );
-			InterpolateOrigin( pos1[i], pos2[i], pos1[i], s );
-		}
+			list[count++] = i;
 	}
+
+	BlendBoneList( q1, pos1, q2, pos2, pbone, list, count, s );
 }
 
 //-----------------------------------------------------------------------------
@@ -481,6 +678,10 @@ void CStudioBoneSetup :: SlerpBones( Vector4D q1[], Vector pos1[], mstudioseqdes
 	}
 	else
 	{
+		int	list[MAXSTUDIOBONES];
+		float	weight[MAXSTUDIOBONES];
+		int	count = 0;
+
 		for( int i = 0; i < m_pStudioHeader->numbones; i++ )
 		{
 			// skip unused bones
@@ -490,11 +691,11 @@ void CStudioBoneSetup :: SlerpBones( Vector4D q1[], Vector pos1[], mstudioseqdes
 			s2 = s * pweight[i];	// blend in based on this bones weight
 			if( s2 <= 0.0f ) continue;
 
-			if( FBitSet( pbone[i].flags, BONE_FIXED_ALIGNMENT ))
-				QuaternionSlerpNoAlign( q1[i], q2[i], s2, q1[i] );
-			else QuaternionSlerp( q1[i], q2[i], s2, q1[i] );
-			InterpolateOrigin( pos1[i], pos2[i], pos1[i], s2 );
+			list[count] = i;
+			weight[count++] = s2;
 		}
+
+		SlerpBoneList( q1, pos1, q2, pos2, pbone, list, weight, count );
 	}
 }
 
@@ -1820,12 +2021,12 @@ bool CStudioBoneSetup :: IKSequenceError( int iSeq, float flCycle, int iRule, ms
 //-----------------------------------------------------------------------------
 void CStudioBoneSetup :: CalcPoseSingle( Vector pos[], Vector4D q[], int sequence, float cycle )
 {
-	static Vector	pos2[MAXSTUDIOBONES];
-	static Vector4D	q2[MAXSTUDIOBONES];
-	static Vector	pos3[MAXSTUDIOBONES];
-	static Vector4D	q3[MAXSTUDIOBONES];
-	static Vector	pos4[MAXSTUDIOBONES];
-	static Vector4D	q4[MAXSTUDIOBONES];
+	Vector		pos2[MAXSTUDIOBONES];
+	Vector4D		q2[MAXSTUDIOBONES];
+	Vector		pos3[MAXSTUDIOBONES];
+	Vector4D		q3[MAXSTUDIOBONES];
+	Vector		pos4[MAXSTUDIOBONES];
+	Vector4D		q4[MAXSTUDIOBONES];
 	bool		anim_4wayblend = true;	// FIXME: get 9-way for gold-source
 	mstudioseqdesc_t	*pseqdesc;
 
@@ -327,6 +327,7 @@ private:
 	const float	*m_flPoseParams;
 	int		m_iBoneMask;
 	float		m_flTime;	// realtime
+	mstudioanimdesc_t	m_baseAnimDesc;	// for backward compatibility
 
 	// intermediate matrices
 	matrix3x4		srcBoneToWorld[MAXSTUDIOBONES];
@@ -18,6 +18,7 @@ GNU General Public License for more details.
 #include <assert.h>
 #include <mathlib.h>
 #include <stringlib.h>
+#include <simd4.h>
 
 void CFrustum :: ClearFrustum( void )
 {
@@ -280,6 +281,95 @@ bool CFrustum :: CullBoxFast( const Vector &mins, const Vector &maxs, int userCl
 	return false;
 }
 
+// same test as CullBoxFast with the corner chosen once per plane, so results are identical
+int CFrustum :: CullBoxList( const float *const mins[3], const float *const maxs[3], int count, uint32_t *visible, int userClipFlags ) const
+{
+	static const int	bitcount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+	simd4_t		nx[FRUSTUM_PLANES], ny[FRUSTUM_PLANES], nz[FRUSTUM_PLANES], dist[FRUSTUM_PLANES];
+	int		signbits[FRUSTUM_PLANES];
+	float		tail[2][3][4];
+	const float	*box[2][3];	// mins and maxs of current four boxes
+	int		iClipFlags;
+	int		numplanes = 0;
+	int		numvisible = 0;
+	int		i, j, k;
+
+	if( userClipFlags != 0 )
+		iClipFlags = userClipFlags;
+	else iClipFlags = clipFlags;
+
+	memset( visible, 0, ((count + 31) >> 5) * sizeof( uint32_t ));
+
+	for( i = 0; i < FRUSTUM_PLANES; i++ )
+	{
+		if( !FBitSet( iClipFlags, BIT( i )))
+			continue;
+
+		const mplane_t *p = &planes[i];
+
+		nx[numplanes] = Simd4Splat( p->normal.x );
+		ny[numplanes] = Simd4Splat( p->normal.y );
+		nz[numplanes] = Simd4Splat( p->normal.z );
+		dist[numplanes] = Simd4Splat( p->dist );
+		signbits[numplanes] = p->signbits;
+		numplanes++;
+	}
+
+	for( i = 0; i < count; i += 4 )
+	{
+		simd4_t	culled = Simd4Splat( 0.0f );
+		int	lanes = 0xF;
+
+		if( count - i < 4 )
+		{
+			// repeat the last box over the missing lanes
+			for( j = 0; j < 4; j++ )
+			{
+				int last = Q_min( i + j, count - 1 );
+
+				for( k = 0; k < 3; k++ )
+				{
+					tail[0][k][j] = mins[k][last];
+					tail[1][k][j] = maxs[k][last];
+				}
+			}
+
+			for( k = 0; k < 3; k++ )
+			{
+				box[0][k] = tail[0][k];
+				box[1][k] = tail[1][k];
+			}
+
+			lanes = ( 1 << ( count - i )) - 1;
+		}
+		else
+		{
+			for( k = 0; k < 3; k++ )
+			{
+				box[0][k] = mins[k] + i;
+				box[1][k] = maxs[k] + i;
+			}
+		}
+
+		for( j = 0; j < numplanes; j++ )
+		{
+			// nearest corner to the inner side of plane
+			simd4_t x = Simd4Load( box[FBitSet( signbits[j], 1 ) ? 0 : 1][0] );
+			simd4_t y = Simd4Load( box[FBitSet( signbits[j], 2 ) ? 0 : 1][1] );
+			simd4_t z = Simd4Load( box[FBitSet( signbits[j], 4 ) ? 0 : 1][2] );
+			simd4_t d = Simd4Add( Simd4Add( Simd4Mul( nx[j], x ), Simd4Mul( ny[j], y )), Simd4Mul( nz[j], z ));
+
+			culled = Simd4Or( culled, Simd4CmpLT( d, dist[j] ));
+		}
+
+		lanes &= ~Simd4Mask( culled );
+		visible[i >> 5] |= (uint32_t)lanes << ( i & 31 );
+		numvisible += bitcount[lanes];
+	}
+
+	return numvisible;
+}
+
 // https://iquilezles.org/articles/frustumcorrect/
 bool CFrustum::CullBoxSafe( const CBoundingBox &bounds ) const
 {
@@ -56,6 +56,10 @@ public:
 	bool CullSphere( const Vector &centre, float radius, int userClipFlags = 0 ) const;
 	bool CullFrustum( const CFrustum *frustum ) const;
 
+	// batch version of CullBoxFast, boxes are given as arrays of components and tested four at once.
+	// Bit N of visible is set when box N is inside, returns the number of visible boxes
+	int CullBoxList( const float *const mins[3], const float *const maxs[3], int count, uint32_t *visible, int userClipFlags = 0 ) const;
+
 private:
 	mplane_t	planes[FRUSTUM_PLANES];
 	uint32_t	clipFlags;
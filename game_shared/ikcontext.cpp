@@ -22,7 +22,7 @@ GNU General Public License for more details.
 #include "bs_defs.h"
 #include "ikcontext.h"
 
-matrix3x4 CIKContext :: m_boneToWorld[MAXSTUDIOBONES];
+thread_local matrix3x4 CIKContext :: m_boneToWorld[MAXSTUDIOBONES];
 	
 //-----------------------------------------------------------------------------
 // Purpose: 
@@ -199,7 +199,7 @@ private:
 	CUtlArray< CUtlArray< ikcontextikrule_t > > m_ikChainRule;
 	CUtlArray< ikcontextikrule_t > m_ikLock;
 
-	static matrix3x4	m_boneToWorld[MAXSTUDIOBONES];
+	static thread_local matrix3x4	m_boneToWorld[MAXSTUDIOBONES];	// scratch, one per posing thread
 	matrix3x4		m_rootxform;
 
 	int m_iFramecounter;
@@ -0,0 +1,156 @@
+/*
+simd4.h - four-wide float vector for the hot loops
+Copyright (C) 2026 PrimeXT Team
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#pragma once
+#ifndef SIMD4_H
+#define SIMD4_H
+
+// SSE is always present on amd64, on x86 only when the compiler was told so.
+// Everything else goes through NEON or plain scalar code with the same results
+#if defined( __SSE__ ) || defined( _M_X64 ) || defined( _M_AMD64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 1 )
+#define SIMD4_SSE
+#include <xmmintrin.h>
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#define SIMD4_NEON
+#include <arm_neon.h>
+#include <math.h>
+#else
+#define SIMD4_SCALAR
+#include <string.h>
+#include <math.h>
+#endif
+
+// comparisons return lane masks (all bits set or cleared) in the same type,
+// they are meant to be combined with Simd4And/Simd4Or and tested with Simd4Mask
+#if defined( SIMD4_SSE )
+typedef __m128 simd4_t;
+
+inline simd4_t Simd4Load( const float *p ) { return _mm_loadu_ps( p ); }
+inline void Simd4Store( float *p, simd4_t a ) { _mm_storeu_ps( p, a ); }
+inline simd4_t Simd4Splat( float f ) { return _mm_set1_ps( f ); }
+inline simd4_t Simd4Set( float x, float y, float z, float w ) { return _mm_setr_ps( x, y, z, w ); }
+inline simd4_t Simd4Add( simd4_t a, simd4_t b ) { return _mm_add_ps( a, b ); }
+inline simd4_t Simd4Sub( simd4_t a, simd4_t b ) { return _mm_sub_ps( a, b ); }
+inline simd4_t Simd4Mul( simd4_t a, simd4_t b ) { return _mm_mul_ps( a, b ); }
+inline simd4_t Simd4Div( simd4_t a, simd4_t b ) { return _mm_div_ps( a, b ); }
+inline simd4_t Simd4Sqrt( simd4_t a ) { return _mm_sqrt_ps( a ); }
+inline simd4_t Simd4Min( simd4_t a, simd4_t b ) { return _mm_min_ps( a, b ); }
+inline simd4_t Simd4Max( simd4_t a, simd4_t b ) { return _mm_max_ps( a, b ); }
+inline simd4_t Simd4CmpLT( simd4_t a, simd4_t b ) { return _mm_cmplt_ps( a, b ); }
+inline simd4_t Simd4CmpLE( simd4_t a, simd4_t b ) { return _mm_cmple_ps( a, b ); }
+inline simd4_t Simd4CmpGE( simd4_t a, simd4_t b ) { return _mm_cmpge_ps( a, b ); }
+inline simd4_t Simd4CmpGT( simd4_t a, simd4_t b ) { return _mm_cmpgt_ps( a, b ); }
+inline simd4_t Simd4And( simd4_t a, simd4_t b ) { return _mm_and_ps( a, b ); }
+inline simd4_t Simd4AndNot( simd4_t a, simd4_t b ) { return _mm_andnot_ps( b, a ); } // a & ~b
+inline simd4_t Simd4Or( simd4_t a, simd4_t b ) { return _mm_or_ps( a, b ); }
+inline simd4_t Simd4Select( simd4_t mask, simd4_t a, simd4_t b ) { return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b )); }
+inline int Simd4Mask( simd4_t mask ) { return _mm_movemask_ps( mask ); }
+#elif defined( SIMD4_NEON )
+typedef float32x4_t simd4_t;
+
+inline simd4_t Simd4Load( const float *p ) { return vld1q_f32( p ); }
+inline void Simd4Store( float *p, simd4_t a ) { vst1q_f32( p, a ); }
+inline simd4_t Simd4Splat( float f ) { return vdupq_n_f32( f ); }
+inline simd4_t Simd4Set( float x, float y, float z, float w ) { const float v[4] = { x, y, z, w }; return vld1q_f32( v ); }
+inline simd4_t Simd4Add( simd4_t a, simd4_t b ) { return vaddq_f32( a, b ); }
+inline simd4_t Simd4Sub( simd4_t a, simd4_t b ) { return vsubq_f32( a, b ); }
+inline simd4_t Simd4Mul( simd4_t a, simd4_t b ) { return vmulq_f32( a, b ); }
+#if defined( __aarch64__ ) || defined( _M_ARM64 )
+inline simd4_t Simd4Div( simd4_t a, simd4_t b ) { return vdivq_f32( a, b ); }
+inline simd4_t Simd4Sqrt( simd4_t a ) { return vsqrtq_f32( a ); }
+#else
+inline simd4_t Simd4Div( simd4_t a, simd4_t b )
+{
+	float x[4], y[4];
+	vst1q_f32( x, a ); vst1q_f32( y, b );
+	for( int i = 0; i < 4; i++ ) x[i] /= y[i];
+	return vld1q_f32( x );
+}
+inline simd4_t Simd4Sqrt( simd4_t a )
+{
+	float x[4];
+	vst1q_f32( x, a );
+	for( int i = 0; i < 4; i++ ) x[i] = sqrtf( x[i] );
+	return vld1q_f32( x );
+}
+#endif
+inline simd4_t Simd4Min( simd4_t a, simd4_t b ) { return vminq_f32( a, b ); }
+inline simd4_t Simd4Max( simd4_t a, simd4_t b ) { return vmaxq_f32( a, b ); }
+inline simd4_t Simd4CmpLT( simd4_t a, simd4_t b ) { return vreinterpretq_f32_u32( vcltq_f32( a, b )); }
+inline simd4_t Simd4CmpLE( simd4_t a, simd4_t b ) { return vreinterpretq_f32_u32( vcleq_f32( a, b )); }
+inline simd4_t Simd4CmpGE( simd4_t a, simd4_t b ) { return vreinterpretq_f32_u32( vcgeq_f32( a, b )); }
+inline simd4_t Simd4CmpGT( simd4_t a, simd4_t b ) { return vreinterpretq_f32_u32( vcgtq_f32( a, b )); }
+inline simd4_t Simd4And( simd4_t a, simd4_t b ) { return vreinterpretq_f32_u32( vandq_u32( vreinterpretq_u32_f32( a ), vreinterpretq_u32_f32( b ))); }
+inline simd4_t Simd4AndNot( simd4_t a, simd4_t b ) { return vreinterpretq_f32_u32( vbicq_u32( vreinterpretq_u32_f32( a ), vreinterpretq_u32_f32( b ))); }
+inline simd4_t Simd4Or( simd4_t a, simd4_t b ) { return vreinterpretq_f32_u32( vorrq_u32( vreinterpretq_u32_f32( a ), vreinterpretq_u32_f32( b ))); }
+inline simd4_t Simd4Select( simd4_t mask, simd4_t a, simd4_t b ) { return vbslq_f32( vreinterpretq_u32_f32( mask ), a, b ); }
+inline int Simd4Mask( simd4_t mask )
+{
+	uint32x4_t bits = vshrq_n_u32( vreinterpretq_u32_f32( mask ), 31 );
+	return vgetq_lane_u32( bits, 0 ) | ( vgetq_lane_u32( bits, 1 ) << 1 ) | ( vgetq_lane_u32( bits, 2 ) << 2 ) | ( vgetq_lane_u32( bits, 3 ) << 3 );
+}
+#else
+struct simd4_t
+{
+	float	v[4];
+};
+
+inline simd4_t Simd4Load( const float *p ) { simd4_t r; memcpy( r.v, p, sizeof( r.v )); return r; }
+inline void Simd4Store( float *p, simd4_t a ) { memcpy( p, a.v, sizeof( a.v )); }
+inline simd4_t Simd4Splat( float f ) { simd4_t r = {{ f, f, f, f }}; return r; }
+inline simd4_t Simd4Set( float x, float y, float z, float w ) { simd4_t r = {{ x, y, z, w }}; return r; }
+
+#define SIMD4_OP( name, expr ) \
+inline simd4_t name( simd4_t a, simd4_t b ) { simd4_t r; for( int i = 0; i < 4; i++ ) { float x = a.v[i], y = b.v[i]; r.v[i] = (expr); } return r; }
+#define SIMD4_CMP( name, expr ) \
+inline simd4_t name( simd4_t a, simd4_t b ) { simd4_t r; for( int i = 0; i < 4; i++ ) { unsigned int m = (a.v[i] expr b.v[i]) ? ~0u : 0u; memcpy( &r.v[i], &m, sizeof( m )); } return r; }
+#define SIMD4_BIT( name, expr ) \
+inline simd4_t name( simd4_t a, simd4_t b ) { simd4_t r; for( int i = 0; i < 4; i++ ) { unsigned int x, y, m; memcpy( &x, &a.v[i], 4 ); memcpy( &y, &b.v[i], 4 ); m = (expr); memcpy( &r.v[i], &m, 4 ); } return r; }
+
+SIMD4_OP( Simd4Add, x + y )
+SIMD4_OP( Simd4Sub, x - y )
+SIMD4_OP( Simd4Mul, x * y )
+SIMD4_OP( Simd4Div, x / y )
+SIMD4_OP( Simd4Min, x < y ? x : y )	// same operand order as minps
+SIMD4_OP( Simd4Max, x > y ? x : y )
+SIMD4_CMP( Simd4CmpLT, < )
+SIMD4_CMP( Simd4CmpLE, <= )
+SIMD4_CMP( Simd4CmpGE, >= )
+SIMD4_CMP( Simd4CmpGT, > )
+SIMD4_BIT( Simd4And, x & y )
+SIMD4_BIT( Simd4AndNot, x & ~y )
+SIMD4_BIT( Simd4Or, x | y )
+
+#undef SIMD4_OP
+#undef SIMD4_CMP
+#undef SIMD4_BIT
+
+inline simd4_t Simd4Sqrt( simd4_t a ) { simd4_t r; for( int i = 0; i < 4; i++ ) r.v[i] = sqrtf( a.v[i] ); return r; }
+inline simd4_t Simd4Select( simd4_t mask, simd4_t a, simd4_t b ) { return Simd4Or( Simd4And( mask, a ), Simd4AndNot( b, mask )); }
+inline int Simd4Mask( simd4_t mask )
+{
+	int	bits = 0;
+
+	for( int i = 0; i < 4; i++ )
+	{
+		unsigned int m;
+		memcpy( &m, &mask.v[i], sizeof( m ));
+		if( m & 0x80000000u ) bits |= ( 1 << i );
+	}
+	return bits;
+}
+#endif
+
+#endif//SIMD4_H
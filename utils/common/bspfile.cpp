@@ -109,6 +109,11 @@ entity_t		g_entities[MAX_MAP_ENTITIES];
 dheader_t		*header, outheader;
 int		wadfile;
 
+// the loaded bsp stays mapped and the byte lumps point right into it,
+// the view is copy-on-write so the tools can still change them in place
+static byte	*bspmapped = NULL;
+static size_t	bspmappedsize = 0;
+
 char		g_wadpath[1024];	// path to wads may be empty
 
 // can be overrided from hlcsg
@@ -270,20 +275,28 @@ void DecompressVis( byte *in, byte *decompressed )
 
 //=============================================================================
 
+static void CheckLumpBounds( int ofs, int length )
+{
+	if( ofs < 0 || length < 0 || (size_t)ofs + (size_t)length > bspmappedsize )
+		COM_FatalError( "LoadBSPFile: lump is out of file\n" );
+}
+
 int CopyLump( int lump, void *dest, int size )
 {
 	int length = header->lumps[lump].filelen;
 	int ofs = header->lumps[lump].fileofs;
 
+	CheckLumpBounds( ofs, length );
+
 	if( length % size )
 		COM_FatalError( "LoadBSPFile: odd lump size\n" );
 
-	// alloc matched size
+	// byte lumps are used right from the mapped file
 	if( lump == LUMP_TEXTURES )
-		dest = g_dtexdata = (byte *)Mem_Alloc( length );
-	if( lump == LUMP_LIGHTING )
-		dest = g_dlightdata = (byte *)Mem_Alloc( length );
-	memcpy( dest, (byte *)header + ofs, length );
+		g_dtexdata = length ? (byte *)header + ofs : NULL;
+	else if( lump == LUMP_LIGHTING )
+		g_dlightdata = length ? (byte *)header + ofs : NULL;
+	else memcpy( dest, (byte *)header + ofs, length );
 
 	return length / size;
 }
@@ -291,26 +304,32 @@ int CopyLump( int lump, void *dest, int size )
 static int CopyExtraLump( int lump, void *dest, int size, const dheader_t *header )
 {
 	dextrahdr_t *extrahdr = (dextrahdr_t *)((byte *)header + sizeof( dheader_t ));
+	byte **mapped = NULL;
 
 	int length = extrahdr->lumps[lump].filelen;
 	int ofs = extrahdr->lumps[lump].fileofs;
 
+	CheckLumpBounds( ofs, length );
+
 	if( length % size )
 		COM_FatalError( "LoadBSPFile: odd lump size\n" );
 
 	if( lump == LUMP_LIGHTVECS )
-		dest = g_ddeluxdata = (byte *)Mem_Alloc( length );
+		mapped = &g_ddeluxdata;
 	if( lump == LUMP_SHADOWMAP )
-		dest = g_dshadowdata = (byte *)Mem_Alloc( length );
+		mapped = &g_dshadowdata;
 	if( lump == LUMP_VERTEX_LIGHT )
-		dest = g_dvlightdata = (byte *)Mem_Alloc( length );
+		mapped = &g_dvlightdata;
 	if( lump == LUMP_SURFACE_LIGHT )
-		dest = g_dflightdata = (byte *)Mem_Alloc( length );
+		mapped = &g_dflightdata;
 	if( lump == LUMP_VERTNORMALS )
-		dest = g_dnormaldata = (byte *)Mem_Alloc( length );
+		mapped = &g_dnormaldata;
 	if( lump == LUMP_VISLIGHTDATA )
-		dest = g_dvislightdata = (byte *)Mem_Alloc( length );
-	memcpy( dest, (byte *)header + ofs, length );
+		mapped = &g_dvislightdata;
+
+	if( mapped != NULL )
+		*mapped = length ? (byte *)header + ofs : NULL;
+	else memcpy( dest, (byte *)header + ofs, length );
 
 	return length / size;
 }
@@ -349,6 +368,68 @@ static int CopyLumpClipnodes( int lump )
 	return length / size;
 }
 
+static size_t MappedLumpSize( const byte *data )
+{
+	const dheader_t	*in = (dheader_t *)bspmapped;
+	const dextrahdr_t	*extrahdr = (dextrahdr_t *)(bspmapped + sizeof( dheader_t ));
+	int		ofs = data - bspmapped;
+
+	for( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		if( in->lumps[i].filelen > 0 && in->lumps[i].fileofs == ofs )
+			return in->lumps[i].filelen;
+	}
+
+	if( bspmappedsize >= sizeof( dheader_t ) + sizeof( dextrahdr_t ) && extrahdr->id == IDEXTRAHEADER )
+	{
+		for( int i = 0; i < EXTRA_LUMPS; i++ )
+		{
+			if( extrahdr->lumps[i].filelen > 0 && extrahdr->lumps[i].fileofs == ofs )
+				return extrahdr->lumps[i].filelen;
+		}
+	}
+
+	return bspmappedsize - ofs;
+}
+
+static bool IsMappedLump( const byte *data )
+{
+	return bspmapped != NULL && data >= bspmapped && data < bspmapped + bspmappedsize;
+}
+
+/*
+=============
+ReallocBSPLump
+
+byte lumps of the loaded bsp can live in the mapped
+file, they are resized and freed only through this
+=============
+*/
+byte *ReallocBSPLump( byte *data, size_t size )
+{
+	if( !IsMappedLump( data ))
+		return (byte *)Mem_Realloc( data, size );
+
+	// leave the mapped data, keep a private copy
+	byte	*out = (byte *)Mem_Alloc( size );
+	if( out ) memcpy( out, data, Q_min( size, MappedLumpSize( data )));
+
+	return out;
+}
+
+void FreeBSPLump( byte *data )
+{
+	if( data && !IsMappedLump( data ))
+		Mem_Free( data );
+}
+
+static void UnmapBSPFile( void )
+{
+	COM_UnmapFile( bspmapped, bspmappedsize );
+	bspmapped = NULL;
+	bspmappedsize = 0;
+}
+
 /*
 =============
 LoadBSPFile
@@ -356,11 +437,15 @@ LoadBSPFile
 */
 void LoadBSPFile( const char *filename )
 {
-	size_t	filesize;
+	UnmapBSPFile();
+
+	// map the file, the pages are read on first access
+	bspmapped = COM_MapFile( filename, &bspmappedsize, true );
+	if( !bspmapped ) COM_FatalError( "couldn't load: %s\n", filename );
 
-	// load the file header
-	header = (dheader_t *)COM_LoadFile( filename, &filesize );
-	if( !header ) COM_FatalError( "couldn't load: %s\n", filename );
+	if( bspmappedsize < sizeof( dheader_t ))
+		COM_FatalError( "%s is too short\n", filename );
+	header = (dheader_t *)bspmapped;
 
 	if( header->version != BSPVERSION )
 		COM_FatalError( "%s is version %i, not %i\n", filename, header->version, BSPVERSION );
@@ -386,7 +471,7 @@ void LoadBSPFile( const char *filename )
 
 	dextrahdr_t *extrahdr = (dextrahdr_t *)((byte *)header + sizeof( dheader_t ));
 
-	if( extrahdr->id == IDEXTRAHEADER )
+	if( bspmappedsize >= sizeof( dheader_t ) + sizeof( dextrahdr_t ) && extrahdr->id == IDEXTRAHEADER )
 	{
 		if( extrahdr->version != EXTRA_VERSION )
 			COM_FatalError( "BSP is extra version %i, not %i", extrahdr->version, EXTRA_VERSION );
@@ -406,17 +491,26 @@ void LoadBSPFile( const char *filename )
 		g_vislightdatasize = CopyExtraLump( LUMP_VISLIGHTDATA, g_dvislightdata, 1, header );
 	}
 
-	Mem_Free( header, C_FILESYSTEM ); // everything has been copied out
+	// the mapping is kept until the next load or write
 }
 
 //============================================================================
 
+// exactly the lump size is read from the data, the rest is zero-padded
+static void WriteLumpData( const void *data, int len )
+{
+	static byte	pad[4];
+
+	if( len > 0 ) SafeWrite( wadfile, (void *)data, len );
+	if( len & 3 ) SafeWrite( wadfile, pad, 4 - ( len & 3 ));
+}
+
 void AddLump( int lumpnum, void *data, int len )
 {
 	dlump_t *lump = &header->lumps[lumpnum];
 	lump->fileofs = lseek( wadfile, 0, SEEK_CUR );
 	lump->filelen = len;
-	SafeWrite( wadfile, data, (len + 3) & ~3 );
+	WriteLumpData( data, len );
 }
 
 static void AddExtraLump( int lumpnum, void *data, int len, dextrahdr_t *header )
@@ -424,7 +518,7 @@ static void AddExtraLump( int lumpnum, void *data, int len, dextrahdr_t *header
 	dlump_t* lump = &header->lumps[lumpnum];
 	lump->fileofs = lseek( wadfile, 0, SEEK_CUR );
 	lump->filelen = len;
-	SafeWrite( wadfile, data, (len + 3) & ~3 );
+	WriteLumpData( data, len );
 }
 
 void AddLumpClipnodes( int lumpnum )
@@ -443,13 +537,13 @@ void AddLumpClipnodes( int lumpnum )
 		}
 
 		lump->filelen = g_numclipnodes * sizeof( dclipnode_t );
-		SafeWrite( wadfile, g_dclipnodes, (lump->filelen + 3) & ~3 );
+		WriteLumpData( g_dclipnodes, lump->filelen );
 	}
 	else
 	{
 		// copy clipnodes into 32-bit array
 		lump->filelen = g_numclipnodes * sizeof( dclipnode32_t );
-		SafeWrite( wadfile, g_dclipnodes32, (lump->filelen + 3) & ~3 );
+		WriteLumpData( g_dclipnodes32, lump->filelen );
 	}
 }
 
@@ -457,13 +551,15 @@ void AddLumpClipnodes( int lumpnum )
 =============
 WriteBSPFile
 
-Swaps the bsp file in place, so it should not be referenced again
+the lumps are streamed to a temporary file straight from
+the arrays and the mapped source, then it replaces the bsp
 =============
 */
 void WriteBSPFile( const char *filename )
 {		
 	dextrahdr_t	outextrahdr;
 	dextrahdr_t	*extrahdr;
+	char		tempname[1024];
 
 	header = &outheader;
 	memset( header, 0, sizeof( dheader_t ));
@@ -474,7 +570,9 @@ void WriteBSPFile( const char *filename )
 	extrahdr->id = IDEXTRAHEADER;
 	extrahdr->version = EXTRA_VERSION;
 	
-	wadfile = SafeOpenWrite( filename );
+	// the source bsp may be still mapped
+	Q_snprintf( tempname, sizeof( tempname ), "%s.tmp", filename );
+	wadfile = SafeOpenWrite( tempname );
 	SafeWrite( wadfile, header, sizeof( dheader_t ));		// overwritten later
 	SafeWrite( wadfile, extrahdr, sizeof( dextrahdr_t ));	// overwritten later
 
@@ -512,14 +610,14 @@ void WriteBSPFile( const char *filename )
 
 	close( wadfile );	
 
-	if( g_dvislightdata ) Mem_Free( g_dvislightdata );
-	if( g_dlightdata ) Mem_Free( g_dlightdata );
-	if( g_ddeluxdata ) Mem_Free( g_ddeluxdata );
-	if( g_dshadowdata ) Mem_Free( g_dshadowdata );
-	if( g_dvlightdata ) Mem_Free( g_dvlightdata );
-	if( g_dflightdata ) Mem_Free( g_dflightdata );
-	if( g_dnormaldata ) Mem_Free( g_dnormaldata );
-	if( g_dtexdata ) Mem_Free( g_dtexdata );
+	FreeBSPLump( g_dvislightdata );
+	FreeBSPLump( g_dlightdata );
+	FreeBSPLump( g_ddeluxdata );
+	FreeBSPLump( g_dshadowdata );
+	FreeBSPLump( g_dvlightdata );
+	FreeBSPLump( g_dflightdata );
+	FreeBSPLump( g_dnormaldata );
+	FreeBSPLump( g_dtexdata );
 
 	g_dvislightdata = NULL;
 	g_dlightdata = NULL;
@@ -529,6 +627,12 @@ void WriteBSPFile( const char *filename )
 	g_dflightdata = NULL;
 	g_dnormaldata = NULL;
 	g_dtexdata = NULL;
+
+	// nothing points into the source anymore
+	UnmapBSPFile();
+
+	if( !COM_ReplaceFile( tempname, filename ))
+		COM_FatalError( "couldn't write %s\n", filename );
 }
 
 //============================================================================
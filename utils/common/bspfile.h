@@ -178,6 +178,8 @@ int CompressVis( const byte *src, const uint src_length, byte *dest, uint dest_l
 
 void LoadBSPFile( const char *filename );
 void WriteBSPFile( const char *filename );
+byte *ReallocBSPLump( byte *data, size_t size );
+void FreeBSPLump( byte *data );
 void PrintBSPFileSizes( bool goldsrcCompatibility = false );
 
 const char *ContentsToString( int type );
@@ -22,6 +22,7 @@ GNU General Public License for more details.
 #include <dirent.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #define O_BINARY 0
 #endif
 
@@ -367,6 +368,94 @@ bool COM_SaveFile( const char *filepath, void *buffer, size_t filesize, bool saf
 	return true;
 }
 
+/*
+==================
+COM_MapFile
+
+map the whole file into memory as read-only.
+pages are loaded by OS on demand, so it's cheap for huge files.
+copy-on-write view can be changed, the touched pages are
+copied by OS and the file itself is never changed
+==================
+*/
+byte *COM_MapFile( const char *filepath, size_t *filesize, bool copyonwrite )
+{
+	byte	*base;
+
+	if( filesize ) *filesize = 0;
+#if XASH_WIN32
+	HANDLE	file, mapping;
+	LARGE_INTEGER	size;
+
+	file = CreateFileA( filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( file == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	if( !GetFileSizeEx( file, &size ) || size.QuadPart <= 0 )
+	{
+		CloseHandle( file );
+		return NULL;
+	}
+
+	mapping = CreateFileMappingA( file, NULL, copyonwrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL );
+	CloseHandle( file );
+	if( !mapping ) return NULL;
+
+	// view keeps the mapping alive
+	base = (byte *)MapViewOfFile( mapping, copyonwrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0 );
+	CloseHandle( mapping );
+	if( !base ) return NULL;
+
+	if( filesize ) *filesize = (size_t)size.QuadPart;
+#else
+	struct stat	buf;
+	int		handle;
+
+	handle = open( filepath, O_RDONLY|O_BINARY );
+	if( handle < 0 ) return NULL;
+
+	if( fstat( handle, &buf ) == -1 || buf.st_size <= 0 )
+	{
+		close( handle );
+		return NULL;
+	}
+
+	base = (byte *)mmap( NULL, buf.st_size, copyonwrite ? PROT_READ|PROT_WRITE : PROT_READ, MAP_PRIVATE, handle, 0 );
+	close( handle );
+	if( base == MAP_FAILED ) return NULL;
+
+	if( filesize ) *filesize = buf.st_size;
+#endif
+	return base;
+}
+
+void COM_UnmapFile( byte *base, size_t filesize )
+{
+	if( !base ) return;
+#if XASH_WIN32
+	UnmapViewOfFile( base );
+#else
+	munmap( base, filesize );
+#endif
+}
+
+/*
+==================
+COM_ReplaceFile
+
+move the file over another one, used to
+write a file that is still mapped or opened
+==================
+*/
+bool COM_ReplaceFile( const char *from, const char *to )
+{
+#if XASH_WIN32
+	return MoveFileExA( from, to, MOVEFILE_REPLACE_EXISTING ) != 0;
+#else
+	return rename( from, to ) == 0;
+#endif
+}
+
 /*
 ==================
 COM_CreatePath
@@ -0,0 +1,94 @@
+/*
+hullfile.h - binary hull interchange between csg and bsp stages
+Copyright (C) 2026 PrimeXT Team
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#ifndef HULLFILE_H
+#define HULLFILE_H
+
+/*
+==============================================================================
+
+mapname.p0 - p3 keeps the polygons and mapname.b0 - b3 the detail brushes
+of each hull. Both are a plain sequence of records in native byte order,
+every record is a multiple of 8 bytes so the points can be read in place
+from a mapped file. Points are stored as doubles without any rounding.
+
+polygons:	dhullface_t, numpoints * dhullpoint_t ... dhullface_t with planenum -1 (end of model)
+brushes:	dhullbrush_t, numsides * ( dhullside_t, numpoints * dhullpoint_t ) ... dhullbrush_t with numsides -1 (end of model)
+==============================================================================
+*/
+#define HULLFILE_IDENT		(('L'<<24)+('H'<<16)+('X'<<8)+'P')	// little-endian "PXHL"
+#define HULLFILE_VERSION		1
+
+typedef struct
+{
+	int		ident;
+	int		version;
+	int		hullnum;
+	int		reserved;
+} dhullheader_t;
+
+typedef struct
+{
+	int		detaillevel;
+	int		planenum;
+	int		texinfo;
+	int		contents;
+	int		numpoints;
+	int		reserved;
+} dhullface_t;
+
+typedef struct
+{
+	int		numsides;
+	int		reserved;
+} dhullbrush_t;
+
+typedef struct
+{
+	int		planenum;
+	int		numpoints;
+} dhullside_t;
+
+typedef struct
+{
+	double		point[3];
+} dhullpoint_t;
+
+// read cursor over a hull file. It works on any memory block,
+// so the data doesn't have to come from the disk
+typedef struct
+{
+	const byte	*pos;
+	const byte	*end;
+	const char	*name;
+} hullstream_t;
+
+inline const void *HullStreamRead( hullstream_t *stream, size_t size )
+{
+	const byte	*data = stream->pos;
+
+	if( size > (size_t)( stream->end - stream->pos ))
+		COM_FatalError( "%s: unexpected end of file\n", stream->name );
+	stream->pos += size;
+
+	return data;
+}
+
+inline bool HullStreamEnd( const hullstream_t *stream )
+{
+	return stream->pos >= stream->end;
+}
+
+#endif//HULLFILE_H
@@ -27,6 +27,8 @@ GNU General Public License for more details.
 #include "ddstex.h"
 #include "squish.h"
 #include "mathlib.h"
+#include "threads.h"
+#include <atomic>
 
 #define BLOCK_SIZE			( 4 * 4 )	// DXT block size quad 4x4 pixels
 #define RGB_TO_YCOCG_Y( r, g, b )	(((  r +   (g<<1) +  b     ) + 2 ) >> 2 )
@@ -155,93 +157,155 @@ inline static void NormalizeBlock( byte *colorBlock, int format )
 
 /*
 ========================
-CompressYCoCgDXT5HQ
+DXT encoder
 
-params:	inBuf		- image to compress
-paramO:	outBuf		- result of compression
-params:	width		- width of image
-params:	height		- height of image
+every 4-pixel row of blocks of each mip level and cubemap side
+is an independent work item, it writes straight into the final
+file at the offset calculated by the estimate pass
 ========================
 */
-inline static void CompressRGBABufferToDXT( const byte *inBuf, vfile_t *f, int width, int height, int format, bool estimate )
+typedef struct
 {
-	ALIGN16 byte	block[64];
-	ALIGN16 byte	outBlock[16];
-	float		metricsRGB[3] = { 0.2126f, 0.7152f, 0.0722f };
-	const char	*typeString = NULL;
-	float		*metrics = NULL;
-	double		start, end;
-	int		flags = 0;
-	char		str[64];
+	const byte	*pixels;		// RGBA source of this level
+	byte		*dest;		// compressed blocks of this level
+	int		width;
+	int		height;
+} ddslevel_t;
 
-	start = I_FloatTime();
+typedef struct
+{
+	const ddslevel_t	*level;
+	int		row;		// row of blocks inside the level
+} ddsrow_t;
 
-	for( int j = 0; j < height; j += 4, inBuf += width * BLOCK_SIZE )
-	{
-		for( int i = 0; i < width; i += 4 )
-		{
-			ExtractBlock( inBuf + i * 4, width, block );
+typedef struct
+{
+	ddsrow_t		*rows;
+	int		numrows;
+	int		format;
+	int		flags;		// squish flags
+	size_t		blocksize;
+	const char	*typeString;
+	bool		progress;
+	std::atomic<int>	rowsdone;
+	int		percent;		// last printed value, guarded by ThreadLock
+} ddsencode_t;
+
+static int		g_dxtquality = DXT_QUALITY_HIGH;
+static ddsencode_t		*g_ddsencode;
+
+void DDS_SetQuality( int quality )
+{
+	g_dxtquality = bound( DXT_QUALITY_FAST, quality, DXT_QUALITY_HIGH );
+}
 
-			if( format == PF_DXT5_YCoCg )
-			{
-				SetBits( flags, squish::kDxt5 | squish::kColourIterativeClusterFit );
-				typeString = "DXT5 YCoCg";
-				ScaleYCoCg( block );
-			}
-			else if( format >= PF_DXT5_NORM_BASE && format <= PF_ATI2_NORM_PARABOLOID )
-			{
-				switch( format )
-				{
-				case PF_DXT5_NORM_BASE:
-					typeString = "DXT5 NormXYZ Base";
-					SetBits( flags, squish::kDxt5 | squish::kColourIterativeClusterFit );
-					break;
-				case PF_ATI2_NORM_PARABOLOID:
-					typeString = "ATI2 NormAG Paraboloid";
-					SetBits( flags, squish::kAti2 );
-					break;
-				}
+/*
+========================
+DDS_SetupEncoder
 
-				NormalizeBlock( block, format );
-			}
-			else if( format == PF_DXT5 )
-			{
-				SetBits( flags, squish::kDxt5 | squish::kColourIterativeClusterFit );
-				typeString = "DXT5 RGB";
-			}
-			else if( format == PF_DXT5_ALPHA || format == PF_DXT5_SDF_ALPHA )
-			{
-				SetBits( flags, squish::kDxt5 | squish::kColourIterativeClusterFit | squish::kWeightColourByAlpha );
-				typeString = "DXT5 RGBA";
-			}
-			else if( format == PF_DXT1 )
-			{
-				SetBits( flags, squish::kDxt1 | squish::kColourIterativeClusterFit );
-				typeString = "DXT1 RGB";
-			}
+select squish flags once per image instead of every block
+========================
+*/
+static void DDS_SetupEncoder( ddsencode_t *enc, int format )
+{
+	int	colourFit;
 
-			squish::Compress( block, outBlock, flags, metrics );
-			VFS_Write( f, outBlock, Image_DXTGetBlockSize( format ));
+	switch( g_dxtquality )
+	{
+	case DXT_QUALITY_FAST:
+		colourFit = squish::kColourRangeFit;
+		break;
+	case DXT_QUALITY_NORMAL:
+		colourFit = squish::kColourClusterFit;
+		break;
+	default:
+		colourFit = squish::kColourIterativeClusterFit;
+		break;
+	}
 
-			if( estimate )
-			{
-				Sys_IgnoreLog( true );
-				Msg( "\rcompress %s: %2d%%", typeString, ( j * width + i ) * 100 / ( width * height ) );
-				Sys_IgnoreLog( false );
-			}
-		}
+	enc->format = format;
+	enc->blocksize = Image_DXTGetBlockSize( format );
+	enc->typeString = NULL;
+	enc->flags = 0;
+
+	switch( format )
+	{
+	case PF_DXT5_YCoCg:
+		enc->flags = squish::kDxt5 | colourFit;
+		enc->typeString = "DXT5 YCoCg";
+		break;
+	case PF_DXT5_NORM_BASE:
+		enc->flags = squish::kDxt5 | colourFit;
+		enc->typeString = "DXT5 NormXYZ Base";
+		break;
+	case PF_ATI2_NORM_PARABOLOID:
+		enc->flags = squish::kAti2;
+		enc->typeString = "ATI2 NormAG Paraboloid";
+		break;
+	case PF_DXT5:
+		enc->flags = squish::kDxt5 | colourFit;
+		enc->typeString = "DXT5 RGB";
+		break;
+	case PF_DXT5_ALPHA:
+	case PF_DXT5_SDF_ALPHA:
+		enc->flags = squish::kDxt5 | colourFit | squish::kWeightColourByAlpha;
+		enc->typeString = "DXT5 RGBA";
+		break;
+	case PF_DXT1:
+		enc->flags = squish::kDxt1 | colourFit;
+		enc->typeString = "DXT1 RGB";
+		break;
 	}
+}
 
-	end = I_FloatTime();
-	Q_timestring((int)(end - start), str );
+/*
+========================
+CompressBlockRow
 
-	if( estimate )
+params: enc		- encoder settings
+params: row		- row of 4x4 blocks to compress
+========================
+*/
+static void CompressBlockRow( ddsencode_t *enc, const ddsrow_t *row )
+{
+	const ddslevel_t	*level = row->level;
+	const byte	*inBuf = level->pixels + row->row * level->width * BLOCK_SIZE;
+	byte		*outBuf = level->dest + row->row * (( level->width + 3 ) / 4 ) * enc->blocksize;
+	ALIGN16 byte	block[64];
+
+	for( int i = 0; i < level->width; i += 4, outBuf += enc->blocksize )
 	{
-		Msg( "\r" );
-		Msg( "compress %s: 100%%. %s elapsed\n", typeString, str );
+		ExtractBlock( inBuf + i * 4, level->width, block );
+
+		if( enc->format == PF_DXT5_YCoCg )
+			ScaleYCoCg( block );
+		else if( enc->format >= PF_DXT5_NORM_BASE && enc->format <= PF_ATI2_NORM_PARABOLOID )
+			NormalizeBlock( block, enc->format );
+
+		squish::Compress( block, outBuf, enc->flags, NULL );
+	}
+
+	if( enc->progress )
+	{
+		int	percent = ( enc->rowsdone.fetch_add( 1 ) + 1 ) * 100 / enc->numrows;
+
+		ThreadLock();
+		if( percent > enc->percent )
+		{
+			enc->percent = percent;
+			Sys_IgnoreLog( true );
+			Msg( "\rcompress %s: %2d%%", enc->typeString, percent );
+			Sys_IgnoreLog( false );
+		}
+		ThreadUnlock();
 	}
 }
 
+static void CompressBlockRowThread( int row, int thread )
+{
+	CompressBlockRow( g_ddsencode, &g_ddsencode->rows[row] );
+}
+
 /*
 ========================================================================
 
@@ -708,39 +772,64 @@ static bool Image_DXTWriteHeader( vfile_t *f, rgbdata_t *pix, int format, int nu
 	return true;
 }
 
-static size_t CompressDXT( vfile_t *f, const byte *buffer, int width, int height, int format, bool estimate )
-{
-	size_t	dst_size;
-	size_t	cur_size;
-	size_t	curpos;
-
-	if( !buffer ) return 0;
-
-	dst_size = Image_DXTGetLinearSize( Image_DXTGetBlockSize( format ), width, height );
-	curpos = VFS_Tell( f );
+/*
+========================
+Image_DXTEstimateLevels
 
-	CompressRGBABufferToDXT( buffer, f, width, height, format, estimate );
+estimate pass: lay out every mip level of every side in the
+output file and count the work without compressing anything.
+returns total size of the file
+========================
+*/
+static size_t Image_DXTEstimateLevels( rgbdata_t *pix, int format, int numSides, int nummips, size_t headersize, ddslevel_t *levels, size_t *pixelsize, int *numrows )
+{
+	size_t	blocksize = Image_DXTGetBlockSize( format );
+	size_t	sidesize = pix->width * pix->height * 4;
+	size_t	filesize = headersize;
 
-	cur_size = VFS_Tell( f ) - curpos;
+	*pixelsize = 0;
+	*numrows = 0;
 
-	if( cur_size != dst_size )
-      	{
-		MsgDev( D_ERROR, "CompressDXT: corrupt mem (buffer is %s bytes, written %s)\n", Q_memprint( dst_size ), Q_memprint( cur_size ));
-		return false;
-	}		
+	for( int i = 0; i < numSides; i++ )
+	{
+		for( int j = 0; j < nummips; j++ )
+		{
+			ddslevel_t	*level = &levels[i * nummips + j];
+			int		width = Q_max( 1, ( pix->width >> j ));
+			int		height = Q_max( 1, ( pix->height >> j ));
+			int		rows = ( height + 3 ) / 4;
+
+			level->width = width;
+			level->height = height;
+			level->dest = (byte *)filesize;	// relative until the file is allocated
+			level->pixels = (byte *)*pixelsize;
+
+			filesize += Image_DXTGetLinearSize( blocksize, width, height );
+			*numrows += rows;
+
+			// levels smaller than a block are read past their end, so keep
+			// as much of the mip buffer as ExtractBlock touches
+			*pixelsize += Q_min( sidesize, (size_t)( 16 * width * ( rows - 1 ) + 12 * width + 4 * (( width + 3 ) & ~3 )));
+		}
+	}
 
-	return true;
+	return filesize;
 }
 
 rgbdata_t *BufferToDDS( rgbdata_t *pix, int saveformat )
 {
-	vfile_t	*file;	// virtual file
-	rgbdata_t	*out = NULL;
-	rgbdata_t	*mip = NULL;
-	bool	normalMap = (saveformat >= PF_DXT5_NORM_BASE && saveformat <= PF_ATI2_NORM_PARABOLOID) ? true : false;
-	int	width, height;
-	int	nummips = 1;
-	int	numSides = 1;
+	vfile_t		*file;	// virtual file
+	rgbdata_t		*out = NULL;
+	bool		normalMap = (saveformat >= PF_DXT5_NORM_BASE && saveformat <= PF_ATI2_NORM_PARABOLOID) ? true : false;
+	ddslevel_t	*levels;
+	byte		*pixels, *buffer;
+	size_t		headersize, sidesize, filesize, pixelsize;
+	ddsencode_t	enc;
+	double		start, end;
+	char		str[64];
+	int		width, height;
+	int		nummips = 1;
+	int		numSides = 1;
 
 	// check for all the possible problems
 	if( !pix ) return NULL;
@@ -763,45 +852,94 @@ rgbdata_t *BufferToDDS( rgbdata_t *pix, int saveformat )
 		return NULL;
 	}
 
-	mip = Image_Copy( pix );
-
 	if( FBitSet( pix->flags, IMAGE_CUBEMAP|IMAGE_SKYBOX ))
 		numSides = 6;
 
+	headersize = VFS_Tell( file );
+	sidesize = pix->width * pix->height * 4;
+	levels = (ddslevel_t *)Mem_Alloc( sizeof( ddslevel_t ) * numSides * nummips );
+	filesize = Image_DXTEstimateLevels( pix, saveformat, numSides, nummips, headersize, levels, &pixelsize, &enc.numrows );
+
+	// create a new pic
+	out = (rgbdata_t *)Mem_Alloc( sizeof( rgbdata_t ) + filesize );
+	out->buffer = ((byte *)out) + sizeof( rgbdata_t ); 
+	memcpy( out->buffer, VFS_GetBuffer( file ), headersize );
+	VFS_Close( file );
+
+	// mips are built in place, so snapshot each level for the encoder
+	pixels = (byte *)Mem_Alloc( pixelsize );
+	buffer = (byte *)Mem_Alloc( sidesize );
+
 	for( int i = 0; i < numSides; i++ )
 	{
-		byte	*buffer = mip->buffer + ((pix->width * pix->height * 4) * i);
+		memcpy( buffer, pix->buffer + sidesize * i, sidesize );
 
 		width = pix->width;
 		height = pix->height;
 
 		for( int j = 0; j < nummips; j++ )
 		{
+			ddslevel_t	*level = &levels[i * nummips + j];
+			size_t		offset = (size_t)level->pixels;
+			bool		last = ( i == numSides - 1 && j == nummips - 1 );
+			size_t		size = ( last ? pixelsize : (size_t)level[1].pixels ) - offset;
+
 			if( j ) Image_BuildMipMap( buffer, width, height, normalMap );
 
-			width = Q_max( 1, ( pix->width >> j ));
-			height = Q_max( 1, ( pix->height >> j ));
+			width = level->width;
+			height = level->height;
 
-			if( !CompressDXT( file, buffer, width, height, saveformat, ( j == 0 ) ))
-			{
-				MsgDev( D_ERROR, "BufferToDDS: can't compress image\n" );
-				VFS_Close( file );
-				Image_Free( mip );
-				return NULL;
-			}
+			memcpy( pixels + offset, buffer, size );
+			level->pixels = pixels + offset;
+			level->dest = out->buffer + (size_t)level->dest;
 		}
 	}
 
-	Image_Free( mip );
+	Mem_Free( buffer );
 
-	// create a new pic
-	out = (rgbdata_t *)Mem_Alloc( sizeof( rgbdata_t ) + VFS_Tell( file ));
-	out->buffer = ((byte *)out) + sizeof( rgbdata_t ); 
-	memcpy( out->buffer, VFS_GetBuffer( file ), VFS_Tell( file ));
+	enc.rows = (ddsrow_t *)Mem_Alloc( sizeof( ddsrow_t ) * enc.numrows );
+
+	for( int i = 0, row = 0; i < numSides * nummips; i++ )
+	{
+		for( int j = 0; j < levels[i].height; j += 4, row++ )
+		{
+			enc.rows[row].level = &levels[i];
+			enc.rows[row].row = j / 4;
+		}
+	}
+
+	DDS_SetupEncoder( &enc, saveformat );
+	enc.rowsdone.store( 0 );
+	enc.percent = -1;
+	start = I_FloatTime();
+
+	// nested call from a work function of another pass can't use the pool
+	if( ThreadActive( ))
+	{
+		enc.progress = false;
+		for( int i = 0; i < enc.numrows; i++ )
+			CompressBlockRow( &enc, &enc.rows[i] );
+	}
+	else
+	{
+		enc.progress = true;
+		g_ddsencode = &enc;
+		RunThreadsOnIndividual( enc.numrows, false, CompressBlockRowThread );
+		g_ddsencode = NULL;
+
+		end = I_FloatTime();
+		Q_timestring((int)(end - start), str );
+		Msg( "\r" );
+		Msg( "compress %s: 100%%. %s elapsed\n", enc.typeString, str );
+	}
+
+	Mem_Free( enc.rows );
+	Mem_Free( pixels );
+	Mem_Free( levels );
 
 	out->width = pix->width;
 	out->height = pix->height;
-	out->size = VFS_Tell( file );
+	out->size = filesize;
 
 	SetBits( out->flags, IMAGE_HAS_COLOR );
 	SetBits( out->flags, IMAGE_DXT_FORMAT );
@@ -812,9 +950,6 @@ rgbdata_t *BufferToDDS( rgbdata_t *pix, int saveformat )
 	if( FBitSet( pix->flags, IMAGE_SKYBOX ))
 		SetBits( out->flags, IMAGE_SKYBOX );
 
-	// release virtual file
-	VFS_Close( file );
-
 	return out;
 }
 
@@ -16,9 +16,18 @@ GNU General Public License for more details.
 #ifndef DDSTEX_H
 #define DDSTEX_H
 
+// block compression tiers for DDS_SetQuality
+typedef enum
+{
+	DXT_QUALITY_FAST = 0,	// range fit, for previews and quick batch runs
+	DXT_QUALITY_NORMAL,		// single cluster fit
+	DXT_QUALITY_HIGH,		// iterative cluster fit (default)
+} dxtquality_t;
+
 rgbdata_t *DDSToBuffer( const char *name, const byte *buffer, size_t filesize );
 rgbdata_t *DDSToRGBA( const char *name, const byte *buffer, size_t filesize );
 rgbdata_t *BufferToDDS( rgbdata_t *pix, int saveformat );
 int DDS_GetSaveFormatForHint( int hint, rgbdata_t *pix );
+void DDS_SetQuality( int quality );
 
 #endif//DDSTEX_H
\ No newline at end of file
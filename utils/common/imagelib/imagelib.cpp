@@ -23,6 +23,7 @@ GNU General Public License for more details.
 #include "ddstex.h"
 #include "mathlib.h"
 #include "crclib.h"
+#include "simd4.h"
 #include <fcntl.h>
 #include <stdio.h>
 #include <miniz.h>
@@ -2194,162 +2195,211 @@ static float Image_MitchellFilter( float x )
 
 /*
 ================
-Image_ResampleHorizontal_Mitchell
+Image_MitchellKernel
 
-Resample a single row horizontally using Mitchell filter with premultiplied alpha
+filter taps for every output sample of one axis. the weights
+don't depend on the other axis, so they are computed only once
 ================
 */
-static void Image_ResampleHorizontal_Mitchell( const byte *in, int inW, int outW, byte *out )
+#define MITCHELL_STRIP_WIDTH	64	// columns of the vertical pass expanded to floats at once
+
+typedef struct
+{
+	int	maxtaps;
+	int	*count;		// taps of each output sample
+	int	*index;		// clamped source samples, maxtaps per output sample
+	float	*weight;
+	float	*total;		// sum of weights of each output sample
+} mitchellkernel_t;
+
+static void Image_MitchellKernel( mitchellkernel_t *kernel, int inSize, int outSize )
 {
 	float	scale, radius;
-	int	x;
 
-	scale = (float)inW / (float)outW;
-	radius = ( inW > outW ) ? 2.0f * scale : 2.0f;
+	memset( kernel, 0, sizeof( *kernel ));
+
+	// nothing to filter, and the scale would be infinite
+	if( inSize <= 0 || outSize <= 0 )
+		return;
 
-	for( x = 0; x < outW; x++ )
+	scale = (float)inSize / (float)outSize;
+	radius = ( inSize > outSize ) ? 2.0f * scale : 2.0f;
+
+	kernel->maxtaps = (int)( radius * 2.0f ) + 2;
+	kernel->count = (int *)Mem_Alloc( sizeof( int ) * outSize );
+	kernel->total = (float *)Mem_Alloc( sizeof( float ) * outSize );
+	kernel->index = (int *)Mem_Alloc( sizeof( int ) * outSize * kernel->maxtaps );
+	kernel->weight = (float *)Mem_Alloc( sizeof( float ) * outSize * kernel->maxtaps );
+
+	for( int x = 0; x < outSize; x++ )
 	{
-		float	center;
-		int	i, left, right, si;
-		float	sumW, sumRp, sumGp, sumBp, sumA;
+		int	*index = kernel->index + x * kernel->maxtaps;
+		float	*weight = kernel->weight + x * kernel->maxtaps;
+		float	center, sumW = 0.0f;
+		int	i, left, right, n = 0;
 
 		center = ( (float)x + 0.5f ) * scale - 0.5f;
 		left = (int)ceil( center - radius );
 		right = (int)floor( center + radius );
 
-		sumW = 0.0f;
-		sumRp = sumGp = sumBp = sumA = 0.0f;
-
-		for( i = left; i <= right; i++ )
+		for( i = left; i <= right && n < kernel->maxtaps; i++, n++ )
 		{
-			float	d, weight;
-			float	r, g, b, a;
+			float	d = (float)( i - center );
 
-			si = bound( 0, i, inW - 1 );
-			d = (float)( i - center );
+			index[n] = bound( 0, i, inSize - 1 );
 
-			if( inW > outW )
-				weight = Image_MitchellFilter( d / scale ) / scale;
+			if( inSize > outSize )
+				weight[n] = Image_MitchellFilter( d / scale ) / scale;
 			else
-				weight = Image_MitchellFilter( d );
-
-			r = in[si * 4 + 0];
-			g = in[si * 4 + 1];
-			b = in[si * 4 + 2];
-			a = in[si * 4 + 3];
-
-			// premultiplied alpha: r * a / 255
-			sumRp += r * a * ( 1.0f / 255.0f ) * weight;
-			sumGp += g * a * ( 1.0f / 255.0f ) * weight;
-			sumBp += b * a * ( 1.0f / 255.0f ) * weight;
-			sumA += a * weight;
-			sumW += weight;
+				weight[n] = Image_MitchellFilter( d );
+			sumW += weight[n];
 		}
 
-		if( sumW > 0.0f )
-		{
-			sumRp /= sumW;
-			sumGp /= sumW;
-			sumBp /= sumW;
-			sumA /= sumW;
-		}
+		kernel->count[x] = n;
+		kernel->total[x] = sumW;
+	}
+}
 
-		if( sumA > 0.0f )
-		{
-			float	invA = 255.0f / sumA;
+static void Image_FreeMitchellKernel( mitchellkernel_t *kernel )
+{
+	Mem_Free( kernel->count );
+	Mem_Free( kernel->total );
+	Mem_Free( kernel->index );
+	Mem_Free( kernel->weight );
+}
 
-			out[x * 4 + 0] = (byte)bound( 0, (int)( sumRp * invA + 0.5f ), 255 );
-			out[x * 4 + 1] = (byte)bound( 0, (int)( sumGp * invA + 0.5f ), 255 );
-			out[x * 4 + 2] = (byte)bound( 0, (int)( sumBp * invA + 0.5f ), 255 );
-		}
-		else
-		{
-			out[x * 4 + 0] = out[x * 4 + 1] = out[x * 4 + 2] = 0;
-		}
-		out[x * 4 + 3] = (byte)bound( 0, (int)( sumA + 0.5f ), 255 );
+/*
+================
+Image_PremultiplyRow
+
+expand RGBA pixels to floats with premultiplied alpha: r * a / 255
+================
+*/
+static void Image_PremultiplyRow( const byte *in, int count, float *out )
+{
+	const simd4_t	inv255 = Simd4Set( 1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f, 1.0f );
+
+	for( int i = 0; i < count; i++, in += 4, out += 4 )
+	{
+		float	a = in[3];
+		simd4_t	c = Simd4Set( in[0], in[1], in[2], a );
+
+		c = Simd4Mul( Simd4Mul( c, Simd4Set( a, a, a, 1.0f )), inv255 );
+		Simd4Store( out, c );
 	}
 }
 
 /*
 ================
-Image_ResampleVertical_Mitchell
+Image_StoreMitchell
 
-Resample image columns using Mitchell filter with premultiplied alpha
+normalize the filtered sample and restore straight alpha
 ================
 */
-static void Image_ResampleVertical_Mitchell( const byte *in, int inH, int outH, byte *out, int outW )
+static void Image_StoreMitchell( simd4_t sum, float total, byte *out )
 {
-	float	scale, radius;
-	int	x;
+	float	c[4];
 
-	scale = (float)inH / (float)outH;
-	radius = ( inH > outH ) ? 2.0f * scale : 2.0f;
+	if( total > 0.0f )
+		sum = Simd4Div( sum, Simd4Splat( total ));
+	Simd4Store( c, sum );
 
-	for( x = 0; x < outW; x++ )
+	if( c[3] > 0.0f )
 	{
-		int	y;
+		float	invA = 255.0f / c[3];
 
-		for( y = 0; y < outH; y++ )
+		out[0] = (byte)bound( 0, (int)( c[0] * invA + 0.5f ), 255 );
+		out[1] = (byte)bound( 0, (int)( c[1] * invA + 0.5f ), 255 );
+		out[2] = (byte)bound( 0, (int)( c[2] * invA + 0.5f ), 255 );
+	}
+	else
+	{
+		out[0] = out[1] = out[2] = 0;
+	}
+	out[3] = (byte)bound( 0, (int)( c[3] + 0.5f ), 255 );
+}
+
+/*
+================
+Image_ResampleHorizontal_Mitchell
+
+Resample rows horizontally using Mitchell filter with premultiplied alpha
+================
+*/
+static void Image_ResampleHorizontal_Mitchell( const byte *in, int inW, int outW, int height, byte *out )
+{
+	mitchellkernel_t	kernel;
+	float		*row;
+
+	Image_MitchellKernel( &kernel, inW, outW );
+	row = (float *)Mem_Alloc( sizeof( float ) * 4 * inW );
+
+	for( int y = 0; y < height; y++, in += inW * 4 )
+	{
+		Image_PremultiplyRow( in, inW, row );
+
+		for( int x = 0; x < outW; x++, out += 4 )
 		{
-			float	center;
-			int	i, top, bottom, si;
-			float	sumW, sumRp, sumGp, sumBp, sumA;
+			const int	*index = kernel.index + x * kernel.maxtaps;
+			const float	*weight = kernel.weight + x * kernel.maxtaps;
+			simd4_t		sum = Simd4Splat( 0.0f );
 
-			center = ( (float)y + 0.5f ) * scale - 0.5f;
-			top = (int)ceil( center - radius );
-			bottom = (int)floor( center + radius );
+			for( int i = 0; i < kernel.count[x]; i++ )
+				sum = Simd4Add( sum, Simd4Mul( Simd4Load( row + index[i] * 4 ), Simd4Splat( weight[i] )));
 
-			sumW = 0.0f;
-			sumRp = sumGp = sumBp = sumA = 0.0f;
+			Image_StoreMitchell( sum, kernel.total[x], out );
+		}
+	}
 
-			for( i = top; i <= bottom; i++ )
-			{
-				float	d, weight;
-				float	r, g, b, a;
+	Mem_Free( row );
+	Image_FreeMitchellKernel( &kernel );
+}
 
-				si = bound( 0, i, inH - 1 );
-				d = (float)( i - center );
+/*
+================
+Image_ResampleVertical_Mitchell
 
-				if( inH > outH )
-					weight = Image_MitchellFilter( d / scale ) / scale;
-				else
-					weight = Image_MitchellFilter( d );
-
-				r = in[si * outW * 4 + x * 4 + 0];
-				g = in[si * outW * 4 + x * 4 + 1];
-				b = in[si * outW * 4 + x * 4 + 2];
-				a = in[si * outW * 4 + x * 4 + 3];
-
-				sumRp += r * a * ( 1.0f / 255.0f ) * weight;
-				sumGp += g * a * ( 1.0f / 255.0f ) * weight;
-				sumBp += b * a * ( 1.0f / 255.0f ) * weight;
-				sumA += a * weight;
-				sumW += weight;
-			}
+Resample image columns using Mitchell filter with premultiplied alpha.
+Columns are expanded to floats one strip at a time and the output is
+walked by rows, so the taps are read from contiguous memory
+================
+*/
+static void Image_ResampleVertical_Mitchell( const byte *in, int inH, int outH, byte *out, int outW )
+{
+	mitchellkernel_t	kernel;
+	float		*strip;
 
-			if( sumW > 0.0f )
-			{
-				sumRp /= sumW;
-				sumGp /= sumW;
-				sumBp /= sumW;
-				sumA /= sumW;
-			}
+	Image_MitchellKernel( &kernel, inH, outH );
+	strip = (float *)Mem_Alloc( sizeof( float ) * 4 * Q_min( outW, MITCHELL_STRIP_WIDTH ) * inH );
 
-			if( sumA > 0.0f )
-			{
-				float	invA = 255.0f / sumA;
+	for( int x0 = 0; x0 < outW; x0 += MITCHELL_STRIP_WIDTH )
+	{
+		int	width = Q_min( outW - x0, MITCHELL_STRIP_WIDTH );
 
-				out[y * outW * 4 + x * 4 + 0] = (byte)bound( 0, (int)( sumRp * invA + 0.5f ), 255 );
-				out[y * outW * 4 + x * 4 + 1] = (byte)bound( 0, (int)( sumGp * invA + 0.5f ), 255 );
-				out[y * outW * 4 + x * 4 + 2] = (byte)bound( 0, (int)( sumBp * invA + 0.5f ), 255 );
-			}
-			else
+		for( int y = 0; y < inH; y++ )
+			Image_PremultiplyRow( in + ( y * outW + x0 ) * 4, width, strip + y * width * 4 );
+
+		for( int y = 0; y < outH; y++ )
+		{
+			const int	*index = kernel.index + y * kernel.maxtaps;
+			const float	*weight = kernel.weight + y * kernel.maxtaps;
+			byte		*dst = out + ( y * outW + x0 ) * 4;
+
+			for( int x = 0; x < width; x++, dst += 4 )
 			{
-				out[y * outW * 4 + x * 4 + 0] = out[y * outW * 4 + x * 4 + 1] = out[y * outW * 4 + x * 4 + 2] = 0;
+				const float	*column = strip + x * 4;
+				simd4_t		sum = Simd4Splat( 0.0f );
+
+				for( int i = 0; i < kernel.count[y]; i++ )
+					sum = Simd4Add( sum, Simd4Mul( Simd4Load( column + index[i] * width * 4 ), Simd4Splat( weight[i] )));
+
+				Image_StoreMitchell( sum, kernel.total[y], dst );
 			}
-			out[y * outW * 4 + x * 4 + 3] = (byte)bound( 0, (int)( sumA + 0.5f ), 255 );
 		}
 	}
+
+	Mem_Free( strip );
+	Image_FreeMitchellKernel( &kernel );
 }
 
 /*
@@ -2364,21 +2414,12 @@ Handles premultiplied alpha for correct compositing at transparency boundaries
 static void Image_Resample32Mitchell( const void *indata, int inW, int inH, void *outdata, int outW, int outH )
 {
 	byte	*temp;
-	int	y;
 
 	// allocate temporary buffer for horizontal pass
 	temp = (byte *)Mem_Alloc( outW * inH * 4 );
 
 	// horizontal pass: resample each row from inW to outW
-	for( y = 0; y < inH; y++ )
-	{
-		const byte	*inRow;
-		byte	*outRow;
-
-		inRow = (const byte *)indata + y * inW * 4;
-		outRow = temp + y * outW * 4;
-		Image_ResampleHorizontal_Mitchell( inRow, inW, outW, outRow );
-	}
+	Image_ResampleHorizontal_Mitchell( (const byte *)indata, inW, outW, inH, temp );
 
 	// vertical pass: resample each column from inH to outH
 	Image_ResampleVertical_Mitchell( temp, inH, outH, (byte *)outdata, outW );
@@ -2724,6 +2765,66 @@ static void Image_BuildMipMapLinear( uint *in, int inWidth, int inHeight )
 	Mem_Free( temp );
 }
 
+/*
+=================
+Image_NormalMipChannel
+
+sum of one channel over the 2x2 blocks of four output pixels
+=================
+*/
+inline static simd4_t Image_NormalMipChannel( const byte *in, int stride )
+{
+	const simd4_t	inv127 = Simd4Splat( 1.0f / 127.0f );
+	const simd4_t	one = Simd4Splat( 1.0f );
+	simd4_t		s0, s1, s2, s3;
+
+	s0 = Simd4Sub( Simd4Mul( Simd4Set( in[0], in[8], in[16], in[24] ), inv127 ), one );
+	s1 = Simd4Sub( Simd4Mul( Simd4Set( in[4], in[12], in[20], in[28] ), inv127 ), one );
+	in += stride;
+	s2 = Simd4Sub( Simd4Mul( Simd4Set( in[0], in[8], in[16], in[24] ), inv127 ), one );
+	s3 = Simd4Sub( Simd4Mul( Simd4Set( in[4], in[12], in[20], in[28] ), inv127 ), one );
+
+	return Simd4Add( Simd4Add( Simd4Add( s0, s1 ), s2 ), s3 );
+}
+
+/*
+=================
+Image_BuildNormalMip4
+
+box filter and renormalize four pixels of a normal map mip.
+the length is computed in float instead of double,
+so a channel can differ by one from the scalar path
+=================
+*/
+static void Image_BuildNormalMip4( const byte *in, int stride, byte *out )
+{
+	simd4_t	nx = Image_NormalMipChannel( in + 0, stride );
+	simd4_t	ny = Image_NormalMipChannel( in + 1, stride );
+	simd4_t	nz = Image_NormalMipChannel( in + 2, stride );
+	simd4_t	length, valid;
+	float	x[4], y[4], z[4];
+
+	length = Simd4Sqrt( Simd4Add( Simd4Add( Simd4Mul( nx, nx ), Simd4Mul( ny, ny )), Simd4Mul( nz, nz )));
+	valid = Simd4CmpGT( length, Simd4Splat( 0.0f ));
+
+	// zero vector gets the same fallback as VectorNormalize
+	nx = Simd4Select( valid, Simd4Div( nx, length ), Simd4Splat( 0.5f ));
+	ny = Simd4Select( valid, Simd4Div( ny, length ), Simd4Splat( 0.5f ));
+	nz = Simd4Select( valid, Simd4Div( nz, length ), Simd4Splat( 1.0f ));
+
+	Simd4Store( x, Simd4Add( Simd4Mul( nx, Simd4Splat( 127.0f )), Simd4Splat( 128.0f )));
+	Simd4Store( y, Simd4Add( Simd4Mul( ny, Simd4Splat( 127.0f )), Simd4Splat( 128.0f )));
+	Simd4Store( z, Simd4Add( Simd4Mul( nz, Simd4Splat( 127.0f )), Simd4Splat( 128.0f )));
+
+	for( int i = 0; i < 4; i++, out += 4 )
+	{
+		out[0] = (byte)x[i];
+		out[1] = (byte)y[i];
+		out[2] = (byte)z[i];
+		out[3] = 255;
+	}
+}
+
 /*
 =================
 Image_BuildMipMap
@@ -2745,7 +2846,11 @@ void Image_BuildMipMap( byte *in, int width, int height, bool isNormalMap, bool
 
 		for( y = 0; y < height; y++, in += width )
 		{
-			for( x = 0; x < width; x += 8, in += 8, out += 4 )
+			// four output pixels at once, the rest one by one
+			for( x = 0; x + 32 <= width; x += 32, in += 32, out += 16 )
+				Image_BuildNormalMip4( in, width, out );
+
+			for( ; x < width; x += 8, in += 8, out += 4 )
 			{
 				normal[0] = (in[0] * inv127 - 1.0f) + (in[4] * inv127 - 1.0f) + (in[width+0] * inv127 - 1.0f) + (in[width+4] * inv127 - 1.0f);
 				normal[1] = (in[1] * inv127 - 1.0f) + (in[5] * inv127 - 1.0f) + (in[width+1] * inv127 - 1.0f) + (in[width+5] * inv127 - 1.0f);
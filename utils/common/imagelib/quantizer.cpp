@@ -50,7 +50,6 @@ GNU General Public License for more details.
 // defs for decreasing alpha factor
 #define alphabiasshift	10			// alpha starts at 1.0
 #define initalpha		(1<<alphabiasshift)
-int			alphadec;			// biased by 10 bits
 
 // radbias and alpharadbias used for radpower calculation
 #define radbiasshift	8
@@ -58,49 +57,53 @@ int			alphadec;			// biased by 10 bits
 #define alpharadbshift	(alphabiasshift+radbiasshift)
 #define alpharadbias	(1<<alpharadbshift)
 
-// types and global variables
-static byte		*thepicture;		// the input image itself
-static int		lengthcount;		// lengthcount = H*W*3
-static int		samplefac;		// sampling factor 1..30
-static int		network[netsize][4];	// the network itself
-static int		netindex[256];		// for network lookup - really 256
-static int		bias[netsize];		// bias and freq arrays for learning
-static int		freq[netsize];
-static int		radpower[initrad];		// radpower for precomputation
-
-void initnet( byte *thepic, int len, int sample )	
+// the whole state of the quantizer, so several images can be quantized at once
+typedef struct
+{
+	byte	*thepicture;		// the input image itself
+	int	lengthcount;		// lengthcount = H*W*3
+	int	samplefac;		// sampling factor 1..30
+	int	alphadec;			// biased by 10 bits
+	int	network[netsize][4];	// the network itself
+	int	netindex[256];		// for network lookup - really 256
+	int	bias[netsize];		// bias and freq arrays for learning
+	int	freq[netsize];
+	int	radpower[initrad];		// radpower for precomputation
+} neuquant_t;
+
+static void initnet( neuquant_t *nq, byte *thepic, int len, int sample )	
 {
 	int i, *p;
-	thepicture = thepic;
-	lengthcount = len;
-	samplefac = sample;
+	nq->thepicture = thepic;
+	nq->lengthcount = len;
+	nq->samplefac = sample;
 	
 	for( i = 0; i < netsize; i++ )
 	{
-		p = network[i];
+		p = nq->network[i];
 		p[0] = p[1] = p[2] = (i << (netbiasshift + 8)) / netsize;
-		freq[i] = intbias / netsize;	// 1 / netsize
-		bias[i] = 0;
+		nq->freq[i] = intbias / netsize;	// 1 / netsize
+		nq->bias[i] = 0;
 	}
 }
 	
 // unbias network to give byte values 0..255 and record position i to prepare for sort
-void unbiasnet( void )
+static void unbiasnet( neuquant_t *nq )
 {
 	for( int i = 0; i < netsize; i++ )
 	{
 		for( int j = 0; j < 3; j++ )
 		{
-			int temp = (network[i][j] + (1 << (netbiasshift - 1))) >> netbiasshift;
+			int temp = (nq->network[i][j] + (1 << (netbiasshift - 1))) >> netbiasshift;
 			if( temp > 255 ) temp = 255;
-			network[i][j] = temp;
+			nq->network[i][j] = temp;
 		}
-		network[i][3] = i; // record colour num
+		nq->network[i][3] = i; // record colour num
 	}
 }
 
 // insertion sort of network and building of netindex[0..255] (to do after unbias)
-void inxbuild( void )
+static void inxbuild( neuquant_t *nq )
 {
 	int *p, *q;
 	int i, j, smallpos, smallval;
@@ -111,14 +114,14 @@ void inxbuild( void )
 
 	for( i = 0; i < netsize; i++ )
 	{
-		p = network[i];
+		p = nq->network[i];
 		smallpos = i;
 		smallval = p[1];			// index on g
 
 		// find smallest in i..netsize-1
 		for( j = i + 1; j < netsize; j++ )
 		{
-			q = network[j];
+			q = nq->network[j];
 
 			if( q[1] < smallval )
 			{
@@ -128,7 +131,7 @@ void inxbuild( void )
 			}
 		}
 
-		q = network[smallpos];
+		q = nq->network[smallpos];
 
 		// swap p (i) and q (smallpos) entries
 		if( i != smallpos )
@@ -142,39 +145,39 @@ void inxbuild( void )
 		// smallval entry is now in position i
 		if( smallval != previouscol )
 		{
-			netindex[previouscol] = (startpos+i) >> 1;
+			nq->netindex[previouscol] = (startpos+i) >> 1;
 
 			for( j = previouscol + 1; j < smallval; j++ )
-				netindex[j] = i;
+				nq->netindex[j] = i;
 
 			previouscol = smallval;
 			startpos = i;
 		}
 	}
 
-	netindex[previouscol] = (startpos + maxnetpos)>>1;
+	nq->netindex[previouscol] = (startpos + maxnetpos)>>1;
 
 	for( j = previouscol + 1; j < 256; j++ )
-		netindex[j] = maxnetpos; // really 256
+		nq->netindex[j] = maxnetpos; // really 256
 }
 
 // search for BGR values 0..255 (after net is unbiased) and return colour index
-int inxsearch( int r, int g, int b )
+static int inxsearch( const neuquant_t *nq, int r, int g, int b )
 {
 	int	i, j, dist, a, bestd;
-	int	*p;
+	const int	*p;
 	int	best;
 
 	bestd = 1000;	// biggest possible dist is 256 * 3
 	best = -1;
-	i = netindex[g];	// index on g
+	i = nq->netindex[g];	// index on g
 	j = i - 1;	// start at netindex[g] and work outwards
 
 	while(( i < netsize ) || ( j >= 0 ))
 	{
 		if( i < netsize )
 		{
-			p = network[i];
+			p = nq->network[i];
 			dist = p[1] - g;		// inx key
 
 			if( dist >= bestd )
@@ -206,7 +209,7 @@ int inxsearch( int r, int g, int b )
 
 		if( j >= 0 )
 		{
-			p = network[j];
+			p = nq->network[j];
 			dist = g - p[1]; // inx key - reverse dif
 
 			if( dist >= bestd )
@@ -240,7 +243,7 @@ int inxsearch( int r, int g, int b )
 }
 
 // search for biased BGR values
-int contest( int r, int g, int b )
+static int contest( neuquant_t *nq, int r, int g, int b )
 {
 	// finds closest neuron (min dist) and updates freq
 	// finds best neuron (min dist-bias) and returns position
@@ -255,12 +258,12 @@ int contest( int r, int g, int b )
 	bestbiasd = bestd;
 	bestpos = -1;
 	bestbiaspos = bestpos;
-	p = bias;
-	f = freq;
+	p = nq->bias;
+	f = nq->freq;
 
 	for( i = 0; i < netsize; i++ )
 	{
-		n = network[i];
+		n = nq->network[i];
 		dist = n[2] - b;
 		if( dist < 0 ) dist = -dist;
 		a = n[1] - g;
@@ -289,18 +292,18 @@ int contest( int r, int g, int b )
 		*p++ += (betafreq << gammashift);
 	}
 
-	freq[bestpos] += beta;
-	bias[bestpos] -= betagamma;
+	nq->freq[bestpos] += beta;
+	nq->bias[bestpos] -= betagamma;
 
 	return bestbiaspos;
 }
 
 // move neuron i towards biased (b,g,r) by factor alpha
-void altersingle( int alpha, int i, int r, int g, int b )
+static void altersingle( neuquant_t *nq, int alpha, int i, int r, int g, int b )
 {
 	int *n;
 
-	n = network[i];	// alter hit neuron
+	n = nq->network[i];	// alter hit neuron
 	*n -= (alpha * (*n - r)) / initalpha;
 	n++;
 	*n -= (alpha * (*n - g)) / initalpha;
@@ -309,7 +312,7 @@ void altersingle( int alpha, int i, int r, int g, int b )
 }
 
 // move adjacent neurons by precomputed alpha*(1-((i-j)^2/[r]^2)) in radpower[|i-j|]
-void alterneigh( int rad, int i, int r, int g, int b )
+static void alterneigh( neuquant_t *nq, int rad, int i, int r, int g, int b )
 {
 	int j, k, lo, hi, a;
 	int *p, *q;
@@ -324,7 +327,7 @@ void alterneigh( int rad, int i, int r, int g, int b )
 
 	j = i + 1;
 	k = i - 1;
-	q = radpower;
+	q = nq->radpower;
 
 	while(( j < hi ) || ( k > lo ))
 	{
@@ -332,7 +335,7 @@ void alterneigh( int rad, int i, int r, int g, int b )
 
 		if( j < hi )
 		{
-			p = network[j];
+			p = nq->network[j];
 			*p -= (a * (*p - r)) / alpharadbias;
 			p++;
 			*p -= (a * (*p - g)) / alpharadbias;
@@ -343,7 +346,7 @@ void alterneigh( int rad, int i, int r, int g, int b )
 
 		if( k > lo )
 		{
-			p = network[k];
+			p = nq->network[k];
 			*p -= (a * (*p - r)) / alpharadbias;
 			p++;
 			*p -= (a * (*p - g)) / alpharadbias;
@@ -355,7 +358,7 @@ void alterneigh( int rad, int i, int r, int g, int b )
 }
 
 // main Learning Loop
-void learn( void )
+static void learn( neuquant_t *nq )
 {
 	byte *p;
 	int i, j, r, g, b;
@@ -363,10 +366,10 @@ void learn( void )
 	int delta, samplepixels;
 	byte *lim;
 
-	alphadec = 30 + ((samplefac - 1) / 3);
-	p = thepicture;
-	lim = thepicture + lengthcount;
-	samplepixels = lengthcount / (samplefac * 4); // RGBA
+	nq->alphadec = 30 + ((nq->samplefac - 1) / 3);
+	p = nq->thepicture;
+	lim = nq->thepicture + nq->lengthcount;
+	samplepixels = nq->lengthcount / (nq->samplefac * 4); // RGBA
 	delta = samplepixels / ncycles;
 	alpha = initalpha;
 	radius = initradius;
@@ -375,19 +378,19 @@ void learn( void )
 	if( rad <= 1 ) rad = 0;
 
 	for( i = 0; i < rad; i++ ) 
-		radpower[i] = alpha * ((( rad * rad - i * i ) * radbias ) / ( rad * rad ));
+		nq->radpower[i] = alpha * ((( rad * rad - i * i ) * radbias ) / ( rad * rad ));
 
 	if( delta <= 0 ) return;
 
-	if(( lengthcount % prime1 ) != 0 )
+	if(( nq->lengthcount % prime1 ) != 0 )
 	{
 		step = prime1 * 4; // RGBA
 	}
-	else if(( lengthcount % prime2 ) != 0 )
+	else if(( nq->lengthcount % prime2 ) != 0 )
 	{
 		step = prime2 * 4; // RGBA
 	}
-	else if(( lengthcount % prime3 ) != 0 )
+	else if(( nq->lengthcount % prime3 ) != 0 )
 	{
 		step = prime3 * 4; // RGBA
 	}
@@ -403,25 +406,25 @@ void learn( void )
 		r = p[0] << netbiasshift;
 		g = p[1] << netbiasshift;
 		b = p[2] << netbiasshift;
-		j = contest( r, g, b );
+		j = contest( nq, r, g, b );
 
-		altersingle( alpha, j, r, g, b );
-		if( rad ) alterneigh( rad, j, r, g, b );   // alter neighbours
+		altersingle( nq, alpha, j, r, g, b );
+		if( rad ) alterneigh( nq, rad, j, r, g, b );   // alter neighbours
 
 		p += step;
-		while( p >= lim ) p -= lengthcount;
+		while( p >= lim ) p -= nq->lengthcount;
 	
 		i++;
 
 		if( i % delta == 0 )
 		{	
-			alpha -= alpha / alphadec;
+			alpha -= alpha / nq->alphadec;
 			radius -= radius / radiusdec;
 			rad = radius >> radiusbiasshift;
 			if( rad <= 1 ) rad = 0;
 
 			for( j = 0; j < rad; j++ ) 
-				radpower[j] = alpha * ((( rad * rad - j * j ) * radbias ) / ( rad * rad ));
+				nq->radpower[j] = alpha * ((( rad * rad - j * j ) * radbias ) / ( rad * rad ));
 		}
 	}
 }
@@ -429,6 +432,7 @@ void learn( void )
 // returns the actual number of palette entries.
 rgbdata_t *Image_Quantize( rgbdata_t *pic, ditherType_t ditherType )
 {
+	neuquant_t	*nq;
 	rgbdata_t	*out;
 	int	i, samples;
 
@@ -444,24 +448,25 @@ rgbdata_t *Image_Quantize( rgbdata_t *pic, ditherType_t ditherType )
 		samples = 1; // maximum quality
 	else samples = 10; // fast mode
 
-	initnet( pic->buffer, pic->size, samples );
-	learn();
-	unbiasnet();
+	nq = (neuquant_t *)Mem_Alloc( sizeof( neuquant_t ));
+	initnet( nq, pic->buffer, pic->size, samples );
+	learn( nq );
+	unbiasnet( nq );
 
 	for( i = 0; i < netsize; i++ )
 	{
-		out->palette[i*4+0] = network[i][0];	// red
-		out->palette[i*4+1] = network[i][1];	// green
-		out->palette[i*4+2] = network[i][2];	// blue 
+		out->palette[i*4+0] = nq->network[i][0];	// red
+		out->palette[i*4+1] = nq->network[i][1];	// green
+		out->palette[i*4+2] = nq->network[i][2];	// blue 
 		out->palette[i*4+3] = 0xFF;		// alpha
 	}
 
-	inxbuild();
+	inxbuild( nq );
 
 	if( ditherType == DITHER_NONE )
 	{
 		for( i = 0; i < pic->width * pic->height; i++ )
-			out->buffer[i] = inxsearch( pic->buffer[i*4+0], pic->buffer[i*4+1], pic->buffer[i*4+2] );
+			out->buffer[i] = inxsearch( nq, pic->buffer[i*4+0], pic->buffer[i*4+1], pic->buffer[i*4+2] );
 	}
 	else if( ditherType == DITHER_FLOYD_STEINBERG )
 	{
@@ -473,7 +478,10 @@ rgbdata_t *Image_Quantize( rgbdata_t *pic, ditherType_t ditherType )
 		// eliminates row-cycling artifacts from reuse of 2-row buffer
 		float *err = (float *)Mem_Alloc( width * height * 3 * sizeof( float ));
 		if( !err ) 
+		{
+			Mem_Free( nq );
 			return NULL;
+		}
 
 		memset( err, 0, width * height * 3 * sizeof( float ));
 
@@ -497,7 +505,7 @@ rgbdata_t *Image_Quantize( rgbdata_t *pic, ditherType_t ditherType )
 				const int g = bound( 0, (int)(raw_g + 0.5f), 255 );
 				const int b = bound( 0, (int)(raw_b + 0.5f), 255 );
 
-				int bestIdx = inxsearch( r, g, b );
+				int bestIdx = inxsearch( nq, r, g, b );
 				out->buffer[idx] = bestIdx;
 
 				float er = raw_r - (float)out->palette[bestIdx*4+0];
@@ -552,6 +560,7 @@ rgbdata_t *Image_Quantize( rgbdata_t *pic, ditherType_t ditherType )
 		Mem_Free( err );
 	}
 
+	Mem_Free( nq );
 	Image_Free( pic ); // release RGBA image
 	return out;
 }
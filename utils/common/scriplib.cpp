@@ -120,6 +120,7 @@ void LoadScriptFile( const char *filename )
 
 	endofscript = false;
 	tokenready = false;
+	scriptline = 0;
 }
 
 
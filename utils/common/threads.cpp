@@ -12,17 +12,82 @@
 #define NO_THREAD_NAMES
 #include "threads.h"
 #include "port.h"
+#include "stringlib.h"
+#include "mathlib.h"
 #include <cstdio>
-//#include <cstring>
-
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#if XASH_POSIX
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #define PACIFIER_STEP	40
 #define PACIFIER_REM	( PACIFIER_STEP / 10 )
 
+#if XASH_WIN32
+#define THREAD_STACK_SIZE	(4096 * 1024)	// 4 Mb
+#else
+#define THREAD_STACK_SIZE	(1024 * 1024)	// 1 Mb
+#endif
+
+// every batch taken from the shared counter is remaining / ( numthreads * WORK_BATCH_DIVISOR )
+// so threads grab big ranges at start and a single items near the end of the pass
+#define WORK_BATCH_DIVISOR	8
+#define WORK_CACHELINE	64
+
+// per-thread work deque. It's a contiguous range of indexes packed as ( end << 32 ) | begin
+// the owner pops items from the front, thieves are cut off the back half of the range.
+// both sides is only a single compare-exchange so there is no locks on the hot path
+typedef struct threadwork_s
+{
+	std::atomic<uint64_t>	range;
+	byte		pad[WORK_CACHELINE - sizeof( std::atomic<uint64_t> )];
+} threadwork_t;
+
+#define WORK_RANGE( begin, end )	(((uint64_t)(end) << 32) | (uint32_t)(begin))
+#define WORK_BEGIN( range )		((int)((range) & 0xFFFFFFFF ))
+#define WORK_END( range )		((int)((range) >> 32 ))
+
+typedef struct threadpool_s
+{
+	std::mutex		mutex;
+	std::condition_variable	wake;		// signalled when new pass is started
+	std::condition_variable	done;		// signalled when last worker is finished
+	pfnRunThreads		func;
+	int			generation;	// incremented for each pass
+	int			numactive;	// how many workers are participate in current pass
+	int			running;
+	int			numspawned;
+	bool			quit;
+#if XASH_WIN32
+	HANDLE			handles[MAX_THREADS];
+#else
+	pthread_t			handles[MAX_THREADS];
+#endif
+} threadpool_t;
+
 static volatile int		g_oldf = -1;
 static qboolean		g_pacifier = false;
-static volatile int		g_dispatch = 0;
-static volatile int		g_workcount = 0;
+static std::atomic_flag	g_pacifierbusy = ATOMIC_FLAG_INIT;
+static std::atomic<int>	g_dispatch( 0 );
+static int		g_workcount = 0;
+static threadwork_t		g_threadwork[MAX_THREADS];
+static threadpool_t		*g_threadpool;
+static thread_local int	g_threadnum = 0;
+static thread_local bool	g_threadworker = false;
+static pfnThreadWork	g_workfunction;
+static bool		g_threaded = false;
+static bool		g_inpass = false;	// RunThreadsOn is in progress, even on a single thread
+static bool		g_enter;
+static std::mutex		g_crit;
+static int		g_oldnumthreads;
+static int		g_threadcpus[MAX_THREADS];	// cpu index for each worker when pinning is enabled
+static double		g_threadbusy[MAX_THREADS];	// seconds spent in the pass function
+int			g_numthreads = -1;
+bool			g_threadaffinity = false;
 
 void UpdatePacifier( float percent )
 {
@@ -30,7 +95,7 @@ void UpdatePacifier( float percent )
 
 	f = (int)(percent * (float)PACIFIER_STEP);
 	f = bound( g_oldf, f, PACIFIER_STEP );
-	
+
 	if( f != g_oldf )
 	{
 		for( int i = g_oldf + 1; i <= f; i++ )
@@ -66,52 +131,130 @@ void EndPacifier( double total )
 	Msg( " (%.2f secs)\n", total );
 }
 
+/*
+=============
+ThreadPacifier
 
-#if XASH_WIN32
+any thread may update the pacifier, but only one at time.
+if someone else is printing right now just skip the update
+=============
+*/
+static void ThreadPacifier( int dispatch )
+{
+	if( !g_pacifier || g_pacifierbusy.test_and_set( std::memory_order_acquire ))
+		return;
 
-#define THREAD_STACK_SIZE	(4096 * 1024)	// 4 Mb
+	UpdatePacifier( (float)dispatch / g_workcount );
+	g_pacifierbusy.clear( std::memory_order_release );
+}
 
-typedef struct thread_s
+/*
+=============
+PopThreadWork
+
+take next index from the front of own range
+=============
+*/
+static bool PopThreadWork( threadwork_t *tw, int *work )
 {
-	int		number;	// threadnum
-	pfnRunThreads	func;	// thread func
-} thread_t;
+	uint64_t	range = tw->range.load( std::memory_order_acquire );
 
-static HANDLE		g_threadhandles[MAX_THREADS];
-static thread_t		g_threads[MAX_THREADS];
-static qboolean		g_threaded = false;
-static pfnThreadWork	g_workfunction;
-int					g_numthreads = -1;
-static int			g_oldnumthreads;
-static bool			g_enter;
-CRITICAL_SECTION	g_crit;
+	while( WORK_BEGIN( range ) < WORK_END( range ))
+	{
+		int	begin = WORK_BEGIN( range );
+
+		if( tw->range.compare_exchange_weak( range, WORK_RANGE( begin + 1, WORK_END( range )), std::memory_order_acq_rel, std::memory_order_acquire ))
+		{
+			*work = begin;
+			return true;
+		}
+	}
+
+	return false;
+}
 
 /*
 =============
-GetThreadWork
+GrabThreadWork
 
+own range is empty, take next batch from the shared counter
 =============
 */
-int GetThreadWork( void )
+static bool GrabThreadWork( threadwork_t *tw, int *work )
 {
-	int	r;
+	int	dispatch = g_dispatch.load( std::memory_order_relaxed );
+	int	count;
 
-	ThreadLock();
+	do
+	{
+		if( dispatch >= g_workcount )
+			return false;
+
+		count = ( g_workcount - dispatch ) / ( g_numthreads * WORK_BATCH_DIVISOR );
+		count = bound( 1, count, g_workcount - dispatch );
+	} while( !g_dispatch.compare_exchange_weak( dispatch, dispatch + count, std::memory_order_relaxed ));
+
+	// own range is empty so nobody can steal from it while we store the new one
+	tw->range.store( WORK_RANGE( dispatch + 1, dispatch + count ), std::memory_order_release );
+	ThreadPacifier( dispatch );
+	*work = dispatch;
+
+	return true;
+}
 
-	if( g_dispatch == g_workcount )
+/*
+=============
+StealThreadWork
+
+everything is dispatched, cut off the back half of some other thread range
+=============
+*/
+static bool StealThreadWork( int thief, int *work )
+{
+	for( int i = 1; i < g_numthreads; i++ )
 	{
-		ThreadUnlock();
-		return -1;
+		threadwork_t	*victim = &g_threadwork[(thief + i) % g_numthreads];
+		uint64_t		range = victim->range.load( std::memory_order_acquire );
+
+		while( WORK_BEGIN( range ) < WORK_END( range ))
+		{
+			int	begin = WORK_BEGIN( range );
+			int	end = WORK_END( range );
+			int	mid = begin + ( end - begin ) / 2;
+
+			if( victim->range.compare_exchange_weak( range, WORK_RANGE( begin, mid ), std::memory_order_acq_rel, std::memory_order_acquire ))
+			{
+				g_threadwork[thief].range.store( WORK_RANGE( mid + 1, end ), std::memory_order_release );
+				*work = mid;
+				return true;
+			}
+		}
 	}
 
-	if( g_pacifier )
-		UpdatePacifier( (float)g_dispatch / g_workcount );
+	return false;
+}
 
-	r = g_dispatch;
-	g_dispatch++;
-	ThreadUnlock ();
+/*
+=============
+GetThreadWork
+
+=============
+*/
+int GetThreadWork( void )
+{
+	threadwork_t	*tw = &g_threadwork[g_threadnum];
+	int		work;
+
+	if( PopThreadWork( tw, &work ))
+		return work;
+
+	if( GrabThreadWork( tw, &work ))
+		return work;
 
-	return r;
+	if( StealThreadWork( g_threadnum, &work ))
+		return work;
+
+	return -1;
 }
 
 static void ThreadWorkerFunction( int thread )
@@ -126,39 +269,174 @@ static void ThreadWorkerFunction( int thread )
 	}
 }
 
-// This runs in the thread and dispatches a RunThreadsFn call.
-static DWORD WINAPI InternalRunThreadsFn( LPVOID pData )
+/*
+=============
+ThreadWorkerLoop
+
+persistent worker, sleeps between the passes
+=============
+*/
+static void ThreadWorkerLoop( int threadnum )
 {
-	thread_t *pThread = (thread_t *)pData;
+	threadpool_t	*pool = g_threadpool;
+	int		generation = -1;	// new worker is always spawned for the upcoming pass
+	pfnRunThreads	func;
+
+	g_threadnum = threadnum;
+	g_threadworker = true;
+
+	while( 1 )
+	{
+		{
+			std::unique_lock<std::mutex> lock( pool->mutex );
+			pool->wake.wait( lock, [&]() {
+				return pool->quit || ( pool->generation != generation && threadnum < pool->numactive );
+			});
 
-	pThread->func( pThread->number );
+			if( pool->quit )
+				return;
 
+			generation = pool->generation;
+			func = pool->func;
+		}
+
+		double	start = I_FloatTime();
+		func( threadnum );
+		g_threadbusy[threadnum] = I_FloatTime() - start;
+
+		{
+			std::lock_guard<std::mutex> lock( pool->mutex );
+			if( --pool->running == 0 )
+				pool->done.notify_one();
+		}
+	}
+}
+
+#if XASH_WIN32
+static DWORD WINAPI ThreadEntry( LPVOID data )
+{
+	ThreadWorkerLoop( (int)(size_t)data );
 	return 0;
 }
+#else
+static void *ThreadEntry( void *data )
+{
+	ThreadWorkerLoop( (int)(size_t)data );
+	return NULL;
+}
+#endif
 
-void ThreadSetDefault( void )
+static void ThreadSpawn( threadpool_t *pool, int threadnum )
 {
-	SYSTEM_INFO	info;
+#if XASH_WIN32
+	pool->handles[threadnum] = CreateThread( NULL, THREAD_STACK_SIZE, ThreadEntry, (LPVOID)(size_t)threadnum, 0, NULL );
+
+	if( !pool->handles[threadnum] )
+		COM_FatalError( "CreateThread failed\n" );
+
+	if( g_threadaffinity && g_threadcpus[threadnum] < (int)( sizeof( DWORD_PTR ) * 8 ))
+		SetThreadAffinityMask( pool->handles[threadnum], (DWORD_PTR)1 << g_threadcpus[threadnum] );
+#else
+	pthread_attr_t	attrib;
 
-	if( g_numthreads == -1 ) 
+	if( pthread_attr_init( &attrib ) != 0 )
+		COM_FatalError( "pthread_attr_init failed\n" );
+	if( pthread_attr_setstacksize( &attrib, THREAD_STACK_SIZE ) != 0 )
+		COM_FatalError( "pthread_attr_setstacksize failed\n" );
+	if( pthread_create( &pool->handles[threadnum], &attrib, ThreadEntry, (void *)(size_t)threadnum ) != 0 )
+		COM_FatalError( "pthread_create failed\n" );
+	pthread_attr_destroy( &attrib );
+
+#if XASH_LINUX
+	if( g_threadaffinity )
 	{
-		// not set manually
-		GetSystemInfo( &info );
-		g_numthreads = info.dwNumberOfProcessors;
+		cpu_set_t	cpus;
+
+		CPU_ZERO( &cpus );
+		CPU_SET( g_threadcpus[threadnum], &cpus );
+		pthread_setaffinity_np( pool->handles[threadnum], sizeof( cpus ), &cpus );
 	}
+#endif
+#endif
+}
 
-	if( g_numthreads < 1 || g_numthreads > MAX_THREADS )
-		g_numthreads = 1;
+static void ThreadJoin( threadpool_t *pool, int threadnum )
+{
+#if XASH_WIN32
+	WaitForSingleObject( pool->handles[threadnum], INFINITE );
+	CloseHandle( pool->handles[threadnum] );
+#else
+	pthread_join( pool->handles[threadnum], NULL );
+#endif
+}
 
-	MsgDev( D_REPORT, "%i threads\n", g_numthreads );
-	g_oldnumthreads = g_numthreads;
+/*
+=============
+ThreadShutdown
+
+stop the workers at exit
+=============
+*/
+static void ThreadShutdown( void )
+{
+	threadpool_t	*pool = g_threadpool;
+
+	// fatal error from a worker or in the middle of the pass,
+	// we can't wait for threads, so leave it to the OS
+	if( !pool || g_threadworker || pool->running > 0 )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( pool->mutex );
+		pool->quit = true;
+	}
+	pool->wake.notify_all();
+
+	for( int i = 0; i < pool->numspawned; i++ )
+		ThreadJoin( pool, i );
+
+	delete pool;
+	g_threadpool = NULL;
+}
+
+/*
+=============
+ThreadPoolRun
+
+run func on numthreads workers and wait until all of them are finished.
+workers are created once at first use and stays alive until exit
+=============
+*/
+static void ThreadPoolRun( int numthreads, pfnRunThreads func )
+{
+	threadpool_t	*pool = g_threadpool;
+
+	if( !pool )
+	{
+		pool = g_threadpool = new threadpool_t();
+		atexit( ThreadShutdown );
+	}
+
+	while( pool->numspawned < numthreads )
+	{
+		ThreadSpawn( pool, pool->numspawned );
+		pool->numspawned++;
+	}
+
+	std::unique_lock<std::mutex> lock( pool->mutex );
+	pool->func = func;
+	pool->numactive = numthreads;
+	pool->running = numthreads;
+	pool->generation++;
+	pool->wake.notify_all();
+	pool->done.wait( lock, [&]() { return pool->running == 0; });
 }
 
 void ThreadLock( void )
 {
 	if( !g_threaded ) return;
 
-	EnterCriticalSection( &g_crit );
+	g_crit.lock();
 
 	if( g_enter ) COM_FatalError( "recursive ThreadLock\n" );
 	g_enter = true;
@@ -171,7 +449,7 @@ void ThreadUnlock( void )
 	if( !g_enter ) COM_FatalError( "ThreadUnlock without lock\n" );
 	g_enter = false;
 
-	LeaveCriticalSection( &g_crit );
+	g_crit.unlock();
 }
 
 bool ThreadLocked( void )
@@ -179,6 +457,19 @@ bool ThreadLocked( void )
 	return g_enter;
 }
 
+/*
+=============
+ThreadActive
+
+the pool is not reentrant, so code that may be called
+from a work function should run serially when this is set
+=============
+*/
+bool ThreadActive( void )
+{
+	return g_inpass || g_threadworker;
+}
+
 void ThreadPush( void )
 {
 	g_numthreads = 1;
@@ -189,163 +480,283 @@ void ThreadPop( void )
 	g_numthreads = g_oldnumthreads;
 }
 
+#if XASH_LINUX
 /*
 =============
-RunThreadsOn
+ThreadParseCPUList
+
+parse linux cpu list like "0-7,16-23"
 =============
 */
-void RunThreadsOn( int workcnt, bool showpacifier, pfnRunThreads func )
+static int ThreadParseCPUList( const char *filename, cpu_set_t *cpus )
 {
-	double	start, end;
-	DWORD	dwDummy;
-	int	i;
+	FILE	*f = fopen( filename, "r" );
+	int	first, last, count = 0;
+	char	sep;
 
-	if( showpacifier )
-	{
-		if( g_numthreads == 1 )
-			Msg( " (single-threaded)\n" );
-		else Msg( "\n" );
-	}
+	CPU_ZERO( cpus );
 
-	start = I_FloatTime();
-	g_pacifier = showpacifier;
-	g_workcount = workcnt;
-	g_dispatch = 0;
-	if( g_pacifier ) StartPacifier();
+	if( !f ) return 0;
 
-	if( g_numthreads == 1 )
-	{	
-		// use same thread
-		func( 0 );
-	}
-	else
+	while( fscanf( f, "%d", &first ) == 1 )
 	{
-		// run threads in parallel
-		InitializeCriticalSection( &g_crit );
-		g_threaded = true;
+		last = first;
+		sep = fgetc( f );
 
-		for( i = 0; i < g_numthreads; i++ )
+		if( sep == '-' )
 		{
-			g_threads[i].number = i;
-			g_threads[i].func = func;
-
-			g_threadhandles[i] = CreateThread( NULL, THREAD_STACK_SIZE, InternalRunThreadsFn, &g_threads, 0, &dwDummy );
+			if( fscanf( f, "%d", &last ) != 1 )
+				break;
+			sep = fgetc( f );
 		}
 
-		WaitForMultipleObjects( g_numthreads, g_threadhandles, TRUE, INFINITE );
+		for( int i = first; i <= last && i < CPU_SETSIZE; i++, count++ )
+			CPU_SET( i, cpus );
 
-		for ( i = 0; i < g_numthreads; i++ )
-			CloseHandle( g_threadhandles[i] );
-
-		DeleteCriticalSection( &g_crit );
-		g_threaded = false;
+		if( sep != ',' ) break;
 	}
 
-	end = I_FloatTime ();
+	fclose( f );
 
-	if( g_pacifier ) EndPacifier( end - start );
+	return count;
 }
 
-void RunThreadsOnIndividual( int workcnt, bool showpacifier, pfnThreadWork func )
-{
-	g_workfunction = func;
-	RunThreadsOn( workcnt, showpacifier, ThreadWorkerFunction );
-}
+/*
+=============
+ThreadCgroupQuota
 
-void RunThreadsOnIncremental( int workcnt, bool showpacifier, pfnRunThreads func )
+returns number of cpus allowed by cgroup cpu bandwidth limit or 0 if unlimited
+=============
+*/
+static int ThreadCgroupQuota( void )
 {
-	RunThreadsOn( workcnt, showpacifier, func );
-}
+	long long	quota = -1, period = 0;
+	char	line[512], path[MAX_PATH];
+	FILE	*f;
 
-#elif XASH_POSIX
-#define Error COM_FatalError
+	// cgroup v2, check the own group first and then the root
+	path[0] = '\0';
 
-static pfnThreadWork	g_workfunction;
-static pfnRunThreads	g_runfunction;
+	if(( f = fopen( "/proc/self/cgroup", "r" )) != NULL )
+	{
+		while( fgets( line, sizeof( line ), f ))
+		{
+			if( !Q_strncmp( line, "0::", 3 ))
+			{
+				line[strcspn( line, "\r\n" )] = '\0';
+				Q_snprintf( path, sizeof( path ), "/sys/fs/cgroup%s/cpu.max", line + 3 );
+				break;
+			}
+		}
+		fclose( f );
+	}
 
+	if(( path[0] && ( f = fopen( path, "r" )) != NULL ) || ( f = fopen( "/sys/fs/cgroup/cpu.max", "r" )) != NULL )
+	{
+		char	value[32];
 
-qboolean	threaded;
+		if( fscanf( f, "%31s %lld", value, &period ) == 2 && Q_strcmp( value, "max" ))
+			quota = atoll( value );
+		fclose( f );
+	}
+	else if(( f = fopen( "/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r" )) != NULL )
+	{
+		// cgroup v1
+		if( fscanf( f, "%lld", &quota ) != 1 )
+			quota = -1;
+		fclose( f );
 
-#define	USED
+		if(( f = fopen( "/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r" )) != NULL )
+		{
+			if( fscanf( f, "%lld", &period ) != 1 )
+				period = 0;
+			fclose( f );
+		}
+	}
 
-int		g_numthreads = 4;
+	if( quota <= 0 || period <= 0 )
+		return 0;
 
-void ThreadSetDefault (void)
-{
-	g_numthreads = 4;
+	return (int)Q_max( 1, ( quota + period - 1 ) / period );
 }
+#endif
 
-#include <pthread.h>
-
-pthread_mutex_t	*my_mutex;
+/*
+=============
+ThreadNumCPUs
 
-void ThreadLock (void)
+how many cpus available for the process
+=============
+*/
+static int ThreadNumCPUs( void )
 {
-	if (my_mutex)
-		pthread_mutex_lock (my_mutex);
-}
+#if XASH_WIN32
+	SYSTEM_INFO	info;
+	DWORD_PTR		processMask, systemMask;
 
-void ThreadUnlock (void)
-{
-	if (my_mutex)
-		pthread_mutex_unlock (my_mutex);
+	if( GetProcessAffinityMask( GetCurrentProcess(), &processMask, &systemMask ))
+	{
+		int	count = 0;
+
+		for( ; processMask; processMask &= processMask - 1 )
+			count++;
+
+		if( count > 0 ) return count;
+	}
+
+	GetSystemInfo( &info );
+	return info.dwNumberOfProcessors;
+#elif XASH_LINUX
+	cpu_set_t	cpus;
+	int	count = 0;
+	int	quota;
+
+	if( sched_getaffinity( 0, sizeof( cpus ), &cpus ) == 0 )
+		count = CPU_COUNT( &cpus );
+
+	if( count <= 0 )
+		count = (int)sysconf( _SC_NPROCESSORS_ONLN );
+
+	// containers usually limits the cpu time rather than affinity
+	if(( quota = ThreadCgroupQuota( )) > 0 )
+		count = Q_min( count, quota );
+
+	return count;
+#else
+	return (int)sysconf( _SC_NPROCESSORS_ONLN );
+#endif
 }
 
 /*
 =============
-GetThreadWork
+ThreadSetupAffinity
 
+assign cpu for every worker. Threads are spread over NUMA nodes
+in round-robin order so each node gets equal share of the workers
 =============
 */
-int GetThreadWork( void )
+static void ThreadSetupAffinity( void )
 {
-	int	r;
+	int	nodecpus[MAX_THREADS][MAX_THREADS];
+	int	nodecount[MAX_THREADS];
+	int	numnodes = 0;
+
+	memset( nodecount, 0, sizeof( nodecount ));
 
-	ThreadLock();
+#if XASH_WIN32
+	ULONG	highest = 0;
 
-	if( g_dispatch == g_workcount )
+	if( !GetNumaHighestNodeNumber( &highest ))
+		highest = 0;
+
+	for( ULONG node = 0; node <= highest && numnodes < MAX_THREADS; node++ )
 	{
-		ThreadUnlock();
-		return -1;
+		ULONGLONG	mask = 0;
+
+		if( !GetNumaNodeProcessorMask( (UCHAR)node, &mask ) || !mask )
+			continue;
+
+		for( int cpu = 0; cpu < 64 && nodecount[numnodes] < MAX_THREADS; cpu++ )
+		{
+			if( mask & ( 1ULL << cpu ))
+				nodecpus[numnodes][nodecount[numnodes]++] = cpu;
+		}
+		numnodes++;
 	}
+#elif XASH_LINUX
+	cpu_set_t	allowed, nodeset;
+	char	path[MAX_PATH];
 
-	if( g_pacifier )
-		UpdatePacifier( (float)g_dispatch / g_workcount );
+	if( sched_getaffinity( 0, sizeof( allowed ), &allowed ) != 0 )
+		return;
 
-	r = g_dispatch;
-	g_dispatch++;
-	ThreadUnlock ();
+	for( int node = 0; node < MAX_THREADS && numnodes < MAX_THREADS; node++ )
+	{
+		Q_snprintf( path, sizeof( path ), "/sys/devices/system/node/node%d/cpulist", node );
+		if( !ThreadParseCPUList( path, &nodeset ))
+			continue;
 
-	return r;
-}
+		for( int cpu = 0; cpu < CPU_SETSIZE && nodecount[numnodes] < MAX_THREADS; cpu++ )
+		{
+			if( CPU_ISSET( cpu, &nodeset ) && CPU_ISSET( cpu, &allowed ))
+				nodecpus[numnodes][nodecount[numnodes]++] = cpu;
+		}
 
-static void ThreadWorkerFunction( int thread )
-{
-	int work;
+		if( nodecount[numnodes] > 0 )
+			numnodes++;
+	}
 
-	while( 1 )
+	if( !numnodes )
 	{
-		work = GetThreadWork ();
-		if( work == -1 ) break;
-		g_workfunction( work, thread );
+		// no NUMA info, treat all the allowed cpus as single node
+		for( int cpu = 0; cpu < CPU_SETSIZE && nodecount[0] < MAX_THREADS; cpu++ )
+		{
+			if( CPU_ISSET( cpu, &allowed ))
+				nodecpus[0][nodecount[0]++] = cpu;
+		}
+		numnodes = nodecount[0] ? 1 : 0;
+	}
+#endif
+	if( !numnodes )
+	{
+		MsgDev( D_WARN, "couldn't get cpu topology, thread affinity is disabled\n" );
+		g_threadaffinity = false;
+		return;
 	}
-}
 
-static void *ThreadRunFunction( void *data )
-{
-	g_runfunction( (size_t)data );
-	return NULL;
+	for( int i = 0; i < MAX_THREADS; i++ )
+	{
+		int	node = i % numnodes;
+		int	slot = ( i / numnodes ) % nodecount[node];
+
+		g_threadcpus[i] = nodecpus[node][slot];
+	}
+
+	MsgDev( D_REPORT, "pinning threads to cpus over %i NUMA node%s\n", numnodes, numnodes > 1 ? "s" : "" );
 }
 
-void RunThreadsOnIndividual( int workcnt, bool showpacifier, pfnThreadWork func )
+void ThreadSetDefault( void )
 {
-	g_workfunction = func;
-	RunThreadsOn( workcnt, showpacifier, ThreadWorkerFunction );
+	if( g_numthreads == -1 )
+	{
+		// not set manually
+		g_numthreads = bound( 1, ThreadNumCPUs(), MAX_THREADS );
+	}
+
+	if( g_numthreads < 1 || g_numthreads > MAX_THREADS )
+		g_numthreads = 1;
+
+	if( g_threadaffinity )
+		ThreadSetupAffinity();
+
+	MsgDev( D_REPORT, "%i threads\n", g_numthreads );
+	g_oldnumthreads = g_numthreads;
 }
 
-void RunThreadsOnIncremental( int workcnt, bool showpacifier, pfnRunThreads func )
+/*
+=============
+ThreadReportUsage
+
+how much of the pass time workers were actually busy.
+low value means that few heavy items at end of the pass
+keeps the rest of threads idle
+=============
+*/
+static void ThreadReportUsage( double total )
 {
-	RunThreadsOn( workcnt, showpacifier, func );
+	double	sum = 0.0, minbusy = total;
+
+	if( total <= 0.0 )
+		return;
+
+	for( int i = 0; i < g_numthreads; i++ )
+	{
+		sum += g_threadbusy[i];
+		minbusy = Q_min( minbusy, g_threadbusy[i] );
+	}
+
+	MsgDev( D_REPORT, "thread utilization %.1f%% (min %.1f%%) on %i threads\n",
+		sum * 100.0 / ( total * g_numthreads ), minbusy * 100.0 / total, g_numthreads );
 }
 
 /*
@@ -353,65 +764,61 @@ void RunThreadsOnIncremental( int workcnt, bool showpacifier, pfnRunThreads func
 RunThreadsOn
 =============
 */
-void RunThreadsOn (int workcnt, bool showpacifier, pfnRunThreads func )
+void RunThreadsOn( int workcnt, bool showpacifier, pfnRunThreads func )
 {
-	g_runfunction  = func;
-
-	size_t		i;
-	pthread_t	work_threads[MAX_THREADS];
-	void *status;
-	pthread_attr_t	attrib;
-	pthread_mutexattr_t	mattrib;
-	int		start, end;
+	double	start, end;
 
-	start = I_FloatTime ();
-	g_dispatch = 0;
-	g_workcount = workcnt;
-	g_pacifier = showpacifier;
-	threaded = true;
+	g_numthreads = bound( 1, g_numthreads, MAX_THREADS );
 
 	if( showpacifier )
 	{
-		if( g_numthreads == 1 ) Msg( " (single-threaded)\n" );
+		if( g_numthreads == 1 )
+			Msg( " (single-threaded)\n" );
 		else Msg( "\n" );
-        }
+	}
+
+	start = I_FloatTime();
+	g_pacifier = showpacifier;
+	g_workcount = workcnt;
+	g_dispatch.store( 0 );
 
-	if (g_pacifier)
-		StartPacifier();
+	for( int i = 0; i < g_numthreads; i++ )
+		g_threadwork[i].range.store( WORK_RANGE( 0, 0 ));
 
-	if (!my_mutex)
-	{
-		my_mutex = (pthread_mutex_t*)Mem_Alloc (sizeof(*my_mutex));
-		if (pthread_mutexattr_init (&mattrib) == -1)
-			Error ("pthread_mutex_attr_create failed");
-		if (pthread_mutex_init (my_mutex, &mattrib) == -1)
-			Error ("pthread_mutex_init failed");
-	}
+	if( g_pacifier ) StartPacifier();
 
-	if (pthread_attr_init (&attrib) == -1)
-		Error ("pthread_attr_create failed");
-	if (pthread_attr_setstacksize (&attrib, 0x100000) == -1)
-		Error ("pthread_attr_setstacksize failed");
+	g_inpass = true;
 
-	for (i=0 ; i<g_numthreads ; i++)
+	if( g_numthreads == 1 )
 	{
-  		if (pthread_create(&work_threads[i], &attrib
-		, ThreadRunFunction, (void*)i) == -1)
-			Error ("pthread_create failed");
+		// use same thread
+		func( 0 );
 	}
-
-	for (i=0 ; i<g_numthreads ; i++)
+	else
 	{
-		if (pthread_join (work_threads[i], &status) == -1)
-			Error ("pthread_join failed");
+		// run threads in parallel
+		g_threaded = true;
+		ThreadPoolRun( g_numthreads, func );
+		g_threaded = false;
 	}
 
-	threaded = false;
+	g_inpass = false;
 
 	end = I_FloatTime ();
 
 	if( g_pacifier ) EndPacifier( end - start );
+
+	if( showpacifier && g_numthreads > 1 )
+		ThreadReportUsage( end - start );
 }
 
+void RunThreadsOnIndividual( int workcnt, bool showpacifier, pfnThreadWork func )
+{
+	g_workfunction = func;
+	RunThreadsOn( workcnt, showpacifier, ThreadWorkerFunction );
+}
 
-#endif
+void RunThreadsOnIncremental( int workcnt, bool showpacifier, pfnRunThreads func )
+{
+	RunThreadsOn( workcnt, showpacifier, func );
+}
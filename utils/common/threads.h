@@ -9,6 +9,7 @@
 ****/
 
 extern int g_numthreads;
+extern bool g_threadaffinity;
 
 #define MAX_THREADS		128
 
@@ -23,6 +24,7 @@ void RunThreadsOnIncremental( int workcnt, bool showpacifier, pfnRunThreads func
 void RunThreadsOn( int workcnt, bool showpacifier, pfnRunThreads func );
 
 bool ThreadLocked( void );
+bool ThreadActive( void );
 void ThreadLock( void );
 void ThreadUnlock( void );
 void ThreadPush( void );
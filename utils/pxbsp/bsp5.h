@@ -13,6 +13,7 @@
 #include "cmdlib.h"
 #include "mathlib.h"
 #include "bspfile.h"
+#include "hullfile.h"
 #include "threads.h"
 #include "polylib.h"
 #include "stringlib.h"
@@ -175,6 +176,7 @@ void SplitFaceEpsilon( face_t *in, plane_t *split, face_t **front, face_t **back
 void DivideFacet( face_t *in, plane_t *split, face_t **front, face_t **back );
 void CalcSurfaceInfo( surface_t *surf );
 void SubdivideFace( face_t *f, face_t **prevptr );
+void CalcMaxNodeSize( tree_t *tree );
 void SolidBSP( tree_t *tree, int modnum, int hullnum );
 vec_t SplitPlaneMetric( const plane_t *p, const vec3_t mins, const vec3_t maxs );
 void MakeNodePortal( node_t *node );
@@ -207,6 +209,7 @@ void InitHash( void );
 
 void AddPortalToNodes( portal_t *p, node_t *front, node_t *back );
 void RemovePortalFromNode( portal_t *portal, node_t *l );
+void MakeHeadnodePlanes( const vec3_t mins, const vec3_t maxs );
 void MakeHeadnodePortals( node_t *node, const vec3_t mins, const vec3_t maxs );
 void FreeTreePortals( tree_t *tree );
 void WritePortalfile( tree_t *tree, bool leaked );
@@ -216,7 +219,7 @@ void FillInside( node_t *node );
 
 // detail.c
 
-brush_t *ReadBrushes( FILE *file );
+brush_t *ReadBrushes( hullstream_t *stream );
 
 //=============================================================================
 
@@ -228,7 +231,7 @@ surface_t *SelectPartition( surface_t *surfaces, node_t *node, bool midsplit, in
 
 tree_t *AllocTree( void );
 void FreeTree( tree_t *t );
-tree_t *MakeTreeFromHullFaces( FILE *polyfile, FILE *brushfile );
+tree_t *MakeTreeFromHullFaces( hullstream_t *polys, hullstream_t *brushes );
 tree_t *TreeProcessModel( tree_t *tree, int modnum, int hullnum );
 void MakeSurflistFromValidFaces( tree_t *tree );
 bool CheckFaceForHint( const face_t *f );
@@ -274,9 +277,10 @@ extern int	g_merge_level;
 extern vec_t	g_prtepsilon;
 extern size_t	g_compatibility_mode;
 
-extern int	valid;
-extern int	c_splitnodes;
-extern int	c_unsplitted_faces;
+// per-thread, hulls and brush models are built concurrently
+extern thread_local int	valid;
+extern thread_local int	c_splitnodes;
+extern thread_local int	c_unsplitted_faces;
 
 extern char	g_portfilename[1024];
 extern char	g_pointfilename[1024];
@@ -284,7 +288,7 @@ extern char	g_linefilename[1024];
 
 extern plane_t	g_mapplanes[MAX_INTERNAL_MAP_PLANES];
 extern int	g_nummapplanes;
-extern node_t	g_outside_node;
+extern thread_local node_t	g_outside_node;
 
 void AddFaceToBounds( face_t *f, vec3_t mins, vec3_t maxs );
 
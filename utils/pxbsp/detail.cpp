@@ -221,24 +221,23 @@ void CalcBrushBounds( const brush_t *b, vec3_t &mins, vec3_t &maxs )
 	}
 }
 
-brush_t *ReadBrushes( FILE *file )
+brush_t *ReadBrushes( hullstream_t *stream )
 {
-	brush_t	*brushes = NULL;
-	int	planenum, numpoints;
-	int	r, brushinfo;
+	const dhullbrush_t	*in;
+	brush_t		*brushes = NULL;
 
 	while( 1 )
 	{
-		r = fscanf( file, "%i\n", &brushinfo );
-
-		if( r == 0 || r == -1 )
+		if( HullStreamEnd( stream ))
 		{
 			if( brushes == NULL )
 				COM_FatalError( "ReadBrushes: no more models\n" );
 			else COM_FatalError( "ReadBrushes: file end\n" );
 		}
 
-		if( brushinfo == -1 )
+		in = (const dhullbrush_t *)HullStreamRead( stream, sizeof( dhullbrush_t ));
+
+		if( in->numsides == -1 )
 			break; // end of detail brushes list
 
 		brush_t *b;
@@ -248,27 +247,23 @@ brush_t *ReadBrushes( FILE *file )
 		side_t **psn;
 		psn = &b->sides;
 
-		while( 1 )
+		for( int i = 0; i < in->numsides; i++ )
 		{
+			const dhullside_t *side = (const dhullside_t *)HullStreamRead( stream, sizeof( dhullside_t ));
 
-			r = fscanf( file, "%i %u\n", &planenum, &numpoints );
-			if( r != 2 ) COM_FatalError( "ReadBrushes: get side failed\n" );
+			if( side->planenum < 0 || side->planenum >= g_nummapplanes || side->numpoints < 0 )
+				COM_FatalError( "ReadBrushes: bad side (plane %i, %i points)\n", side->planenum, side->numpoints );
 
-			if( planenum == -1 )
-				break; // end of brushes description
+			int numpoints = side->numpoints;
+			const dhullpoint_t *points = (const dhullpoint_t *)HullStreamRead( stream, numpoints * sizeof( dhullpoint_t ));
 
 			side_t *s = AllocSide();
-			s->plane = g_mapplanes[planenum ^ 1];
+			s->plane = g_mapplanes[side->planenum ^ 1];
 			s->w = AllocWinding( numpoints );
 			s->w->numpoints = numpoints;
 
 			for( int x = 0; x < numpoints; x++ )
-			{
-				double v[3];
-				r = fscanf( file, "%lf %lf %lf\n", &v[0], &v[1], &v[2] );
-				if( r != 3 ) COM_FatalError( "ReadBrushes: get point failed\n" );
-				VectorCopy( v, s->w->p[numpoints - 1 - x] );
-			}
+				VectorCopy( points[x].point, s->w->p[numpoints - 1 - x] );
 
 			s->next = NULL;
 			*psn = s;
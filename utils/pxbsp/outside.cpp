@@ -10,16 +10,17 @@
 
 #include "bsp5.h"
 
-int	outleafs;
-int	valid;
-int	c_falsenodes;
-int	c_free_faces;
-int	c_keep_faces;
-portal_t	*prevleaknode;
-FILE	*pointfile = NULL;
-FILE	*linefile = NULL;
-int	hit_occupied;
-int	backdraw;
+// flood state is per-thread, the clipping hulls are filled concurrently
+thread_local int	outleafs;
+thread_local int	valid;
+thread_local int	c_falsenodes;
+thread_local int	c_free_faces;
+thread_local int	c_keep_faces;
+thread_local portal_t	*prevleaknode;
+FILE		*pointfile = NULL;	// only the drawing hull writes the leak files
+FILE		*linefile = NULL;
+thread_local int	hit_occupied;
+thread_local int	backdraw;
 
 /*
 ===========
@@ -389,9 +390,13 @@ bool FillOutside( tree_t *tree, int hullnum, bool leakfile )
 
 	if( RecursiveFillOutside( g_outside_node.portals->nodes[s], false, leakfile ))
 	{
-		if( pointfile ) fclose( pointfile );
-		if( linefile ) fclose( linefile );
-		pointfile = linefile = NULL;
+		// clipping hulls are filled at the same time and never own the leak files
+		if( leakfile )
+		{
+			if( pointfile ) fclose( pointfile );
+			if( linefile ) fclose( linefile );
+			pointfile = linefile = NULL;
+		}
 		leaked = true;
 
 		// do animation
@@ -423,7 +428,8 @@ bool FillOutside( tree_t *tree, int hullnum, bool leakfile )
 	MsgDev( D_REPORT, "%5i freed faces\n", c_free_faces );
 	MsgDev( D_REPORT, "%5i keep faces\n", c_keep_faces );
 	MsgDev( D_REPORT, "%5i falsenodes\n", c_falsenodes );
-	Msg( "%i nodes (%i after merging)\n", c_nodes, c_splitnodes );
+	if( leakfile ) Msg( "%i nodes (%i after merging)\n", c_nodes, c_splitnodes );
+	else MsgDev( D_REPORT, "%i nodes (%i after merging)\n", c_nodes, c_splitnodes );
 
 	// save portal file for vis tracing
 	if( leakfile ) WritePortalfile( tree, leaked );
@@ -48,7 +48,9 @@ typedef struct
 	markfaces_t	*middle;	// may contains coplanar faces and discardable(SOLIDHINT) faces
 } surftree_t;
 
-static double	g_splitvalue[MAX_INTERNAL_MAP_PLANES][2];
+// scratch for ChoosePlaneFromList, every building thread keeps its own
+static thread_local double	(*g_splitvalue)[2];
+static thread_local int	g_maxsplitvalues;
 
 // organize all surfaces into a tree structure to accelerate intersection test
 // can reduce more than 90% compile time for very complicated maps
@@ -537,6 +539,13 @@ surface_t *ChoosePlaneFromList( surface_t *surfaces, const vec3_t mins, const ve
 	plane_t		*plane;
 	face_t		*f, **fp;
 
+	if( g_maxsplitvalues < g_nummapplanes )
+	{
+		Mem_Free( g_splitvalue );
+		g_splitvalue = (double (*)[2])Mem_Alloc( g_nummapplanes * sizeof( *g_splitvalue ));
+		g_maxsplitvalues = g_nummapplanes;
+	}
+
 	planecount = totalsplit = 0;
 	surfacetree = BuildSurfaceTree( surfaces, BSPCHOP_EPSILON );
 
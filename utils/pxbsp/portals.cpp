@@ -11,7 +11,7 @@
 #include "bsp5.h"
 
 
-node_t	g_outside_node;		// portals outside the world face this
+thread_local node_t	g_outside_node;	// portals outside the world face this, one per building thread
 
 //=============================================================================
 /*
@@ -80,36 +80,28 @@ void PrintPortal( portal_t *p )
 
 /*
 ================
-MakeHeadnodePortals
+HeadnodePlanes
 
-The created portals will face the global outside_node
+six planes that enclose the model bounds
 ================
 */
-void MakeHeadnodePortals( node_t *node, const vec3_t mins, const vec3_t maxs )
+static void HeadnodePlanes( const vec3_t mins, const vec3_t maxs, plane_t bplanes[6] )
 {
 	vec3_t	bounds[2];
-	portal_t	*p, *portals[6];
-	plane_t	bplanes[6], *pl;
-	int	i, j, n;
+	plane_t	*pl;
+	int	i, j;
 
 	// pad with some space so there will never be null volume leafs
 	VectorCopy( mins, bounds[0] );
 	VectorCopy( maxs, bounds[1] );
 
 	ExpandBounds( bounds[0], bounds[1], SIDESPACE );
-	g_outside_node.contents = CONTENTS_SOLID;
-	g_outside_node.portals = NULL;
 
 	for( i = 0; i < 3; i++ )
 	{
 		for( j = 0; j < 2; j++ )
 		{
-			n = j * 3 + i;
-
-			p = AllocPortal ();
-			portals[n] = p;
-			
-			pl = &bplanes[n];
+			pl = &bplanes[j * 3 + i];
 			memset( pl, 0, sizeof( *pl ));
 
 			if( j )
@@ -122,6 +114,61 @@ void MakeHeadnodePortals( node_t *node, const vec3_t mins, const vec3_t maxs )
 				pl->normal[i] = 1;
 				pl->dist = bounds[j][i];
 			}
+		}
+	}
+}
+
+/*
+================
+MakeHeadnodePlanes
+
+register the headnode planes before the trees are built in parallel,
+so FindFloatPlane never has to add planes from the worker threads and
+the plane numbers stay the same as with serial processing
+================
+*/
+void MakeHeadnodePlanes( const vec3_t mins, const vec3_t maxs )
+{
+	plane_t	bplanes[6];
+
+	HeadnodePlanes( mins, maxs, bplanes );
+
+	for( int i = 0; i < 3; i++ )
+	{
+		for( int j = 0; j < 2; j++ )
+		{
+			plane_t	*pl = &bplanes[j * 3 + i];
+			FindFloatPlane( pl->normal, pl->dist );
+		}
+	}
+}
+
+/*
+================
+MakeHeadnodePortals
+
+The created portals will face the global outside_node
+================
+*/
+void MakeHeadnodePortals( node_t *node, const vec3_t mins, const vec3_t maxs )
+{
+	portal_t	*p, *portals[6];
+	plane_t	bplanes[6], *pl;
+	int	i, j, n;
+
+	HeadnodePlanes( mins, maxs, bplanes );
+	g_outside_node.contents = CONTENTS_SOLID;
+	g_outside_node.portals = NULL;
+
+	for( i = 0; i < 3; i++ )
+	{
+		for( j = 0; j < 2; j++ )
+		{
+			n = j * 3 + i;
+
+			p = AllocPortal ();
+			portals[n] = p;
+			pl = &bplanes[n];
 
 			p->planenum = FindFloatPlane( pl->normal, pl->dist );
 			p->winding = BaseWindingForPlane( pl->normal, pl->dist );
@@ -14,6 +14,7 @@
 #include "crashhandler.h"
 #include "app_info.h"
 #include "build_info.h"
+#include <atomic>
 
 //
 // command line flags
@@ -179,15 +180,24 @@ void SplitFace( face_t *in, plane_t *split, face_t **front, face_t **back, bool
 
 //===========================================================================
 
-int	c_activefaces, c_peakfaces;
-int	c_activesurfaces, c_peaksurfaces;
-int	c_activeportals, c_peakportals;
+// trees are built from several threads at once
+std::atomic<int>	c_activefaces, c_peakfaces;
+std::atomic<int>	c_activesurfaces, c_peaksurfaces;
+std::atomic<int>	c_activeportals, c_peakportals;
+
+static void CountAlloc( std::atomic<int> &active, std::atomic<int> &peak )
+{
+	int	count = ++active;
+	int	prev = peak.load();
+
+	while( count > prev && !peak.compare_exchange_weak( prev, count ));
+}
 
 void PrintMemory( void )
 {
-	Msg( "faces   : %6i (%6i)\n", c_activefaces, c_peakfaces );
-	Msg( "surfaces: %6i (%6i)\n", c_activesurfaces, c_peaksurfaces );
-	Msg( "portals : %6i (%6i)\n", c_activeportals, c_peakportals );
+	Msg( "faces   : %6i (%6i)\n", c_activefaces.load(), c_peakfaces.load() );
+	Msg( "surfaces: %6i (%6i)\n", c_activesurfaces.load(), c_peaksurfaces.load() );
+	Msg( "portals : %6i (%6i)\n", c_activeportals.load(), c_peakportals.load() );
 }
 
 /*
@@ -199,10 +209,7 @@ face_t *AllocFace( void )
 {
 	face_t	*f;
 	
-	c_activefaces++;
-
-	if( c_activefaces > c_peakfaces )
-		c_peakfaces = c_activefaces;
+	CountAlloc( c_activefaces, c_peakfaces );
 		
 	f = (face_t *)Mem_Alloc( sizeof( face_t ), C_SURFACE );
 	f->planenum = -1;
@@ -291,10 +298,7 @@ surface_t *AllocSurface( void )
 {
 	surface_t	*s;
 
-	c_activesurfaces++;
-
-	if( c_activesurfaces > c_peaksurfaces )
-		c_peaksurfaces = c_activesurfaces;
+	CountAlloc( c_activesurfaces, c_peaksurfaces );
 	
 	s = (surface_t *)Mem_Alloc( sizeof( surface_t ), C_SURFACE );
 	ClearBounds( s->mins, s->maxs );
@@ -321,9 +325,7 @@ AllocPortal
 */
 portal_t *AllocPortal( void )
 {
-	c_activeportals++;
-	if( c_activeportals > c_peakportals )
-		c_peakportals = c_activeportals;
+	CountAlloc( c_activeportals, c_peakportals );
 	
 	return (portal_t *)Mem_Alloc( sizeof( portal_t ), C_PORTAL );
 }
@@ -372,53 +374,170 @@ void FreeLeaf( node_t *n )
 }
 
 //===========================================================================
+typedef struct
+{
+	tree_t	*trees[MAX_MAP_MODELS];
+	int	numtrees;
+} hulltrees_t;
+
+static hulltrees_t	g_hulltrees[MAX_MAP_HULLS];
+
 /*
 =================
-CreateSingleHull
+OpenHullFile
+
+map the binary hull file written by pxcsg
 =================
 */
-void CreateSingleHull( const char *source, int hullnum )
+static byte *OpenHullFile( const char *name, int hullnum, hullstream_t *stream, size_t *filesize )
 {
-	int	modnum = 0;
-	FILE	*brushfile;
-	FILE	*polyfile;
-	char	name[1024];
-	tree_t	*tree;
+	const dhullheader_t	*header;
+	byte		*base;
 
-	Msg( "CreateHull: %i\n", hullnum );
+	base = COM_MapFile( name, filesize );
+	if( !base ) COM_FatalError( "Can't open %s", name );
 
-	Q_snprintf( name, sizeof( name ), "%s.p%i", source, hullnum );
-	polyfile = fopen( name, "r" );
-	if (!polyfile) {
-		COM_FatalError("Can't open %s", name);
-		return;
+	header = (const dhullheader_t *)base;
+
+	if( *filesize < sizeof( dhullheader_t ) || header->ident != HULLFILE_IDENT )
+		COM_FatalError( "%s is not a hull file\n", name );
+
+	if( header->version != HULLFILE_VERSION )
+		COM_FatalError( "%s has wrong version %i (should be %i)\n", name, header->version, HULLFILE_VERSION );
+
+	if( header->hullnum != hullnum )
+		COM_FatalError( "%s contains hull %i (should be %i)\n", name, header->hullnum, hullnum );
+
+	stream->pos = base + sizeof( dhullheader_t );
+	stream->end = base + *filesize;
+	stream->name = name;
+
+	return base;
+}
+
+/*
+=================
+ReadHullTrees
+
+load all the models of a hull. Everything what depends
+on the processing order is done here, so the trees can
+be built in any order afterwards
+=================
+*/
+void ReadHullTrees( const char *source, int hullnum )
+{
+	hulltrees_t	*hull = &g_hulltrees[hullnum];
+	hullstream_t	polys, brushes;
+	char		polyname[1024];
+	char		brushname[1024];
+	size_t		polysize, brushsize;
+	byte		*polyfile;
+	byte		*brushfile;
+	tree_t		*tree;
+
+	Q_snprintf( polyname, sizeof( polyname ), "%s.p%i", source, hullnum );
+	polyfile = OpenHullFile( polyname, hullnum, &polys, &polysize );
+
+	Q_snprintf( brushname, sizeof( brushname ), "%s.b%i", source, hullnum );
+	brushfile = OpenHullFile( brushname, hullnum, &brushes, &brushsize );
+
+	while(( tree = MakeTreeFromHullFaces( &polys, &brushes )) != NULL )
+	{
+		if( hull->numtrees == MAX_MAP_MODELS )
+			COM_FatalError( "MAX_MAP_MODELS limit exceeded\n" );
+
+		// first tree is the world, it defines node size for the all hulls
+		if( g_maxnode_size == DEFAULT_MAXNODE_SIZE )
+			CalcMaxNodeSize( tree );
+
+		// headnode portals are the only thing what adds the planes
+		if( tree->surfaces && ( hullnum == 0 || !g_noclip ))
+			MakeHeadnodePlanes( tree->mins, tree->maxs );
+
+		hull->trees[hull->numtrees++] = tree;
 	}
 
-	Q_snprintf( name, sizeof( name ), "%s.b%i", source, hullnum );
-	brushfile = fopen( name, "r" );
-	if (!brushfile) {
-		COM_FatalError("Can't open %s", name);
+	COM_UnmapFile( polyfile, polysize );
+	unlink( polyname );
+
+	COM_UnmapFile( brushfile, brushsize );
+	unlink( brushname );
+}
+
+/*
+=================
+CreateHullTree
+
+work item 0 is the whole drawing hull: tjunctions, edges and
+draw nodes are emitted model by model into the shared tables.
+The rest are single clipping trees, they are only built here
+=================
+*/
+void CreateHullTree( int work, int threadnum )
+{
+	hulltrees_t	*hull = &g_hulltrees[0];
+
+	if( work == 0 )
+	{
+		for( int modnum = 0; modnum < hull->numtrees; modnum++ )
+		{
+			tree_t	*tree = TreeProcessModel( hull->trees[modnum], modnum, 0 );
+
+			EmitDrawNodes( tree );
+			FreeTree( tree );
+			hull->trees[modnum] = NULL;
+		}
 		return;
 	}
 
-	while(( tree = MakeTreeFromHullFaces( polyfile, brushfile )) != NULL )
+	for( int hullnum = 1; hullnum < MAX_MAP_HULLS; hullnum++ )
 	{
-		tree = TreeProcessModel( tree, modnum, hullnum );
-	
-		if( hullnum == 0 ) EmitDrawNodes( tree );
-		else EmitClipNodes( tree, modnum, hullnum );
+		hull = &g_hulltrees[hullnum];
+		work -= ( hullnum == 1 ) ? 1 : g_hulltrees[hullnum - 1].numtrees;
 
-		FreeTree( tree );
-		modnum++;
+		if( work < hull->numtrees )
+		{
+			hull->trees[work] = TreeProcessModel( hull->trees[work], work, hullnum );
+			return;
+		}
 	}
+}
 
-	Q_snprintf( name, sizeof( name ), "%s.p%i", source, hullnum );
-	fclose( polyfile );
-	unlink( name );
+/*
+=================
+CreateHulls
 
-	Q_snprintf( name, sizeof( name ), "%s.b%i", source, hullnum );
-	fclose( brushfile );
-	unlink( name );
+hulls and brush models are built in parallel, but emitted
+in the original order so the output doesn't depend on threads
+=================
+*/
+void CreateHulls( const char *source )
+{
+	int	numwork = 1;
+
+	for( int hullnum = 0; hullnum < MAX_MAP_HULLS; hullnum++ )
+	{
+		ReadHullTrees( source, hullnum );
+		if( hullnum > 0 ) numwork += g_hulltrees[hullnum].numtrees;
+	}
+
+	Msg( "CreateHulls: %i models\n", g_hulltrees[0].numtrees );
+	RunThreadsOnIndividual( numwork, false, CreateHullTree );
+
+	for( int hullnum = 1; hullnum < MAX_MAP_HULLS; hullnum++ )
+	{
+		hulltrees_t	*hull = &g_hulltrees[hullnum];
+
+		for( int modnum = 0; modnum < hull->numtrees; modnum++ )
+		{
+			EmitClipNodes( hull->trees[modnum], modnum, hullnum );
+			FreeTree( hull->trees[modnum] );
+			hull->trees[modnum] = NULL;
+		}
+		hull->numtrees = 0;
+	}
+
+	g_hulltrees[0].numtrees = 0;
 }
 
 /*
@@ -431,7 +550,6 @@ void ProcessFile( const char *source )
 {
 	char	bspfilename[1024];
 	char	name[1024];
-	int	i;
 
 	// create filenames
 	Q_snprintf( g_portfilename, sizeof( g_portfilename ), "%s.prt", source );
@@ -458,10 +576,7 @@ void ProcessFile( const char *source )
 	// init the tables to be shared by all models
 	BeginBSPFile ();
 
-	for( i = 0; i < MAX_MAP_HULLS; i++ )
-	{
-		CreateSingleHull( source, i );
-	}
+	CreateHulls( source );
 
 	// write the updated bsp file out
 	FinishBSPFile( bspfilename );
@@ -525,6 +640,7 @@ static void PrintBspUsage( void )
 	Msg( "\n-= %s Options =-\n\n", APP_ABBREVIATION );
 	Msg( "    -dev #           : compile with developer message (1 - 4). default is %d\n", DEFAULT_DEVELOPER );
 	Msg( "    -threads #       : manually specify the number of threads to run\n" );
+	Msg( "    -numa            : pin threads to cpu cores spread over NUMA nodes\n" );
 	Msg( "    -noclip          : don't create clipping hulls\n" );
 	Msg( "    -notjunc         : don't break edges on t-junctions (not for final runs)\n" );
  	Msg( "    -nofill          : don't fill outside (used for brush models, not levels)\n" );
@@ -565,6 +681,10 @@ int main( int argc, char **argv )
 			g_numthreads = atoi( argv[i+1] );
 			i++;
 		}
+		else if( !Q_strcmp( argv[i], "-numa" ))
+		{
+			g_threadaffinity = true;
+		}
 		else if( !Q_strcmp( argv[i], "-noclip" ))
 		{
 			g_noclip = true;
@@ -20,16 +20,16 @@
 
 */
 
-int		c_leaffaces;
-int		c_nodefaces;
-int		c_splitnodes;
-int		c_clipped_portals;
+// each tree is built on a single thread from the start to the end
+thread_local int	c_leaffaces;
+thread_local int	c_nodefaces;
+thread_local int	c_splitnodes;
+thread_local int	c_clipped_portals;
 
 //============================================================================
-static bool	g_report_progress = false;
-static face_t	*markfaces[MAX_MAP_MARKSURFACES + 1];
-static int	dispatch_tree_faces;
-static int	total_tree_faces;
+static thread_local bool	g_report_progress = false;
+static thread_local int	dispatch_tree_faces;
+static thread_local int	total_tree_faces;
 
 /*
 ==================
@@ -772,6 +772,8 @@ static void MakeLeaf( node_t *leafnode )
 
 	if( !( FBitSet( leafnode->flags, FNODE_LEAFPORTAL ) && leafnode->contents == CONTENTS_SOLID ))
 	{
+		face_t	**markfaces;
+
 		nummarkfaces = 0;
 		for (surf = leafnode->surfaces; surf; surf = surf->next )
 		{
@@ -780,23 +782,31 @@ static void MakeLeaf( node_t *leafnode )
 
 			for( f = surf->faces; f != NULL; f = f->next )
 			{
-				if( f->original == NULL )
-				{
-					// because it is not on node or its content is solid
-					continue;
-				}
-
-				if( nummarkfaces == MAX_MAP_MARKSURFACES )
-					COM_FatalError( "MAX_MAP_MARKSURFACES limit exceeded\n" );
-				markfaces[nummarkfaces++] = f->original;
+				// because it is not on node or its content is solid
+				if( f->original != NULL )
+					nummarkfaces++;
 			}
 		}
 
-		markfaces[nummarkfaces] = NULL; // end marker
-		nummarkfaces++;
+		if( nummarkfaces > MAX_MAP_MARKSURFACES )
+			COM_FatalError( "MAX_MAP_MARKSURFACES limit exceeded\n" );
+
+		leafnode->markfaces = (face_t **)Mem_Alloc(( nummarkfaces + 1 ) * sizeof( *leafnode->markfaces ));
+		markfaces = leafnode->markfaces;
+
+		for (surf = leafnode->surfaces; surf; surf = surf->next )
+		{
+			if( !surf->onnode )
+				continue;
+
+			for( f = surf->faces; f != NULL; f = f->next )
+			{
+				if( f->original != NULL )
+					*markfaces++ = f->original;
+			}
+		}
 
-		leafnode->markfaces = (face_t **)Mem_Alloc( nummarkfaces * sizeof( *leafnode->markfaces ));
-		memcpy( leafnode->markfaces, markfaces, nummarkfaces * sizeof( *leafnode->markfaces ));
+		*markfaces = NULL; // end marker
 	}
 
 	FreeLeafSurfs( leafnode );
@@ -987,6 +997,26 @@ void BuildBspTree_r( node_t *node, bool subdivide )
 	BuildBspTree_r( node->children[1], subdivide );
 }
 
+/*
+==================
+CalcMaxNodeSize
+
+automatic node size comes from the first tree (the world)
+and is shared by the all hulls
+==================
+*/
+void CalcMaxNodeSize( tree_t *tree )
+{
+	vec3_t	size;
+	vec_t	maxnode;
+
+	VectorSubtract( tree->maxs, tree->mins, size );
+	maxnode = VectorMax( size ) / 8.0; // 8192 / 8 = 1024
+	maxnode = Q_roundup( maxnode, 1024.0 );
+	MsgDev( D_REPORT, "max node size %g\n", maxnode );
+	g_maxnode_size = maxnode;
+}
+
 /*
 ==================
 SolidBSP
@@ -999,23 +1029,16 @@ The original surface chain will be completely freed.
 */
 void SolidBSP( tree_t *tree, int modnum, int hullnum )
 {
-	vec3_t	brushmins, brushmaxs, size;
+	vec3_t	brushmins, brushmaxs;
 	bool	report = (modnum == 0);
 	double	start, end;
 	int	flags = 0;
-	vec_t	maxnode;
 
 	MsgDev( D_REPORT, "----- SolidBSP ----- (hull %i, model %i)\n", hullnum, modnum );
 
 	// calc the maxnode size based on world size
 	if( g_maxnode_size == DEFAULT_MAXNODE_SIZE )
-	{
-		VectorSubtract( tree->maxs, tree->mins, size );
-		maxnode = VectorMax( size ) / 8.0; // 8192 / 8 = 1024
-		maxnode = Q_roundup( maxnode, 1024.0 );
-		MsgDev( D_REPORT, "max node size %g\n", maxnode );
-		g_maxnode_size = maxnode;
-	}
+		CalcMaxNodeSize( tree );
 
 	tree->headnode = AllocNode ();
 	tree->headnode->detailbrushes = tree->detailbrushes;
@@ -1066,7 +1089,8 @@ void SolidBSP( tree_t *tree, int modnum, int hullnum )
 
 	// generate six portals that enclose the entire world
 	MakeHeadnodePortals( tree->headnode, tree->mins, tree->maxs );
-	g_report_progress = report;
+	// clipping hulls are built at the same time, only the drawing hull shows progress
+	g_report_progress = report && ( hullnum == 0 );
 
 	if( g_report_progress )
 	{
@@ -1084,8 +1108,11 @@ void SolidBSP( tree_t *tree, int modnum, int hullnum )
 
 	if( report )
 	{
-		end = I_FloatTime ();
-		EndPacifier( end - start );
+		if( g_report_progress )
+		{
+			end = I_FloatTime ();
+			EndPacifier( end - start );
+		}
 		if( c_clipped_portals ) MsgDev( D_WARN, "%i portals was clipped away\n", c_clipped_portals );
 		if( c_unsplitted_faces ) MsgDev( D_WARN, "%i faces can't be a split\n", c_unsplitted_faces );
 	}
@@ -21,7 +21,7 @@ the outside filling stage can remove some of them so a better bsp can be generat
 
 int	c_totalverts;
 int	c_uniqueverts;
-int	c_unsplitted_faces;
+thread_local int	c_unsplitted_faces;
 
 /*
 ===============
@@ -143,77 +143,64 @@ void MakeSurflistFromValidFaces( tree_t *tree )
 MakeTreeFromHullFaces
 ===============
 */
-tree_t *MakeTreeFromHullFaces( FILE *polyfile, FILE *brushfile )
+tree_t *MakeTreeFromHullFaces( hullstream_t *polys, hullstream_t *brushes )
 {
-	int	texinfo, contents, numpoints;
-	int	r, planenum, detaillevel;
-	tree_t	*tree = NULL;
-	bool	skipface;
-	int	line = 0;
-	double	v[3];
-	face_t	*f;
+	const dhullface_t	*in;
+	const dhullpoint_t	*points;
+	tree_t		*tree = NULL;
+	face_t		*f;
 
 	// read in the polygons
 	while( 1 )
 	{
-		r = fscanf( polyfile, "%i %i %i %i %i\n", &detaillevel, &planenum, &texinfo, &contents, &numpoints );
-		skipface = false;
-		line++;
-
-		if( r == 0 || r == -1 )
+		if( HullStreamEnd( polys ))
 			return NULL;
 
+		in = (const dhullface_t *)HullStreamRead( polys, sizeof( dhullface_t ));
+
 		// alloc a new tree for model
 		if( !tree ) tree = AllocTree();
 
-		if( planenum == -1 ) // end of model
+		if( in->planenum == -1 ) // end of model
 			break;
 
-		if( r != 5 )
-			COM_FatalError( "ReadSurfs (line %i): scanf failure %d != 5\n", line, r );
+		if( in->planenum < 0 || in->planenum > g_nummapplanes )
+			COM_FatalError( "ReadSurfs: %i > numplanes\n", in->planenum );
 
-		if( planenum > g_nummapplanes )
-			COM_FatalError( "ReadSurfs (line %i): %i > numplanes\n", line, planenum );
+		if( in->texinfo > g_numtexinfo )
+			COM_FatalError( "ReadSurfs: %i > numtexinfo\n", in->texinfo );
 
-		if( texinfo > g_numtexinfo )
-			COM_FatalError( "ReadSurfs (line %i): %i > numtexinfo\n", line, texinfo );
+		if( in->detaillevel < 0 )
+			COM_FatalError( "ReadSurfs: detaillevel %i < 0", in->detaillevel );
 
-		if( detaillevel < 0 )
-			COM_FatalError( "ReadSurfs (line %i): detaillevel %i < 0", line, detaillevel);
+		if( in->numpoints < 0 )
+			COM_FatalError( "ReadSurfs: bad winding (%i points)\n", in->numpoints );
 
-		if( !Q_stricmp( GetTextureByTexinfo( texinfo ), "SKIP" ))
-			skipface = true;
+		points = (const dhullpoint_t *)HullStreamRead( polys, in->numpoints * sizeof( dhullpoint_t ));
 
-		if( !skipface )
-		{
-			f = AllocFace ();
-			f->planenum = planenum;
-			f->texturenum = texinfo;
-			f->contents = contents;
-			f->detaillevel = detaillevel;
-			f->w = AllocWinding( numpoints );
-			f->w->numpoints = numpoints;
-			f->next = tree->validfaces[planenum];
-			tree->validfaces[planenum] = f;
-			SetFaceType( f );
-		}
+		if( !Q_stricmp( GetTextureByTexinfo( in->texinfo ), "SKIP" ))
+			continue;
 
-		// restore winding
-		for( int i = 0; i < numpoints; i++ )
-		{
-			r = fscanf( polyfile, "%lf %lf %lf\n", &v[0], &v[1], &v[2] );
-			if( !skipface ) VectorCopy( v, f->w->p[i] );
-			line++;
-		}
+		f = AllocFace ();
+		f->planenum = in->planenum;
+		f->texturenum = in->texinfo;
+		f->contents = in->contents;
+		f->detaillevel = in->detaillevel;
+		f->w = AllocWinding( in->numpoints );
+		f->w->numpoints = in->numpoints;
+		f->next = tree->validfaces[in->planenum];
+		tree->validfaces[in->planenum] = f;
+		SetFaceType( f );
 
-		fscanf( polyfile, "\n" );
-		line++;
+		// restore winding
+		for( int i = 0; i < in->numpoints; i++ )
+			VectorCopy( points[i].point, f->w->p[i] );
 	}
 
 	MakeSurflistFromValidFaces( tree );
 
 	// time to read detailbrushes
-	tree->detailbrushes = ReadBrushes( brushfile );
+	tree->detailbrushes = ReadBrushes( brushes );
 
 	return tree;
 }
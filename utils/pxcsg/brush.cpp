@@ -11,11 +11,15 @@
 // brush.c
 
 #include "csg.h"
+#include <atomic>
 
 plane_t		g_mapplanes[MAX_INTERNAL_MAP_PLANES];
-int		g_planehash[PLANE_HASHES];
 int		g_nummapplanes;
 
+// planes are never removed and a chain head is published only after the
+// plane is complete, so lookups walk the chains without taking the lock
+static std::atomic<int>	g_planehash[PLANE_HASHES];
+
 /*
 =============================================================================
 
@@ -54,8 +58,8 @@ void AddPlaneToHash( plane_t *p )
 	int hash;
 
 	hash = (PLANE_HASHES - 1) & (int)fabs( p->dist );
-	p->hash_chain = g_planehash[hash];
-	g_planehash[hash] = p - g_mapplanes + 1;
+	p->hash_chain = g_planehash[hash].load( std::memory_order_relaxed );
+	g_planehash[hash].store( p - g_mapplanes + 1, std::memory_order_release );
 }
 
 /*
@@ -123,43 +127,55 @@ int CreateNewFloatPlane( const vec3_t srcnormal, const vec3_t origin )
 
 /*
 =============
-FindFloatPlane
+FindPlaneInHash
 
 =============
 */
-int FindFloatPlane( const vec3_t normal, const vec3_t origin )
+static int FindPlaneInHash( const vec3_t normal, const vec3_t origin, vec_t dist )
 {
 	int	i, hash, h;
-	vec_t	dist;
-	plane_t	*p;
 
-	dist = DotProduct( origin, normal );
 	hash = (PLANE_HASHES - 1) & (int)fabs( dist );
 
-	ThreadLock();
-
 	// search the border bins as well
 	for( i = -1; i <= 1; i++ )
 	{
 		h = (hash + i) & (PLANE_HASHES - 1);
-		for( int pidx = g_planehash[h] - 1; pidx != -1; pidx = g_mapplanes[pidx].hash_chain - 1 )
+		for( int pidx = g_planehash[h].load( std::memory_order_acquire ) - 1; pidx != -1; pidx = g_mapplanes[pidx].hash_chain - 1 )
 		{
-			p = &g_mapplanes[pidx];
-
-			if( PlaneEqual( p, normal, origin, dist ))
-			{
-				ThreadUnlock();
-				return p - g_mapplanes;
-			}
+			if( PlaneEqual( &g_mapplanes[pidx], normal, origin, dist ))
+				return pidx;
 		}
 	}
 
-	// allocate a new two opposite planes
-	int returnval = CreateNewFloatPlane( normal, origin );
+	return -1;
+}
+
+/*
+=============
+FindFloatPlane
+
+=============
+*/
+int FindFloatPlane( const vec3_t normal, const vec3_t origin )
+{
+	vec_t	dist;
+	int	planenum;
+
+	dist = DotProduct( origin, normal );
+
+	if(( planenum = FindPlaneInHash( normal, origin, dist )) != -1 )
+		return planenum;
+
+	ThreadLock();
+
+	// another thread may have added it in the meantime
+	if(( planenum = FindPlaneInHash( normal, origin, dist )) == -1 )
+		planenum = CreateNewFloatPlane( normal, origin );
 
 	ThreadUnlock();
 
-	return returnval;
+	return planenum;
 }
 
 int FindFloatPlane2( const vec3_t normal, const vec3_t origin )
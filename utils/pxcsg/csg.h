@@ -17,6 +17,7 @@
 #include "polylib.h"
 #include "threads.h"
 #include "bspfile.h"
+#include "hullfile.h"
 #include "port.h"
 #include "utlarray.h"
 #include <stdint.h>
@@ -252,6 +253,8 @@ bface_t *CopyFace( const bface_t *f );
 void UnlinkFaces( bface_t **head, bface_t *face = NULL );
 void EmitFace( int hull, const bface_t *f, int detaillevel = 0 );
 void EmitDetailBrush( int hull, const bface_t *faces );
+void BeginBrushOutput( int brushnum, int threadnum );
+void EndBrushOutput( int brushnum );
 void ChopEntityBrushes( mapent_t *mapent );
 void WriteMapBrushes( brush_t *b, bface_t *outside );
 
@@ -254,6 +254,8 @@ static void CSGBrush( int brushnum, int threadnum = -1 )
 	vec_t		area;
 	mapent_t		*e;
 
+	BeginBrushOutput( brushnum, threadnum );
+
 	brushnum = g_firstbrush + brushnum;
 	b1 = &g_mapbrushes[brushnum];
 	e = &g_mapentities[b1->entitynum];
@@ -555,6 +557,8 @@ static void CSGBrush( int brushnum, int threadnum = -1 )
 		// all of the faces left in outside are real surface faces
 		SaveOutside( b1, hull, outside );
 	}
+
+	EndBrushOutput( brushnum - g_firstbrush );
 }
 
 /*
@@ -562,7 +566,7 @@ static void CSGBrush( int brushnum, int threadnum = -1 )
 ChopEntityBrushes
 
 Chop brushes for a gived entity
-and dump result faces into text-format files
+and dump result faces into binary hull files
 that called mapname.p0-3
 ==================
 */
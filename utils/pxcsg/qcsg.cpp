@@ -35,7 +35,64 @@ static FILE	*out_detbrush[MAX_MAP_HULLS];
 vec3_t		world_mins, world_maxs, world_size;
 static FILE	*test_mapfile = NULL;
 
+typedef struct
+{
+	byte		*data;
+	size_t		size;
+	size_t		maxsize;
+} hullbuffer_t;
+
+typedef struct
+{
+	hullbuffer_t	surfaces[MAX_MAP_HULLS];
+	hullbuffer_t	detbrush[MAX_MAP_HULLS];
+} hullarena_t;
+
+typedef struct
+{
+	hullarena_t	*arena;
+	size_t		surfaces[MAX_MAP_HULLS][2];	// range of the brush records in the arena
+	size_t		detbrush[MAX_MAP_HULLS][2];
+} brushoutput_t;
+
+// every CSG thread appends records to its own arena without locking,
+// the ranges of each brush are written out in brush order at the end
+// of the entity, so the hull files don't depend on thread scheduling
+static hullarena_t		g_hullarenas[MAX_THREADS];
+static brushoutput_t	*g_brushoutput;
+static thread_local hullarena_t	*t_hullarena = &g_hullarenas[0];
+
 //======================================================================
+static void HullBufferWrite( hullbuffer_t *buf, const void *data, size_t size )
+{
+	if( buf->size + size > buf->maxsize )
+	{
+		buf->maxsize = Q_max( buf->maxsize * 2, buf->size + size );
+		buf->maxsize = Q_max( buf->maxsize, 65536 );
+		buf->data = (byte *)Mem_Realloc( buf->data, buf->maxsize );
+	}
+
+	memcpy( buf->data + buf->size, data, size );
+	buf->size += size;
+}
+
+static void HullBufferPoints( hullbuffer_t *buf, const winding_t *w )
+{
+	dhullpoint_t	out;
+
+	for( int i = 0; i < w->numpoints; i++ )
+	{
+		VectorCopy( w->p[i], out.point );
+		HullBufferWrite( buf, &out, sizeof( out ));
+	}
+}
+
+static void HullFileWrite( FILE *f, const void *data, size_t size )
+{
+	if( size && fwrite( data, 1, size, f ) != size )
+		COM_FatalError( "failed to write hull file\n" );
+}
+
 /*
 ===========
 EmitFace
@@ -43,50 +100,136 @@ EmitFace
 */
 void EmitFace( int hull, const bface_t *f, int detaillevel )
 {
+	hullbuffer_t	*buf = &t_hullarena->surfaces[hull];
+	dhullface_t	out;
+
 	// don't write out the discardable faces
 	if( FBitSet( f->flags, FSIDE_SKIP ))
 		return;
 
-	ThreadLock();
+	memset( &out, 0, sizeof( out ));
+	out.detaillevel = detaillevel;
+	out.planenum = f->planenum;
+	out.texinfo = f->texinfo;
+	out.contents = f->contents[0];
+	out.numpoints = f->w->numpoints;
+
+	HullBufferWrite( buf, &out, sizeof( out ));
+	HullBufferPoints( buf, f->w );
+}
 
-	fprintf( out_surfaces[hull], "%i %i %i %i %i\n", detaillevel, f->planenum, f->texinfo, f->contents[0], f->w->numpoints );
+/*
+===========
+EmitDetailBrush
+===========
+*/
+void EmitDetailBrush( int hull, const bface_t *faces )
+{
+	hullbuffer_t	*buf = &t_hullarena->detbrush[hull];
+	dhullbrush_t	brush;
+	dhullside_t	side;
 
-	for( int i = 0; i < f->w->numpoints; i++ )
+	memset( &brush, 0, sizeof( brush ));
+
+	for( const bface_t *f = faces; f != NULL; f = f->next )
+		brush.numsides++;
+
+	HullBufferWrite( buf, &brush, sizeof( brush ));
+
+	for( const bface_t *f = faces; f != NULL; f = f->next )
 	{
-		fprintf( out_surfaces[hull], "%5.8f %5.8f %5.8f\n", f->w->p[i][0], f->w->p[i][1], f->w->p[i][2] );
+		side.planenum = f->planenum;
+		side.numpoints = f->w->numpoints;
+
+		HullBufferWrite( buf, &side, sizeof( side ));
+		HullBufferPoints( buf, f->w );
 	}
+}
+
+/*
+===========
+BeginBrushOutput
 
-	// put in an extra line break
-	fprintf( out_surfaces[hull], "\n" );
+select the arena of the calling thread
+===========
+*/
+void BeginBrushOutput( int brushnum, int threadnum )
+{
+	brushoutput_t	*out = &g_brushoutput[brushnum];
 
-	ThreadUnlock ();
+	t_hullarena = &g_hullarenas[Q_max( threadnum, 0 )];
+	out->arena = t_hullarena;
+
+	for( int i = 0; i < MAX_MAP_HULLS; i++ )
+	{
+		out->surfaces[i][0] = t_hullarena->surfaces[i].size;
+		out->detbrush[i][0] = t_hullarena->detbrush[i].size;
+	}
 }
 
 /*
 ===========
-EmitDetailBrush
+EndBrushOutput
 ===========
 */
-void EmitDetailBrush( int hull, const bface_t *faces )
+void EndBrushOutput( int brushnum )
 {
-	ThreadLock();
+	brushoutput_t	*out = &g_brushoutput[brushnum];
 
-	fprintf( out_detbrush[hull], "0\n" );
+	for( int i = 0; i < MAX_MAP_HULLS; i++ )
+	{
+		out->surfaces[i][1] = t_hullarena->surfaces[i].size;
+		out->detbrush[i][1] = t_hullarena->detbrush[i].size;
+	}
+}
 
-	for( const bface_t *f = faces; f != NULL; f = f->next )
+/*
+===========
+WriteBrushOutput
+
+merge the arenas into the hull files in brush order
+===========
+*/
+static void WriteBrushOutput( int numbrushes )
+{
+	for( int i = 0; i < numbrushes; i++ )
 	{
-		fprintf( out_detbrush[hull], "%i %u\n", f->planenum, f->w->numpoints );
+		brushoutput_t	*out = &g_brushoutput[i];
 
-		for( int i = 0; i < f->w->numpoints; i++ )
+		for( int j = 0; j < MAX_MAP_HULLS; j++ )
 		{
-			fprintf( out_detbrush[hull], "%5.8f %5.8f %5.8f\n", f->w->p[i][0], f->w->p[i][1], f->w->p[i][2] );
+			HullFileWrite( out_surfaces[j], out->arena->surfaces[j].data + out->surfaces[j][0], out->surfaces[j][1] - out->surfaces[j][0] );
+			HullFileWrite( out_detbrush[j], out->arena->detbrush[j].data + out->detbrush[j][0], out->detbrush[j][1] - out->detbrush[j][0] );
 		}
 	}
 
-	// write end marker
-	fprintf( out_detbrush[hull], "-1 -1\n" );
+	for( int i = 0; i < MAX_THREADS; i++ )
+	{
+		for( int j = 0; j < MAX_MAP_HULLS; j++ )
+		{
+			g_hullarenas[i].surfaces[j].size = 0;
+			g_hullarenas[i].detbrush[j].size = 0;
+		}
+	}
+}
 
-	ThreadUnlock();
+/*
+===========
+FreeBrushOutput
+===========
+*/
+static void FreeBrushOutput( void )
+{
+	for( int i = 0; i < MAX_THREADS; i++ )
+	{
+		for( int j = 0; j < MAX_MAP_HULLS; j++ )
+		{
+			Mem_Free( g_hullarenas[i].surfaces[j].data );
+			Mem_Free( g_hullarenas[i].detbrush[j].data );
+		}
+	}
+
+	memset( g_hullarenas, 0, sizeof( g_hullarenas ));
 }
 
 /*
@@ -246,19 +389,30 @@ ProcessModels
 */
 void ProcessModels( const char *source )
 {
+	dhullface_t	endface = { -1, -1, -1, -1, -1, 0 };
+	dhullbrush_t	endbrush = { -1, 0 };
 	char	name[1024];
 	int	i;
 
 	// open surface and detail files
 	for( i = 0; i < MAX_MAP_HULLS; i++ )
 	{
+		dhullheader_t	header;
+
+		memset( &header, 0, sizeof( header ));
+		header.ident = HULLFILE_IDENT;
+		header.version = HULLFILE_VERSION;
+		header.hullnum = i;
+
 		Q_snprintf( name, sizeof( name ), "%s.p%i", source, i );
-		out_surfaces[i] = fopen( name, "w" );
+		out_surfaces[i] = fopen( name, "wb" );
 		if( !out_surfaces[i] ) COM_FatalError( "couldn't open %s\n", name );
+		HullFileWrite( out_surfaces[i], &header, sizeof( header ));
 
 		Q_snprintf( name, sizeof( name ), "%s.b%i", source, i );
-		out_detbrush[i] = fopen( name, "w" );
+		out_detbrush[i] = fopen( name, "wb" );
 		if( !out_detbrush[i] ) COM_FatalError( "couldn't open %s\n", name );
+		HullFileWrite( out_detbrush[i], &header, sizeof( header ));
 	}
 
 	// DEBUG: write test map
@@ -281,7 +435,11 @@ void ProcessModels( const char *source )
 
 		if( ent->numbrushes )
 		{
+			g_brushoutput = (brushoutput_t *)Mem_Alloc( ent->numbrushes * sizeof( brushoutput_t ));
 			ChopEntityBrushes( ent );
+			WriteBrushOutput( ent->numbrushes );
+			Mem_Free( g_brushoutput );
+			g_brushoutput = NULL;
 
 			// write end of model marker
 			for( int j = 0; j < MAX_MAP_HULLS; j++ )
@@ -289,8 +447,8 @@ void ProcessModels( const char *source )
 				if( j != 0 && VectorIsNull( g_hull_size[j][0] ) && VectorIsNull( g_hull_size[j][1] ))
 					continue;
 
-				fprintf( out_surfaces[j], "-1 -1 -1 -1 -1\n" );
-				fprintf( out_detbrush[j], "-1\n" );
+				HullFileWrite( out_surfaces[j], &endface, sizeof( endface ));
+				HullFileWrite( out_detbrush[j], &endbrush, sizeof( endbrush ));
 			}
 		}
 
@@ -298,6 +456,8 @@ void ProcessModels( const char *source )
 			fprintf( test_mapfile, "}\n" );
 	}
 
+	FreeBrushOutput();
+
 	// close surface and detail files
 	for( i = 0; i < MAX_MAP_HULLS; i++ )
 	{
@@ -646,6 +806,7 @@ static void PrintCsgUsage( void )
 	Msg( "\n-= %s Options =-\n\n", APP_ABBREVIATION );
 	Msg( "    -dev #           : compile with developer message (1 - 4). default is %d\n", DEFAULT_DEVELOPER );
 	Msg( "    -threads #       : manually specify the number of threads to run\n" );
+	Msg( "    -numa            : pin threads to cpu cores spread over NUMA nodes\n" );
 	Msg( "    -noclip          : don't create clipping hulls\n" );
 	Msg( "    -onlyents        : do an entity update from .map to .bsp\n" );
  	Msg( "    -nowadtextures   : include all used textures into bsp\n" );
@@ -716,6 +877,10 @@ int main( int argc, char **argv )
 			g_numthreads = atoi( argv[i+1] );
 			i++;
 		}
+		else if( !Q_strcmp( argv[i], "-numa" ))
+		{
+			g_threadaffinity = true;
+		}
 		else if( !Q_strcmp( argv[i], "-noclip" ))
 		{
 			g_noclip = true;
@@ -0,0 +1,518 @@
+/*
+imagecheck.cpp - compare imagelib resampling and mip filters with the reference kernels
+Copyright (C) 2026 PrimeXT Team
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "conprint.h"
+#include "cmdlib.h"
+#include "stringlib.h"
+#include "file_system.h"
+#include "imagelib.h"
+#include "mathlib.h"
+#include "crashhandler.h"
+#include "build_info.h"
+#include "app_info.h"
+#include "port.h"
+
+// the Mitchell taps are summed in the reference order, but the normal
+// mips take the length in float and the compiler may contract the SIMD
+// multiply-adds, so a channel may be off by one
+#define CHECK_TOLERANCE	1
+
+static int	num_checks = 0;
+static int	num_failed = 0;
+
+/*
+==============================================================================
+
+REFERENCE KERNELS
+
+the scalar filters imagelib used before the SIMD versions, kept
+verbatim so their output is the golden image for the comparison
+==============================================================================
+*/
+static float Ref_MitchellFilter( float x )
+{
+	x = ( x < 0.0f ) ? -x : x;
+
+	if( x < 1.0f )
+		return ( 21.0f * x * x * x - 36.0f * x * x + 16.0f ) * ( 1.0f / 18.0f );
+
+	if( x < 2.0f )
+		return ( -7.0f * x * x * x + 36.0f * x * x - 60.0f * x + 32.0f ) * ( 1.0f / 18.0f );
+
+	return 0.0f;
+}
+
+static void Ref_ResampleHorizontal_Mitchell( const byte *in, int inW, int outW, byte *out )
+{
+	float	scale, radius;
+	int	x;
+
+	scale = (float)inW / (float)outW;
+	radius = ( inW > outW ) ? 2.0f * scale : 2.0f;
+
+	for( x = 0; x < outW; x++ )
+	{
+		float	center;
+		int	i, left, right, si;
+		float	sumW, sumRp, sumGp, sumBp, sumA;
+
+		center = ( (float)x + 0.5f ) * scale - 0.5f;
+		left = (int)ceil( center - radius );
+		right = (int)floor( center + radius );
+
+		sumW = 0.0f;
+		sumRp = sumGp = sumBp = sumA = 0.0f;
+
+		for( i = left; i <= right; i++ )
+		{
+			float	d, weight;
+			float	r, g, b, a;
+
+			si = bound( 0, i, inW - 1 );
+			d = (float)( i - center );
+
+			if( inW > outW )
+				weight = Ref_MitchellFilter( d / scale ) / scale;
+			else
+				weight = Ref_MitchellFilter( d );
+
+			r = in[si * 4 + 0];
+			g = in[si * 4 + 1];
+			b = in[si * 4 + 2];
+			a = in[si * 4 + 3];
+
+			// premultiplied alpha: r * a / 255
+			sumRp += r * a * ( 1.0f / 255.0f ) * weight;
+			sumGp += g * a * ( 1.0f / 255.0f ) * weight;
+			sumBp += b * a * ( 1.0f / 255.0f ) * weight;
+			sumA += a * weight;
+			sumW += weight;
+		}
+
+		if( sumW > 0.0f )
+		{
+			sumRp /= sumW;
+			sumGp /= sumW;
+			sumBp /= sumW;
+			sumA /= sumW;
+		}
+
+		if( sumA > 0.0f )
+		{
+			float	invA = 255.0f / sumA;
+
+			out[x * 4 + 0] = (byte)bound( 0, (int)( sumRp * invA + 0.5f ), 255 );
+			out[x * 4 + 1] = (byte)bound( 0, (int)( sumGp * invA + 0.5f ), 255 );
+			out[x * 4 + 2] = (byte)bound( 0, (int)( sumBp * invA + 0.5f ), 255 );
+		}
+		else
+		{
+			out[x * 4 + 0] = out[x * 4 + 1] = out[x * 4 + 2] = 0;
+		}
+		out[x * 4 + 3] = (byte)bound( 0, (int)( sumA + 0.5f ), 255 );
+	}
+}
+
+static void Ref_ResampleVertical_Mitchell( const byte *in, int inH, int outH, byte *out, int outW )
+{
+	float	scale, radius;
+	int	x;
+
+	scale = (float)inH / (float)outH;
+	radius = ( inH > outH ) ? 2.0f * scale : 2.0f;
+
+	for( x = 0; x < outW; x++ )
+	{
+		int	y;
+
+		for( y = 0; y < outH; y++ )
+		{
+			float	center;
+			int	i, top, bottom, si;
+			float	sumW, sumRp, sumGp, sumBp, sumA;
+
+			center = ( (float)y + 0.5f ) * scale - 0.5f;
+			top = (int)ceil( center - radius );
+			bottom = (int)floor( center + radius );
+
+			sumW = 0.0f;
+			sumRp = sumGp = sumBp = sumA = 0.0f;
+
+			for( i = top; i <= bottom; i++ )
+			{
+				float	d, weight;
+				float	r, g, b, a;
+
+				si = bound( 0, i, inH - 1 );
+				d = (float)( i - center );
+
+				if( inH > outH )
+					weight = Ref_MitchellFilter( d / scale ) / scale;
+				else
+					weight = Ref_MitchellFilter( d );
+
+				r = in[si * outW * 4 + x * 4 + 0];
+				g = in[si * outW * 4 + x * 4 + 1];
+				b = in[si * outW * 4 + x * 4 + 2];
+				a = in[si * outW * 4 + x * 4 + 3];
+
+				sumRp += r * a * ( 1.0f / 255.0f ) * weight;
+				sumGp += g * a * ( 1.0f / 255.0f ) * weight;
+				sumBp += b * a * ( 1.0f / 255.0f ) * weight;
+				sumA += a * weight;
+				sumW += weight;
+			}
+
+			if( sumW > 0.0f )
+			{
+				sumRp /= sumW;
+				sumGp /= sumW;
+				sumBp /= sumW;
+				sumA /= sumW;
+			}
+
+			if( sumA > 0.0f )
+			{
+				float	invA = 255.0f / sumA;
+
+				out[y * outW * 4 + x * 4 + 0] = (byte)bound( 0, (int)( sumRp * invA + 0.5f ), 255 );
+				out[y * outW * 4 + x * 4 + 1] = (byte)bound( 0, (int)( sumGp * invA + 0.5f ), 255 );
+				out[y * outW * 4 + x * 4 + 2] = (byte)bound( 0, (int)( sumBp * invA + 0.5f ), 255 );
+			}
+			else
+			{
+				out[y * outW * 4 + x * 4 + 0] = out[y * outW * 4 + x * 4 + 1] = out[y * outW * 4 + x * 4 + 2] = 0;
+			}
+			out[y * outW * 4 + x * 4 + 3] = (byte)bound( 0, (int)( sumA + 0.5f ), 255 );
+		}
+	}
+}
+
+static void Ref_Resample32Mitchell( const byte *in, int inW, int inH, byte *out, int outW, int outH )
+{
+	byte	*temp = (byte *)Mem_Alloc( outW * inH * 4 );
+
+	for( int y = 0; y < inH; y++ )
+		Ref_ResampleHorizontal_Mitchell( in + y * inW * 4, inW, outW, temp + y * outW * 4 );
+	Ref_ResampleVertical_Mitchell( temp, inH, outH, out, outW );
+
+	Mem_Free( temp );
+}
+
+static void Ref_BuildNormalMip( byte *in, int width, int height )
+{
+	byte	*out = in;
+	float	inv127 = (1.0f / 127.0f);
+	vec3_t	normal;
+	int	x, y;
+
+	width <<= 2;
+	height >>= 1;
+
+	for( y = 0; y < height; y++, in += width )
+	{
+		for( x = 0; x < width; x += 8, in += 8, out += 4 )
+		{
+			normal[0] = (in[0] * inv127 - 1.0f) + (in[4] * inv127 - 1.0f) + (in[width+0] * inv127 - 1.0f) + (in[width+4] * inv127 - 1.0f);
+			normal[1] = (in[1] * inv127 - 1.0f) + (in[5] * inv127 - 1.0f) + (in[width+1] * inv127 - 1.0f) + (in[width+5] * inv127 - 1.0f);
+			normal[2] = (in[2] * inv127 - 1.0f) + (in[6] * inv127 - 1.0f) + (in[width+2] * inv127 - 1.0f) + (in[width+6] * inv127 - 1.0f);
+
+			if( VectorNormalize( normal ) == 0.0f )
+				VectorSet( normal, 0.5f, 0.5f, 1.0f );
+
+			out[0] = (byte)(128 + 127 * normal[0]);
+			out[1] = (byte)(128 + 127 * normal[1]);
+			out[2] = (byte)(128 + 127 * normal[2]);
+			out[3] = 255;
+		}
+	}
+}
+
+/*
+==============================================================================
+
+SYNTHETIC IMAGES
+
+==============================================================================
+*/
+static uint	check_seed = 0x1234567;
+
+static byte CheckRandom( void )
+{
+	// fixed sequence, the same images on every run and platform
+	check_seed = check_seed * 1664525 + 1013904223;
+	return (byte)( check_seed >> 24 );
+}
+
+// noise, gradients and hard edges with fully transparent areas
+static rgbdata_t *CheckColorImage( int width, int height )
+{
+	rgbdata_t	*pic = Image_Alloc( width, height );
+	byte	*p = pic->buffer;
+
+	for( int y = 0; y < height; y++ )
+	{
+		for( int x = 0; x < width; x++, p += 4 )
+		{
+			switch(( x / 7 + y / 5 ) % 3 )
+			{
+			case 0:
+				p[0] = CheckRandom();
+				p[1] = CheckRandom();
+				p[2] = CheckRandom();
+				p[3] = CheckRandom();
+				break;
+			case 1:
+				p[0] = (byte)( x * 255 / Q_max( 1, width - 1 ));
+				p[1] = (byte)( y * 255 / Q_max( 1, height - 1 ));
+				p[2] = 128;
+				p[3] = 255;
+				break;
+			default:
+				p[0] = p[1] = p[2] = 255;
+				p[3] = ( x & 4 ) ? 255 : 0;
+				break;
+			}
+		}
+	}
+
+	return pic;
+}
+
+// random unit normals, with opposing pairs so some 2x2 blocks sum to zero
+static rgbdata_t *CheckNormalImage( int width, int height )
+{
+	rgbdata_t	*pic = Image_Alloc( width, height );
+	byte	*p = pic->buffer;
+	vec3_t	n;
+
+	for( int y = 0; y < height; y++ )
+	{
+		for( int x = 0; x < width; x++, p += 4 )
+		{
+			if(( x & 1 ) && (( x / 2 + y ) % 5 ) == 0 )
+			{
+				p[0] = 255 - p[-4];
+				p[1] = 255 - p[-3];
+				p[2] = 255 - p[-2];
+				p[3] = 255;
+				continue;
+			}
+
+			VectorSet( n, CheckRandom() - 128.0f, CheckRandom() - 128.0f, CheckRandom() );
+			if( VectorNormalize( n ) == 0.0f )
+				VectorSet( n, 0.0f, 0.0f, 1.0f );
+
+			p[0] = (byte)( 128 + 127 * n[0] );
+			p[1] = (byte)( 128 + 127 * n[1] );
+			p[2] = (byte)( 128 + 127 * n[2] );
+			p[3] = 255;
+		}
+	}
+
+	return pic;
+}
+
+/*
+==============================================================================
+
+COMPARISON
+
+==============================================================================
+*/
+static void CheckCompare( const char *name, const byte *test, const byte *golden, int width, int height )
+{
+	int	maxdiff = 0, numdiff = 0;
+	int	count = width * height * 4;
+
+	for( int i = 0; i < count; i++ )
+	{
+		int	d = abs( (int)test[i] - (int)golden[i] );
+
+		if( d == 0 ) continue;
+		maxdiff = Q_max( maxdiff, d );
+		numdiff++;
+	}
+
+	num_checks++;
+
+	if( maxdiff > CHECK_TOLERANCE )
+	{
+		Msg( "^1FAILED^7 %-36s %4ix%-4i max diff %i, %i of %i channels differ\n", name, width, height, maxdiff, numdiff, count );
+		num_failed++;
+	}
+	else
+	{
+		Msg( "^2ok^7     %-36s %4ix%-4i max diff %i, %i of %i channels differ\n", name, width, height, maxdiff, numdiff, count );
+	}
+}
+
+// Image_Resample against the reference Mitchell filter
+static void CheckResample( const char *name, rgbdata_t *src, int outW, int outH )
+{
+	char	label[64];
+	byte	*golden = (byte *)Mem_Alloc( outW * outH * 4 );
+	rgbdata_t	*test = Image_Resample( Image_Copy( src ), outW, outH );
+
+	Ref_Resample32Mitchell( src->buffer, src->width, src->height, golden, outW, outH );
+	Q_snprintf( label, sizeof( label ), "%s resample from %ix%i", name, src->width, src->height );
+	CheckCompare( label, test->buffer, golden, outW, outH );
+
+	Image_Free( test );
+	Mem_Free( golden );
+}
+
+// Image_BuildMipMap color mip against the reference Mitchell filter at half size
+static void CheckColorMip( const char *name, rgbdata_t *src )
+{
+	int	outW = src->width >> 1;
+	int	outH = src->height >> 1;
+	byte	*golden = (byte *)Mem_Alloc( src->width * src->height * 4 );
+	rgbdata_t	*test = Image_Copy( src );
+	char	label[64];
+
+	// a 1-pixel side has no half size, the mip is left as it was
+	memcpy( golden, src->buffer, src->width * src->height * 4 );
+
+	if( outW > 0 && outH > 0 )
+	{
+		Ref_Resample32Mitchell( src->buffer, src->width, src->height, golden, outW, outH );
+	}
+	else
+	{
+		outW = src->width;
+		outH = src->height;
+	}
+	Image_BuildMipMap( test->buffer, test->width, test->height, false );
+	Q_snprintf( label, sizeof( label ), "%s mip from %ix%i", name, src->width, src->height );
+	CheckCompare( label, test->buffer, golden, outW, outH );
+
+	Image_Free( test );
+	Mem_Free( golden );
+}
+
+// Image_BuildMipMap normal map mip against the scalar box filter
+static void CheckNormalMip( const char *name, rgbdata_t *src )
+{
+	rgbdata_t	*golden = Image_Copy( src );
+	rgbdata_t	*test = Image_Copy( src );
+	char	label[64];
+
+	Ref_BuildNormalMip( golden->buffer, golden->width, golden->height );
+	Image_BuildMipMap( test->buffer, test->width, test->height, true );
+	Q_snprintf( label, sizeof( label ), "%s normal mip from %ix%i", name, src->width, src->height );
+	CheckCompare( label, test->buffer, golden->buffer, src->width >> 1, src->height >> 1 );
+
+	Image_Free( test );
+	Image_Free( golden );
+}
+
+static void CheckImage( const char *name, rgbdata_t *pic )
+{
+	CheckColorMip( name, pic );
+	CheckResample( name, pic, Q_max( 1, pic->width * 3 / 7 ), Q_max( 1, pic->height * 3 / 7 ));
+	CheckResample( name, pic, pic->width * 2 + 1, pic->height + 3 );
+}
+
+static void CheckSynthetic( void )
+{
+	// odd, power of two and 1-pixel sides
+	static const int sizes[][2] =
+	{
+		{ 256, 256 }, { 255, 129 }, { 64, 1 }, { 1, 64 }, { 1, 1 }, { 3, 2 }, { 37, 23 },
+	};
+
+	// the normal mip needs even sides, the widths cover the 4 pixel SIMD step and the tail
+	static const int normalsizes[][2] =
+	{
+		{ 256, 256 }, { 10, 6 }, { 2, 2 }, { 18, 34 },
+	};
+
+	for( size_t i = 0; i < ARRAYSIZE( sizes ); i++ )
+	{
+		rgbdata_t *pic = CheckColorImage( sizes[i][0], sizes[i][1] );
+		CheckImage( "synthetic", pic );
+		Image_Free( pic );
+	}
+
+	for( size_t i = 0; i < ARRAYSIZE( normalsizes ); i++ )
+	{
+		rgbdata_t *pic = CheckNormalImage( normalsizes[i][0], normalsizes[i][1] );
+		CheckNormalMip( "synthetic", pic );
+		Image_Free( pic );
+	}
+}
+
+static void PrintTitle()
+{
+	Msg("\n");
+	Msg("  pximagecheck - compare imagelib filters with the reference kernels\n");
+	Msg("  Version   : %s (^1%s ^7/ ^2%s ^7/ ^3%s ^7/ ^4%s^7)\n",
+		APP_VERSION_STRING,
+		BuildInfo::GetDate(),
+		BuildInfo::GetCommitHash(),
+		BuildInfo::GetArchitecture(),
+		BuildInfo::GetPlatform()
+	);
+	Msg("  Website   : https://github.com/SNMetamorph/PrimeXT\n");
+	Msg("  Usage     : [images...] [-normal <images...>]\n");
+	Msg("\n");
+}
+
+int main( int argc, char **argv )
+{
+	bool	normals = false;
+
+	CrashHandler::Setup();
+	PrintTitle();
+
+	CheckSynthetic();
+
+	// optional real textures, everything after -normal is checked as a normal map
+	for( int i = 1; i < argc; i++ )
+	{
+		if( !Q_stricmp( argv[i], "-normal" ))
+		{
+			normals = true;
+			continue;
+		}
+
+		rgbdata_t *pic = COM_LoadImage( argv[i] );
+
+		if( !pic || FBitSet( pic->flags, IMAGE_QUANTIZED ))
+		{
+			Msg( "^3Warning:^7 %s is not a 32-bit image, skipped\n", argv[i] );
+			Image_Free( pic );
+			continue;
+		}
+
+		if( normals )
+		{
+			if(( pic->width & 1 ) || ( pic->height & 1 ))
+				Msg( "^3Warning:^7 %s has odd sides, skipped\n", argv[i] );
+			else CheckNormalMip( argv[i], pic );
+		}
+		else
+		{
+			CheckImage( argv[i], pic );
+		}
+
+		Image_Free( pic );
+	}
+
+	Msg( "\n%i checks, %i failed\n", num_checks, num_failed );
+
+	return ( num_failed > 0 ) ? 1 : 0;
+}
@@ -23,23 +23,31 @@ GNU General Public License for more details.
 #include "port.h"
 #include <math.h>
 
-bool LMP_WriteLmptex( const char *lumpname, rgbdata_t *pix, bool todisk )
+/*
+=============
+LMP_BuildLmptex
+
+make the lmp lump from a quantized image,
+returns NULL if the image doesn't fit
+=============
+*/
+byte *LMP_BuildLmptex( const char *lumpname, rgbdata_t *pix, size_t *outsize )
 {
-	bool	result;
+	byte	lbmpalette[256*3];
 	lmp_t	*lmp;
 
 	// check for all the possible problems
 	if (!pix || !FBitSet(pix->flags, IMAGE_QUANTIZED)) 
 	{
 		Msg(S_ERROR "image not quantized or buffer invalid\n");
-		return false;
+		return NULL;
 	}
 
 	// lmp may have any dimensions
 	if (pix->width < IMAGE_MINWIDTH || pix->width > IMAGE_MAXWIDTH || pix->height < IMAGE_MINHEIGHT || pix->height > IMAGE_MAXHEIGHT)
 	{
 		Msg(S_ERROR "image too small or too large\n");
-		return false; // to small or too large
+		return NULL; // to small or too large
 	}
 
 	// calculate gamma corrected linear palette
@@ -84,6 +92,20 @@ bool LMP_WriteLmptex( const char *lumpname, rgbdata_t *pix, bool todisk )
 		MsgDev(D_ERROR, "%s is corrupted (buffer is %s bytes, written %s)\n", lumpname, Q_memprint(lumpsize), Q_memprint(disksize));
 	}
 
+	*outsize = lumpsize;
+
+	return lumpbuffer;
+}
+
+bool LMP_WriteLmptex( const char *lumpname, rgbdata_t *pix, bool todisk )
+{
+	byte	*lumpbuffer;
+	size_t	lumpsize;
+	bool	result;
+
+	lumpbuffer = LMP_BuildLmptex( lumpname, pix, &lumpsize );
+	if( !lumpbuffer ) return false;
+
 	if( todisk ) result = COM_SaveFile( lumpname, lumpbuffer, lumpsize );
 	else result = W_SaveLump( output_wad, lumpname, lumpbuffer, lumpsize, TYP_GFXPIC, ATTR_NONE ) >= 0;
 
@@ -92,7 +114,7 @@ bool LMP_WriteLmptex( const char *lumpname, rgbdata_t *pix, bool todisk )
 	return result;
 }
 
-bool LMP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &height )
+bool LMP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &height, bool quiet )
 {
 	// NOTE: we can replace this lump but this is unsafe
 	if( find != NULL )
@@ -102,21 +124,21 @@ bool LMP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &
 		switch( GetReplaceLevel( ))
 		{
 		case REP_IGNORE:
-			Msg(S_ERROR "%s already exists\n", find->name); 
+			if( !quiet ) Msg(S_ERROR "%s already exists\n", find->name); 
 			Image_Free(image);
 			return false;
 		case REP_NORMAL:
 			if( FBitSet( find->attribs, ATTR_READONLY ))
 			{
 				// g-cont. i left this limitation as a protect of the replacement of compressed lumps
-				Msg(S_ERROR "%s is read-only\n", find->name);
+				if( !quiet ) Msg(S_ERROR "%s is read-only\n", find->name);
 				Image_Free( image );
 				return false;
 			}
 			if( lumpsize != find->size )
 			{
-				Msg(S_ERROR "%s.lmp [%s] should be [%s]\n",
-				find->name, Q_memprint( lumpsize ), Q_memprint( find->size )); 
+				if( !quiet ) Msg(S_ERROR "%s.lmp [%s] should be [%s]\n",
+					find->name, Q_memprint( lumpsize ), Q_memprint( find->size )); 
 				Image_Free( image );
 				return false;
 			}
@@ -131,7 +153,7 @@ bool LMP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &
 
 				if( lseek( W_GetHandle( output_wad ), find->filepos, SEEK_SET ) == -1 )
 				{
-					Msg(S_ERROR "%s is corrupted\n", find->name);
+					if( !quiet ) Msg(S_ERROR "%s is corrupted\n", find->name);
 					lseek( W_GetHandle( output_wad ), oldpos, SEEK_SET );
 					Image_Free( image );
 					return false;
@@ -139,7 +161,7 @@ bool LMP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &
 
 				if( read( W_GetHandle( output_wad ), &test, sizeof( test )) != sizeof( test ))
 				{
-					Msg(S_ERROR "%s is corrupted\n", find->name);
+					if( !quiet ) Msg(S_ERROR "%s is corrupted\n", find->name);
 					lseek( W_GetHandle( output_wad ), oldpos, SEEK_SET );
 					Image_Free( image );
 					return false;
@@ -18,6 +18,8 @@ GNU General Public License for more details.
 #include "stringlib.h"
 #include "file_system.h"
 #include "imagelib.h"
+#include "ddstex.h"
+#include "threads.h"
 #include "makewad.h"
 #include "status_code.h"
 #include "crashhandler.h"
@@ -109,32 +111,44 @@ static bool Makewad_SaveImage( const char *filename, rgbdata_t *pix )
 
 /*
 ================
-LoadImage
+LoadFile
 
-handle bmp & tga
+from the disk or the source wad
 ================
 */
-static rgbdata_t *Makewad_LoadImage( const char *filename, bool quiet = false )
+static byte *Makewad_LoadFile( const char *filename, size_t *fileSize )
 {
-	size_t fileSize;	
-	byte *buf = (byte *)COM_LoadFile( filename, &fileSize, false );
-	const char *ext = COM_FileExtension( filename );
-	rgbdata_t *pic = NULL;
+	byte *buf = (byte *)COM_LoadFile( filename, fileSize, false );
 	char barename[64];
 
 	if (!buf && source_wad != NULL)
 	{
 		COM_FileBase(filename, barename);
-		buf = W_LoadLump(source_wad, barename, &fileSize, W_TypeFromExt(filename));
+		buf = W_LoadLump(source_wad, barename, fileSize, W_TypeFromExt(filename));
 	}
 
-	if (!buf)
-	{
-		if (!quiet) {
-			Msg(S_ERROR "unable to load (%s)\n", filename);
-		}
-		return NULL;
-	}
+	return buf;
+}
+
+static bool Makewad_SupportedFormat( const char *filename )
+{
+	const char *ext = COM_FileExtension( filename );
+
+	return !Q_stricmp(ext, "tga") || !Q_stricmp(ext, "bmp") || !Q_stricmp(ext, "mip")
+		|| !Q_stricmp(ext, "lmp") || !Q_stricmp(ext, "dds") || !Q_stricmp(ext, "png");
+}
+
+/*
+================
+DecodeImage
+
+handle bmp & tga, the file buffer is left intact
+================
+*/
+static rgbdata_t *Makewad_DecodeImage( const char *filename, const byte *buf, size_t fileSize, bool quiet = false )
+{
+	const char *ext = COM_FileExtension( filename );
+	rgbdata_t *pic = NULL;
 
 	if (!Q_stricmp(ext, "tga"))
 		pic = Image_LoadTGA(filename, buf, fileSize);
@@ -152,8 +166,6 @@ static rgbdata_t *Makewad_LoadImage( const char *filename, bool quiet = false )
 		Msg(S_ERROR "unsupported format (%s)\n", ext);
 	}
 
-	Mem_Free( buf ); // release file
-
 	if( pic != NULL )
 	{
 		// check for quake1 palette
@@ -177,6 +189,33 @@ static rgbdata_t *Makewad_LoadImage( const char *filename, bool quiet = false )
 	return pic; // may be NULL
 }
 
+/*
+================
+LoadImage
+
+handle bmp & tga
+================
+*/
+static rgbdata_t *Makewad_LoadImage( const char *filename, bool quiet = false )
+{
+	size_t fileSize;
+	byte *buf = Makewad_LoadFile( filename, &fileSize );
+	rgbdata_t *pic;
+
+	if (!buf)
+	{
+		if (!quiet) {
+			Msg(S_ERROR "unable to load (%s)\n", filename);
+		}
+		return NULL;
+	}
+
+	pic = Makewad_DecodeImage( filename, buf, fileSize, quiet );
+	Mem_Free( buf ); // release file
+
+	return pic; // may be NULL
+}
+
 // just for debug
 void Test_ConvertImageTo8Bit( const char *filename )
 {
@@ -219,7 +258,7 @@ FileStatusCode WAD_CreateTexture( const char *filename )
 	dlumpinfo_t *find;
 	char lumpname[64];
 	int mipwidth, mipheight;
-	rgbdata_t *image = nullptr, *alphaMask = nullptr;
+	rgbdata_t *image = nullptr;
 
 	// store name for detect suffixes
 	COM_FileBase(filename, lumpname);
@@ -243,7 +282,6 @@ FileStatusCode WAD_CreateTexture( const char *filename )
 
 	mipwidth = image->width;
 	mipheight = image->height;
-	bool imageHasAlpha = FBitSet(image->flags, IMAGE_HAS_8BIT_ALPHA);
 
 	// wad-copy mode: wad->wad
 	if (working_mode == ProgramWorkingMode::CopyTexturesToWad)
@@ -312,87 +350,271 @@ FileStatusCode WAD_CreateTexture( const char *filename )
 		return result ? FileStatusCode::Success : FileStatusCode::ErrorSilent;
 	}
 
-	// normal mode: bmp->wad, tga->wad
-	// append '{' character in case source image has transparency
-	if (imageHasAlpha && lumpname[0] != '{')
-	{
-		char changedLumpName[64];
-		Q_snprintf(changedLumpName, sizeof(changedLumpName), "{%s", lumpname);
-		Q_strncpy(lumpname, changedLumpName, sizeof(lumpname));
+	// packing mode goes through WAD_PackTextures
+	return FileStatusCode::UnknownError;
+}
+
+/*
+==============================================================================
+
+packing mode: the sources are handled in batches, images are quantized
+on all threads while the wad is only touched from the main thread in the
+order of the sources, so the result doesn't depend on the thread count
+
+==============================================================================
+*/
+#define WAD_BATCH_SIZE		64	// source images kept in memory at once
+
+typedef struct
+{
+	const char	*filename;
+	char		lumpname[64];
+	FileStatusCode	status;
+	bool		pending;		// waits for the replace check and the write
+	byte		*buffer;		// source file, kept to rebuild the lump with another size
+	size_t		bufsize;
+	byte		hash[16];
+	int		mipwidth;		// size before the replace check
+	int		mipheight;
+	int		lumpwidth;	// size the lump was built with
+	int		lumpheight;
+	byte		*lump;
+	size_t		lumpsize;
+} wadtexture_t;
+
+static wadtexture_t		texture_batch[WAD_BATCH_SIZE];
+
+/*
+=============
+WAD_ReadTexture
+
+check the name and load the source file,
+main thread only
+=============
+*/
+static void WAD_ReadTexture( wadtexture_t *t )
+{
+	// store name for detect suffixes
+	COM_FileBase(t->filename, t->lumpname);
+
+	if (Image_HintFromSuf(t->lumpname, true) != IMG_DIFFUSE) {
+		t->status = FileStatusCode::InvalidImageHint; // only diffuse textures can be passed
+		return;
 	}
 
-	if (graphics_wadfile)
-	{
-		// check for minmax sizes
-		mipwidth = bound(IMAGE_MINWIDTH, mipwidth, IMAGE_MAXWIDTH);
-		mipheight = bound(IMAGE_MINHEIGHT, mipheight, IMAGE_MAXHEIGHT);
+	if (Q_strlen(t->lumpname) > WAD3_NAMELEN) {
+		t->status = FileStatusCode::NameTooLong;
+		return;
+	}
 
-		find = W_FindLmptex(output_wad, lumpname);
+	if (!Makewad_SupportedFormat(t->filename)) {
+		t->status = FileStatusCode::UnsupportedFormat;
+		return;
+	}
 
-		if (!LMP_CheckForReplace(find, image, mipwidth, mipheight)) {
-			return FileStatusCode::ErrorSilent; // NOTE: image already freed on failed
-		}
+	t->buffer = Makewad_LoadFile(t->filename, &t->bufsize);
+	if (!t->buffer) {
+		t->status = FileStatusCode::LoadFailed;
+		return;
+	}
+
+	WAD_HashSource(t->buffer, t->bufsize, t->hash);
 
-		image = Image_Resample(image, mipwidth, mipheight); // align by 16 or fit to the replacement
-		if (!FBitSet(image->flags, IMAGE_QUANTIZED))
+	if (WAD_TextureUnchanged(t->filename, t->hash)) {
+		t->status = FileStatusCode::Unchanged;
+		return;
+	}
+
+	t->pending = true;
+}
+
+/*
+=============
+WAD_BuildLump
+
+resample, quantize and make the lump,
+consumes the image
+=============
+*/
+static void WAD_BuildLump( wadtexture_t *t, rgbdata_t *image, int width, int height )
+{
+	bool imageHasAlpha = FBitSet(image->flags, IMAGE_HAS_8BIT_ALPHA);
+	rgbdata_t *alphaMask = nullptr;
+
+	// align by 16 or fit to the replacement
+	image = Image_Resample(image, width, height);
+	if (!FBitSet(image->flags, IMAGE_QUANTIZED))
+	{
+		if (imageHasAlpha) {
+			alphaMask = Image_ExtractAlphaMask(image);
+		}
+		image = Image_Quantize(image, DITHER_FLOYD_STEINBERG); // now quantize image
+		if (imageHasAlpha)
 		{
-			if (imageHasAlpha) {
-				alphaMask = Image_ExtractAlphaMask(image);
-			}
-			image = Image_Quantize(image, DITHER_FLOYD_STEINBERG); // now quantize image
-			if (imageHasAlpha) 
-			{
-				Image_ApplyAlphaMask(image, alphaMask, alpha_threshold);
-				Image_Free(alphaMask);
-			}
+			Image_ApplyAlphaMask(image, alphaMask, alpha_threshold);
+			Image_Free(alphaMask);
 		}
+	}
 
-		bool result = LMP_WriteLmptex(lumpname, image);
-		Image_Free(image);
-		return result ? FileStatusCode::Success : FileStatusCode::ErrorSilent;
+	if (graphics_wadfile)
+		t->lump = LMP_BuildLmptex(t->lumpname, image, &t->lumpsize);
+	else t->lump = MIP_BuildMiptex(t->lumpname, image, &t->lumpsize);
+
+	t->lumpwidth = width;
+	t->lumpheight = height;
+	Image_Free(image);
+}
+
+static bool WAD_CheckForReplace( wadtexture_t *t, int &width, int &height, bool quiet )
+{
+	dlumpinfo_t *find;
+
+	if (graphics_wadfile)
+	{
+		find = W_FindLmptex(output_wad, t->lumpname);
+		return LMP_CheckForReplace(find, NULL, width, height, quiet);
 	}
-	else
+
+	find = W_FindMiptex(output_wad, t->lumpname);
+	return MIP_CheckForReplace(find, NULL, width, height, quiet);
+}
+
+/*
+=============
+WAD_DecodeTexture
+
+decode the source, pick the lump name and size
+=============
+*/
+static rgbdata_t *WAD_DecodeTexture( wadtexture_t *t )
+{
+	rgbdata_t *image = Makewad_DecodeImage(t->filename, t->buffer, t->bufsize);
+
+	if (!image)
+		return NULL;
+
+	// append '{' character in case source image has transparency
+	if (FBitSet(image->flags, IMAGE_HAS_8BIT_ALPHA) && t->lumpname[0] != '{')
 	{
-		// check for minmax sizes
-		mipwidth = bound(IMAGE_MINWIDTH, mipwidth, IMAGE_MAXWIDTH);
-		mipheight = bound(IMAGE_MINHEIGHT, mipheight, IMAGE_MAXHEIGHT);
+		char changedLumpName[64];
+		Q_snprintf(changedLumpName, sizeof(changedLumpName), "{%s", t->lumpname);
+		Q_strncpy(t->lumpname, changedLumpName, sizeof(t->lumpname));
+	}
 
+	// check for minmax sizes
+	t->mipwidth = bound(IMAGE_MINWIDTH, image->width, IMAGE_MAXWIDTH);
+	t->mipheight = bound(IMAGE_MINHEIGHT, image->height, IMAGE_MAXHEIGHT);
+
+	if (!graphics_wadfile)
+	{
 		if (resize_percent > 0.0f)
 		{
-			mipwidth *= (resize_percent / 100.0f);
-			mipheight *= (resize_percent / 100.0f);
+			t->mipwidth *= (resize_percent / 100.0f);
+			t->mipheight *= (resize_percent / 100.0f);
 		}
 
 		// all the mips must be aligned by 16
-		mipwidth = (mipwidth + 7) & ~7;
-		mipheight = (mipheight + 7) & ~7;
+		t->mipwidth = (t->mipwidth + 7) & ~7;
+		t->mipheight = (t->mipheight + 7) & ~7;
+	}
 
-		find = W_FindMiptex(output_wad, lumpname);
-		if (!MIP_CheckForReplace(find, image, mipwidth, mipheight)) {
-			return FileStatusCode::ErrorSilent; // NOTE: image already freed on failed
-		}
+	return image;
+}
 
-		// align by 16 or fit to the replacement
-		image = Image_Resample(image, mipwidth, mipheight);
-		if (!FBitSet(image->flags, IMAGE_QUANTIZED)) 
-		{
-			if (imageHasAlpha) {
-				alphaMask = Image_ExtractAlphaMask(image);
-			}
-			image = Image_Quantize(image, DITHER_FLOYD_STEINBERG); // now quantize image
-			if (imageHasAlpha) 
-			{
-				Image_ApplyAlphaMask(image, alphaMask, alpha_threshold);
-				Image_Free(alphaMask);
-			}
-		}
+/*
+=============
+WAD_PrepareTexture
+
+decode the source and build the lump for the size
+the replace check is expected to ask for
+=============
+*/
+static void WAD_PrepareTexture( int num, int threadnum )
+{
+	wadtexture_t *t = &texture_batch[num];
+	rgbdata_t *image;
+
+	if (!t->pending)
+		return;
+
+	image = WAD_DecodeTexture(t);
+	if (!image)
+	{
+		t->status = FileStatusCode::LoadFailed;
+		t->pending = false;
+		return;
+	}
+
+	int width = t->mipwidth;
+	int height = t->mipheight;
+
+	// the forced replace reads the old lump through the shared handle
+	ThreadLock();
+	bool accepted = WAD_CheckForReplace(t, width, height, true);
+	ThreadUnlock();
+
+	// the real check will print the reason of refuse
+	if (accepted)
+		WAD_BuildLump(t, image, width, height);
+	else Image_Free(image);
+}
+
+/*
+=============
+WAD_WriteTexture
+
+replace check and save, main thread only
+=============
+*/
+static FileStatusCode WAD_WriteTexture( wadtexture_t *t )
+{
+	rgbdata_t *image = NULL;
+
+	if (t->status == FileStatusCode::Unchanged)
+	{
+		if (WAD_TextureUnchanged(t->filename, t->hash))
+			return FileStatusCode::Unchanged;
+
+		// an earlier texture of the batch has taken the lump
+		if ((image = WAD_DecodeTexture(t)) == NULL)
+			return FileStatusCode::LoadFailed;
+		t->pending = true;
+	}
+
+	if (!t->pending)
+		return t->status;
 
-		bool result = MIP_WriteMiptex(lumpname, image);
+	int width = t->mipwidth;
+	int height = t->mipheight;
+
+	if (!WAD_CheckForReplace(t, width, height, false))
+	{
 		Image_Free(image);
-		return result ? FileStatusCode::Success : FileStatusCode::ErrorSilent;
+		return FileStatusCode::ErrorSilent;
 	}
 
-	return FileStatusCode::UnknownError;
+	// an earlier texture of the batch has the same name and another size
+	if (!t->lump || width != t->lumpwidth || height != t->lumpheight)
+	{
+		if (!image)
+			image = Makewad_DecodeImage(t->filename, t->buffer, t->bufsize);
+
+		Mem_Free(t->lump);
+		t->lump = NULL;
+
+		if (image != NULL)
+			WAD_BuildLump(t, image, width, height);
+
+		if (!t->lump)
+			return FileStatusCode::ErrorSilent;
+	}
+
+	int type = graphics_wadfile ? TYP_GFXPIC : TYP_MIPTEX;
+	if (W_SaveLump(output_wad, t->lumpname, t->lump, t->lumpsize, type, ATTR_NONE) < 0)
+		return FileStatusCode::ErrorSilent;
+
+	WAD_UpdateCache(t->filename, t->lumpname, type, t->hash);
+	return FileStatusCode::Success;
 }
 
 void __cdecl Shutdown_Makewad( void )
@@ -405,15 +627,67 @@ static const char *GetStatusCodeDescription(FileStatusCode statusCode)
 {
 	switch (statusCode)
 	{
+		case FileStatusCode::Success: return "success";
+		case FileStatusCode::ErrorSilent: return "failed";
 		case FileStatusCode::InvalidImageHint: return "wrong texture type";
 		case FileStatusCode::NameTooLong: return "file name too long";
 		case FileStatusCode::NoMatchedInputFiles: return "no matched files in source WAD";
 		case FileStatusCode::UnknownError: return "unknown error";
 		case FileStatusCode::UnknownLumpFormat: return "unknown lump format";
+		case FileStatusCode::UnsupportedFormat: return "unsupported image format";
+		case FileStatusCode::LoadFailed: return "unable to load";
+		case FileStatusCode::Unchanged: return "unchanged, skipped";
 	}
 	return "unknown";
 }
 
+static void PrintStatus(FileStatusCode statusCode)
+{
+	if (statusCode == FileStatusCode::Success) {
+		Msg("^2success\n");
+		processed_files++;
+	}
+	else if (statusCode == FileStatusCode::Unchanged) {
+		Msg("^2unchanged\n");
+		processed_files++;
+	}
+	else if (statusCode != FileStatusCode::ErrorSilent) {
+		Msg("^1%s\n", GetStatusCodeDescription(statusCode));
+	}
+}
+
+static void WAD_PackTextures(search_t *search)
+{
+	for (int first = 0; first < search->numfilenames; first += WAD_BATCH_SIZE)
+	{
+		int count = search->numfilenames - first;
+
+		if (count > WAD_BATCH_SIZE)
+			count = WAD_BATCH_SIZE;
+
+		memset(texture_batch, 0, sizeof(texture_batch));
+
+		for (int i = 0; i < count; i++)
+		{
+			texture_batch[i].filename = search->filenames[first + i];
+			WAD_ReadTexture(&texture_batch[i]);
+		}
+
+		RunThreadsOnIndividual(count, false, WAD_PrepareTexture);
+
+		for (int i = 0; i < count; i++)
+		{
+			wadtexture_t *t = &texture_batch[i];
+
+			Msg("Processing %s... ", t->filename);
+			PrintStatus(WAD_WriteTexture(t));
+
+			Mem_Free(t->buffer);
+			Mem_Free(t->lump);
+		}
+	}
+}
+
 static void PrintTitle()
 {
 	Msg("\n");
@@ -440,6 +714,10 @@ static void PrintOptionsList()
 		"     ^5-alphathres^7   : alpha threshold for transparency (0.0 - 1.0, default is 0.5)\n"
 		"     ^5-defaults^7     : don't ask user to set settings, use default if other not set\n"
 		"     ^5-outputfmt^7    : image format to be used when extracting images (bmp/dds/png/tga, default is \"bmp\")\n"
+		"     ^5-dxtquality^7   : dds block compression quality (fast/normal/high, default is \"high\")\n"
+		"     ^5-nocache^7      : quantize all the images again, even if they are not changed\n"
+		"     ^5-threads^7      : number of threads to use\n"
+		"     ^5-numa^7         : pin threads to cpu cores spread over NUMA nodes\n"
 		"     ^5-dev^7          : set message verbose level (1 - 5, default is 3)\n"
 		"\n"
 	);
@@ -562,6 +840,34 @@ int main( int argc, char **argv )
 			Q_strncpy(output_ext, argv[i + 1], sizeof(output_ext));
 			i++;
 		}
+		else if (!Q_stricmp(argv[i], "-dxtquality"))
+		{
+			if (!Q_stricmp(argv[i + 1], "fast"))
+				DDS_SetQuality(DXT_QUALITY_FAST);
+			else if (!Q_stricmp(argv[i + 1], "normal"))
+				DDS_SetQuality(DXT_QUALITY_NORMAL);
+			else if (!Q_stricmp(argv[i + 1], "high"))
+				DDS_SetQuality(DXT_QUALITY_HIGH);
+			else
+			{
+				Msg("Specified unknown dxt quality\n");
+				break;
+			}
+			i++;
+		}
+		else if (!Q_stricmp(argv[i], "-nocache"))
+		{
+			no_texture_cache = true;
+		}
+		else if (!Q_stricmp(argv[i], "-threads"))
+		{
+			g_numthreads = atoi(argv[i + 1]);
+			i++;
+		}
+		else if (!Q_stricmp(argv[i], "-numa"))
+		{
+			g_threadaffinity = true;
+		}
 		else if (!Q_stricmp(argv[i], "-alphathres"))
 		{
 			ask_for_settings = false;
@@ -604,6 +910,8 @@ int main( int argc, char **argv )
 		char testname[64];
 		char *find = NULL;
 
+		ThreadSetDefault();
+
 		Q_strncpy( srcwad, srcpath, sizeof( srcwad ));
 		find = Q_stristr( srcwad, ".wad" );
 
@@ -707,17 +1015,19 @@ int main( int argc, char **argv )
 		}
 
 		start = I_FloatTime();
-		for (i = 0; i < search->numfilenames; i++)
+		if (working_mode == ProgramWorkingMode::PackingTextures)
 		{
-			Msg("Processing %s... ", search->filenames[i]);
-
-			FileStatusCode statusCode = WAD_CreateTexture(search->filenames[i]);
-			if (statusCode == FileStatusCode::Success) {
-				Msg("^2success\n");
-				processed_files++;
-			}
-			else if (statusCode != FileStatusCode::ErrorSilent) {
-				Msg("^1%s\n", GetStatusCodeDescription(statusCode));
+			WAD_LoadCache(dstwad);
+			WAD_PackTextures(search);
+			WAD_SaveCache(dstwad);
+			WAD_FreeCache();
+		}
+		else
+		{
+			for (i = 0; i < search->numfilenames; i++)
+			{
+				Msg("Processing %s... ", search->filenames[i]);
+				PrintStatus(WAD_CreateTexture(search->filenames[i]));
 			}
 		}
 
@@ -26,5 +26,18 @@ extern wfile_t *source_wad;
 extern wfile_t *output_wad;
 extern char output_path[256];
 extern float resize_percent;
+extern float alpha_threshold;
+extern int graphics_wadfile;
+extern bool no_texture_cache;
+
+//
+// wadcache.cpp
+//
+void WAD_HashSource( const byte *buffer, size_t size, byte hash[16] );
+void WAD_LoadCache( const char *wadname );
+void WAD_SaveCache( const char *wadname );
+void WAD_FreeCache( void );
+bool WAD_TextureUnchanged( const char *source, const byte hash[16] );
+void WAD_UpdateCache( const char *source, const char *lumpname, int type, const byte hash[16] );
 
 #endif//MAKEWAD_H
\ No newline at end of file
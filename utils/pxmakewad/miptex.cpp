@@ -23,13 +23,17 @@ GNU General Public License for more details.
 #include "port.h"
 #include <math.h>
 
-byte	lbmpalette[256*3];
-float	linearpalette[256][3];
-float 	d_red, d_green, d_blue;
-bool	color_used[256];
-float	maxdistortion;
-int	colors_used;
-byte	pixdata[256];
+// state of a single miptex build, so the textures can be built on several threads
+typedef struct
+{
+	byte	lbmpalette[256*3];
+	float	linearpalette[256][3];
+	float 	d_red, d_green, d_blue;
+	bool	color_used[256];
+	float	maxdistortion;
+	int	colors_used;
+	byte	pixdata[256];
+} miptexbuild_t;
 
 /*
 =============
@@ -38,26 +42,26 @@ MIP_AddColor
 add unique color and restore original gamma
 =============
 */
-byte MIP_AddColor( float r, float g, float b )
+static byte MIP_AddColor( miptexbuild_t *mb, float r, float g, float b )
 {
 	// one color as reserved for transparent
 	for( int i = 0; i < 255; i++ )
 	{
-		if( !color_used[i] )
+		if( !mb->color_used[i] )
 		{
-			linearpalette[i][0] = r;
-			linearpalette[i][1] = g;
-			linearpalette[i][2] = b;
+			mb->linearpalette[i][0] = r;
+			mb->linearpalette[i][1] = g;
+			mb->linearpalette[i][2] = b;
 
 			r = bound( 0.0f, r, 1.0f );
-			lbmpalette[i*3+0] = (byte)pow( r, INVGAMMA ) * 255;
+			mb->lbmpalette[i*3+0] = (byte)pow( r, INVGAMMA ) * 255;
 			g = bound( 0.0f, g, 1.0f );
-			lbmpalette[i*3+1] = (byte)pow( g, INVGAMMA ) * 255;
+			mb->lbmpalette[i*3+1] = (byte)pow( g, INVGAMMA ) * 255;
 			r = bound( 0.0f, r, 1.0f );
-			lbmpalette[i*3+2] = (byte)pow( b, INVGAMMA ) * 255;
+			mb->lbmpalette[i*3+2] = (byte)pow( b, INVGAMMA ) * 255;
 
-			color_used[i] = true;
-			colors_used++;
+			mb->color_used[i] = true;
+			mb->colors_used++;
 
 			return i;
 		}
@@ -73,7 +77,7 @@ MIP_AveragePixels
 average pixels for mip-mapping
 =============
 */
-byte MIP_AveragePixels( int count )
+static byte MIP_AveragePixels( miptexbuild_t *mb, int count )
 {
 	float 	bestdistortion, distortion;
 	float 	r, g, b, dr, dg, db;
@@ -83,19 +87,19 @@ byte MIP_AveragePixels( int count )
 
 	for( i = 0; i < count; i++ )
 	{
-		pix = pixdata[i];
-		r += linearpalette[pix][0];
-		g += linearpalette[pix][1];
-		b += linearpalette[pix][2];
+		pix = mb->pixdata[i];
+		r += mb->linearpalette[pix][0];
+		g += mb->linearpalette[pix][1];
+		b += mb->linearpalette[pix][2];
 	}
 
 	r /= count;
 	g /= count;
 	b /= count;
 
-	r += d_red;
-	g += d_green;
-	b += d_blue;
+	r += mb->d_red;
+	g += mb->d_green;
+	b += mb->d_blue;
 	
 	// find the best color
 	bestdistortion = 3.0;
@@ -103,12 +107,12 @@ byte MIP_AveragePixels( int count )
 
 	for( i = 0; i < 255; i++ )
 	{
-		if( color_used[i] )
+		if( mb->color_used[i] )
 		{
 			pix = i;
-			dr = r - linearpalette[i][0];
-			dg = g - linearpalette[i][1];
-			db = b - linearpalette[i][2];
+			dr = r - mb->linearpalette[i][0];
+			dg = g - mb->linearpalette[i][1];
+			db = b - mb->linearpalette[i][2];
 
 			distortion = (dr * dr) + (dg * dg) + (db * db);
 
@@ -116,7 +120,7 @@ byte MIP_AveragePixels( int count )
 			{
 				if( !distortion )
 				{
-					d_red = d_green = d_blue = 0.0f;	// no distortion yet
+					mb->d_red = mb->d_green = mb->d_blue = 0.0f;	// no distortion yet
 					return pix;			// perfect match
 				}
 
@@ -126,59 +130,69 @@ byte MIP_AveragePixels( int count )
 		}
 	}
 
-	if( bestdistortion > 0.001f && colors_used < 255 )
+	if( bestdistortion > 0.001f && mb->colors_used < 255 )
 	{
-		bestcolor = MIP_AddColor( r, g, b );
-		d_red = d_green = d_blue = 0.0f;
+		bestcolor = MIP_AddColor( mb, r, g, b );
+		mb->d_red = mb->d_green = mb->d_blue = 0.0f;
 		bestdistortion = 0.0f;
 	}
 	else
 	{
 		// error diffusion
-		d_red = r - linearpalette[bestcolor][0];
-		d_green = g - linearpalette[bestcolor][1];
-		d_blue = b - linearpalette[bestcolor][2];
+		mb->d_red = r - mb->linearpalette[bestcolor][0];
+		mb->d_green = g - mb->linearpalette[bestcolor][1];
+		mb->d_blue = b - mb->linearpalette[bestcolor][2];
 	}
 
-	if( bestdistortion > maxdistortion )
-		maxdistortion = bestdistortion;
+	if( bestdistortion > mb->maxdistortion )
+		mb->maxdistortion = bestdistortion;
 
 	return bestcolor;
 }
 
-bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix )
+/*
+=============
+MIP_BuildMiptex
+
+make the miptex lump from a quantized image,
+returns NULL if the image doesn't fit
+=============
+*/
+byte *MIP_BuildMiptex( const char *lumpname, rgbdata_t *pix, size_t *outsize )
 {
+	miptexbuild_t	build;
+	miptexbuild_t	*mb = &build;
 	char	tmpname[64];
 	mip_t	*mip;
 
 	// check for all the possible problems
 	if (!pix || !FBitSet(pix->flags, IMAGE_QUANTIZED)) {
 		Msg(S_ERROR "lump with this name already exists or image not quantized\n");
-		return false;
+		return NULL;
 	}
 
 	if ((pix->width & 7) || (pix->height & 7)) {
 		Msg(S_ERROR "image width/height not aligned by 16\n");
-		return false; // not aligned by 16
+		return NULL; // not aligned by 16
 	}
 
 	if (pix->width < IMAGE_MINWIDTH || pix->width > IMAGE_MAXWIDTH || pix->height < IMAGE_MINHEIGHT || pix->height > IMAGE_MAXHEIGHT) {
 		Msg(S_ERROR "image too small or too large\n");
-		return false; // to small or too large
+		return NULL; // to small or too large
 	}
 
 	// calculate gamma corrected linear palette
 	for( int i = 0; i < 256; i++ )
 	{
 		// setup palette
-		lbmpalette[i*3+0] = pix->palette[i*4+0];
-		lbmpalette[i*3+1] = pix->palette[i*4+1];
-		lbmpalette[i*3+2] = pix->palette[i*4+2];
+		mb->lbmpalette[i*3+0] = pix->palette[i*4+0];
+		mb->lbmpalette[i*3+1] = pix->palette[i*4+1];
+		mb->lbmpalette[i*3+2] = pix->palette[i*4+2];
 
 		for( int j = 0; j < 3; j++ )
 		{
-			float f = lbmpalette[i*3+j] / 255.0f;
-			linearpalette[i][j] = pow( f, GAMMA ); // assume textures are done at 2.2, we want to remap them at 1.0
+			float f = mb->lbmpalette[i*3+j] / 255.0f;
+			mb->linearpalette[i][j] = pow( f, GAMMA ); // assume textures are done at 2.2, we want to remap them at 1.0
 		}
 	}
 
@@ -192,7 +206,7 @@ bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix )
 	// all the lumps must be aligned by 4
 	// or Wally will stop working properly
 	lumpsize = (lumpsize + 3) & ~3;
-	maxdistortion = 0.0f;
+	mb->maxdistortion = 0.0f;
 
 	if( FBitSet( pix->flags, IMAGE_HAS_1BIT_ALPHA ))
 		all_colors = true;
@@ -204,15 +218,15 @@ bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix )
 	{
 		// assume palette full for some reasons
 		for( int i = 0; i < 256; i++ )
-			color_used[i] = true;
-		colors_used = 256;
+			mb->color_used[i] = true;
+		mb->colors_used = 256;
 	}
 	else
 	{
 		// figure out what palette entries are actually used
 		for( int i = 0; i < 256; i++ )
-			color_used[i] = false;
-		colors_used = 0;
+			mb->color_used[i] = false;
+		mb->colors_used = 0;
 
 		for( int x = 0; x < pix->width; x++ )
 		{
@@ -220,15 +234,15 @@ bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix )
 			{
 				int color = pix->buffer[y * pix->width + x];
 
-				if( !color_used[color] )
+				if( !mb->color_used[color] )
 				{
-					color_used[color] = true;
-					colors_used++;
+					mb->color_used[color] = true;
+					mb->colors_used++;
 				}
 			}
 		}
 
-		MsgDev( D_REPORT, "%s (colors %i)\n", lumpname, colors_used );
+		MsgDev( D_REPORT, "%s (colors %i)\n", lumpname, mb->colors_used );
 	}
 
 	lumpbuffer = lump_p = (byte *)Mem_Alloc( lumpsize );
@@ -256,7 +270,7 @@ bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix )
 		int pixTest = (int)((float)(mipstep * mipstep) * 0.4f ); // 40% of pixels
 
 		mip->offsets[miplevel] = lump_p - (byte *)mip;
-		d_red = d_green = d_blue = 0.0f; // no distortion yet
+		mb->d_red = mb->d_green = mb->d_blue = 0.0f; // no distortion yet
 
 		for( int y = 0; y < pix->height; y += mipstep )
 		{
@@ -274,7 +288,7 @@ bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix )
 						// add it in to the image filter
 						if( !FBitSet( pix->flags, IMAGE_HAS_1BIT_ALPHA ) || testpixel != 255 )
 						{
-							pixdata[count] = testpixel;
+							mb->pixdata[count] = testpixel;
 							count++;
 						}
 					}
@@ -282,7 +296,7 @@ bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix )
 
 				// solid pixels account for < 40% of this pixel, make it transparent
 				if( count > pixTest )
-					*lump_p++ = MIP_AveragePixels( count );
+					*lump_p++ = MIP_AveragePixels( mb, count );
 				else *lump_p++ = 255;
 			}	
 		}
@@ -292,7 +306,7 @@ bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix )
 	*(unsigned short *)lump_p = 256; // palette size
 	lump_p += sizeof( short );
 
-	memcpy( lump_p, lbmpalette, 768 );
+	memcpy( lump_p, mb->lbmpalette, 768 );
 	lump_p += 768;
 
 	size_t disksize = (( lump_p - lumpbuffer ) + 3) & ~3;
@@ -301,6 +315,19 @@ bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix )
 		MsgDev(D_ERROR, "%s is corrupted (buffer is %s bytes, written %s)\n", lumpname, Q_memprint(lumpsize), Q_memprint(disksize));
 	}
 
+	*outsize = lumpsize;
+
+	return lumpbuffer;
+}
+
+bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix )
+{
+	byte	*lumpbuffer;
+	size_t	lumpsize;
+
+	lumpbuffer = MIP_BuildMiptex( lumpname, pix, &lumpsize );
+	if( !lumpbuffer ) return false;
+
 	bool result = W_SaveLump( output_wad, lumpname, lumpbuffer, lumpsize, TYP_MIPTEX, ATTR_NONE ) >= 0;
 
 	Mem_Free( lumpbuffer );
@@ -308,7 +335,7 @@ bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix )
 	return result;
 }
 
-bool MIP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &height )
+bool MIP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &height, bool quiet )
 {
 	// NOTE: we can replace this lump but this is unsafe
 	if( find != NULL )
@@ -318,21 +345,21 @@ bool MIP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &
 		switch( GetReplaceLevel( ))
 		{
 		case REP_IGNORE:
-			Msg(S_ERROR "%s already exists\n", find->name); 
+			if( !quiet ) Msg(S_ERROR "%s already exists\n", find->name); 
 			Image_Free( image );
 			return false;
 		case REP_NORMAL:
 			if( FBitSet( find->attribs, ATTR_READONLY ))
 			{
 				// g-cont. i left this limitation as a protect of the replacement of compressed lumps
-				Msg(S_ERROR "%s is read-only\n", find->name);
+				if( !quiet ) Msg(S_ERROR "%s is read-only\n", find->name);
 				Image_Free( image );
 				return false;
 			}
 			if( lumpsize != find->size )
 			{
-				Msg(S_ERROR "%s.mip [%s] should be [%s]\n",
-				find->name, Q_memprint( lumpsize ), Q_memprint( find->size )); 
+				if( !quiet ) Msg(S_ERROR "%s.mip [%s] should be [%s]\n",
+					find->name, Q_memprint( lumpsize ), Q_memprint( find->size )); 
 				Image_Free( image );
 				return false;
 			}
@@ -347,7 +374,7 @@ bool MIP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &
 
 				if( lseek( W_GetHandle( output_wad ), find->filepos, SEEK_SET ) == -1 )
 				{
-					Msg(S_ERROR "%s is corrupted\n", find->name );
+					if( !quiet ) Msg(S_ERROR "%s is corrupted\n", find->name );
 					lseek( W_GetHandle( output_wad ), oldpos, SEEK_SET );
 					Image_Free( image );
 					return false;
@@ -355,7 +382,7 @@ bool MIP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &
 
 				if( read( W_GetHandle( output_wad ), &test, sizeof( test )) != sizeof( test ))
 				{
-					Msg(S_ERROR "%s is corrupted\n", find->name );
+					if( !quiet ) Msg(S_ERROR "%s is corrupted\n", find->name );
 					lseek( W_GetHandle( output_wad ), oldpos, SEEK_SET );
 					Image_Free( image );
 					return false;
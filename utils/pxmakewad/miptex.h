@@ -16,12 +16,15 @@ GNU General Public License for more details.
 #ifndef MIPTEX_H
 #define MIPTEX_H
 
-extern byte	lbmpalette[256*3];
-
-bool MIP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &height );
+// Build functions are reentrant and return a Mem_Alloc'ed lump,
+// Write functions build the lump and store it into the output wad.
+// CheckForReplace frees the image when the lump can't be replaced
+bool MIP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &height, bool quiet = false );
+byte *MIP_BuildMiptex( const char *lumpname, rgbdata_t *pix, size_t *outsize );
 bool MIP_WriteMiptex( const char *lumpname, rgbdata_t *pix );
 
-bool LMP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &height );
+bool LMP_CheckForReplace( dlumpinfo_t *find, rgbdata_t *image, int &width, int &height, bool quiet = false );
+byte *LMP_BuildLmptex( const char *lumpname, rgbdata_t *pix, size_t *outsize );
 bool LMP_WriteLmptex( const char *lumpname, rgbdata_t *pix, bool todisk = false );
 
 #endif//MIPTEX_H
\ No newline at end of file
@@ -23,5 +23,8 @@ enum class FileStatusCode
 	NameTooLong,
 	NoMatchedInputFiles,
 	UnknownLumpFormat,
+	UnsupportedFormat,
+	LoadFailed,
+	Unchanged,
 	UnknownError
 };
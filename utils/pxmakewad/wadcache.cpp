@@ -0,0 +1,271 @@
+/*
+wadcache.cpp - source hashes of the packed textures to skip unchanged ones
+Copyright (C) 2026 PrimeXT Team
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "conprint.h"
+#include "cmdlib.h"
+#include "stringlib.h"
+#include "file_system.h"
+#include "imagelib.h"
+#include "makewad.h"
+#include "crclib.h"
+#include "port.h"
+
+#define WAD_CACHE_IDENT		(('C'<<24)+('W'<<16)+('X'<<8)+'P')	// little-endian "PXWC"
+#define WAD_CACHE_VERSION		2
+
+/*
+==============================================================================
+
+wadname.wtc remembers which source file every texture of the wad was built
+from. The hash covers the source file and the settings that affect the
+result, the lump position proves that nobody touched the lump since then.
+
+header, numentries * dwadcacheentry_t
+==============================================================================
+*/
+typedef struct
+{
+	int		ident;
+	int		version;
+	int		numentries;
+	int		reserved;
+} dwadcacheheader_t;
+
+typedef struct
+{
+	char		source[256];		// path of the source image
+	char		lumpname[WAD3_NAMELEN + 1];	// lump names may use all 16 chars
+	byte		hash[16];			// MD5 of the source file and the settings
+	int		type;
+	int		filepos;
+	int		disksize;
+	int		reserved;
+} dwadcacheentry_t;
+
+bool		no_texture_cache = false;
+static dwadcacheentry_t	*cache_entries = NULL;
+static int		cache_numentries = 0;
+static bool		cache_changed = false;
+
+static void GetWadCacheName( const char *wadname, char *out, size_t size )
+{
+	char	name[256];
+
+	Q_strncpy( name, wadname, sizeof( name ));
+	COM_StripExtension( name );
+	Q_snprintf( out, size, "%s.wtc", name );
+}
+
+static dwadcacheentry_t *WAD_FindCacheEntry( const char *source )
+{
+	for( int i = 0; i < cache_numentries; i++ )
+	{
+		if( !Q_stricmp( cache_entries[i].source, source ))
+			return &cache_entries[i];
+	}
+
+	return NULL;
+}
+
+/*
+=============
+WAD_HashSource
+
+hash the source file together with everything
+that changes the texture made from it
+=============
+*/
+void WAD_HashSource( const byte *buffer, size_t size, byte hash[16] )
+{
+	int		version = WAD_CACHE_VERSION;
+	MD5Context_t	ctx;
+
+	MD5Init( &ctx );
+	MD5Update( &ctx, (byte *)&version, sizeof( version ));
+	MD5Update( &ctx, (byte *)&resize_percent, sizeof( resize_percent ));
+	MD5Update( &ctx, (byte *)&alpha_threshold, sizeof( alpha_threshold ));
+	MD5Update( &ctx, (byte *)&graphics_wadfile, sizeof( graphics_wadfile ));
+	MD5Update( &ctx, buffer, size );
+	MD5Final( hash, &ctx );
+}
+
+/*
+=============
+WAD_LoadCache
+
+=============
+*/
+void WAD_LoadCache( const char *wadname )
+{
+	const dwadcacheheader_t	*header;
+	char		filename[256];
+	size_t		filesize;
+	byte		*cache;
+
+	if( no_texture_cache )
+		return;
+
+	GetWadCacheName( wadname, filename, sizeof( filename ));
+	cache = (byte *)COM_LoadFile( filename, &filesize, false );
+
+	if( !cache )
+		return;
+
+	header = (dwadcacheheader_t *)cache;
+
+	if( filesize < sizeof( dwadcacheheader_t ) || header->ident != WAD_CACHE_IDENT || header->version != WAD_CACHE_VERSION
+	|| header->numentries < 0 || sizeof( dwadcacheheader_t ) + (size_t)header->numentries * sizeof( dwadcacheentry_t ) != filesize )
+	{
+		MsgDev( D_WARN, "%s has wrong format, ignored\n", filename );
+		Mem_Free( cache );
+		return;
+	}
+
+	cache_numentries = header->numentries;
+	cache_entries = (dwadcacheentry_t *)Mem_Alloc( cache_numentries * sizeof( dwadcacheentry_t ));
+	memcpy( cache_entries, cache + sizeof( dwadcacheheader_t ), cache_numentries * sizeof( dwadcacheentry_t ));
+	Mem_Free( cache );
+
+	// the strings come from the disk
+	for( int i = 0; i < cache_numentries; i++ )
+	{
+		cache_entries[i].source[sizeof( cache_entries[i].source ) - 1] = '\0';
+		cache_entries[i].lumpname[sizeof( cache_entries[i].lumpname ) - 1] = '\0';
+	}
+}
+
+/*
+=============
+WAD_SaveCache
+
+=============
+*/
+void WAD_SaveCache( const char *wadname )
+{
+	dwadcacheheader_t	header;
+	char		filename[256];
+	FILE		*f;
+
+	if( no_texture_cache || !cache_changed )
+		return;
+
+	memset( &header, 0, sizeof( header ));
+	header.ident = WAD_CACHE_IDENT;
+	header.version = WAD_CACHE_VERSION;
+	header.numentries = cache_numentries;
+
+	GetWadCacheName( wadname, filename, sizeof( filename ));
+
+	if(( f = fopen( filename, "wb" )) == NULL )
+	{
+		MsgDev( D_WARN, "couldn't write %s\n", filename );
+		return;
+	}
+
+	bool	success = ( fwrite( &header, sizeof( header ), 1, f ) == 1 );
+
+	if( success && cache_numentries > 0 )
+		success = ( fwrite( cache_entries, sizeof( dwadcacheentry_t ), cache_numentries, f ) == (size_t)cache_numentries );
+
+	fclose( f );
+
+	if( !success )
+	{
+		MsgDev( D_WARN, "couldn't write %s\n", filename );
+		remove( filename );
+	}
+
+	cache_changed = false;
+}
+
+void WAD_FreeCache( void )
+{
+	Mem_Free( cache_entries );
+	cache_entries = NULL;
+	cache_numentries = 0;
+	cache_changed = false;
+}
+
+/*
+=============
+WAD_TextureUnchanged
+
+the source was packed earlier with the same settings
+and the lump is still where it was written
+=============
+*/
+bool WAD_TextureUnchanged( const char *source, const byte hash[16] )
+{
+	dwadcacheentry_t	*entry;
+	dlumpinfo_t	*find;
+
+	if( no_texture_cache || !output_wad )
+		return false;
+
+	entry = WAD_FindCacheEntry( source );
+
+	if( !entry || memcmp( entry->hash, hash, sizeof( entry->hash )))
+		return false;
+
+	find = W_FindLump( output_wad, entry->lumpname, entry->type );
+
+	if( !find || find->filepos != entry->filepos || find->disksize != entry->disksize )
+		return false;
+
+	return true;
+}
+
+/*
+=============
+WAD_UpdateCache
+
+remember the lump that was just saved
+=============
+*/
+void WAD_UpdateCache( const char *source, const char *lumpname, int type, const byte hash[16] )
+{
+	dwadcacheentry_t	*entry;
+	dlumpinfo_t	*find;
+
+	if( no_texture_cache || !output_wad || Q_strlen( source ) >= sizeof( entry->source ))
+		return;
+
+	find = W_FindLump( output_wad, lumpname, type );
+	if( !find ) return;
+
+	// the lump belongs to this source now
+	for( int i = cache_numentries - 1; i >= 0; i-- )
+	{
+		if( cache_entries[i].type == type && !Q_strnicmp( cache_entries[i].lumpname, find->name, WAD3_NAMELEN ) && Q_stricmp( cache_entries[i].source, source ))
+			cache_entries[i] = cache_entries[--cache_numentries];
+	}
+
+	entry = WAD_FindCacheEntry( source );
+
+	if( !entry )
+	{
+		cache_entries = (dwadcacheentry_t *)Mem_Realloc( cache_entries, ( cache_numentries + 1 ) * sizeof( dwadcacheentry_t ));
+		entry = &cache_entries[cache_numentries++];
+	}
+
+	memset( entry, 0, sizeof( *entry ));
+	Q_strncpy( entry->source, source, sizeof( entry->source ));
+	Q_strncpy( entry->lumpname, find->name, sizeof( entry->lumpname ));
+	memcpy( entry->hash, hash, sizeof( entry->hash ));
+	entry->type = type;
+	entry->filepos = find->filepos;
+	entry->disksize = find->disksize;
+	cache_changed = true;
+}
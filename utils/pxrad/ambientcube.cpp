@@ -215,7 +215,7 @@ bool R_GetDirectLightFromSurface( dface_t *surf, const vec3_t point, lightpoint_
 // Computes ambient lighting along a specified ray.  
 // Ray represents a cone, tanTheta is the tan of the inner cone angle
 //-----------------------------------------------------------------------------
-static void CalcRayAmbientLighting( int threadnum, const vec3_t vStart, const vec3_t vEnd, vec3_t radcolor )
+static void CalcRayAmbientLighting( int threadnum, const vec3_t vStart, const vec3_t vEnd, const trace_t &trace, vec3_t radcolor )
 {
 	lightpoint_t info;
 	vec3_t vDelta;
@@ -224,10 +224,6 @@ static void CalcRayAmbientLighting( int threadnum, const vec3_t vStart, const ve
 	info.fraction = 1.0f;
 	VectorClear( radcolor );
 
-
-	trace_t trace;
-	TestLine( threadnum, vStart, vEnd, &trace, false );
-
 	if( trace.contents == CONTENTS_SKY )
 	{
 		VectorSubtract( vEnd, vStart, vDelta );
@@ -276,7 +272,9 @@ static void CalcRayAmbientLighting( int threadnum, const vec3_t vStart, const ve
 static void ComputeAmbientFromSphericalSamples( int threadnum, const vec3_t p1, vec3_t lightBoxColor[6] )
 {
 	// Figure out the color that rays hit when shot out from this position.
-	vec3_t	p2;
+	vec3_t	p2[MAX_TRACE_BATCH];
+	vec3_t	start[MAX_TRACE_BATCH];
+	trace_t	trace[MAX_TRACE_BATCH];
 	vec_t	weight_sum[6];
 	vec3_t	*skynormals = g_skynormals_random;
 
@@ -288,10 +286,24 @@ static void ComputeAmbientFromSphericalSamples( int threadnum, const vec3_t p1,
 
 	for( int i = 0; i < g_lightprobesamples; i++, skynormals++ )
 	{
-		VectorMA( p1, (65536.0f * 1.74f), *skynormals, p2 );
+		int	batch = i % MAX_TRACE_BATCH;
+
+		// trace the rays by batches
+		if( batch == 0 )
+		{
+			int	count = Q_min( g_lightprobesamples - i, MAX_TRACE_BATCH );
+
+			for( int j = 0; j < count; j++ )
+			{
+				VectorCopy( p1, start[j] );
+				VectorMA( p1, (65536.0f * 1.74f), skynormals[j], p2[j] );
+			}
+
+			TestLines( threadnum, count, start, p2, trace, false );
+		}
 
 		vec3_t temp_color;
-		CalcRayAmbientLighting( threadnum, p1, p2, temp_color);
+		CalcRayAmbientLighting( threadnum, p1, p2[batch], trace[batch], temp_color);
 
 		for ( int j = 0; j < 6; j++ )
 		{
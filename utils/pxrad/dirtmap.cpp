@@ -16,6 +16,7 @@
 #define DIRT_NUM_ELEVATION_STEPS	3
 #define DIRT_NUM_ANGLE_STEPS		16
 #define DIRT_NUM_VECTORS		( DIRT_NUM_ANGLE_STEPS * DIRT_NUM_ELEVATION_STEPS )
+#define DIRT_NUM_PASSES		4	// adaptive sampling traces every 4th angle step per pass
 
 static vec3_t	g_dirtvecs[DIRT_NUM_VECTORS];
 static int	g_num_dirtvecs = 0;
@@ -54,6 +55,31 @@ void SetupDirt( void )
 	MsgDev( D_REPORT, "%d dirtmap vectors\n", g_num_dirtvecs );
 }
 
+/*
+============
+AdaptiveSamplingDone
+
+count of total samples are taken, is their mean close
+enough to the mean of all the samples? Accept g_adaptive_error
+using 95% confidence interval, like -fastsky does for the sky
+============
+*/
+bool AdaptiveSamplingDone( int count, int total, vec_t sum, vec_t sum2 )
+{
+	if( g_adaptive_error <= 0.0f || count < 2 )
+		return false;
+
+	if( count >= total )
+		return true;
+
+	vec_t	mean = sum / count;
+	vec_t	variance = Q_max( 0.0f, ( sum2 - sum * mean ) / ( count - 1 ));
+	vec_t	correction = (vec_t)( total - count ) / ( total - 1 ); // there is no more than total samples
+	vec_t	standardError = sqrt( variance / count * correction );
+
+	return ( standardError * 1.96f <= g_adaptive_error );
+}
+
 float GatherSampleDirt( int threadnum, int fn, const vec3_t pos, const vec3_t normal, entity_t *ignoreent )
 {
 	vec3_t	tangent, binormal, direction;
@@ -61,12 +87,12 @@ float GatherSampleDirt( int threadnum, int fn, const vec3_t pos, const vec3_t no
 	vec_t	dirtDepth = 128.0;
 	vec_t	dirtScale = 2.0;
 	vec_t	dirtGain = 2.0;
-	vec3_t	vecSrc, vecEnd;
-	trace_t	trace;
+	vec3_t	vecSrc[DIRT_NUM_VECTORS + 1];
+	vec3_t	vecEnd[DIRT_NUM_VECTORS + 1];
+	trace_t	trace[DIRT_NUM_VECTORS + 1];
 
 	if( !g_dirtmapping ) return 1.0f; // early out
 
-	VectorCopy( pos, vecSrc );
 	gatherDirt = 0.0f;
 
 	if( fn >= 0 )
@@ -88,33 +114,72 @@ float GatherSampleDirt( int threadnum, int fn, const vec3_t pos, const vec3_t no
 		VectorVectors( normal, tangent, binormal );
 	}
 
-	for( int i = 0; i < g_num_dirtvecs; i++ )
+	int	numpasses = ( g_adaptive_error > 0.0f ) ? DIRT_NUM_PASSES : 1;
+	int	total = g_num_dirtvecs + 1;
+	vec_t	gatherDirt2 = 0.0f;
+	int	count = 0;
+
+	for( int pass = 0; pass < numpasses; pass++ )
 	{
-		// transform vector into tangent space
-		direction[0] = tangent[0] * g_dirtvecs[i][0] + binormal[0] * g_dirtvecs[i][1] + normal[0] * g_dirtvecs[i][2];
-		direction[1] = tangent[1] * g_dirtvecs[i][0] + binormal[1] * g_dirtvecs[i][1] + normal[1] * g_dirtvecs[i][2];
-		direction[2] = tangent[2] * g_dirtvecs[i][0] + binormal[2] * g_dirtvecs[i][1] + normal[2] * g_dirtvecs[i][2];
+		int	numrays = 0;
 
-		VectorMA( pos, dirtDepth, direction, vecEnd );
-		TestLine( threadnum, vecSrc, vecEnd, &trace );
+		for( int i = 0; i < g_num_dirtvecs; i++ )
+		{
+			// every pass covers the whole hemisphere
+			if(( i / DIRT_NUM_ELEVATION_STEPS ) % numpasses != pass )
+				continue;
+
+			// transform vector into tangent space
+			direction[0] = tangent[0] * g_dirtvecs[i][0] + binormal[0] * g_dirtvecs[i][1] + normal[0] * g_dirtvecs[i][2];
+			direction[1] = tangent[1] * g_dirtvecs[i][0] + binormal[1] * g_dirtvecs[i][1] + normal[1] * g_dirtvecs[i][2];
+			direction[2] = tangent[2] * g_dirtvecs[i][0] + binormal[2] * g_dirtvecs[i][1] + normal[2] * g_dirtvecs[i][2];
+
+			VectorCopy( pos, vecSrc[numrays] );
+			VectorMA( pos, dirtDepth, direction, vecEnd[numrays] );
+			numrays++;
+		}
 
-		if( trace.contents == CONTENTS_SOLID )
-			gatherDirt += 1.0f - trace.fraction;
-	}
+		if( pass == 0 )
+		{
+			// direct ray
+			VectorCopy( pos, vecSrc[numrays] );
+			VectorMA( pos, dirtDepth, normal, vecEnd[numrays] );
+			numrays++;
+		}
+
+		// all the rays of the pass are traced together, studio models occlude too
+		TestLines( threadnum, numrays, vecSrc, vecEnd, trace, false, ignoreent );
+
+		for( int i = 0; i < numrays; i++ )
+		{
+			if( trace[i].contents == CONTENTS_SOLID )
+			{
+				vec_t	dirt = 1.0f - trace[i].fraction;
+				gatherDirt += dirt;
+				gatherDirt2 += dirt * dirt;
+			}
+		}
+
+		count += numrays;
 
-	// direct ray
-	VectorMA( pos, dirtDepth, normal, vecEnd );
-	TestLine( threadnum, vecSrc, vecEnd, &trace );
+		// open areas are converged after the first pass
+		if( AdaptiveSamplingDone( count, total, gatherDirt, gatherDirt2 ))
+			break;
+	}
 
-	if( trace.contents == CONTENTS_SOLID )
-		gatherDirt += 1.0f - trace.fraction;
+	// stats
+	if( threadnum >= 0 )
+	{
+		g_dirt_samples[threadnum]++;
+		g_dirt_rays[threadnum] += count;
+	}
 
 	// early out
 	if( gatherDirt <= 0.0f )
 		return 1.0f;
 
 	// apply gain (does this even do much? heh)
-	outDirt = pow( gatherDirt / ( g_num_dirtvecs + 1 ), dirtGain ) * dirtScale;
+	outDirt = pow( gatherDirt / count, dirtGain ) * dirtScale;
 	if( outDirt > 1.0f ) outDirt = 1.0f;
 
 	return 1.0f - outDirt;
@@ -11,6 +11,16 @@
 #include "qrad.h"
 #include "imagelib.h"
 
+#define AA_FIRST_SAMPLES		5	// center and four corners are always traced
+
+// order of the 3x3 antialiasing samples, the adaptive sampling wants
+// the center and the corners first to see the whole luxel early
+static const int	g_aa_order[2][9] =
+{
+{ 0, 1, 2, 3, 4, 5, 6, 7, 8 },
+{ 4, 0, 2, 6, 8, 1, 3, 5, 7 },
+};
+
 typedef struct facelist_s
 {
 	word		facenum;
@@ -2275,7 +2285,7 @@ void CreateDirectLights( void )
 #ifdef HLRAD_COMPUTE_VISLIGHTMATRIX
 	// rows: facenum -> visible light bits like a normal vis info
 	g_vislightdatasize = g_numfaces * ((g_numworldlights + 7) / 8);
-	if( g_dvislightdata ) Mem_Free( g_dvislightdata );
+	FreeBSPLump( g_dvislightdata );
 	g_dvislightdata = (byte *)Mem_Alloc( g_vislightdatasize );
 #endif
 }
@@ -2535,6 +2545,34 @@ _forceinline void AddSampleLight( int threadnum, bool topatch, vec3_t add, vec3_
 
 
 
+/*
+=============
+SampleVisibility
+
+fraction of the antialiasing samples that see the light. The center
+and the corners go first, if they agree the rest is usually skipped
+=============
+*/
+static float SampleVisibility( int threadnum, const vec3_t *pos, int numsamples, const vec3_t stop, int contents, bool topatch, entity_t *ignoreent )
+{
+	int	lit = 0;
+	int	count;
+
+	for( count = 0; count < numsamples; count++ )
+	{
+		// the visibility is 0 or 1, so the sum of squares is the same
+		if( count >= AA_FIRST_SAMPLES && AdaptiveSamplingDone( count, numsamples, lit, lit ))
+			break;
+		lit += ( TestLine( threadnum, pos[count], stop, topatch, ignoreent ) == contents );
+	}
+
+	// stats
+	g_aa_tests[threadnum]++;
+	g_aa_rays[threadnum] += count;
+
+	return (float)lit * ( 1.0f / (float)count );
+}
+
 /*
 =============
 GatherSampleLight
@@ -2552,7 +2590,6 @@ vec3_t *s_light, vec3_t *s_dir, vec_t *s_occ, byte *styles, byte *vislight, bool
 	vec3_t	trace_pos;
 	vec_t	avg;
 	int		aa_samples = 0;
-	vec_t	aa_divider;
 	directlight_t *dl;
 	
 	bool	this_sample_uses_aa = g_aa && (fn >= 0) && (!topatch);
@@ -2569,9 +2606,15 @@ vec3_t *s_light, vec3_t *s_dir, vec_t *s_occ, byte *styles, byte *vislight, bool
 				break;
 		if( aa_samples == 0 )
 			return;
-		aa_divider = 1.0f / (float)aa_samples;
 	}
 
+	// dirtmapping darkens the direct light of lightmaps and vertex lighting but not the patches,
+	// two-sided meshes are lit from both sides so there is no hemisphere to check
+	vec_t	dirt = 1.0f;
+
+	if( g_dirtmapping && !topatch && fn != -2 )
+		dirt = GatherSampleDirt( threadnum, fn, *pos, n, ignoreent );
+
 	if( (topatch != g_perpixelsky ) && (g_indirect_sun > 0.0) && (g_numskylights > 0 || g_envsky) && (fn >= 0) )
 	{	
 		// check light visibility
@@ -2644,7 +2687,14 @@ vec3_t *s_light, vec3_t *s_dir, vec_t *s_occ, byte *styles, byte *vislight, bool
 			VectorScale( add, 2.0f * g_indirect_sun / (float)count, add );
 			VectorScale( add_direction, 2.0f * g_indirect_sun / (float)count, add_direction );
 
+			if( dirt != 1.0f )
+			{
+				VectorScale( add, dirt, add );
+				VectorScale( add_direction, dirt, add_direction );
+			}
+
 			AddSampleLight( threadnum, topatch, add, add_direction, g_skystyle, s_light, s_dir, s_occ, styles );		
+			RelightCapture( threadnum, RELIGHT_SKY_GROUP, g_skystyle, styles, add, add_direction );
 		}
 	}
 
@@ -2726,14 +2776,12 @@ vec3_t *s_light, vec3_t *s_dir, vec_t *s_occ, byte *styles, byte *vislight, bool
 
 					if( this_sample_uses_aa )
 					{
-						int lit = 0;
-						for( int k = 0; k < aa_samples; k++ )
-							lit += ( TestLine( threadnum, pos[k], delta, dl->topatch, ignoreent ) == CONTENTS_SKY );
-						
-						if( lit == 0 )
+						float lit = SampleVisibility( threadnum, pos, aa_samples, delta, CONTENTS_SKY, dl->topatch, ignoreent );
+
+						if( lit == 0.0f )
 							continue;
 
-						dot *= (float)lit * aa_divider;
+						dot *= lit;
 					}
 					else
 						if( TestLine( threadnum, trace_pos, delta, dl->topatch, ignoreent ) != CONTENTS_SKY )
@@ -2859,14 +2907,12 @@ vec3_t *s_light, vec3_t *s_dir, vec_t *s_occ, byte *styles, byte *vislight, bool
 
 			if( this_sample_uses_aa )
 			{
-				int lit = 0;
-				for( int k = 0; k < aa_samples; k++ )
-					lit += ( TestLine( threadnum, pos[k], testline_origin, dl->topatch, ignoreent ) == CONTENTS_EMPTY );
-				
-				if( lit == 0 )
+				float lit = SampleVisibility( threadnum, pos, aa_samples, testline_origin, CONTENTS_EMPTY, dl->topatch, ignoreent );
+
+				if( lit == 0.0f )
 					continue;
 
-				ratio *= (float)lit * aa_divider;
+				ratio *= lit;
 			}
 			else
 				if( TestLine( threadnum, trace_pos, testline_origin, dl->topatch, ignoreent ) != CONTENTS_EMPTY )
@@ -2877,7 +2923,14 @@ vec3_t *s_light, vec3_t *s_dir, vec_t *s_occ, byte *styles, byte *vislight, bool
 			VectorScale( direction, avg, add_direction );
 		}
 
+		if( dirt != 1.0f )
+		{
+			VectorScale( add, dirt, add );
+			VectorScale( add_direction, dirt, add_direction );
+		}
+
 		AddSampleLight( threadnum, topatch, add, add_direction, dl->style, s_light, s_dir, s_occ, styles );
+		RelightCapture( threadnum, dl->relightgroup, dl->style, styles, add, add_direction );
 
 #ifdef HLRAD_COMPUTE_VISLIGHTMATRIX
 		// no reason to set it again
@@ -3029,6 +3082,8 @@ static void CalcLightmap( int thread, lightinfo_t *l, facelight_t *fl )
 		fl->samples[i].surface = l->surfpt[i].surface;
 	}
 
+	RelightBeginFace( thread, l->lmcachewidth * l->lmcacheheight );
+
 	// for each sample whose light we need to calculate
 	for( i = 0; i < l->lmcachewidth * l->lmcacheheight; i++ )
 	{
@@ -3082,6 +3137,7 @@ static void CalcLightmap( int thread, lightinfo_t *l, facelight_t *fl )
 		int leaf = PointInLeaf( spot ) - g_dleafs;
 
 		// gather light
+		RelightSetSample( thread, i );
 #if defined( HLRAD_DELUXEMAPPING ) && defined( HLRAD_SHADOWMAPPING )
 		GatherSampleLight( thread, l->surfnum, &spot, leaf, pointnormal, l->light[i], l->deluxe[i], l->shadow[i], f->styles, vislight, 0 );
 #elif defined( HLRAD_DELUXEMAPPING )
@@ -3136,6 +3192,7 @@ static void CalcLightmap( int thread, lightinfo_t *l, facelight_t *fl )
 #endif
 #endif
 				}
+				RelightBlurSample( thread, i, pos, weighting );
 				subsamples += weighting;
 			}
 		}
@@ -3155,6 +3212,7 @@ static void CalcLightmap( int thread, lightinfo_t *l, facelight_t *fl )
 #endif
 #endif
 			}
+			RelightScaleSample( thread, i, (1.0 / subsamples));
 		}
 	}
 
@@ -3184,6 +3242,8 @@ static void CalcLightmap( int thread, lightinfo_t *l, facelight_t *fl )
 #endif
 #endif
 
+	RelightEndFace( thread, l->surfnum, f->styles );
+
 	Mem_Free( l->light );
 #ifdef HLRAD_DELUXEMAPPING
 	Mem_Free( l->normals );
@@ -3229,6 +3289,8 @@ static void CalcLightmapAA( int thread, lightinfo_t *l, facelight_t *fl )
 	
 	
 
+	RelightBeginFace( thread, l->lmcachewidth * l->lmcacheheight );
+
 	// for each sample whose light we need to calculate	
 	for( i = 0; i < l->lmcachewidth * l->lmcacheheight; i++ )
 	{
@@ -3295,8 +3357,12 @@ static void CalcLightmapAA( int thread, lightinfo_t *l, facelight_t *fl )
 		point_outside = point_outside || ((l->lmcacheheight - (i / l->lmcachewidth)) < l->lmcache_offset);
 
 
-		for( int k = 0; k < 9; k++ )
-		{			
+		const int	*order = g_aa_order[g_adaptive_error > 0.0f];
+
+		for( int n = 0; n < 9; n++ )
+		{
+			int	k = order[n];
+
 			if( point_outside && k != 4 )
 				continue;
 
@@ -3362,6 +3428,7 @@ static void CalcLightmapAA( int thread, lightinfo_t *l, facelight_t *fl )
 		leaf = PointInLeaf( spots_aa[0] ) - g_dleafs;
 
 			// gather light
+		RelightSetSample( thread, i );
 	#if defined( HLRAD_DELUXEMAPPING ) && defined( HLRAD_SHADOWMAPPING )
 		GatherSampleLight( thread, l->surfnum, spots_aa, leaf, pointnormal, l->light[i], l->deluxe[i], l->shadow[i], f->styles, vislight, 0 );
 	#elif defined( HLRAD_DELUXEMAPPING )
@@ -3416,6 +3483,7 @@ static void CalcLightmapAA( int thread, lightinfo_t *l, facelight_t *fl )
 #endif
 #endif
 				}
+				RelightBlurSample( thread, i, pos, weighting );
 				subsamples += weighting;
 			}
 		}
@@ -3435,6 +3503,7 @@ static void CalcLightmapAA( int thread, lightinfo_t *l, facelight_t *fl )
 #endif
 #endif
 			}
+			RelightScaleSample( thread, i, (1.0 / subsamples));
 		}
 	}
 
@@ -3464,6 +3533,8 @@ static void CalcLightmapAA( int thread, lightinfo_t *l, facelight_t *fl )
 #endif
 #endif
 
+	RelightEndFace( thread, l->surfnum, f->styles );
+
 	Mem_Free( l->light );
 #ifdef HLRAD_DELUXEMAPPING
 	Mem_Free( l->normals );
@@ -3524,13 +3595,22 @@ void BuildFaceLights( int facenum, int thread )
 		f->styles[0] = g_face_patches[facenum]->emitstyle;
 
 	InitLightinfo( &l, facenum );
-	CalcPoints( &l );
 
-	//lazy
-	if( g_aa )
-		CalcLightmapAA( thread, &l, fl );
+	if( RelightFaceSamples( facenum, thread, fl, f->styles ))
+	{
+		// direct light was restored from the relight cache
+		l.numsurfpt = fl->numsamples;
+	}
 	else
-		CalcLightmap( thread, &l, fl );
+	{
+		CalcPoints( &l );
+
+		//lazy
+		if( g_aa )
+			CalcLightmapAA( thread, &l, fl );
+		else
+			CalcLightmap( thread, &l, fl );
+	}
 
 	VectorCopy( l.plane->normal, normal );
 
@@ -3662,7 +3742,7 @@ void PrecompLightmapOffsets( void )
 		g_lightdatasize += fl->numsamples * 3 * lightstyles;
 	}
 
-	g_dlightdata = (byte *)Mem_Realloc( g_dlightdata, g_lightdatasize );
+	g_dlightdata = ReallocBSPLump( g_dlightdata, g_lightdatasize );
 }
 #else
 void PrecompLightmapOffsets( void )
@@ -3878,19 +3958,19 @@ void PrecompLightmapOffsets( void )
 	if( g_found_extradata )
 	{
 #ifdef HLRAD_DELUXEMAPPING
-		g_ddeluxdata = (byte *)Mem_Realloc( g_ddeluxdata, g_lightdatasize );
+		g_ddeluxdata = ReallocBSPLump( g_ddeluxdata, g_lightdatasize );
 		g_deluxdatasize = g_lightdatasize;
 #ifdef HLRAD_SHADOWMAPPING
-		g_dshadowdata = (byte *)Mem_Realloc( g_dshadowdata, g_lightdatasize / 3 );
+		g_dshadowdata = ReallocBSPLump( g_dshadowdata, g_lightdatasize / 3 );
 		g_shadowdatasize = g_lightdatasize / 3;
 #endif
 #endif
 	}
-	g_dlightdata = (byte *)Mem_Realloc( g_dlightdata, g_lightdatasize );
+	g_dlightdata = ReallocBSPLump( g_dlightdata, g_lightdatasize );
 
 	// calc normal datasize
 	g_normaldatasize = sizeof( dnormallump_t ) + ( g_numvertnormals * sizeof( dvertnorm_t )) + (g_numnormals * sizeof( dnormal_t ));
-	g_dnormaldata = (byte *)Mem_Realloc( g_dnormaldata, g_normaldatasize );
+	g_dnormaldata = ReallocBSPLump( g_dnormaldata, g_normaldatasize );
 
 	// write indexed normals into memory
 	byte *buffer = g_dnormaldata;
@@ -4036,6 +4116,23 @@ void CalcLuxelsCount( void )
 	}
 	Msg( "%d luxels affected by direct light\n", total_luxels );
 	Msg( "%d luxels reached by direct light\n", lighted_luxels );
+
+	size_t	aa_tests = 0, aa_rays = 0;
+	size_t	dirt_samples = 0, dirt_rays = 0;
+
+	for( int i = 0; i < MAX_THREADS; i++ )
+	{
+		aa_tests += g_aa_tests[i];
+		aa_rays += g_aa_rays[i];
+		dirt_samples += g_dirt_samples[i];
+		dirt_rays += g_dirt_rays[i];
+	}
+
+	// how well the adaptive sampling is doing
+	if( aa_tests > 0 )
+		Msg( "%.2f antialiasing rays per luxel and light\n", (double)aa_rays / aa_tests );
+	if( dirt_samples > 0 )
+		Msg( "%.2f dirtmap rays per luxel\n", (double)dirt_rays / dirt_samples );
 }
 
 /*
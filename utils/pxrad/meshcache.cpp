@@ -0,0 +1,705 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// meshcache.c	// shared posed studio meshes and their persistent cache
+
+#include "qrad.h"
+#include "model_trace.h"
+
+#define MESH_CACHE_IDENT		(('C'<<24)+('M'<<16)+('X'<<8)+'P')	// little-endian "PXMC"
+#define MESH_CACHE_VERSION		2
+#define MESH_CACHE_ALIGN		64	// BVH nodes and triangles are used right from the mapped file
+
+/*
+==============================================================================
+
+mapname.smc keeps the posed studio meshes in model space together with
+their BVH, so the next run doesn't need to rebuild them. Entries are keyed
+by model CRC, body and skin, the entity transform is applied per instance.
+
+NOTE: external textures are not a part of the key, the same as for the
+transfer cache. Run with -nomeshcache after changing them.
+
+header, numentries * dsharedmesh_t, data
+==============================================================================
+*/
+typedef struct
+{
+	int		ident;
+	int		version;
+	int		numentries;
+	int		nodesize;			// sizeof( bvhnode4_t )
+	int		trissize;			// sizeof( bvhtris4_t )
+	int		reserved[3];
+} dmeshcacheheader_t;
+
+typedef struct
+{
+	uint		meshCRC;
+	int		body;
+	int		skin;
+	int		hastree;
+	int		numtextures;
+	int		numfaces;
+	int		numverts;
+	int		numnodes;
+	int		numtris;
+	int		reserved[3];
+	uint64_t		textureofs;		// dsharedtexture_t[numtextures]
+	uint64_t		faceofs;			// dsharedface_t[numfaces]
+	uint64_t		vertofs;			// dsharedvert_t[numverts]
+	uint64_t		nodeofs;			// bvhnode4_t[numnodes]
+	uint64_t		trisofs;			// bvhtris4_t[numtris]
+	dvlightofs_t	vsubmodels[32];		// MAXSTUDIOMODELS
+	dflightofs_t	fsubmodels[32];
+} dsharedmesh_t;
+
+typedef struct
+{
+	int		flags;
+	int		width;
+	int		height;
+	int		reserved;
+	uint64_t		dataofs;			// alpha-test pixels, 0 if texture has no data
+} dsharedtexture_t;
+
+typedef struct
+{
+	int		a, b, c;
+	int		skinref;
+	byte		shadow;
+	byte		color[3];
+} dsharedface_t;
+
+typedef struct
+{
+	float		point[3];
+	float		normal[3];
+	float		st[2];
+	int		twosided;
+} dsharedvert_t;
+
+bool		g_nomeshcache = false;
+static tsharedmesh_t	**g_sharedmeshes;
+static int		g_numsharedmeshes;
+static byte		*g_meshcache;
+static size_t		g_meshcachesize;
+static bool		g_meshcachechanged;
+
+static void GetMeshCacheName( char *out, size_t size )
+{
+	char	name[MAX_PATH];
+
+	Q_strncpy( name, source, sizeof( name ));
+	COM_StripExtension( name );
+	Q_snprintf( out, size, "%s.smc", name );
+}
+
+static const dsharedmesh_t *FindMeshCacheEntry( uint32_t meshCRC, int body, int skin )
+{
+	const dmeshcacheheader_t	*header = (dmeshcacheheader_t *)g_meshcache;
+	const dsharedmesh_t	*entry;
+
+	if( !g_meshcache )
+		return NULL;
+
+	entry = (dsharedmesh_t *)(g_meshcache + sizeof( dmeshcacheheader_t ));
+
+	for( int i = 0; i < header->numentries; i++, entry++ )
+	{
+		if( entry->meshCRC == meshCRC && entry->body == body && entry->skin == skin )
+			return entry;
+	}
+
+	return NULL;
+}
+
+static bool CheckMeshCacheLump( uint64_t ofs, uint64_t count, size_t size )
+{
+	return ofs <= g_meshcachesize && count * size <= g_meshcachesize - ofs;
+}
+
+static bool CheckMeshCacheEntry( const dsharedmesh_t *entry )
+{
+	if( entry->numtextures < 0 || entry->numfaces <= 0 || entry->numverts <= 0 || entry->numnodes < 0 || entry->numtris < 0 )
+		return false;
+
+	if( !CheckMeshCacheLump( entry->textureofs, entry->numtextures, sizeof( dsharedtexture_t ))
+	|| !CheckMeshCacheLump( entry->faceofs, entry->numfaces, sizeof( dsharedface_t ))
+	|| !CheckMeshCacheLump( entry->vertofs, entry->numverts, sizeof( dsharedvert_t ))
+	|| !CheckMeshCacheLump( entry->nodeofs, entry->numnodes, sizeof( bvhnode4_t ))
+	|| !CheckMeshCacheLump( entry->trisofs, entry->numtris, sizeof( bvhtris4_t )))
+		return false;
+
+	if(( entry->nodeofs % MESH_CACHE_ALIGN ) || ( entry->trisofs % MESH_CACHE_ALIGN ))
+		return false;
+
+	const dsharedtexture_t	*tex = (dsharedtexture_t *)(g_meshcache + entry->textureofs);
+
+	for( int i = 0; i < entry->numtextures; i++ )
+	{
+		if( tex[i].width < 0 || tex[i].height < 0 )
+			return false;
+		if( tex[i].dataofs && !CheckMeshCacheLump( tex[i].dataofs, tex[i].width, tex[i].height ))
+			return false;
+	}
+
+	const dsharedface_t	*face = (dsharedface_t *)(g_meshcache + entry->faceofs);
+
+	for( int i = 0; i < entry->numfaces; i++ )
+	{
+		if( face[i].a < 0 || face[i].a >= entry->numverts || face[i].b < 0 || face[i].b >= entry->numverts )
+			return false;
+		if( face[i].c < 0 || face[i].c >= entry->numverts || face[i].skinref < 0 || face[i].skinref >= entry->numtextures )
+			return false;
+	}
+
+	if( !entry->hastree )
+		return true;
+
+	// the tree is traced right from the file, every link must stay inside it.
+	// nodes are stored parent first so a child index is always greater
+	const bvhnode4_t	*node = (bvhnode4_t *)(g_meshcache + entry->nodeofs);
+
+	for( int i = 0; i < entry->numnodes; i++ )
+	{
+		for( int j = 0; j < 4; j++ )
+		{
+			int	child = node[i].child[j];
+
+			if( child == BVH4_EMPTY_NODE )
+				continue;
+			if( child >= 0 && ( child <= i || child >= entry->numnodes ))
+				return false;
+			if( child < 0 && ~child >= entry->numtris )
+				return false;
+		}
+	}
+
+	const bvhtris4_t	*tris = (bvhtris4_t *)(g_meshcache + entry->trisofs);
+
+	for( int i = 0; i < entry->numtris; i++ )
+	{
+		for( int j = 0; j < BVH4_LEAF_TRIS; j++ )
+		{
+			if( tris[i].face[j] < -1 || tris[i].face[j] >= entry->numfaces )
+				return false;
+		}
+	}
+
+	return true;
+}
+
+// shared meshes that were read from the cache must be gone or detached before this
+static void FreeMeshCache( void )
+{
+	COM_UnmapFile( g_meshcache, g_meshcachesize );
+	g_meshcache = NULL;
+	g_meshcachesize = 0;
+}
+
+/*
+=============
+LoadMeshCache
+
+map the cache, meshes are unpacked on request
+=============
+*/
+void LoadMeshCache( void )
+{
+	const dmeshcacheheader_t	*header;
+	char			filename[MAX_PATH];
+	size_t			filesize;
+
+	if( g_nomeshcache )
+		return;
+
+	GetMeshCacheName( filename, sizeof( filename ));
+	g_meshcache = COM_MapFile( filename, &filesize );
+
+	if( !g_meshcache )
+		return;
+
+	g_meshcachesize = filesize;
+	header = (dmeshcacheheader_t *)g_meshcache;
+
+	if( filesize < sizeof( dmeshcacheheader_t ) || header->ident != MESH_CACHE_IDENT || header->version != MESH_CACHE_VERSION
+	|| header->nodesize != sizeof( bvhnode4_t ) || header->trissize != sizeof( bvhtris4_t ) || header->numentries < 0
+	|| !CheckMeshCacheLump( sizeof( dmeshcacheheader_t ), header->numentries, sizeof( dsharedmesh_t )))
+	{
+		MsgDev( D_WARN, "%s has wrong format, ignored\n", filename );
+		FreeMeshCache();
+		return;
+	}
+
+	const dsharedmesh_t *entry = (dsharedmesh_t *)(g_meshcache + sizeof( dmeshcacheheader_t ));
+
+	for( int i = 0; i < header->numentries; i++ )
+	{
+		if( !CheckMeshCacheEntry( &entry[i] ))
+		{
+			MsgDev( D_WARN, "%s is damaged, ignored\n", filename );
+			FreeMeshCache();
+			return;
+		}
+	}
+}
+
+/*
+=============
+UnpackSharedMesh
+
+faces and vertexes are copied out, textures and
+the BVH are pointed directly into the mapped file
+=============
+*/
+static tmesh_t *UnpackSharedMesh( const dsharedmesh_t *entry )
+{
+	size_t	memsize = sizeof( tmesh_t ) + sizeof( timage_t ) * entry->numtextures;
+	memsize += sizeof( tface_t ) * entry->numfaces + sizeof( tvert_t ) * entry->numverts;
+
+	byte	*meshdata = (byte *)Mem_Alloc( memsize );
+	tmesh_t	*mesh = (tmesh_t *)meshdata;
+
+	meshdata += sizeof( tmesh_t );
+	mesh->textures = (timage_t *)meshdata;
+	meshdata += sizeof( timage_t ) * entry->numtextures;
+	mesh->numtextures = entry->numtextures;
+	mesh->faces = (tface_t *)meshdata;
+	meshdata += sizeof( tface_t ) * entry->numfaces;
+	mesh->numfaces = entry->numfaces;
+	mesh->verts = (tvert_t *)meshdata;
+	mesh->numverts = entry->numverts;
+
+	const dsharedtexture_t	*intex = (dsharedtexture_t *)(g_meshcache + entry->textureofs);
+
+	for( int i = 0; i < entry->numtextures; i++ )
+	{
+		timage_t	*tex = &mesh->textures[i];
+
+		tex->flags = intex[i].flags;
+		tex->width = intex[i].width;
+		tex->height = intex[i].height;
+		tex->data = intex[i].dataofs ? g_meshcache + intex[i].dataofs : NULL;
+	}
+
+	const dsharedface_t	*inface = (dsharedface_t *)(g_meshcache + entry->faceofs);
+
+	for( int i = 0; i < entry->numfaces; i++ )
+	{
+		tface_t	*face = &mesh->faces[i];
+
+		face->a = inface[i].a;
+		face->b = inface[i].b;
+		face->c = inface[i].c;
+		face->shadow = inface[i].shadow ? true : false;
+		face->contents = CONTENTS_SOLID;
+		face->texture = &mesh->textures[inface[i].skinref];
+		face->color[0] = inface[i].color[0];
+		face->color[1] = inface[i].color[1];
+		face->color[2] = inface[i].color[2];
+	}
+
+	const dsharedvert_t	*invert = (dsharedvert_t *)(g_meshcache + entry->vertofs);
+
+	for( int i = 0; i < entry->numverts; i++ )
+	{
+		tvert_t	*vert = &mesh->verts[i];
+
+		VectorCopy( invert[i].point, vert->point );
+		VectorCopy( invert[i].normal, vert->normal );
+		vert->st[0] = invert[i].st[0];
+		vert->st[1] = invert[i].st[1];
+		vert->twosided = invert[i].twosided ? true : false;
+	}
+
+	memcpy( mesh->vsubmodels, entry->vsubmodels, sizeof( mesh->vsubmodels ));
+	memcpy( mesh->fsubmodels, entry->fsubmodels, sizeof( mesh->fsubmodels ));
+#ifdef HLRAD_RAYTRACE
+	if( entry->hastree )
+	{
+		bvhnode4_t	*nodes = (bvhnode4_t *)(g_meshcache + entry->nodeofs);
+		bvhtris4_t	*tris = (bvhtris4_t *)(g_meshcache + entry->trisofs);
+		mesh->rayBVH.SetTree( nodes, entry->numnodes, tris, entry->numtris, mesh );
+	}
+#endif
+	return mesh;
+}
+
+static tsharedmesh_t *LinkSharedMesh( uint32_t meshCRC, int body, int skin, tmesh_t *mesh )
+{
+	tsharedmesh_t	*shared = (tsharedmesh_t *)Mem_Alloc( sizeof( tsharedmesh_t ));
+
+	shared->meshCRC = meshCRC;
+	shared->body = body;
+	shared->skin = skin;
+	shared->mesh = mesh;
+
+	g_sharedmeshes = (tsharedmesh_t **)Mem_Realloc( g_sharedmeshes, ( g_numsharedmeshes + 1 ) * sizeof( tsharedmesh_t* ));
+	g_sharedmeshes[g_numsharedmeshes++] = shared;
+
+	return shared;
+}
+
+/*
+=============
+FindSharedMesh
+
+returns the posed mesh that was built before
+in this run or by one of the previous runs
+=============
+*/
+tsharedmesh_t *FindSharedMesh( uint32_t meshCRC, int body, int skin )
+{
+	const dsharedmesh_t	*entry;
+	tsharedmesh_t	*shared;
+
+	for( int i = 0; i < g_numsharedmeshes; i++ )
+	{
+		shared = g_sharedmeshes[i];
+
+		if( shared->meshCRC == meshCRC && shared->body == body && shared->skin == skin )
+			return shared;
+	}
+
+	if(( entry = FindMeshCacheEntry( meshCRC, body, skin )) == NULL )
+		return NULL;
+
+	shared = LinkSharedMesh( meshCRC, body, skin, UnpackSharedMesh( entry ));
+	shared->hastree = entry->hastree ? true : false;
+
+	return shared;
+}
+
+tsharedmesh_t *AddSharedMesh( uint32_t meshCRC, int body, int skin, tmesh_t *mesh )
+{
+	g_meshcachechanged = true;
+
+	return LinkSharedMesh( meshCRC, body, skin, mesh );
+}
+
+/*
+=============
+ShareMeshTree
+
+the BVH is built once in model space, every
+instance traces it with its own transform
+=============
+*/
+void ShareMeshTree( tmesh_t *instance )
+{
+#ifdef HLRAD_RAYTRACE
+	tsharedmesh_t	*shared = instance->shared;
+
+	if( !shared->hastree )
+	{
+		shared->mesh->rayBVH.BuildTree( shared->mesh );
+		shared->hastree = true;
+		g_meshcachechanged = true;
+	}
+
+	instance->rayBVH.ShareTree( &shared->mesh->rayBVH, instance, instance->transform );
+#endif
+}
+
+/*
+=============
+DetachSharedMeshes
+
+copy everything that points into the mapped file
+so the cache can be unmapped and overwritten
+=============
+*/
+static void DetachSharedMeshes( void )
+{
+	for( int i = 0; i < g_numsharedmeshes; i++ )
+	{
+		tsharedmesh_t	*shared = g_sharedmeshes[i];
+		const dsharedmesh_t	*entry;
+
+		if(( entry = FindMeshCacheEntry( shared->meshCRC, shared->body, shared->skin )) == NULL )
+			continue;
+
+		tmesh_t	*mesh = shared->mesh;
+		size_t	texdatasize = 0;
+
+		for( int j = 0; j < mesh->numtextures; j++ )
+		{
+			if( mesh->textures[j].data )
+				texdatasize += mesh->textures[j].width * mesh->textures[j].height;
+		}
+
+		if( texdatasize > 0 )
+		{
+			byte	*texdata = shared->texdata = (byte *)Mem_Alloc( texdatasize );
+
+			for( int j = 0; j < mesh->numtextures; j++ )
+			{
+				timage_t	*tex = &mesh->textures[j];
+
+				if( !tex->data ) continue;
+
+				memcpy( texdata, tex->data, tex->width * tex->height );
+				tex->data = texdata;
+				texdata += tex->width * tex->height;
+			}
+		}
+#ifdef HLRAD_RAYTRACE
+		const CWorldRayTraceBVH	*bvh = &mesh->rayBVH;
+
+		if( (byte *)bvh->GetNodes() >= g_meshcache && (byte *)bvh->GetNodes() < g_meshcache + g_meshcachesize )
+		{
+			bvhnode4_t	*nodes = new bvhnode4_t[bvh->NumNodes()];
+			bvhtris4_t	*tris = new bvhtris4_t[bvh->NumTris()];
+
+			memcpy( nodes, bvh->GetNodes(), sizeof( bvhnode4_t ) * bvh->NumNodes( ));
+			memcpy( tris, bvh->GetTris(), sizeof( bvhtris4_t ) * bvh->NumTris( ));
+			mesh->rayBVH.SetTree( nodes, bvh->NumNodes(), tris, bvh->NumTris(), mesh, true );
+
+			// instances still point to the mapped tree
+			for( int j = 1; j < g_numentities; j++ )
+			{
+				entity_t	*e = &g_entities[j];
+				tmesh_t	*inst = (tmesh_t *)e->cache;
+
+				if( e->modtype == mod_studio && inst && inst->shared == shared && inst->rayBVH.GetNodes() == (bvhnode4_t *)(g_meshcache + entry->nodeofs))
+					inst->rayBVH.ShareTree( &mesh->rayBVH, inst, inst->transform );
+			}
+		}
+#endif
+	}
+
+	FreeMeshCache();
+}
+
+static uint64_t AlignMeshCacheOffset( uint64_t ofs )
+{
+	return ( ofs + MESH_CACHE_ALIGN - 1 ) & ~(uint64_t)( MESH_CACHE_ALIGN - 1 );
+}
+
+static bool WriteMeshCachePadding( FILE *f, uint64_t &pos, uint64_t ofs )
+{
+	static byte	pad[MESH_CACHE_ALIGN];
+
+	ASSERT( ofs >= pos && ofs - pos <= MESH_CACHE_ALIGN );
+
+	if( ofs > pos && fwrite( pad, (size_t)( ofs - pos ), 1, f ) != 1 )
+		return false;
+	pos = ofs;
+
+	return true;
+}
+
+static bool WriteMeshCacheData( FILE *f, uint64_t &pos, const void *data, size_t size )
+{
+	if( size && fwrite( data, size, 1, f ) != 1 )
+		return false;
+	pos += size;
+
+	return true;
+}
+
+/*
+=============
+SaveMeshCache
+
+=============
+*/
+void SaveMeshCache( void )
+{
+	dmeshcacheheader_t	header;
+	char		filename[MAX_PATH];
+	uint64_t		pos, ofs;
+	FILE		*f;
+
+	if( g_nomeshcache || !g_meshcachechanged )
+		return;
+
+	// it will be overwritten
+	if( g_meshcache )
+		DetachSharedMeshes();
+
+	memset( &header, 0, sizeof( header ));
+	header.ident = MESH_CACHE_IDENT;
+	header.version = MESH_CACHE_VERSION;
+	header.numentries = g_numsharedmeshes;
+	header.nodesize = sizeof( bvhnode4_t );
+	header.trissize = sizeof( bvhtris4_t );
+
+	dsharedmesh_t	*entries = (dsharedmesh_t *)Mem_Alloc( sizeof( dsharedmesh_t ) * Q_max( g_numsharedmeshes, 1 ));
+
+	// lay out the data
+	ofs = sizeof( dmeshcacheheader_t ) + sizeof( dsharedmesh_t ) * g_numsharedmeshes;
+
+	for( int i = 0; i < g_numsharedmeshes; i++ )
+	{
+		const tsharedmesh_t	*shared = g_sharedmeshes[i];
+		const tmesh_t	*mesh = shared->mesh;
+		dsharedmesh_t	*out = &entries[i];
+
+		out->meshCRC = shared->meshCRC;
+		out->body = shared->body;
+		out->skin = shared->skin;
+		out->numtextures = mesh->numtextures;
+		out->numfaces = mesh->numfaces;
+		out->numverts = mesh->numverts;
+		memcpy( out->vsubmodels, mesh->vsubmodels, sizeof( out->vsubmodels ));
+		memcpy( out->fsubmodels, mesh->fsubmodels, sizeof( out->fsubmodels ));
+#ifdef HLRAD_RAYTRACE
+		if( shared->hastree )
+		{
+			out->hastree = true;
+			out->numnodes = mesh->rayBVH.NumNodes();
+			out->numtris = mesh->rayBVH.NumTris();
+		}
+#endif
+		out->nodeofs = ofs = AlignMeshCacheOffset( ofs );
+		ofs += sizeof( bvhnode4_t ) * out->numnodes;
+		out->trisofs = ofs;
+		ofs += sizeof( bvhtris4_t ) * out->numtris;
+		out->textureofs = ofs;
+		ofs += sizeof( dsharedtexture_t ) * out->numtextures;
+		out->faceofs = ofs;
+		ofs += sizeof( dsharedface_t ) * out->numfaces;
+		out->vertofs = ofs;
+		ofs += sizeof( dsharedvert_t ) * out->numverts;
+
+		for( int j = 0; j < out->numtextures; j++ )
+		{
+			if( mesh->textures[j].data )
+				ofs += mesh->textures[j].width * mesh->textures[j].height;
+		}
+	}
+
+	GetMeshCacheName( filename, sizeof( filename ));
+
+	if(( f = fopen( filename, "wb" )) == NULL )
+	{
+		MsgDev( D_WARN, "couldn't write %s\n", filename );
+		Mem_Free( entries );
+		return;
+	}
+
+	pos = 0;
+	bool	success = WriteMeshCacheData( f, pos, &header, sizeof( header ));
+	success = success && WriteMeshCacheData( f, pos, entries, sizeof( dsharedmesh_t ) * g_numsharedmeshes );
+
+	for( int i = 0; i < g_numsharedmeshes && success; i++ )
+	{
+		const tmesh_t	*mesh = g_sharedmeshes[i]->mesh;
+		const dsharedmesh_t	*out = &entries[i];
+#ifdef HLRAD_RAYTRACE
+		success = WriteMeshCachePadding( f, pos, out->nodeofs );
+		success = success && WriteMeshCacheData( f, pos, mesh->rayBVH.GetNodes(), sizeof( bvhnode4_t ) * out->numnodes );
+		success = success && WriteMeshCacheData( f, pos, mesh->rayBVH.GetTris(), sizeof( bvhtris4_t ) * out->numtris );
+#else
+		success = WriteMeshCachePadding( f, pos, out->nodeofs );
+#endif
+		uint64_t	dataofs = out->vertofs + sizeof( dsharedvert_t ) * out->numverts;
+
+		for( int j = 0; j < out->numtextures && success; j++ )
+		{
+			const timage_t	*tex = &mesh->textures[j];
+			dsharedtexture_t	dtex;
+
+			memset( &dtex, 0, sizeof( dtex ));
+			dtex.flags = tex->flags;
+			dtex.width = tex->width;
+			dtex.height = tex->height;
+
+			if( tex->data )
+			{
+				dtex.dataofs = dataofs;
+				dataofs += tex->width * tex->height;
+			}
+
+			success = WriteMeshCacheData( f, pos, &dtex, sizeof( dtex ));
+		}
+
+		for( int j = 0; j < out->numfaces && success; j++ )
+		{
+			const tface_t	*face = &mesh->faces[j];
+			dsharedface_t	dface;
+
+			memset( &dface, 0, sizeof( dface ));
+			dface.a = face->a;
+			dface.b = face->b;
+			dface.c = face->c;
+			dface.skinref = face->texture - mesh->textures;
+			dface.shadow = face->shadow;
+			dface.color[0] = face->color[0];
+			dface.color[1] = face->color[1];
+			dface.color[2] = face->color[2];
+
+			success = WriteMeshCacheData( f, pos, &dface, sizeof( dface ));
+		}
+
+		for( int j = 0; j < out->numverts && success; j++ )
+		{
+			const tvert_t	*vert = &mesh->verts[j];
+			dsharedvert_t	dvert;
+
+			memset( &dvert, 0, sizeof( dvert ));
+			VectorCopy( vert->point, dvert.point );
+			VectorCopy( vert->normal, dvert.normal );
+			dvert.st[0] = vert->st[0];
+			dvert.st[1] = vert->st[1];
+			dvert.twosided = vert->twosided;
+
+			success = WriteMeshCacheData( f, pos, &dvert, sizeof( dvert ));
+		}
+
+		for( int j = 0; j < out->numtextures && success; j++ )
+		{
+			const timage_t	*tex = &mesh->textures[j];
+
+			if( tex->data )
+				success = WriteMeshCacheData( f, pos, tex->data, tex->width * tex->height );
+		}
+	}
+
+	fclose( f );
+	Mem_Free( entries );
+
+	if( !success )
+	{
+		MsgDev( D_WARN, "couldn't write %s\n", filename );
+		remove( filename );
+		return;
+	}
+
+	g_meshcachechanged = false;
+}
+
+/*
+=============
+FreeSharedMeshes
+
+=============
+*/
+void FreeSharedMeshes( void )
+{
+	for( int i = 0; i < g_numsharedmeshes; i++ )
+	{
+		if( g_sharedmeshes[i]->texdata )
+			Mem_Free( g_sharedmeshes[i]->texdata );
+#ifdef HLRAD_RAYTRACE
+		g_sharedmeshes[i]->mesh->rayBVH.FreeTree();
+#endif
+		Mem_Free( g_sharedmeshes[i]->mesh );
+		Mem_Free( g_sharedmeshes[i] );
+	}
+
+	Mem_Free( g_sharedmeshes );
+	g_sharedmeshes = NULL;
+	g_numsharedmeshes = 0;
+
+	FreeMeshCache();
+}
@@ -1380,7 +1380,7 @@ void WriteModelLighting( void )
 	}
 
 	Msg( "total modellight data: %s\n", Q_memprint( totaldatasize ));
-	g_dflightdata = (byte *)Mem_Realloc( g_dflightdata, totaldatasize );
+	g_dflightdata = ReallocBSPLump( g_dflightdata, totaldatasize );
 
 	// now setup to get the miptex data (or just the headers if using -wadtextures) from the wadfile
 	l = (dvlightlump_t *)g_dflightdata;
@@ -182,6 +182,7 @@ struct tmesh_t
 {
 	vec3_t		absmin, absmax;
 	timage_t	*textures;
+	int			numtextures;
 	tface_t		*faces;
 	int			numfaces;
 	tvert_t		*verts;
@@ -198,6 +199,8 @@ struct tmesh_t
 	float		origin[3];
 	float		angles[3];
 	float		scale[3];
+	struct tsharedmesh_t	*shared;	// posed mesh in model space this instance was made from (studio only)
+	matrix3x4		transform;	// model to world
 
 	aabb_tree_t	face_tree;
 #ifdef HLRAD_RAYTRACE
@@ -206,6 +209,21 @@ struct tmesh_t
 #endif
 };
 
+// posed studio mesh shared by all the entities with the same model, body and skin
+struct tsharedmesh_t
+{
+	uint32_t		meshCRC;
+	int		body;
+	int		skin;
+	tmesh_t		*mesh;		// model space, textures are used by the instances
+	byte		*texdata;		// textures that were moved out of the mapped cache
+	bool		hastree;		// BVH was built or loaded from the cache
+};
+
+tsharedmesh_t *FindSharedMesh( uint32_t meshCRC, int body, int skin );
+tsharedmesh_t *AddSharedMesh( uint32_t meshCRC, int body, int skin, tmesh_t *mesh );
+void ShareMeshTree( tmesh_t *instance );
+
 typedef struct
 {
 	dplane_t		*edges;
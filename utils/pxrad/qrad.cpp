@@ -11,6 +11,7 @@
 // qrad.c
 
 #include "qrad.h"
+#include "simd4.h"
 #include "app_info.h"
 #include "crashhandler.h"
 #include "build_info.h"
@@ -28,9 +29,16 @@ int			g_numskynormals[SKYLEVELMAX+1];
 vec3_t		*g_skynormals[SKYLEVELMAX+1];
 patch_t		*g_patches;
 uint		g_num_patches;
-static vec3_t	(*emitlight)[MAXLIGHTMAPS];
+static vec4_t	(*emitlight)[MAXLIGHTMAPS];	// w is always zero
 static vec3_t	(*addlight)[MAXLIGHTMAPS];
 static byte	(*newstyles)[MAXLIGHTMAPS];
+// the gathering reads these for every transfer, so they are
+// kept in their own arrays instead of the big patch_t records
+static vec4_t	*emitreflectivity;
+static byte	(*emitstyles)[MAXLIGHTMAPS];
+#ifdef HLRAD_DELUXEMAPPING
+static vec4_t	*emitorigin;
+#endif
 #ifdef HLRAD_DELUXEMAPPING
 static vec3_t	(*emitlight_dir)[MAXLIGHTMAPS];
 static vec3_t	(*addlight_dir)[MAXLIGHTMAPS];
@@ -41,6 +49,10 @@ int			g_overflowed_styles_onface[MAX_THREADS];
 int			g_overflowed_styles_onpatch[MAX_THREADS];
 int			g_direct_luxels[MAX_THREADS];
 int			g_lighted_luxels[MAX_THREADS];
+size_t		g_aa_tests[MAX_THREADS];		// visibility tests of the antialiased luxels
+size_t		g_aa_rays[MAX_THREADS];
+size_t		g_dirt_samples[MAX_THREADS];
+size_t		g_dirt_rays[MAX_THREADS];
 
 bool		g_texture_init[MAX_MAP_TEXTURES];
 static winding_t	*g_windingArray[MAX_SUBDIVIDE];
@@ -48,6 +60,7 @@ static uint	g_numwindings = 0;
 static size_t	g_transfer_data_bytes;
 size_t		g_transfer_data_size[MAX_THREADS];
 uint		g_numbounce = DEFAULT_BOUNCE;		// originally this was 8
+bool		g_benchbounce = false;
 vec_t		g_chop = DEFAULT_CHOP;
 vec_t		g_texchop = DEFAULT_TEXCHOP;
 vec_t		g_smoothvalue = DEFAULT_SMOOTHVALUE;
@@ -68,9 +81,11 @@ bool		g_nolerp = false;
 bool		g_envsky = false;
 bool		g_solidsky = false;
 bool		g_aa = false;
+vec_t		g_adaptive_error = DEFAULT_ADAPTIVE_ERROR;
 bool		g_delambert = false;
 bool		g_worldspace = false;
 bool		g_studiolegacy = false;
+bool		g_checktrace = false;
 vec_t		g_scale = DEFAULT_GLOBAL_SCALE;
 rgbdata_t	*g_skytextures[6];
 vec_t		g_lightprobeepsilon = DEFAULT_LIGHTPROBE_EPSILON;
@@ -2002,6 +2017,17 @@ static void FreeTransfers( void )
 {
 	patch_t	*patch = g_patches;
 
+	if( FreeTransferCache( ))
+	{
+		// transfer lists was pointed into the cache file
+		for( int i = 0; i < g_num_patches; i++, patch++ )
+		{
+			patch->tData = NULL;
+			patch->tIndex = NULL;
+		}
+		return;
+	}
+
 	for( int i = 0; i < g_num_patches; i++, patch++ )
 	{
 		if( patch->tData )
@@ -2406,6 +2432,7 @@ void CollectLight( void )
 		{
 			VectorAdd( patch->totallight[j], addlight[i][j], patch->totallight[j] );
 			VectorScale( addlight[i][j], TRANSFER_SCALE, emitlight[i][j] );
+			emitlight[i][j][3] = 0.0f;
 			VectorClear( addlight[i][j] );
 #ifdef HLRAD_DELUXEMAPPING
 			VectorAdd( patch->totallight_dir[j], addlight_dir[i][j], patch->totallight_dir[j] );
@@ -2416,6 +2443,7 @@ void CollectLight( void )
 
 		// store new styles back into patch
 		memcpy( g_patches[i].totalstyle, newstyles[i], sizeof( byte[MAXLIGHTMAPS] ));
+		memcpy( emitstyles[i], newstyles[i], sizeof( byte[MAXLIGHTMAPS] ));
 	}
 }
 
@@ -2425,13 +2453,22 @@ BounceLight
 
 Get light from other patches
   Run multi-threaded
+
+transfer lists are sorted by the emitter index, so the emitter arrays
+are streamed forward. Light is accumulated in registers for every
+style of the receiver and stored once when the patch is done
 =============
 */
 void BounceLight( int threadnum )
 {
+	byte	styles[MAXLIGHTMAPS];
+	simd4_t	accum[MAXLIGHTMAPS];
+#ifdef HLRAD_DELUXEMAPPING
+	simd4_t	accum_dir[MAXLIGHTMAPS];
+#endif
+	const simd4_t	zero = Simd4Splat( 0.0f );
 	int	j, k, m;
 	patch_t	*patch;
-	vec3_t	v;
 
 	while( 1 )
 	{
@@ -2447,8 +2484,15 @@ void BounceLight( int threadnum )
 
 		const dplane_t *plane1 = GetPlaneFromFace( patch->faceNumber );
 
-		for( m = 0; m < MAXLIGHTMAPS && newstyles[j][m] != 255; m++ )
-			VectorClear( addlight[j][m] );
+		memcpy( styles, newstyles[j], sizeof( styles ));
+
+		for( m = 0; m < MAXLIGHTMAPS; m++ )
+		{
+			accum[m] = zero;
+#ifdef HLRAD_DELUXEMAPPING
+			accum_dir[m] = zero;
+#endif
+		}
 
 		for( k = 0; k < iIndex; k++, tIndex++ )
 		{
@@ -2464,45 +2508,52 @@ void BounceLight( int threadnum )
 					continue;
 				}
 
-				patch_t	*emitpatch = &g_patches[patchnum];
+				const byte	*emitstyle = emitstyles[patchnum];
+				simd4_t		scale = Simd4Splat( (float)(*tData) );
+				simd4_t		reflectivity = Simd4Load( emitreflectivity[patchnum] );
 #ifdef HLRAD_DELUXEMAPPING
-				vec3_t	direction;
+				vec4_t	direction;
 
-				VectorSubtract( emitpatch->origin, patch->origin, direction );
+				VectorSubtract( emitorigin[patchnum], patch->origin, direction );
+				direction[3] = 0.0f;
 
 				if( DotProduct( direction, plane1->normal ) <= 0.0f )	//vector between origins can be negative, have to fix it
 				{
 					vec3_t	origin2;
-					GetAlternateOrigin( patch->origin, plane1->normal, emitpatch, origin2 );
+					GetAlternateOrigin( patch->origin, plane1->normal, &g_patches[patchnum], origin2 );
 					VectorSubtract( origin2, patch->origin, direction );
 				}
 
 				VectorNormalize( direction );
+				simd4_t	dir = Simd4Load( direction );
 #endif
 				// for each style on the emitting patch
-				for( int emitstyle = 0; emitstyle < MAXLIGHTMAPS && emitpatch->totalstyle[emitstyle] != 255; emitstyle++ )
+				for( int s = 0; s < MAXLIGHTMAPS && emitstyle[s] != 255; s++ )
 				{
 					// find the matching style on this (destination) patch
-					for( m = 0; m < MAXLIGHTMAPS && newstyles[j][m] != 255; m++ )
+					for( m = 0; m < MAXLIGHTMAPS && styles[m] != 255; m++ )
 					{
-						if( newstyles[j][m] == emitpatch->totalstyle[emitstyle] )
+						if( styles[m] == emitstyle[s] )
 							break;
 					}
 
 					if( m < MAXLIGHTMAPS )
 					{
-						VectorScale( emitlight[patchnum][emitstyle], (float)(*tData), v );
-						VectorMultiply( v, emitpatch->reflectivity, v );
+						simd4_t	v = Simd4Mul( Simd4Mul( Simd4Load( emitlight[patchnum][s] ), scale ), reflectivity );
 
-						if( !VectorIsFinite( v )) continue;
+						// v * 0 is NaN for infinite and NaN values
+						if(( Simd4Mask( Simd4CmpGE( Simd4Mul( v, zero ), zero )) & 7 ) != 7 )
+							continue;
 
-						if( newstyles[j][m] == 255 )
-							newstyles[j][m] = emitpatch->totalstyle[emitstyle];
+						if( styles[m] == 255 )
+							styles[m] = emitstyle[s];
 
-						VectorAdd( addlight[j][m], v, addlight[j][m] );
+						accum[m] = Simd4Add( accum[m], v );
 #ifdef HLRAD_DELUXEMAPPING
-						vec_t	brightness = VectorAvg( v );
-						VectorMA( addlight_dir[j][m], brightness, direction, addlight_dir[j][m] );
+						vec4_t	light;
+						Simd4Store( light, v );
+						vec_t	brightness = VectorAvg( light );
+						accum_dir[m] = Simd4Add( accum_dir[m], Simd4Mul( Simd4Splat( brightness ), dir ));
 #endif
 					}
 					else
@@ -2513,6 +2564,19 @@ void BounceLight( int threadnum )
 			}
 		}
 
+		for( m = 0; m < MAXLIGHTMAPS && styles[m] != 255; m++ )
+		{
+			vec4_t	light;
+
+			Simd4Store( light, accum[m] );
+			VectorCopy( light, addlight[j][m] );
+#ifdef HLRAD_DELUXEMAPPING
+			Simd4Store( light, accum_dir[m] );
+			VectorCopy( light, addlight_dir[j][m] );
+#endif
+		}
+
+		memcpy( newstyles[j], styles, sizeof( styles ));
 		g_overflowed_styles_onpatch[threadnum] += overflowed_styles;
 	}
 }
@@ -2524,8 +2588,15 @@ BounceLight
 */
 void BounceLight( void )
 {
+	double	start, end, total = 0.0;
+	uint64_t	numtransfers = 0;
 	int	i, j;
 
+	emitreflectivity = (vec4_t *)Mem_Alloc(( g_num_patches + 1 ) * sizeof( vec4_t ));
+	emitstyles = (byte (*)[MAXLIGHTMAPS])Mem_Alloc(( g_num_patches + 1 ) * sizeof( byte[MAXLIGHTMAPS] ));
+#ifdef HLRAD_DELUXEMAPPING
+	emitorigin = (vec4_t *)Mem_Alloc(( g_num_patches + 1 ) * sizeof( vec4_t ));
+#endif
 	for( i = 0; i < g_num_patches; i++ )
 	{
 		patch_t	*patch = &g_patches[i];
@@ -2538,13 +2609,38 @@ void BounceLight( void )
 #endif
 		}
 		memcpy( newstyles[i], g_patches[i].totalstyle, sizeof( byte[MAXLIGHTMAPS] ));
+		memcpy( emitstyles[i], g_patches[i].totalstyle, sizeof( byte[MAXLIGHTMAPS] ));
+		VectorCopy( patch->reflectivity, emitreflectivity[i] );
+#ifdef HLRAD_DELUXEMAPPING
+		VectorCopy( patch->origin, emitorigin[i] );
+#endif
+		numtransfers += patch->iData;
 	}
 
 	for( i = 0; i < g_numbounce; i++ )
 	{
+		start = I_FloatTime();
 		RunThreadsOnIncremental( g_num_patches, true, BounceLight, i + 1 );
+		end = I_FloatTime();
+		total += end - start;
 		CollectLight();
 	}
+
+	if( g_benchbounce && total > 0.0 )
+	{
+		Msg( "BounceLight: %u patches, %.2f M transfers\n", g_num_patches, numtransfers / 1000000.0 );
+		Msg( "BounceLight: %u bounces in %.2f secs, %.2f bounces/sec, %.2f M transfers/sec\n", g_numbounce, total,
+		g_numbounce / total, (double)numtransfers * g_numbounce / total / 1000000.0 );
+	}
+
+	Mem_Free( emitreflectivity );
+	Mem_Free( emitstyles );
+	emitreflectivity = NULL;
+	emitstyles = NULL;
+#ifdef HLRAD_DELUXEMAPPING
+	Mem_Free( emitorigin );
+	emitorigin = NULL;
+#endif
 }
 
 //==============================================================
@@ -2585,9 +2681,15 @@ void RadWorld( void )
 
 	InitWorldTrace();
 
+	// only light values were changed, direct light will be rescaled from the cache
+	bool relight = g_relight && LoadRelightCache();
+
 	// generate a position map for each face
-	RunThreadsOnIndividual( g_numfaces, true, FindFacePositions );
-	CalcPositionsSize();
+	if( !relight )
+	{
+		RunThreadsOnIndividual( g_numfaces, true, FindFacePositions );
+		CalcPositionsSize();
+	}
 
 	if( g_envsky )
 		LoadEnvSkyTextures();
@@ -2616,16 +2718,26 @@ void RadWorld( void )
 	RunThreadsOnIndividual( g_numfaces, true, BuildFaceLights );
 	CalcSampleSize ();
 
+	if( g_relight )
+	{
+		SaveRelightCache();
+		FreeRelightCache();
+	}
+
 	FreeFacePositions ();
 
 	CalcLuxelsCount();
 
 	if( g_numbounce > 0 && g_usingpatches )
 	{
-		// build transfer lists	
-		MakeTransfers();
+		// build transfer lists or reuse them from the previous run
+		if( !LoadTransferCache( ))
+		{
+			MakeTransfers();
+			SaveTransferCache();
+		}
 
-		emitlight = (vec3_t (*)[MAXLIGHTMAPS])Mem_Alloc(( g_num_patches + 1 ) * sizeof( vec3_t[MAXLIGHTMAPS] ));
+		emitlight = (vec4_t (*)[MAXLIGHTMAPS])Mem_Alloc(( g_num_patches + 1 ) * sizeof( vec4_t[MAXLIGHTMAPS] ));
 		addlight = (vec3_t (*)[MAXLIGHTMAPS])Mem_Alloc(( g_num_patches + 1 ) * sizeof( vec3_t[MAXLIGHTMAPS] ));
 		newstyles = (byte (*)[MAXLIGHTMAPS])Mem_Alloc(( g_num_patches + 1 ) * sizeof( byte[MAXLIGHTMAPS] ));
 #ifdef HLRAD_DELUXEMAPPING
@@ -2809,6 +2921,7 @@ static void PrintRadUsage( void )
 	Msg( "\n-= %s Options =-\n\n", APP_ABBREVIATION );
 	Msg( "    -dev #         : compile with developer message (1 - 4). default is %d\n", DEFAULT_DEVELOPER );
 	Msg( "    -threads #     : manually specify the number of threads to run\n" );
+	Msg( "    -numa          : pin threads to cpu cores spread over NUMA nodes\n" );
  	Msg( "    -extra         : improve lighting quality with lightmap filtering\n" );
 	Msg( "    -bounce #      : set number of radiosity bounces\n" );
 	Msg( "    -ambient r g b : set ambient world light (0.0 to 1.0, r g b)\n" );
@@ -2835,9 +2948,11 @@ static void PrintRadUsage( void )
 	Msg( "    -envsky        : get sky color from gfx\\env textures\n" );
 	Msg( "    -solidsky      : use solid sky color from the light_environment, do not mix it with the sun color\n" );
 	Msg( "    -aa            : 3x3 antialiaing for direct lighting\n" );
+	Msg( "    -adaptive #.#  : stop -aa and dirtmap sampling at this error (0.0 to 1.0). default is 0 (all samples)\n" );
 	Msg( "    -delambert     : removes lambert component from the final lightmap\n" );	
 	Msg( "    -worldspace    : deluxe map in world space, not tangent space\n" );
 	Msg( "    -studiolegacy  : use legacy tree for studio models tracing instead of BVH\n" );
+	Msg( "    -checktrace    : check studio model BVH traces against brute force on random rays\n" );
 	Msg( "    -lightprobeepsilon #.#: set light probe importance threshold value. default is %f\n", DEFAULT_LIGHTPROBE_EPSILON );
 	Msg( "    -lightprobesamples #: set number of rays for light probes baking. default is 256\n" );
 	Msg( "    -studiobounce #: set number of studio model radiosity bounces. default is %d\n", DEFAULT_STUDIO_BOUNCE );
@@ -2846,6 +2961,10 @@ static void PrintRadUsage( void )
 	Msg( "    -skystyle #    : set lightstyle for sky lighting. default is %d\n", LS_NORMAL );
 	Msg( "    -perpixelsky   : per pixel calculation of sky lighting\n" );
 	Msg( "    -patchaa       : use multiple samples for patch visibility\n" );
+	Msg( "    -notransfercache : don't read or write radiosity transfer lists cache\n" );
+	Msg( "    -nomeshcache   : don't read or write posed studio models cache\n" );
+	Msg( "    -benchbounce   : report radiosity bounce throughput (bounces/sec)\n" );
+	Msg( "    -relight       : reuse direct light of the last run if only light values were changed\n" );
 
 #ifdef HLRAD_PARANOIA_BUMP
 	Msg( "    -gammamode #   : gamma correction mode (0, 1, 2)\n" );
@@ -2884,6 +3003,10 @@ int main( int argc, char **argv )
 			g_numthreads = atoi( argv[i+1] );
 			i++;
 		}
+		else if( !Q_strcmp( argv[i], "-numa" ))
+		{
+			g_threadaffinity = true;
+		}
 		else if( !Q_strcmp( argv[i], "-fast" ))
 		{
 			g_nomodelshadow = true;
@@ -2976,6 +3099,12 @@ int main( int argc, char **argv )
 		{
 			g_aa = true;
 		}
+		else if( !Q_strcmp( argv[i], "-adaptive" ))
+		{
+			g_adaptive_error = (float)atof( argv[i+1] );
+			g_adaptive_error = bound( 0.0f, g_adaptive_error, 1.0f );
+			i++;
+		}
 		else if( !Q_strcmp( argv[i], "-delambert" ))
 		{
 			g_delambert = true;
@@ -2988,6 +3117,10 @@ int main( int argc, char **argv )
 		{
 			g_studiolegacy = true;
 		}
+		else if( !Q_strcmp( argv[i], "-checktrace" ))
+		{
+			g_checktrace = true;
+		}
 		else if( !Q_strcmp( argv[i], "-scale" ))
 		{
 			g_scale = (float)atof( argv[i+1] );
@@ -3029,6 +3162,22 @@ int main( int argc, char **argv )
 		{
 			g_patchaa = true;
 		}
+		else if( !Q_strcmp( argv[i], "-notransfercache" ))
+		{
+			g_notransfercache = true;
+		}
+		else if( !Q_strcmp( argv[i], "-nomeshcache" ))
+		{
+			g_nomeshcache = true;
+		}
+		else if( !Q_strcmp( argv[i], "-benchbounce" ))
+		{
+			g_benchbounce = true;
+		}
+		else if( !Q_strcmp( argv[i], "-relight" ))
+		{
+			g_relight = true;
+		}
 		else if( !Q_strcmp( argv[i], "-chop" ))
 		{
 			g_chop = (float)atof( argv[i+1] );
@@ -44,6 +44,7 @@
 #define DLIGHT_THRESHOLD		0.0f
 #define DEFAULT_GLOBAL_SCALE	0.5f
 #define DEFAULT_LIGHTPROBE_EPSILON	0.1f
+#define DEFAULT_ADAPTIVE_ERROR	0.0f	// sample everything
 #define	STUDIO_SURFACE_HIT		-2
 #define PATCH_MAX_TRACE_ORIGINS	8
 	
@@ -79,6 +80,7 @@
 #define MAX_SINGLEMAP_MODEL		((MAX_MODEL_SURFACE_EXTENT+1) * (MAX_MODEL_SURFACE_EXTENT+1) * 3)
 #define MAX_SUBDIVIDE			16384
 #define MAX_TEXLIGHTS			1024
+#define MAX_TRACE_BATCH		64	// lines traced together by TestLines
 
 // Paranoia settings
 #define LIGHTFLAG_NOT_NORMAL	2
@@ -123,6 +125,7 @@ typedef struct dlight_s
 	struct patch_s	*patch;
 	byte		*pvs;		// accumulated domain of the light
 	int			flags;		// buz: how to work without flags???
+	int			relightgroup;	// lights that are rescaled together
 
 	// sun spread stuff
 	vec_t		*sunnormalweights;
@@ -385,6 +388,10 @@ extern int		g_overflowed_styles_onface[MAX_THREADS];
 extern int		g_overflowed_styles_onpatch[MAX_THREADS];
 extern int		g_direct_luxels[MAX_THREADS];
 extern int		g_lighted_luxels[MAX_THREADS];
+extern size_t		g_aa_tests[MAX_THREADS];
+extern size_t		g_aa_rays[MAX_THREADS];
+extern size_t		g_dirt_samples[MAX_THREADS];
+extern size_t		g_dirt_rays[MAX_THREADS];
 extern vec_t		g_anorms[NUMVERTEXNORMALS][3];
 extern size_t		g_transfer_data_size[MAX_THREADS];
 extern edgeshare_t		*g_edgeshare;
@@ -414,6 +421,7 @@ extern bool		g_wadtextures;
 extern bool		g_dirtmapping;
 extern bool		g_onlylights;
 extern int		g_numdlights;
+extern directlight_t	*g_directlights;
 extern uint		g_gammamode;
 extern vec_t	g_gamma;
 extern vec_t	g_blur;
@@ -427,9 +435,11 @@ extern bool		g_nolerp;	//cause dm changed how g_lerp_enabled works
 extern bool		g_envsky;
 extern bool		g_solidsky;
 extern bool		g_aa;
+extern vec_t	g_adaptive_error;
 extern bool		g_delambert;
 extern bool		g_worldspace;
 extern bool		g_studiolegacy;
+extern bool		g_checktrace;
 extern vec_t	g_scale;
 extern rgbdata_t	*g_skytextures[6];
 extern vec_t	g_lightprobeepsilon;
@@ -445,6 +455,9 @@ extern int		g_skystyle;
 extern bool		g_usingpatches;
 extern bool		g_perpixelsky;
 extern bool		g_patchaa;
+extern bool		g_notransfercache;
+extern bool		g_nomeshcache;
+extern bool		g_relight;
 
 //
 // ambientcube.c
@@ -466,6 +479,7 @@ void CalcPositionsSize( void );
 // dirtmap.c
 //
 void SetupDirt( void );
+bool AdaptiveSamplingDone( int count, int total, vec_t sum, vec_t sum2 );
 float GatherSampleDirt( int threadnum, int fn, const vec3_t pos, const vec3_t normal, entity_t *ignoreent );
 
 //
@@ -568,6 +582,13 @@ void AliasGetBounds( entity_t *ent, vec3_t mins, vec3_t maxs );
 void LoadStudio( entity_t *ent, void *buffer, int fileLength, int flags );
 void StudioGetBounds( entity_t *ent, vec3_t mins, vec3_t maxs );
 
+//
+// meshcache.c
+//
+void LoadMeshCache( void );
+void SaveMeshCache( void );
+void FreeSharedMeshes( void );
+
 //
 // textures.c
 //
@@ -575,12 +596,37 @@ void TEX_LoadTextures( void );
 miptex_t *GetTextureByMiptex( int miptex );
 void TEX_FreeTextures( void );
 
+//
+// transfers.c
+//
+void HashTransferInputs( byte hash[16] );
+bool LoadTransferCache( void );
+void SaveTransferCache( void );
+bool FreeTransferCache( void );
+
+//
+// relight.c
+//
+#define RELIGHT_SKY_GROUP	0	// indirect sun light, scaled with the skylights
+
+bool LoadRelightCache( void );
+void SaveRelightCache( void );
+void FreeRelightCache( void );
+bool RelightFaceSamples( int facenum, int threadnum, facelight_t *fl, byte *styles );
+void RelightBeginFace( int threadnum, int cachesize );
+void RelightSetSample( int threadnum, int sample );
+void RelightCapture( int threadnum, int group, int style, const byte *styles, const vec3_t add, const vec3_t add_direction );
+void RelightBlurSample( int threadnum, int sample, int pos, vec_t weighting );
+void RelightScaleSample( int threadnum, int sample, vec_t scale );
+void RelightEndFace( int threadnum, int facenum, const byte *styles );
+
 //
 // trace.c
 //
 void InitWorldTrace( void );
 int TestLine( int threadnum, const vec3_t start, const vec3_t end, bool nomodels = false, entity_t *ignoreent = NULL );
 void TestLine( int threadnum, const vec3_t start, const vec3_t stop, trace_t *trace, bool nomodels = true, entity_t *ignoreent = NULL );
+void TestLines( int threadnum, int numlines, const vec3_t *start, const vec3_t *stop, trace_t *trace, bool nomodels = true, entity_t *ignoreent = NULL );
 void FreeWorldTrace( void );
 
 dleaf_t *PointInLeaf( const vec3_t point );
@@ -657,6 +657,7 @@ void CWorldRayTraceBVH :: BuildTree( tmesh_t *src )
 	int			minSAH_axis;
 	int			minSAH_separator;
 	bbox_t		minSAH_boxleft, minSAH_boxright;
+	bvhnode_t	*tree;
 	bvhnode_t	*node_cur;
 	bvhnode_t	*node_last;	
 	bbox_t		*box_cur;
@@ -670,6 +671,9 @@ void CWorldRayTraceBVH :: BuildTree( tmesh_t *src )
 		if( mesh->faces[i].shadow )
 			box_count++;
 
+	if( !box_count )
+		return; // nothing to trace
+
 	node_count = box_count * 2 - 1;
 
 	boxes = new bbox_t[box_count];
@@ -680,13 +684,14 @@ void CWorldRayTraceBVH :: BuildTree( tmesh_t *src )
 	boxes_id[2] = new bbox_t*[box_count];
 	faces_id = new int[box_count];
 
-	nodes = new bvhnode_t[node_count];
-	nodes[0].start_id = 0;
-	nodes[0].end_id = box_count - 1;
-	nodes[0].hit = BVH_EXIT_NODE;
-	nodes[0].miss = BVH_EXIT_NODE;	
-	VectorSet( nodes[0].bbox.min,  FLT_MAX,  FLT_MAX,  FLT_MAX );
-	VectorSet( nodes[0].bbox.max, -FLT_MAX, -FLT_MAX, -FLT_MAX );	
+	tree = new bvhnode_t[node_count];
+	tree[0].start_id = 0;
+	tree[0].end_id = box_count - 1;
+	tree[0].hit = BVH_EXIT_NODE;
+	tree[0].miss = BVH_EXIT_NODE;	
+	tree[0].depth = 0;
+	VectorSet( tree[0].bbox.min,  FLT_MAX,  FLT_MAX,  FLT_MAX );
+	VectorSet( tree[0].bbox.max, -FLT_MAX, -FLT_MAX, -FLT_MAX );	
 
 
 	for( i = 0, j = 0, box_cur = &boxes[0]; i < box_count; i++, j++, box_cur++ )
@@ -707,8 +712,8 @@ void CWorldRayTraceBVH :: BuildTree( tmesh_t *src )
 		VectorCompareMin( mesh->verts[face->c].point, box_cur->min, box_cur->min );
 		VectorCompareMax( mesh->verts[face->c].point, box_cur->max, box_cur->max );
 
-		VectorCompareMin( nodes[0].bbox.min, box_cur->min, nodes[0].bbox.min );
-		VectorCompareMax( nodes[0].bbox.max, box_cur->max, nodes[0].bbox.max );		
+		VectorCompareMin( tree[0].bbox.min, box_cur->min, tree[0].bbox.min );
+		VectorCompareMax( tree[0].bbox.max, box_cur->max, tree[0].bbox.max );		
 
 		boxes_id[0][i] = box_cur;
 		boxes_id[1][i] = box_cur;
@@ -717,14 +722,30 @@ void CWorldRayTraceBVH :: BuildTree( tmesh_t *src )
 
 	
 	
-	node_last = &nodes[0];
+	node_last = &tree[0];
 	
-	for( i = 0, node_cur = &nodes[0]; i < node_count; i++, node_cur++ )
+	for( i = 0, node_cur = &tree[0]; i < node_count; i++, node_cur++ )
 		if( node_cur->end_id > node_cur->start_id )
 		{
+			int	first_axis = 0, last_axis = 2;
+			int	first_sep = node_cur->start_id;
+			int	last_sep = node_cur->end_id - 1;
+
+			// degenerate triangles can make SAH peel one box at a time,
+			// past this depth the node is halved on the longest axis so
+			// the four-wide tree always fits the traversal stack
+			if( node_cur->depth >= BVH_MAX_SAH_DEPTH )
+			{
+				vec3_t	size;
+
+				VectorSubtract( node_cur->bbox.max, node_cur->bbox.min, size );
+				first_axis = last_axis = ( size[0] >= size[1] && size[0] >= size[2] ) ? 0 : ( size[1] >= size[2] ) ? 1 : 2;
+				first_sep = last_sep = ( node_cur->start_id + node_cur->end_id ) / 2;
+			}
+
 			minSAH = FLT_MAX;
 			
-			for( j = 0; j < 3; j++ )
+			for( j = first_axis; j <= last_axis; j++ )
 			{
 				switch( j )
 				{
@@ -750,7 +771,7 @@ void CWorldRayTraceBVH :: BuildTree( tmesh_t *src )
 					VectorCompareMax( boxsah_right[k+1].max, boxes_id[j][k]->max, boxsah_right[k].max );
 				}
 
-				for( k = node_cur->start_id; k < node_cur->end_id; k++ )
+				for( k = first_sep; k <= last_sep; k++ )
 				{
 					tempSAH = SAH( boxsah_left[k] ) * ( k - node_cur->start_id + 1 );
 					tempSAH += SAH( boxsah_right[k+1] ) * ( node_cur->end_id - k ); 
@@ -766,14 +787,24 @@ void CWorldRayTraceBVH :: BuildTree( tmesh_t *src )
 				}
 			}
 
+			if( minSAH == FLT_MAX )
+			{
+				// no finite cost (huge or NaN boxes), halve on the last sorted axis
+				minSAH_axis = last_axis;
+				minSAH_separator = ( first_sep + last_sep ) / 2;
+				memcpy( &minSAH_boxleft, &boxsah_left[minSAH_separator], sizeof( bbox_t ));
+				memcpy( &minSAH_boxright, &boxsah_right[minSAH_separator+1], sizeof( bbox_t ));
+			}
+
 			//splitting current node
 			node_last++;
-			node_cur->hit = node_last - &nodes[0];
+			node_cur->hit = node_last - &tree[0];
 			//child1
 			node_last->start_id = node_cur->start_id;
 			node_last->end_id = minSAH_separator;
 			node_last->hit = node_cur->hit + 1;
 			node_last->miss = node_cur->hit + 1;
+			node_last->depth = node_cur->depth + 1;
 			memcpy( &node_last->bbox, &minSAH_boxleft, sizeof( bbox_t ));
 			//child2
 			node_last++;
@@ -781,6 +812,7 @@ void CWorldRayTraceBVH :: BuildTree( tmesh_t *src )
 			node_last->end_id = node_cur->end_id;
 			node_last->hit = node_cur->miss;
 			node_last->miss = node_cur->miss;
+			node_last->depth = node_cur->depth + 1;
 			memcpy( &node_last->bbox, &minSAH_boxright, sizeof( bbox_t ));
 
 			//Msg(" bvh node num %d, split pos %d, split axis %d\n", i , minSAH_separator, minSAH_axis );
@@ -792,7 +824,7 @@ void CWorldRayTraceBVH :: BuildTree( tmesh_t *src )
 		}
 
 
-	for( i = 0, node_cur = &nodes[0]; i < node_count; i++, node_cur++ )
+	for( i = 0, node_cur = &tree[0]; i < node_count; i++, node_cur++ )
 		if( node_cur->end_id == node_cur->start_id )	//leaf node, negative hit points to a face
 			node_cur->hit = - faces_id[(boxes_id[0][node_cur->start_id] - &boxes[0])]; 
 		
@@ -804,143 +836,797 @@ void CWorldRayTraceBVH :: BuildTree( tmesh_t *src )
 	delete[] boxes_id[1];
 	delete[] boxes_id[2];
 	delete[] faces_id;
+
+	// collapse binary tree into the four-wide one
+	nodes = new bvhnode4_t[box_count];
+	tris = new bvhtris4_t[box_count];
+	numnodes = numtris = 0;
+	owntree = true;
+
+	CollapseNode( tree, 0, false );
+	delete[] tree;
 }
 
-void CWorldRayTraceBVH :: TraceRay( const vec3_t start, const vec3_t stop, trace_t *trace, bool stop_on_first_intersection )
+/*
+=============
+ShareTree
+
+the instance has the same triangles in the same order, only
+moved into the world, so the rays are moved into model space
+=============
+*/
+void CWorldRayTraceBVH :: ShareTree( const CWorldRayTraceBVH *src, tmesh_t *instance, const matrix3x4 local2world )
 {
-	vec3_t	ray_dir, inv_ray_dir, ray_origin;
-	vec_t	dist;
+	nodes = src->nodes;
+	tris = src->tris;
+	numnodes = src->numnodes;
+	numtris = src->numtris;
+	mesh = instance;
+	owntree = false;
+
+	instanced = true;
+	Matrix3x4_Copy( transform, local2world );
+	Matrix3x4_Invert_Full( itransform, local2world );
+}
+
+void CWorldRayTraceBVH :: SetTree( bvhnode4_t *treenodes, int count, bvhtris4_t *treetris, int trianglecount, tmesh_t *src, bool owner )
+{
+	nodes = treenodes;
+	tris = treetris;
+	numnodes = count;
+	numtris = trianglecount;
+	mesh = src;
+	owntree = owner;
+}
+
+void CWorldRayTraceBVH :: FreeTree( void )
+{
+	// shared and mapped trees belong to someone else
+	if( owntree )
+	{
+		delete[] nodes;
+		delete[] tris;
+	}
+
+	nodes = NULL;
+	tris = NULL;
+	numnodes = numtris = 0;
+	owntree = false;
+}
+
+/*
+=============
+MakeLeafPacket
+
+pack all the triangles of small subtree into the leaf
+=============
+*/
+int CWorldRayTraceBVH :: MakeLeafPacket( const bvhnode_t *tree, int nodenum )
+{
+	bvhtris4_t	*packet = &tris[numtris];
+	int		stack[BVH4_LEAF_TRIS * 2];
+	int		depth = 0;
+	int		count = 0;
+
+	memset( packet, 0, sizeof( *packet ));
+	for( int i = 0; i < BVH4_LEAF_TRIS; i++ )
+		packet->face[i] = -1;
+
+	stack[depth++] = nodenum;
+
+	while( depth > 0 )
+	{
+		const bvhnode_t *node = &tree[stack[--depth]];
+
+		if( node->end_id > node->start_id )
+		{
+			stack[depth++] = node->hit + 1;
+			stack[depth++] = node->hit;
+			continue;
+		}
+
+		ASSERT( count < BVH4_LEAF_TRIS );
+
+		const tface_t *face = &mesh->faces[-node->hit];
+		const float *p0 = mesh->verts[face->a].point;
+		const float *p1 = mesh->verts[face->b].point;
+		const float *p2 = mesh->verts[face->c].point;
+
+		for( int i = 0; i < 3; i++ )
+		{
+			packet->p0[i][count] = p0[i];
+			packet->e0[i][count] = p1[i] - p0[i];
+			packet->e1[i][count] = p2[i] - p0[i];
+		}
+
+		packet->face[count++] = -node->hit;
+	}
+
+	return ~(numtris++);
+}
+
+/*
+=============
+CollapseNode
+
+open up the largest children of binary node until there are four of them
+=============
+*/
+int CWorldRayTraceBVH :: CollapseNode( const bvhnode_t *tree, int nodenum, bool leaf_allowed )
+{
+	const bvhnode_t	*node = &tree[nodenum];
+	int		slots[4];
+	int		numslots = 0;
+
+	if( node->end_id - node->start_id < BVH4_LEAF_TRIS )
+	{
+		if( leaf_allowed )
+			return MakeLeafPacket( tree, nodenum );
+		slots[numslots++] = nodenum; // very small tree, root holds the single leaf
+	}
+	else
+	{
+		slots[numslots++] = node->hit;
+		slots[numslots++] = node->hit + 1;
+	}
 
-	VectorCopy( start, ray_origin );
+	while( numslots < 4 )
+	{
+		float	best_area = -1.0f;
+		int	best = -1;
+
+		for( int i = 0; i < numslots; i++ )
+		{
+			const bvhnode_t *child = &tree[slots[i]];
+
+			if( child->end_id - child->start_id < BVH4_LEAF_TRIS )
+				continue; // will be a leaf anyway
+
+			float area = SAH( child->bbox );
+
+			if( area > best_area )
+			{
+				best_area = area;
+				best = i;
+			}
+		}
+
+		if( best == -1 ) break;
+
+		int split = slots[best];
+		slots[best] = tree[split].hit;
+		slots[numslots++] = tree[split].hit + 1;
+	}
+
+	int index = numnodes++;
+	bvhnode4_t *out = &nodes[index];
+
+	for( int i = 0; i < 4; i++ )
+	{
+		if( i < numslots )
+		{
+			const bvhnode_t *child = &tree[slots[i]];
+
+			for( int j = 0; j < 3; j++ )
+			{
+				out->mins[j][i] = child->bbox.min[j];
+				out->maxs[j][i] = child->bbox.max[j];
+			}
+
+			out->child[i] = CollapseNode( tree, slots[i], true );
+		}
+		else
+		{
+			for( int j = 0; j < 3; j++ )
+				out->mins[j][i] = out->maxs[j][i] = 0.0f;
+			out->child[i] = BVH4_EMPTY_NODE;
+		}
+	}
+
+	return index;
+}
+
+/*
+=============
+IntersectTriangles4
+
+four ray-triangle tests at once, either one ray against four
+triangles or four rays against one. returns u, v, w and distance
+=============
+*/
+static _forceinline void IntersectTriangles4( const simd4_t org[3], const simd4_t dir[3], const simd4_t p0[3], const simd4_t e0[3], const simd4_t e1[3], simd4_t uvt[4] )
+{
+	simd4_t	pv[3], tv[3], qv[3];
+	simd4_t	det, inv_det;
+
+	// pv = dir x e1
+	pv[0] = Simd4Sub( Simd4Mul( dir[1], e1[2] ), Simd4Mul( dir[2], e1[1] ));
+	pv[1] = Simd4Sub( Simd4Mul( dir[2], e1[0] ), Simd4Mul( dir[0], e1[2] ));
+	pv[2] = Simd4Sub( Simd4Mul( dir[0], e1[1] ), Simd4Mul( dir[1], e1[0] ));
+
+	det = Simd4Add( Simd4Add( Simd4Mul( e0[0], pv[0] ), Simd4Mul( e0[1], pv[1] )), Simd4Mul( e0[2], pv[2] ));
+	inv_det = Simd4Div( Simd4Splat( 1.0f ), det );
+
+	tv[0] = Simd4Sub( org[0], p0[0] );
+	tv[1] = Simd4Sub( org[1], p0[1] );
+	tv[2] = Simd4Sub( org[2], p0[2] );
+
+	// qv = tv x e0
+	qv[0] = Simd4Sub( Simd4Mul( tv[1], e0[2] ), Simd4Mul( tv[2], e0[1] ));
+	qv[1] = Simd4Sub( Simd4Mul( tv[2], e0[0] ), Simd4Mul( tv[0], e0[2] ));
+	qv[2] = Simd4Sub( Simd4Mul( tv[0], e0[1] ), Simd4Mul( tv[1], e0[0] ));
+
+	uvt[0] = Simd4Mul( Simd4Add( Simd4Add( Simd4Mul( tv[0], pv[0] ), Simd4Mul( tv[1], pv[1] )), Simd4Mul( tv[2], pv[2] )), inv_det );
+	uvt[1] = Simd4Mul( Simd4Add( Simd4Add( Simd4Mul( dir[0], qv[0] ), Simd4Mul( dir[1], qv[1] )), Simd4Mul( dir[2], qv[2] )), inv_det );
+	uvt[2] = Simd4Sub( Simd4Sub( Simd4Splat( 1.0f ), uvt[0] ), uvt[1] );
+	uvt[3] = Simd4Mul( Simd4Add( Simd4Add( Simd4Mul( e1[0], qv[0] ), Simd4Mul( e1[1], qv[1] )), Simd4Mul( e1[2], qv[2] )), inv_det );
+}
+
+static _forceinline simd4_t TriangleHitMask( const simd4_t uvt[4], simd4_t closest )
+{
+	simd4_t	zero = Simd4Splat( 0.0f );
+	simd4_t	mask;
+
+	mask = Simd4And( Simd4CmpGE( uvt[0], zero ), Simd4CmpGE( uvt[1], zero ));
+	mask = Simd4And( mask, Simd4CmpGE( uvt[2], zero ));
+	mask = Simd4And( mask, Simd4CmpGE( uvt[3], zero ));
+
+	return Simd4And( mask, Simd4CmpLT( uvt[3], closest ));
+}
+
+static _forceinline void SetupRayDirection( const vec3_t start, const vec3_t stop, vec3_t ray_dir, vec3_t inv_ray_dir, vec_t &dist )
+{
 	VectorSubtract( stop, start, ray_dir );
 	dist = VectorNormalize( ray_dir );
-	trace->fraction = dist;
 
 	ray_dir[0] = (ray_dir[0] == 0.0f) ? FLT_EPSILON : ray_dir[0];
 	ray_dir[1] = (ray_dir[1] == 0.0f) ? FLT_EPSILON : ray_dir[1];
 	ray_dir[2] = (ray_dir[2] == 0.0f) ? FLT_EPSILON : ray_dir[2];
 	VectorRecip( ray_dir, inv_ray_dir );
+}
 
+void CWorldRayTraceBVH :: ClipToFace( const tface_t *face, const vec3_t dir, const float uvt[3], trace_t *trace )
+{
+	vec3_t	world_dir;
 
-	bvhnode_t	*node_cur;
-	vec3_t tbot, ttop, tmin, tmax;
-	vec2_t t;
-	vec_t t0, t1;
-	vec2_t hit;
+	// faces of the instance are in world space
+	if( instanced )
+	{
+		Matrix3x4_VectorRotate( transform, dir, world_dir );
+		dir = world_dir;
+	}
 
-	vec3_t p0, e0, e1, pv;
-	vec_t inv_det;
-	vec3_t tv, qv;
-	vec4_t uvt;
-	bool tri_hit;
+	trace->contents = face->contents;
 
-	//int counter = 0;
-	//int tris_counter = 0;
+	//studio gi
+	if( (DotProduct( dir, face->normal ) < 0.0f )||FBitSet( face->texture->flags, STUDIO_NF_TWOSIDE ) )
+	{
+		trace->surface = STUDIO_SURFACE_HIT;
+		for( int style = 0; style < MAXLIGHTMAPS; style++ )
+		{
+			trace->styles[style] = mesh->styles[style];
+			VectorClear( trace->light[style] );
+			if( mesh->verts[face->a].light )
+				VectorMA( trace->light[style], uvt[2], mesh->verts[face->a].light->light[style], trace->light[style] );
+			if( mesh->verts[face->b].light )
+				VectorMA( trace->light[style], uvt[0], mesh->verts[face->b].light->light[style], trace->light[style] );
+			if( mesh->verts[face->c].light )
+				VectorMA( trace->light[style], uvt[1], mesh->verts[face->c].light->light[style], trace->light[style] );
+
+			trace->light[style][0] *= TextureToLinear( face->color[0] );
+			trace->light[style][1] *= TextureToLinear( face->color[1] );
+			trace->light[style][2] *= TextureToLinear( face->color[2] );
+
+			if( FBitSet( face->texture->flags, STUDIO_NF_TWOSIDE ) )
+				VectorScale( trace->light[style], 0.31831f, trace->light[style] );	//not very accurate
+		}
+	}
+	else
+		trace->surface = -1;
+}
 
-	int node_cur_id = 0;
-	while( node_cur_id != BVH_EXIT_NODE )
+void CWorldRayTraceBVH :: TraceRay( const vec3_t start, const vec3_t stop, trace_t *trace, bool stop_on_first_intersection )
+{
+	vec3_t		ray_dir, inv_ray_dir;
+	simd4_t		org[3], dir[3], inv[3];
+	int		stack[BVH4_STACK_SIZE];
+	const tface_t	*hitface = NULL;
+	float		hituvt[3];
+	vec_t		dist, closest;
+	vec3_t		local_start, local_stop;
+	int		depth = 0;
+
+	if( instanced )
 	{
-		//counter++;
-		node_cur = &nodes[node_cur_id];
-		
-		VectorSubtract( node_cur->bbox.min, ray_origin, tbot );
-		VectorMultiply( tbot, inv_ray_dir, tbot );
+		// the fraction is the same in model space
+		Matrix3x4_VectorTransform( itransform, start, local_start );
+		Matrix3x4_VectorTransform( itransform, stop, local_stop );
+		start = local_start;
+		stop = local_stop;
+	}
+
+	SetupRayDirection( start, stop, ray_dir, inv_ray_dir, dist );
+	closest = dist;
+
+	for( int i = 0; i < 3; i++ )
+	{
+		org[i] = Simd4Splat( start[i] );
+		dir[i] = Simd4Splat( ray_dir[i] );
+		inv[i] = Simd4Splat( inv_ray_dir[i] );
+	}
+
+	if( numnodes > 0 )
+		stack[depth++] = 0;
+
+	while( depth > 0 )
+	{
+		int	code = stack[--depth];
+
+		if( code >= 0 )
+		{
+			const bvhnode4_t	*node = &nodes[code];
+			simd4_t		t1, t2, tnear, tfar;
+			float		tn[4];
+			int		order[4];
+			int		count = 0;
+
+			// slab test against the four child boxes
+			t1 = Simd4Mul( Simd4Sub( Simd4Load( node->mins[0] ), org[0] ), inv[0] );
+			t2 = Simd4Mul( Simd4Sub( Simd4Load( node->maxs[0] ), org[0] ), inv[0] );
+			tnear = Simd4Min( t1, t2 );
+			tfar = Simd4Max( t1, t2 );
+
+			for( int i = 1; i < 3; i++ )
+			{
+				t1 = Simd4Mul( Simd4Sub( Simd4Load( node->mins[i] ), org[i] ), inv[i] );
+				t2 = Simd4Mul( Simd4Sub( Simd4Load( node->maxs[i] ), org[i] ), inv[i] );
+				tnear = Simd4Max( tnear, Simd4Min( t1, t2 ));
+				tfar = Simd4Min( tfar, Simd4Max( t1, t2 ));
+			}
+
+			simd4_t hit = Simd4And( Simd4CmpGE( tfar, Simd4Max( tnear, Simd4Splat( 0.0f ))), Simd4CmpLE( tnear, Simd4Splat( closest )));
+			int mask = Simd4Mask( hit );
+
+			if( !mask ) continue;
+
+			Simd4Store( tn, tnear );
+
+			// sort by distance, farthest is pushed first
+			for( int i = 0; i < 4; i++ )
+			{
+				if( !FBitSet( mask, BIT( i )) || node->child[i] == BVH4_EMPTY_NODE )
+					continue;
+
+				int j = count++;
+				for( ; j > 0 && tn[order[j - 1]] < tn[i]; j-- )
+					order[j] = order[j - 1];
+				order[j] = i;
+			}
+
+			if( depth + count > BVH4_STACK_SIZE )
+				COM_FatalError( "TraceRay: BVH stack overflow, tree is too deep\n" );
+
+			for( int i = 0; i < count; i++ )
+				stack[depth++] = node->child[order[i]];
+		}
+		else
+		{
+			const bvhtris4_t	*packet = &tris[~code];
+			simd4_t		p0[3], e0[3], e1[3];
+			simd4_t		uvt[4];
+			float		out[4][4];
+
+			for( int i = 0; i < 3; i++ )
+			{
+				p0[i] = Simd4Load( packet->p0[i] );
+				e0[i] = Simd4Load( packet->e0[i] );
+				e1[i] = Simd4Load( packet->e1[i] );
+			}
+
+			IntersectTriangles4( org, dir, p0, e0, e1, uvt );
+			int mask = Simd4Mask( TriangleHitMask( uvt, Simd4Splat( closest )));
+
+			if( !mask ) continue;
 
-		VectorSubtract( node_cur->bbox.max, ray_origin, ttop );
-		VectorMultiply( ttop, inv_ray_dir, ttop );
+			for( int i = 0; i < 4; i++ )
+				Simd4Store( out[i], uvt[i] );
 
-		VectorCompareMin( ttop, tbot, tmin );
-		VectorCompareMax( ttop, tbot, tmax );
+			for( int i = 0; i < BVH4_LEAF_TRIS; i++ )
+			{
+				if( !FBitSet( mask, BIT( i )) || packet->face[i] < 0 )
+					continue;
+
+				const tface_t *face = &mesh->faces[packet->face[i]];
+
+				if( out[3][i] >= closest )
+					continue; // nearer triangle in this packet
+
+				if( face->texture->data && !TraceTexture( face, out[0][i], out[1][i], out[2][i] ))
+					continue;
+
+				closest = out[3][i];
+				hituvt[0] = out[0][i];
+				hituvt[1] = out[1][i];
+				hituvt[2] = out[2][i];
+				hitface = face;
+
+				if( stop_on_first_intersection )
+					break;
+			}
+
+			if( hitface && stop_on_first_intersection )
+				break;
+		}
+	}
+
+	if( hitface )
+	{
+		if( stop_on_first_intersection )
+		{
+			trace->contents = hitface->contents;
+			trace->surface = -1;
+		}
+		else ClipToFace( hitface, ray_dir, hituvt, trace );
+	}
+
+	trace->fraction = closest / dist;
+}
 
-		t[0] = Q_max( tmin[0], tmin[1] );
-		t[1] = Q_max( tmin[0], tmin[2] );
-		t0 = Q_max( t[0], t[1] );
+void CWorldRayTraceBVH :: TraceRays( int numrays, const vec3_t *start, const vec3_t *stop, trace_t *trace, bool stop_on_first_intersection )
+{
+	vec3_t	local_start[4], local_stop[4];
 
-		t[0] = Q_min( tmax[0], tmax[1] );
-		t[1] = Q_min( tmax[0], tmax[2] );
-		t1 = Q_min( t[0], t[1] );
+	for( int i = 0; i < numrays; i += 4 )
+	{
+		int	count = Q_min( numrays - i, 4 );
 
-		if( ( t1 >= Q_max( t0, 0.0f ) )&&( t0 <= trace->fraction ) )	//box hit
+		if( instanced )
+		{
+			for( int j = 0; j < count; j++ )
+			{
+				Matrix3x4_VectorTransform( itransform, start[i + j], local_start[j] );
+				Matrix3x4_VectorTransform( itransform, stop[i + j], local_stop[j] );
+			}
+			TracePacket( count, local_start, local_stop, trace + i, stop_on_first_intersection );
+		}
+		else TracePacket( count, start + i, stop + i, trace + i, stop_on_first_intersection );
+	}
+}
+
+/*
+=============
+TracePacket
+
+up to four rays are going through the tree together, so each
+box and triangle test is done once for the whole packet
+=============
+*/
+void CWorldRayTraceBVH :: TracePacket( int numrays, const vec3_t *start, const vec3_t *stop, trace_t *trace, bool stop_on_first_intersection )
+{
+	vec3_t		ray_dir[4], inv_ray_dir;
+	float		org_soa[3][4], dir_soa[3][4], inv_soa[3][4];
+	simd4_t		org[3], dir[3], inv[3];
+	const tface_t	*hitface[4] = { NULL, NULL, NULL, NULL };
+	float		hituvt[4][3];
+	float		closest[4], dist[4];
+	int		stack[BVH4_STACK_SIZE];
+	int		depth = 0;
+	int		alive = 0;	// rays that still want intersections
+
+	for( int r = 0; r < 4; r++ )
+	{
+		if( r < numrays )
+		{
+			SetupRayDirection( start[r], stop[r], ray_dir[r], inv_ray_dir, dist[r] );
+			closest[r] = dist[r];
+			SetBits( alive, BIT( r ));
+
+			for( int i = 0; i < 3; i++ )
+			{
+				org_soa[i][r] = start[r][i];
+				dir_soa[i][r] = ray_dir[r][i];
+				inv_soa[i][r] = inv_ray_dir[i];
+			}
+		}
+		else
 		{
-			if( node_cur->hit <= 0 )	//leaf node, check face intersection
+			// unused lane, masked out by alive
+			dist[r] = closest[r] = 0.0f;
+			for( int i = 0; i < 3; i++ )
 			{
-				//tris_counter++;
+				org_soa[i][r] = 0.0f;
+				dir_soa[i][r] = inv_soa[i][r] = 1.0f;
+			}
+		}
+	}
 
-				node_cur_id = node_cur->miss;
+	for( int i = 0; i < 3; i++ )
+	{
+		org[i] = Simd4Load( org_soa[i] );
+		dir[i] = Simd4Load( dir_soa[i] );
+		inv[i] = Simd4Load( inv_soa[i] );
+	}
 
-				const tface_t *face = &mesh->faces[-node_cur->hit];
-				VectorCopy( mesh->verts[face->a].point, p0 );
-				VectorSubtract( mesh->verts[face->b].point, p0, e0 );
-				VectorSubtract( mesh->verts[face->c].point, p0, e1 );
+	if( numnodes > 0 )
+		stack[depth++] = 0;
 
-				CrossProduct( ray_dir, e1, pv );
-				inv_det = 1.0f / DotProduct( e0, pv );
+	while( depth > 0 && alive )
+	{
+		int	code = stack[--depth];
 
-				VectorSubtract( ray_origin, p0, tv );
-				CrossProduct( tv, e0, qv );
+		if( code >= 0 )
+		{
+			const bvhnode4_t	*node = &nodes[code];
+			simd4_t		limit = Simd4Load( closest );
+			float		tn[4], nearest[4];
+			int		order[4];
+			int		count = 0;
 
-				uvt[0] = DotProduct( tv, pv ) * inv_det;
-				uvt[1] = DotProduct( ray_dir, qv ) * inv_det;
-				uvt[2] = 1.0f - uvt[0] - uvt[1];				
-				uvt[3] = DotProduct( e1, qv ) * inv_det;
+			for( int i = 0; i < 4; i++ )
+			{
+				simd4_t	t1, t2, tnear, tfar;
+
+				if( node->child[i] == BVH4_EMPTY_NODE )
+					continue;
 
-				tri_hit = uvt[0] >= 0.0f;
-				tri_hit = tri_hit && ( uvt[1] >= 0.0f );
-				tri_hit = tri_hit && ( uvt[2] >= 0.0f );
-				tri_hit = tri_hit && ( uvt[3] >= 0.0f );
+				// one child box against the four rays
+				t1 = Simd4Mul( Simd4Sub( Simd4Splat( node->mins[0][i] ), org[0] ), inv[0] );
+				t2 = Simd4Mul( Simd4Sub( Simd4Splat( node->maxs[0][i] ), org[0] ), inv[0] );
+				tnear = Simd4Min( t1, t2 );
+				tfar = Simd4Max( t1, t2 );
 
-				if( tri_hit )
+				for( int j = 1; j < 3; j++ )
 				{
-					if( face->texture->data )
-						if( !TraceTexture( face, uvt[0], uvt[1], uvt[2]) )
-							continue;
+					t1 = Simd4Mul( Simd4Sub( Simd4Splat( node->mins[j][i] ), org[j] ), inv[j] );
+					t2 = Simd4Mul( Simd4Sub( Simd4Splat( node->maxs[j][i] ), org[j] ), inv[j] );
+					tnear = Simd4Max( tnear, Simd4Min( t1, t2 ));
+					tfar = Simd4Min( tfar, Simd4Max( t1, t2 ));
+				}
 
-					trace->fraction = uvt[3];
-					trace->contents = face->contents;
+				simd4_t hit = Simd4And( Simd4CmpGE( tfar, Simd4Max( tnear, Simd4Splat( 0.0f ))), Simd4CmpLE( tnear, limit ));
+				int mask = Simd4Mask( hit ) & alive;
 
-					if( stop_on_first_intersection )
-					{	
-						trace->surface = -1;
-						trace->fraction /= dist;
-						return;
-					}
+				if( !mask ) continue;
 
-					//studio gi
-					if( (DotProduct( ray_dir, face->normal ) < 0.0f )||FBitSet( face->texture->flags, STUDIO_NF_TWOSIDE ) )
-					{
-						trace->surface = STUDIO_SURFACE_HIT;
-						for( int style = 0; style < MAXLIGHTMAPS; style++ )
-						{
-							trace->styles[style] = mesh->styles[style];
-							VectorClear( trace->light[style] );
-							if( mesh->verts[face->a].light )
-								VectorMA( trace->light[style], uvt[2], mesh->verts[face->a].light->light[style], trace->light[style] );
-							if( mesh->verts[face->b].light )
-								VectorMA( trace->light[style], uvt[0], mesh->verts[face->b].light->light[style], trace->light[style] );
-							if( mesh->verts[face->c].light )
-								VectorMA( trace->light[style], uvt[1], mesh->verts[face->c].light->light[style], trace->light[style] );
-
-							trace->light[style][0] *= TextureToLinear( face->color[0] );
-							trace->light[style][1] *= TextureToLinear( face->color[1] );
-							trace->light[style][2] *= TextureToLinear( face->color[2] );
-
-							if( FBitSet( face->texture->flags, STUDIO_NF_TWOSIDE ) )
-								VectorScale( trace->light[style], 0.31831f, trace->light[style] );	//not very accurate
-						}
-					}
-					else
-						trace->surface = -1;
+				// sort children by the nearest ray entry
+				Simd4Store( tn, tnear );
+				nearest[i] = FLT_MAX;
+				for( int r = 0; r < 4; r++ )
+				{
+					if( FBitSet( mask, BIT( r )))
+						nearest[i] = Q_min( nearest[i], tn[r] );
 				}
+
+				int j = count++;
+				for( ; j > 0 && nearest[order[j - 1]] < nearest[i]; j-- )
+					order[j] = order[j - 1];
+				order[j] = i;
 			}
-			else
-				node_cur_id = node_cur->hit;
+
+			if( depth + count > BVH4_STACK_SIZE )
+				COM_FatalError( "TracePacket: BVH stack overflow, tree is too deep\n" );
+
+			for( int i = 0; i < count; i++ )
+				stack[depth++] = node->child[order[i]];
 		}
 		else
-			node_cur_id = node_cur->miss;
+		{
+			const bvhtris4_t	*packet = &tris[~code];
+
+			for( int i = 0; i < BVH4_LEAF_TRIS && alive; i++ )
+			{
+				simd4_t	p0[3], e0[3], e1[3];
+				simd4_t	uvt[4];
+				float	out[4][4];
+
+				if( packet->face[i] < 0 )
+					continue;
+
+				for( int j = 0; j < 3; j++ )
+				{
+					p0[j] = Simd4Splat( packet->p0[j][i] );
+					e0[j] = Simd4Splat( packet->e0[j][i] );
+					e1[j] = Simd4Splat( packet->e1[j][i] );
+				}
+
+				IntersectTriangles4( org, dir, p0, e0, e1, uvt );
+				int mask = Simd4Mask( TriangleHitMask( uvt, Simd4Load( closest ))) & alive;
+
+				if( !mask ) continue;
+
+				const tface_t *face = &mesh->faces[packet->face[i]];
+
+				for( int j = 0; j < 4; j++ )
+					Simd4Store( out[j], uvt[j] );
+
+				for( int r = 0; r < 4; r++ )
+				{
+					if( !FBitSet( mask, BIT( r )))
+						continue;
+
+					if( face->texture->data && !TraceTexture( face, out[0][r], out[1][r], out[2][r] ))
+						continue;
+
+					closest[r] = out[3][r];
+					hituvt[r][0] = out[0][r];
+					hituvt[r][1] = out[1][r];
+					hituvt[r][2] = out[2][r];
+					hitface[r] = face;
+
+					if( stop_on_first_intersection )
+						ClearBits( alive, BIT( r ));
+				}
+			}
+		}
+	}
+
+	for( int r = 0; r < numrays; r++ )
+	{
+		if( hitface[r] )
+		{
+			if( stop_on_first_intersection )
+			{
+				trace[r].contents = hitface[r]->contents;
+				trace[r].surface = -1;
+			}
+			else ClipToFace( hitface[r], ray_dir[r], hituvt[r], &trace[r] );
+		}
+
+		trace[r].fraction = closest[r] / dist[r];
+	}
+}
+
+/*
+=============
+BruteForceTrace
+
+reference for CheckTree, the ray is tested against every
+triangle in storage order. returns distance fraction of the
+closest hit, hitface is NULL when nothing was hit
+=============
+*/
+float CWorldRayTraceBVH :: BruteForceTrace( const vec3_t start, const vec3_t stop, const tface_t **hitface )
+{
+	vec3_t	ray_dir, inv_ray_dir;
+	simd4_t	org[3], dir[3];
+	vec3_t	local_start, local_stop;
+	vec_t	dist, closest;
+
+	if( instanced )
+	{
+		Matrix3x4_VectorTransform( itransform, start, local_start );
+		Matrix3x4_VectorTransform( itransform, stop, local_stop );
+		start = local_start;
+		stop = local_stop;
+	}
+
+	SetupRayDirection( start, stop, ray_dir, inv_ray_dir, dist );
+	closest = dist;
+	*hitface = NULL;
+
+	for( int i = 0; i < 3; i++ )
+	{
+		org[i] = Simd4Splat( start[i] );
+		dir[i] = Simd4Splat( ray_dir[i] );
+	}
+
+	for( int p = 0; p < numtris; p++ )
+	{
+		const bvhtris4_t	*packet = &tris[p];
+		simd4_t		p0[3], e0[3], e1[3];
+		simd4_t		uvt[4];
+		float		out[4][4];
+
+		for( int i = 0; i < 3; i++ )
+		{
+			p0[i] = Simd4Load( packet->p0[i] );
+			e0[i] = Simd4Load( packet->e0[i] );
+			e1[i] = Simd4Load( packet->e1[i] );
+		}
+
+		IntersectTriangles4( org, dir, p0, e0, e1, uvt );
+
+		for( int i = 0; i < 4; i++ )
+			Simd4Store( out[i], uvt[i] );
+
+		for( int i = 0; i < BVH4_LEAF_TRIS; i++ )
+		{
+			if( packet->face[i] < 0 )
+				continue;
+
+			// written as the hit condition so degenerate triangles (NaN) are rejected too
+			if( !( out[0][i] >= 0.0f && out[1][i] >= 0.0f && out[2][i] >= 0.0f && out[3][i] >= 0.0f && out[3][i] < closest ))
+				continue;
+
+			const tface_t *face = &mesh->faces[packet->face[i]];
+
+			if( face->texture->data && !TraceTexture( face, out[0][i], out[1][i], out[2][i] ))
+				continue;
+
+			closest = out[3][i];
+			*hitface = face;
+		}
+	}
+
+	return closest / dist;
+}
+
+/*
+=============
+CheckTree
+
+random rays are going from the sphere around the model into its
+bounds, the closest hit of the tree must be the same as the hit of
+brute force test, and the packets must give the same traces as
+single rays
+=============
+*/
+int CWorldRayTraceBVH :: CheckTree( int numrays )
+{
+	vec3_t		start[4], stop[4], center, dir;
+	trace_t		single[4], packet[4], any[4];
+	const tface_t	*hitface;
+	int		mismatches = 0;
+	vec_t		radius;
+
+	if( !mesh || numtris <= 0 )
+		return 0;
+
+	VectorAverage( mesh->absmin, mesh->absmax, center );
+	radius = VectorDistance( mesh->absmin, mesh->absmax ) * 0.5f + 1.0f;
+
+	for( int i = 0; i < numrays; i += 4 )
+	{
+		int	count = Q_min( numrays - i, 4 );
+
+		for( int j = 0; j < count; j++ )
+		{
+			dir[0] = RandomFloat( -1.0f, 1.0f );
+			dir[1] = RandomFloat( -1.0f, 1.0f );
+			dir[2] = RandomFloat( -1.0f, 1.0f );
+			if( VectorNormalize( dir ) == 0.0f )
+				VectorSet( dir, 0.0f, 0.0f, 1.0f );
+
+			VectorMA( center, radius, dir, start[j] );
+			stop[j][0] = RandomFloat( mesh->absmin[0], mesh->absmax[0] );
+			stop[j][1] = RandomFloat( mesh->absmin[1], mesh->absmax[1] );
+			stop[j][2] = RandomFloat( mesh->absmin[2], mesh->absmax[2] );
+
+			// continue through the model
+			VectorSubtract( stop[j], start[j], dir );
+			VectorMA( stop[j], 1.0f, dir, stop[j] );
+		}
+
+		for( int j = 0; j < count; j++ )
+		{
+			single[j].contents = packet[j].contents = any[j].contents = CONTENTS_EMPTY;
+			single[j].fraction = packet[j].fraction = any[j].fraction = 1.0f;
+			single[j].surface = packet[j].surface = any[j].surface = -1;
+			TraceRay( start[j], stop[j], &single[j] );
+		}
+
+		TraceRays( count, start, stop, packet );
+		TraceRays( count, start, stop, any, true );
+
+		for( int j = 0; j < count; j++ )
+		{
+			float fraction = BruteForceTrace( start[j], stop[j], &hitface );
+			bool bad = false;
+
+			if( single[j].fraction != fraction || single[j].contents != ( hitface ? hitface->contents : CONTENTS_EMPTY ))
+				bad = true;
+
+			if( packet[j].fraction != single[j].fraction || packet[j].contents != single[j].contents || packet[j].surface != single[j].surface )
+				bad = true;
+
+			if(( any[j].fraction < 1.0f ) != ( hitface != NULL ))
+				bad = true;
+
+			if( bad ) mismatches++;
+		}
 	}
 
-	trace->fraction /= dist;	
-	//Msg( " fraction %f, counter %d, tris_counter %d\n", trace->fraction, counter, tris_counter );
+	return mismatches;
 }
 
 #endif
@@ -15,6 +15,7 @@
 #include <assert.h>
 #include "cmdlib.h"
 #include "mathlib.h"
+#include "simd4.h"
 #include <utlarray.h>
 
 struct tface_t;
@@ -146,37 +147,99 @@ private:
 
 
 #define BVH_EXIT_NODE		INT_MAX
+#define BVH4_EMPTY_NODE		INT_MIN	// unused child slot
+#define BVH4_LEAF_TRIS		4	// triangles per leaf packet
+#define BVH4_STACK_SIZE		256
+#define BVH_MAX_SAH_DEPTH		48	// deeper nodes are split at the median, keeps the stack of 256 enough
 
 struct bbox_t
 {
 	vec3_t	min, max;	
 };
 
+// binary tree, only used while building
 struct bvhnode_t
 {
 	int		start_id, end_id;
 	int 	hit, miss;
+	int	depth;
 	bbox_t	bbox;
 };
 
+// four child boxes in SoA layout so one ray is tested against all of them at once.
+// child >= 0 is a node, otherwise ~child is the leaf packet index
+struct alignas( 64 ) bvhnode4_t
+{
+	float	mins[3][4];
+	float	maxs[3][4];
+	int	child[4];
+	int	pad[4];
+};
+
+// leaf triangles in SoA layout, face is -1 on unused lanes
+struct alignas( 64 ) bvhtris4_t
+{
+	float	p0[3][4];
+	float	e0[3][4];
+	float	e1[3][4];
+	int	face[4];
+};
+
 class CWorldRayTraceBVH
 {
 private:
-	bvhnode_t	*nodes;
+	bvhnode4_t	*nodes;
+	bvhtris4_t	*tris;
+	int		numnodes;
+	int		numtris;
 	tmesh_t		*mesh;	
+	bool		owntree;	// nodes and tris were allocated with new[]
+
+	// instanced tree is built in model space and shared
+	bool		instanced;
+	matrix3x4		transform;	// model to world
+	matrix3x4		itransform;	// world to model
 public:
 	CWorldRayTraceBVH()
 	{
 		nodes = NULL;
+		tris = NULL;
+		numnodes = numtris = 0;
 		mesh = NULL;
+		owntree = false;
+		instanced = false;
 	}
 
 	void BuildTree( tmesh_t *src );
+	void FreeTree( void );
+
+	// use the tree of another mesh with the same triangles in model space
+	void ShareTree( const CWorldRayTraceBVH *src, tmesh_t *instance, const matrix3x4 local2world );
+
+	// tree that was built earlier and stored somewhere (e.g. mapped from the cache),
+	// owner means the arrays were allocated with new[] and FreeTree deletes them
+	void SetTree( bvhnode4_t *treenodes, int count, bvhtris4_t *treetris, int trianglecount, tmesh_t *src, bool owner = false );
+
+	const bvhnode4_t *GetNodes( void ) const { return nodes; }
+	const bvhtris4_t *GetTris( void ) const { return tris; }
+	int NumNodes( void ) const { return numnodes; }
+	int NumTris( void ) const { return numtris; }
 
 	void TraceRay( const vec3_t start, const vec3_t stop, trace_t *trace, bool stop_on_first_intersection = false  );
+
+	// traces rays by packets of four, each trace gets the same result as TraceRay would give
+	void TraceRays( int numrays, const vec3_t *start, const vec3_t *stop, trace_t *trace, bool stop_on_first_intersection = false );
+
+	// compares TraceRay and TraceRays with a test of every triangle on random rays, returns count of mismatches
+	int CheckTree( int numrays );
 private:
 	float SAH( const bbox_t box );
 	bool TraceTexture( const tface_t *face, float u, float v, float w );	
+	int CollapseNode( const bvhnode_t *tree, int nodenum, bool leaf_allowed );
+	int MakeLeafPacket( const bvhnode_t *tree, int nodenum );
+	void TracePacket( int numrays, const vec3_t *start, const vec3_t *stop, trace_t *trace, bool stop_on_first_intersection );
+	void ClipToFace( const tface_t *face, const vec3_t dir, const float uvt[3], trace_t *trace );
+	float BruteForceTrace( const vec3_t start, const vec3_t stop, const tface_t **hitface );
 };
 
 #endif//RAYTRACER_H
@@ -0,0 +1,864 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// relight.c	// rebuild the direct light from the previous run when only light values are changed
+
+#include "qrad.h"
+#include "crclib.h"
+
+#define RELIGHT_CACHE_IDENT		(('L'<<24)+('R'<<16)+('X'<<8)+'P')	// little-endian "PXRL"
+#define RELIGHT_CACHE_VERSION		1
+
+#define MAX_RELIGHT_GROUPS		65536
+
+/*
+==============================================================================
+
+mapname.rlc keeps the direct light of every lightmap sample split by light group,
+as it was before the ambient, texlight and radiosity terms are added. Each light
+entity is a group of its own, texlights are grouped by texture. Light is linear in
+the intensity, so a group record is rescaled by new / old intensity per channel.
+Patches, transfers and the bounce are computed as usual
+
+header, lights[numlights], faces[numfaces], samples[numsamples], records[numrecords], vislight data
+==============================================================================
+*/
+typedef struct
+{
+	int		ident;
+	int		version;
+	byte		hash[16];			// MD5 of geometry and direct lighting settings
+	uint		numfaces;
+	uint		numlights;
+	uint		numgroups;
+	uint		vislightsize;
+	uint		skyused;			// indirect sun was gathered on the samples
+	uint		reserved;
+	uint64_t		numsamples;
+	uint64_t		numrecords;
+} drelightheader_t;
+
+// everything the light shape depends on, must match exactly
+typedef struct
+{
+	int		type;
+	int		style;
+	int		falloff;
+	int		topatch;
+	int		facenum;
+	int		modelnum;
+	int		lightnum;
+	int		group;
+	int		numsunnormals;
+	vec3_t		origin;
+	vec3_t		normal;
+	vec_t		fade;
+	vec_t		stopdot;
+	vec_t		stopdot2;
+	vec_t		lf_scale;
+	vec_t		radius;
+	vec_t		patch_area;
+	vec_t		patch_emitter_range;
+	vec_t		sunspreadangle;
+} drelightkey_t;
+
+typedef struct
+{
+	drelightkey_t	key;
+	vec3_t		intensity;
+	vec3_t		diffuse_intensity;
+} drelightlight_t;
+
+typedef struct
+{
+	uint		numsamples;
+	int		width;
+	byte		styles[MAXLIGHTMAPS];
+	uint		numrecords;
+	uint64_t		firstsample;
+	uint64_t		firstrecord;
+} drelightface_t;
+
+typedef struct
+{
+	vec3_t		pos;
+	vec3_t		normal;
+	int		surface;
+	int		occluded;
+} drelightsample_t;
+
+typedef struct
+{
+	int		sample;
+	word		group;
+	byte		slot;
+	byte		reserved;
+	vec3_t		light;
+	vec3_t		dir;
+} relightrec_t;
+
+typedef struct
+{
+	relightrec_t	*records;
+	uint		numrecords;
+	byte		styles[MAXLIGHTMAPS];
+} relightface_t;
+
+// per-thread recording of the face that is being lit
+typedef struct
+{
+	bool		active;
+	int		sample;			// current lightmap cache sample
+
+	relightrec_t	*cache;			// records of the lightmap cache samples
+	int		numcache;
+	int		maxcache;
+	int		*first;			// cache sample -> first record
+	int		cachesize;
+
+	relightrec_t	*out;			// records of the final samples
+	int		numout;
+	int		maxout;
+	int		outsample;
+	int		outfirst;
+} relightcapture_t;
+
+bool			g_relight = false;
+static bool		g_relighting;		// direct light comes from the cache
+static bool		g_relightskyused;
+static int		g_numrelightgroups;
+static relightface_t	*g_relightfaces;		// recorded during the full run
+static relightcapture_t	g_relightcapture[MAX_THREADS];
+
+static byte		*g_relightcache;
+static size_t		g_relightcachesize;
+static const drelightface_t	*g_relightinfaces;
+static const drelightsample_t	*g_relightinsamples;
+static const relightrec_t	*g_relightinrecords;
+static vec3_t		*g_relightscale;		// per group and channel
+static vec_t		*g_relightdirscale;
+
+/*
+=============
+HashRelightInputs
+
+transfer inputs already cover the geometry, patches and the
+shadow casters, add the settings that change the direct light
+=============
+*/
+static void HashRelightInputs( byte hash[16] )
+{
+	MD5Context_t	ctx;
+	byte		transfers[16];
+	int		value;
+
+	MD5Init( &ctx );
+
+	value = RELIGHT_CACHE_VERSION;
+	MD5Update( &ctx, (byte *)&value, sizeof( value ));
+	HashTransferInputs( transfers );
+	MD5Update( &ctx, transfers, sizeof( transfers ));
+
+	MD5Update( &ctx, (byte *)&g_aa, sizeof( g_aa ));
+	MD5Update( &ctx, (byte *)&g_adaptive_error, sizeof( g_adaptive_error ));
+	MD5Update( &ctx, (byte *)&g_dirtmapping, sizeof( g_dirtmapping ));
+	MD5Update( &ctx, (byte *)&g_blur, sizeof( g_blur ));
+	MD5Update( &ctx, (byte *)&g_smoothing_threshold, sizeof( g_smoothing_threshold ));
+	MD5Update( &ctx, (byte *)&g_fastmode, sizeof( g_fastmode ));
+	MD5Update( &ctx, (byte *)&g_indirect_sun, sizeof( g_indirect_sun ));
+	MD5Update( &ctx, (byte *)&g_perpixelsky, sizeof( g_perpixelsky ));
+	MD5Update( &ctx, (byte *)&g_fastsky, sizeof( g_fastsky ));
+	MD5Update( &ctx, (byte *)&g_solidsky, sizeof( g_solidsky ));
+	MD5Update( &ctx, (byte *)&g_envsky, sizeof( g_envsky ));
+	MD5Update( &ctx, (byte *)&g_skystyle, sizeof( g_skystyle ));
+	MD5Update( &ctx, (byte *)&g_studiolegacy, sizeof( g_studiolegacy ));
+
+	MD5Final( hash, &ctx );
+}
+
+static void GetRelightCacheName( char *out, size_t size )
+{
+	char	name[MAX_PATH];
+
+	Q_strncpy( name, source, sizeof( name ));
+	COM_StripExtension( name );
+	Q_snprintf( out, size, "%s.rlc", name );
+}
+
+/*
+=============
+AssignRelightGroups
+
+every light entity is a group of its own, texlights share
+the group with the other patches of the same texture
+=============
+*/
+static int AssignRelightGroups( void )
+{
+	int		numgroups = RELIGHT_SKY_GROUP + 1;
+	int		nummiptex = 0;
+	int		*texgroups;
+	directlight_t	*dl;
+
+	for( int i = 0; i < g_numtexinfo; i++ )
+		nummiptex = Q_max( nummiptex, g_texinfo[i].miptex + 1 );
+	texgroups = (int *)Mem_Alloc(( nummiptex + 1 ) * sizeof( int ));
+
+	for( dl = g_directlights; dl != NULL; dl = dl->next )
+	{
+		if( dl->type == emit_surface )
+		{
+			int	miptex = g_texinfo[g_dfaces[dl->facenum].texinfo].miptex;
+
+			if( !texgroups[miptex] )
+				texgroups[miptex] = numgroups++;
+			dl->relightgroup = texgroups[miptex];
+		}
+		else
+		{
+			dl->relightgroup = numgroups++;
+		}
+	}
+
+	Mem_Free( texgroups );
+
+	return numgroups;
+}
+
+static void GetRelightKey( const directlight_t *dl, drelightkey_t *key )
+{
+	memset( key, 0, sizeof( *key ));
+	key->type = dl->type;
+	key->style = dl->style;
+	key->falloff = dl->falloff;
+	key->topatch = dl->topatch;
+	key->facenum = dl->facenum;
+	key->modelnum = dl->modelnum;
+	key->lightnum = dl->lightnum;
+	key->group = dl->relightgroup;
+	key->numsunnormals = dl->numsunnormals;
+	VectorCopy( dl->origin, key->origin );
+	VectorCopy( dl->normal, key->normal );
+	key->fade = dl->fade;
+	key->stopdot = dl->stopdot;
+	key->stopdot2 = dl->stopdot2;
+	key->lf_scale = dl->lf_scale;
+	key->radius = dl->radius;
+	key->patch_area = dl->patch_area;
+	key->patch_emitter_range = dl->patch_emitter_range;
+	key->sunspreadangle = dl->sunspreadangle;
+}
+
+/*
+=============
+CalcRelightScale
+
+per channel ratio between the new and the old value. The first light of
+the group sets the ratio, others have to follow it or the group is not
+a plain rescale and the cache can't be used
+=============
+*/
+static bool CalcRelightScale( vec3_t scale, vec_t *dirscale, const vec3_t oldvalue, const vec3_t newvalue, bool first )
+{
+	if( first )
+	{
+		for( int i = 0; i < 3; i++ )
+		{
+			if( oldvalue[i] != 0.0f )
+				scale[i] = newvalue[i] / oldvalue[i];
+			else if( newvalue[i] == 0.0f )
+				scale[i] = 1.0f;
+			else return false;
+		}
+
+		// deluxe vectors are scaled by the light average
+		if( VectorAvg( oldvalue ) != 0.0f )
+			*dirscale = VectorAvg( newvalue ) / VectorAvg( oldvalue );
+		else *dirscale = 1.0f;
+
+		return true;
+	}
+
+	for( int i = 0; i < 3; i++ )
+	{
+		if( fabs( newvalue[i] - scale[i] * oldvalue[i] ) > 0.001f * Q_max( fabs( newvalue[i] ), 1.0f ))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+=============
+CalcRelightScales
+
+compare the light layout against the cache
+=============
+*/
+static bool CalcRelightScales( const drelightheader_t *header, const drelightlight_t *in )
+{
+	drelightkey_t	key;
+	directlight_t	*dl;
+	byte		*used;
+	int		numchanged = 0;
+	bool		skyfirst = true;
+	uint		i;
+
+	g_relightscale = (vec3_t *)Mem_Alloc( g_numrelightgroups * sizeof( vec3_t ));
+	g_relightdirscale = (vec_t *)Mem_Alloc( g_numrelightgroups * sizeof( vec_t ));
+	used = (byte *)Mem_Alloc( g_numrelightgroups );
+
+	for( i = 0, dl = g_directlights; dl != NULL; dl = dl->next, i++, in++ )
+	{
+		if( i >= header->numlights )
+			break;
+
+		GetRelightKey( dl, &key );
+
+		if( memcmp( &key, &in->key, sizeof( key )))
+			break;
+
+		int	group = dl->relightgroup;
+
+		if( !CalcRelightScale( g_relightscale[group], &g_relightdirscale[group], in->intensity, dl->intensity, !used[group] ))
+			break;
+		used[group] = true;
+
+		// indirect sun is blended from the sun and the diffuse sky colors
+		if( dl->type == emit_skylight && header->skyused && !g_envsky )
+		{
+			if( !CalcRelightScale( g_relightscale[RELIGHT_SKY_GROUP], &g_relightdirscale[RELIGHT_SKY_GROUP], in->diffuse_intensity, dl->diffuse_intensity, skyfirst ))
+				break;
+			skyfirst = false;
+
+			if( !g_solidsky && !CalcRelightScale( g_relightscale[RELIGHT_SKY_GROUP], NULL, in->intensity, dl->intensity, false ))
+				break;
+		}
+	}
+
+	if( dl != NULL || i != header->numlights )
+	{
+		Mem_Free( used );
+		return false;
+	}
+
+	if( skyfirst )
+	{
+		// envsky or no skylights at all
+		VectorFill( g_relightscale[RELIGHT_SKY_GROUP], 1.0f );
+		g_relightdirscale[RELIGHT_SKY_GROUP] = 1.0f;
+	}
+	used[RELIGHT_SKY_GROUP] = header->skyused;
+
+	for( int j = 0; j < g_numrelightgroups; j++ )
+	{
+		const vec_t	*scale = g_relightscale[j];
+
+		if( used[j] && ( scale[0] != 1.0f || scale[1] != 1.0f || scale[2] != 1.0f || g_relightdirscale[j] != 1.0f ))
+			numchanged++;
+	}
+
+	Mem_Free( used );
+
+	Msg( "Relight:             %i of %i light groups changed\n", numchanged, g_numrelightgroups );
+
+	return true;
+}
+
+/*
+=============
+LoadRelightCache
+
+returns true when the direct light can be rebuilt from the cache,
+otherwise prepares to record it for the next run
+=============
+*/
+bool LoadRelightCache( void )
+{
+	const drelightheader_t	*header;
+	char			filename[MAX_PATH];
+	byte			hash[16];
+	size_t			filesize;
+
+	g_numrelightgroups = AssignRelightGroups();
+	GetRelightCacheName( filename, sizeof( filename ));
+	g_relightcache = COM_MapFile( filename, &filesize );
+
+	if( g_relightcache )
+	{
+		g_relightcachesize = filesize;
+		header = (drelightheader_t *)g_relightcache;
+		HashRelightInputs( hash );
+
+		if( filesize < sizeof( drelightheader_t ) || header->ident != RELIGHT_CACHE_IDENT || header->version != RELIGHT_CACHE_VERSION )
+		{
+			MsgDev( D_WARN, "%s has wrong format, ignored\n", filename );
+		}
+		else if( memcmp( header->hash, hash, sizeof( hash )) || header->numfaces != g_numfaces
+		|| header->numgroups != g_numrelightgroups || header->vislightsize != g_vislightdatasize )
+		{
+			MsgDev( D_INFO, "relight cache is outdated\n" );
+		}
+		else
+		{
+			size_t	facesofs = sizeof( drelightheader_t ) + header->numlights * sizeof( drelightlight_t );
+			size_t	samplesofs = facesofs + header->numfaces * sizeof( drelightface_t );
+			size_t	recordsofs = samplesofs + header->numsamples * sizeof( drelightsample_t );
+			size_t	vislightofs = recordsofs + header->numrecords * sizeof( relightrec_t );
+
+			if( vislightofs + header->vislightsize != filesize )
+			{
+				MsgDev( D_WARN, "%s is truncated, ignored\n", filename );
+			}
+			else if( !CalcRelightScales( header, (drelightlight_t *)(g_relightcache + sizeof( drelightheader_t ))))
+			{
+				MsgDev( D_INFO, "light layout was changed, relight cache ignored\n" );
+			}
+			else
+			{
+				g_relightinfaces = (drelightface_t *)(g_relightcache + facesofs);
+				g_relightinsamples = (drelightsample_t *)(g_relightcache + samplesofs);
+				g_relightinrecords = (relightrec_t *)(g_relightcache + recordsofs);
+
+				for( int i = 0; i < g_numfaces; i++ )
+				{
+					const drelightface_t	*in = &g_relightinfaces[i];
+
+					if( in->firstsample + in->numsamples > header->numsamples || in->firstrecord + in->numrecords > header->numrecords )
+						COM_FatalError( "%s: bad samples on face %i\n", filename, i );
+				}
+
+				// lights that were seen by the faces
+				const byte	*vislight = g_relightcache + vislightofs;
+				for( uint i = 0; i < header->vislightsize; i++ )
+					g_dvislightdata[i] |= vislight[i];
+
+				g_relighting = true;
+				return true;
+			}
+		}
+
+		FreeRelightCache();
+	}
+
+	if( g_numrelightgroups > MAX_RELIGHT_GROUPS )
+	{
+		MsgDev( D_WARN, "too many light groups for relight (%i)\n", g_numrelightgroups );
+		return false;
+	}
+
+	// record the direct light in this run
+	g_relightfaces = (relightface_t *)Mem_Alloc( g_numfaces * sizeof( relightface_t ));
+
+	return false;
+}
+
+/*
+=============
+RelightFaceSamples
+
+restore the samples that CalcLightmap would produce
+=============
+*/
+bool RelightFaceSamples( int facenum, int threadnum, facelight_t *fl, byte *styles )
+{
+	const drelightface_t	*in;
+	const drelightsample_t	*samp;
+	const relightrec_t		*rec;
+
+	if( !g_relighting )
+		return false;
+
+	in = &g_relightinfaces[facenum];
+	fl->samples = (sample_t *)Mem_Alloc( in->numsamples * sizeof( sample_t ));
+	fl->numsamples = in->numsamples;
+	fl->width = in->width;
+	memcpy( styles, in->styles, sizeof( in->styles ));
+
+	// stats
+	g_direct_luxels[threadnum] += fl->numsamples;
+
+	samp = g_relightinsamples + in->firstsample;
+
+	for( uint i = 0; i < in->numsamples; i++, samp++ )
+	{
+		sample_t	*s = &fl->samples[i];
+
+		VectorCopy( samp->pos, s->pos );
+		s->surface = samp->surface;
+		s->occluded = samp->occluded ? true : false;
+#ifdef HLRAD_DELUXEMAPPING
+		VectorCopy( samp->normal, s->normal );
+#endif
+	}
+
+	rec = g_relightinrecords + in->firstrecord;
+
+	for( uint i = 0; i < in->numrecords; i++, rec++ )
+	{
+		sample_t	*s = &fl->samples[rec->sample];
+		vec3_t	v;
+
+		VectorMultiply( rec->light, g_relightscale[rec->group], v );
+		VectorAdd( s->light[rec->slot], v, s->light[rec->slot] );
+#ifdef HLRAD_DELUXEMAPPING
+		VectorMA( s->deluxe[rec->slot], g_relightdirscale[rec->group], rec->dir, s->deluxe[rec->slot] );
+#endif
+	}
+
+	return true;
+}
+
+static relightrec_t *RelightAllocRecord( relightrec_t **records, int *numrecords, int *maxrecords )
+{
+	if( *numrecords == *maxrecords )
+	{
+		*maxrecords = Q_max( *maxrecords * 2, 1024 );
+		*records = (relightrec_t *)Mem_Realloc( *records, *maxrecords * sizeof( relightrec_t ));
+	}
+
+	relightrec_t	*rec = &(*records)[(*numrecords)++];
+	memset( rec, 0, sizeof( *rec ));
+
+	return rec;
+}
+
+/*
+=============
+RelightBeginFace
+
+start recording the lightmap cache samples of the face
+=============
+*/
+void RelightBeginFace( int threadnum, int cachesize )
+{
+	relightcapture_t	*cap = &g_relightcapture[threadnum];
+
+	if( !g_relightfaces )
+		return;
+
+	cap->active = true;
+	cap->sample = -1;
+	cap->numcache = 0;
+	cap->numout = 0;
+	cap->outsample = -1;
+	cap->outfirst = 0;
+	cap->cachesize = cachesize;
+	cap->first = NULL;
+}
+
+void RelightSetSample( int threadnum, int sample )
+{
+	g_relightcapture[threadnum].sample = sample;
+}
+
+/*
+=============
+RelightCapture
+
+called by GatherSampleLight after the light was added to the sample
+=============
+*/
+void RelightCapture( int threadnum, int group, int style, const byte *styles, const vec3_t add, const vec3_t add_direction )
+{
+	relightcapture_t	*cap = &g_relightcapture[threadnum];
+	relightrec_t	*rec;
+	int		slot;
+
+	if( !cap->active )
+		return;
+
+	for( slot = 0; slot < MAXLIGHTMAPS; slot++ )
+	{
+		if( styles[slot] == style )
+			break;
+	}
+
+	if( slot == MAXLIGHTMAPS )
+		return; // style was overflowed
+
+	// merge texlights of the same group
+	for( int i = cap->numcache - 1; i >= 0 && cap->cache[i].sample == cap->sample; i-- )
+	{
+		rec = &cap->cache[i];
+
+		if( rec->group == group && rec->slot == slot )
+		{
+			VectorAdd( rec->light, add, rec->light );
+			VectorAdd( rec->dir, add_direction, rec->dir );
+			return;
+		}
+	}
+
+	rec = RelightAllocRecord( &cap->cache, &cap->numcache, &cap->maxcache );
+	rec->sample = cap->sample;
+	rec->group = group;
+	rec->slot = slot;
+	VectorCopy( add, rec->light );
+	VectorCopy( add_direction, rec->dir );
+}
+
+/*
+=============
+RelightBlurSample
+
+apply the same blur as the lightmap cache gets
+=============
+*/
+void RelightBlurSample( int threadnum, int sample, int pos, vec_t weighting )
+{
+	relightcapture_t	*cap = &g_relightcapture[threadnum];
+
+	if( !cap->active || weighting == 0.0f )
+		return;
+
+	if( !cap->first )
+	{
+		// records are sorted by the cache sample
+		cap->first = (int *)Mem_Alloc(( cap->cachesize + 1 ) * sizeof( int ));
+
+		for( int i = 0; i < cap->numcache; i++ )
+			cap->first[cap->cache[i].sample + 1]++;
+
+		for( int i = 0; i < cap->cachesize; i++ )
+			cap->first[i + 1] += cap->first[i];
+	}
+
+	if( sample != cap->outsample )
+	{
+		cap->outsample = sample;
+		cap->outfirst = cap->numout;
+	}
+
+	for( int i = cap->first[pos]; i < cap->first[pos + 1]; i++ )
+	{
+		const relightrec_t	*in = &cap->cache[i];
+		relightrec_t	*rec = NULL;
+
+		for( int j = cap->outfirst; j < cap->numout; j++ )
+		{
+			if( cap->out[j].group == in->group && cap->out[j].slot == in->slot )
+			{
+				rec = &cap->out[j];
+				break;
+			}
+		}
+
+		if( !rec )
+		{
+			rec = RelightAllocRecord( &cap->out, &cap->numout, &cap->maxout );
+			rec->sample = sample;
+			rec->group = in->group;
+			rec->slot = in->slot;
+		}
+
+		VectorMA( rec->light, weighting, in->light, rec->light );
+		VectorMA( rec->dir, weighting, in->dir, rec->dir );
+	}
+}
+
+void RelightScaleSample( int threadnum, int sample, vec_t scale )
+{
+	relightcapture_t	*cap = &g_relightcapture[threadnum];
+
+	if( !cap->active || sample != cap->outsample )
+		return;
+
+	for( int i = cap->outfirst; i < cap->numout; i++ )
+	{
+		VectorScale( cap->out[i].light, scale, cap->out[i].light );
+		VectorScale( cap->out[i].dir, scale, cap->out[i].dir );
+	}
+}
+
+/*
+=============
+RelightEndFace
+
+=============
+*/
+void RelightEndFace( int threadnum, int facenum, const byte *styles )
+{
+	relightcapture_t	*cap = &g_relightcapture[threadnum];
+	relightface_t	*out = &g_relightfaces[facenum];
+
+	if( !cap->active )
+		return;
+
+	out->numrecords = cap->numout;
+	out->records = (relightrec_t *)Mem_Alloc( cap->numout * sizeof( relightrec_t ));
+	memcpy( out->records, cap->out, cap->numout * sizeof( relightrec_t ));
+	memcpy( out->styles, styles, sizeof( out->styles ));
+
+	for( int i = 0; i < cap->numout && !g_relightskyused; i++ )
+	{
+		if( cap->out[i].group == RELIGHT_SKY_GROUP )
+			g_relightskyused = true;
+	}
+
+	Mem_Free( cap->first );
+	cap->first = NULL;
+	cap->active = false;
+}
+
+/*
+=============
+SaveRelightCache
+
+=============
+*/
+void SaveRelightCache( void )
+{
+	drelightheader_t	header;
+	drelightlight_t	light;
+	drelightface_t	face;
+	drelightsample_t	samp;
+	char		filename[MAX_PATH];
+	directlight_t	*dl;
+	FILE		*f;
+
+	if( !g_relightfaces )
+		return;
+
+	memset( &header, 0, sizeof( header ));
+	header.ident = RELIGHT_CACHE_IDENT;
+	header.version = RELIGHT_CACHE_VERSION;
+	header.numfaces = g_numfaces;
+	header.numgroups = g_numrelightgroups;
+	header.vislightsize = g_vislightdatasize;
+	header.skyused = g_relightskyused;
+	HashRelightInputs( header.hash );
+
+	for( dl = g_directlights; dl != NULL; dl = dl->next )
+		header.numlights++;
+
+	for( int i = 0; i < g_numfaces; i++ )
+	{
+		header.numsamples += g_facelight[i].numsamples;
+		header.numrecords += g_relightfaces[i].numrecords;
+	}
+
+	GetRelightCacheName( filename, sizeof( filename ));
+
+	if(( f = fopen( filename, "wb" )) == NULL )
+	{
+		MsgDev( D_WARN, "couldn't write %s\n", filename );
+		return;
+	}
+
+	bool	success = ( fwrite( &header, sizeof( header ), 1, f ) == 1 );
+
+	for( dl = g_directlights; dl != NULL && success; dl = dl->next )
+	{
+		memset( &light, 0, sizeof( light ));
+		GetRelightKey( dl, &light.key );
+		VectorCopy( dl->intensity, light.intensity );
+		VectorCopy( dl->diffuse_intensity, light.diffuse_intensity );
+		success = ( fwrite( &light, sizeof( light ), 1, f ) == 1 );
+	}
+
+	uint64_t	numsamples = 0;
+	uint64_t	numrecords = 0;
+
+	for( int i = 0; i < g_numfaces && success; i++ )
+	{
+		memset( &face, 0, sizeof( face ));
+		face.numsamples = g_facelight[i].numsamples;
+		face.width = g_facelight[i].width;
+		face.numrecords = g_relightfaces[i].numrecords;
+		face.firstsample = numsamples;
+		face.firstrecord = numrecords;
+		memcpy( face.styles, g_relightfaces[i].styles, sizeof( face.styles ));
+		numsamples += face.numsamples;
+		numrecords += face.numrecords;
+
+		success = ( fwrite( &face, sizeof( face ), 1, f ) == 1 );
+	}
+
+	for( int i = 0; i < g_numfaces && success; i++ )
+	{
+		facelight_t	*fl = &g_facelight[i];
+
+		for( int j = 0; j < fl->numsamples && success; j++ )
+		{
+			sample_t	*s = &fl->samples[j];
+
+			memset( &samp, 0, sizeof( samp ));
+			VectorCopy( s->pos, samp.pos );
+#ifdef HLRAD_DELUXEMAPPING
+			VectorCopy( s->normal, samp.normal );
+#endif
+			samp.surface = s->surface;
+			samp.occluded = s->occluded;
+
+			success = ( fwrite( &samp, sizeof( samp ), 1, f ) == 1 );
+		}
+	}
+
+	for( int i = 0; i < g_numfaces && success; i++ )
+	{
+		relightface_t	*rf = &g_relightfaces[i];
+
+		if( rf->numrecords && fwrite( rf->records, sizeof( relightrec_t ), rf->numrecords, f ) != rf->numrecords )
+			success = false;
+	}
+
+	if( success && g_vislightdatasize > 0 )
+		success = ( fwrite( g_dvislightdata, g_vislightdatasize, 1, f ) == 1 );
+
+	fclose( f );
+
+	if( !success )
+	{
+		MsgDev( D_WARN, "couldn't write %s\n", filename );
+		remove( filename );
+	}
+}
+
+/*
+=============
+FreeRelightCache
+
+=============
+*/
+void FreeRelightCache( void )
+{
+	if( g_relightfaces )
+	{
+		for( int i = 0; i < g_numfaces; i++ )
+			Mem_Free( g_relightfaces[i].records );
+		Mem_Free( g_relightfaces );
+		g_relightfaces = NULL;
+	}
+
+	for( int i = 0; i < MAX_THREADS; i++ )
+	{
+		relightcapture_t	*cap = &g_relightcapture[i];
+
+		Mem_Free( cap->cache );
+		Mem_Free( cap->out );
+		memset( cap, 0, sizeof( *cap ));
+	}
+
+	if( g_relightcache )
+		COM_UnmapFile( g_relightcache, g_relightcachesize );
+	g_relightcache = NULL;
+	g_relightcachesize = 0;
+	g_relightinfaces = NULL;
+	g_relightinsamples = NULL;
+	g_relightinrecords = NULL;
+
+	Mem_Free( g_relightscale );
+	Mem_Free( g_relightdirscale );
+	g_relightscale = NULL;
+	g_relightdirscale = NULL;
+	g_relighting = false;
+	g_relightskyused = false;
+}
@@ -101,8 +101,6 @@ static void StudioSetupTriangle( tmesh_t *mesh, int index )
 	AddPointToBounds( mesh->verts[face->c].point, mesh->absmin, mesh->absmax );
 	ExpandBounds( face->absmin, face->absmax, 1.0 );
 
-	// convert skinref to texture pointer
-	face->texture = &mesh->textures[face->skinref];
 	// setup efficiency intersection data
 	face->PrepareIntersectionData( mesh->verts );
 }
@@ -129,7 +127,15 @@ static void StudioRelinkFace( aabb_tree_t *tree, tface_t *face )
 	InsertLinkBefore( &face->area, &node->solid_edicts );
 }
 
-static int StudioCreateMeshFromTriangles( entity_t *ent, studiohdr_t *phdr, const char *modname, int body, int skin, int flags, matrix3x4 transform[] )
+/*
+=============
+StudioCreateMeshFromTriangles
+
+build the posed mesh in model space, it has no lighting data
+and is shared by all the instances with the same body and skin
+=============
+*/
+static tmesh_t *StudioCreateMeshFromTriangles( studiohdr_t *phdr, const char *modname, int body, int skin, matrix3x4 transform[] )
 {
 	TmpModel_t	submodel[MAXSTUDIOMODELS];	// list of unique models
 	int		i, j, k, totalVertSize = 0;
@@ -377,31 +383,17 @@ static int StudioCreateMeshFromTriangles( entity_t *ent, studiohdr_t *phdr, cons
 
 	size_t	memsize = sizeof( tmesh_t ) + ( sizeof( tface_t ) * numFaces ) + ( sizeof( tvert_t ) * numVerts ) + texdata_size;
 
-	// alloc vislight matrix
-	if( FBitSet( flags, FMESH_MODEL_LIGHTMAPS|FMESH_VERTEX_LIGHTING ))
-		memsize += (g_numworldlights + 7) / 8;
-
-	// alloc lighting faces
-	if( FBitSet( flags, FMESH_MODEL_LIGHTMAPS ))
-		memsize += sizeof( lface_t ) * numFaces;
-
-	// alloc lighting verts
-	if( FBitSet( flags, FMESH_VERTEX_LIGHTING ))
-		memsize += sizeof( lvert_t ) * numVerts;
-
 //	Msg( "%s alloc %s\n", modname, Q_memprint( memsize ));
 
 	byte	*meshdata = (byte *)Mem_Alloc( memsize );
 	byte	*meshend = meshdata + memsize; // bounds checking
 	tmesh_t	*mesh = (tmesh_t *)meshdata;
 
-	if( ent->cache ) Mem_Free( ent->cache ); // throw previous instance
-	ent->cache = meshdata; // FreeEntities will be automatically free that
-
 	// setup pointers
 	meshdata += sizeof( tmesh_t );
 	mesh->textures = (timage_t *)meshdata;
 	meshdata += sizeof( timage_t ) * phdr->numtextures;
+	mesh->numtextures = phdr->numtextures;
 	mesh->faces = (tface_t *)meshdata;
 	meshdata += sizeof( tface_t ) * numFaces;
 	mesh->numfaces = numFaces;
@@ -410,21 +402,6 @@ static int StudioCreateMeshFromTriangles( entity_t *ent, studiohdr_t *phdr, cons
 	memcpy( mesh->faces, faces, sizeof( tface_t ) * mesh->numfaces );
 	Mem_Free( faces );
 
-	// setup additional lightdata if present
-	if( FBitSet( flags, FMESH_MODEL_LIGHTMAPS ))
-	{
-		for( int i = 0; i < numFaces; i++ )
-		{
-			mesh->faces[i].light = (lface_t *)meshdata;
-			meshdata += sizeof( lface_t );
-
-			// clearing lightdata
-			for( int j = 0; j < MAXLIGHTMAPS; j++ )
-				mesh->faces[i].light->styles[j] = 255;
-			mesh->faces[i].light->lightofs = -1;
-		}
-	}
-
 	mesh->verts = (tvert_t *)meshdata;
 	meshdata += sizeof( tvert_t ) * numVerts;
 	mesh->numverts = numVerts;
@@ -433,81 +410,9 @@ static int StudioCreateMeshFromTriangles( entity_t *ent, studiohdr_t *phdr, cons
 	memcpy( mesh->verts, verts, sizeof( tvert_t ) * mesh->numverts );
 	Mem_Free( verts );
 
-	// setup additional lightdata if present
-	if( FBitSet( flags, FMESH_VERTEX_LIGHTING ))
-	{
-		for( int i = 0; i < numVerts; i++ )
-		{
-			mesh->verts[i].light = (lvert_t *)meshdata;
-			meshdata += sizeof( lvert_t );
-			VectorCopy( mesh->verts[i].point, mesh->verts[i].light->pos );
-
-			VectorClear( mesh->verts[i].light->pos );
-		}
-	}
-
-	//move every vertex lighting pos closer to the face center to prevent selfshadowing in the corners
-	if( FBitSet( flags, FMESH_VERTEX_LIGHTING ))	
-	{
-		for( i = 0; i < mesh->numfaces; i++ )
-		{
-			vec3_t	origin, delta;
-			vec_t	dist, dot;
-			tvert_t	*tv[3];
-
-			tv[0] = &mesh->verts[mesh->faces[i].a];
-			tv[1] = &mesh->verts[mesh->faces[i].b];
-			tv[2] = &mesh->verts[mesh->faces[i].c];
-/*
-			VectorCopy( tv[0]->point, origin );
-			VectorAdd( origin, tv[1]->point, origin );
-			VectorAdd( origin, tv[2]->point, origin );
-			VectorScale( origin, 0.333333333f, origin );
-*/
-			//incenter seems to be better than centroid
-			TriangleIncenter( tv[0]->point, tv[1]->point, tv[2]->point, origin );
-
-			for( j = 0; j < 3; j++ )
-			{
-				VectorSubtract( origin, tv[j]->point, delta );
-
-				dist = VectorNormalize( delta );
-
-				dot = DotProduct( delta, tv[j]->normal );
-
-				if( dot < 0.0f )
-				{
-					VectorMA( delta, -dot, tv[j]->normal, delta );	//project offset vector to the tangent plane
-				}
-				
-				dist = Q_min( dist, 1.0f );
-				VectorMA( tv[j]->light->pos, dist, delta, tv[j]->light->pos );
-			}
-		}
-
-		for( i = 0; i < numVerts; i++ )
-		{
-			vec_t	dist;
-			dist = VectorNormalize( mesh->verts[i].light->pos );
-			dist = Q_min( dist, 1.0f );
-
-			VectorMA( mesh->verts[i].point, dist, mesh->verts[i].light->pos, mesh->verts[i].light->pos );
-		}
-	}
-
 	memcpy( mesh->vsubmodels, vsubmodels, sizeof( mesh->vsubmodels ));
 	memcpy( mesh->fsubmodels, fsubmodels, sizeof( mesh->fsubmodels ));
 
-	if( FBitSet( flags, FMESH_MODEL_LIGHTMAPS|FMESH_VERTEX_LIGHTING ))
-	{
-		mesh->vislight = (byte *)meshdata;
-		meshdata += (g_numworldlights + 7) / 8;
-	}
-
-	for( int l = 0; l < MAXLIGHTMAPS; l++ )
-		mesh->styles[l] = 255;
-
-
 	//diffuse color for faces, also mark two-sided vertices
 	for( i = 0; i < mesh->numfaces; i++ )
 	{
@@ -621,6 +526,173 @@ static int StudioCreateMeshFromTriangles( entity_t *ent, studiohdr_t *phdr, cons
 		}
 	}
 
+	if( meshdata != meshend )
+		Msg( "%s memory corrupted\n", modname );
+
+	if( !numFaces )
+	{
+		Mem_Free( mesh );
+		return NULL;
+	}
+
+	// convert skinref to texture pointer
+	for( i = 0; i < numFaces; i++ )
+		mesh->faces[i].texture = &mesh->textures[mesh->faces[i].skinref];
+
+	return mesh;
+}
+
+/*
+=============
+StudioCreateInstance
+
+place a copy of the shared mesh into the world
+and add the lighting data for this entity
+=============
+*/
+static tmesh_t *StudioCreateInstance( entity_t *ent, const tmesh_t *shared, const char *modname, int flags, const matrix3x4 transform )
+{
+	int	numFaces = shared->numfaces;
+	int	numVerts = shared->numverts;
+	int	i, j;
+
+	size_t	memsize = sizeof( tmesh_t ) + ( sizeof( tface_t ) * numFaces ) + ( sizeof( tvert_t ) * numVerts );
+
+	// alloc vislight matrix
+	if( FBitSet( flags, FMESH_MODEL_LIGHTMAPS|FMESH_VERTEX_LIGHTING ))
+		memsize += (g_numworldlights + 7) / 8;
+
+	// alloc lighting faces
+	if( FBitSet( flags, FMESH_MODEL_LIGHTMAPS ))
+		memsize += sizeof( lface_t ) * numFaces;
+
+	// alloc lighting verts
+	if( FBitSet( flags, FMESH_VERTEX_LIGHTING ))
+		memsize += sizeof( lvert_t ) * numVerts;
+
+	byte	*meshdata = (byte *)Mem_Alloc( memsize );
+	byte	*meshend = meshdata + memsize; // bounds checking
+	tmesh_t	*mesh = (tmesh_t *)meshdata;
+
+	if( ent->cache ) Mem_Free( ent->cache ); // throw previous instance
+	ent->cache = meshdata; // FreeEntities will be automatically free that
+
+	// textures are never changed, keep them in the shared mesh
+	mesh->textures = shared->textures;
+	mesh->numtextures = shared->numtextures;
+
+	// setup pointers
+	meshdata += sizeof( tmesh_t );
+	mesh->faces = (tface_t *)meshdata;
+	meshdata += sizeof( tface_t ) * numFaces;
+	mesh->numfaces = numFaces;
+
+	// store faces
+	memcpy( mesh->faces, shared->faces, sizeof( tface_t ) * mesh->numfaces );
+
+	// setup additional lightdata if present
+	if( FBitSet( flags, FMESH_MODEL_LIGHTMAPS ))
+	{
+		for( i = 0; i < numFaces; i++ )
+		{
+			mesh->faces[i].light = (lface_t *)meshdata;
+			meshdata += sizeof( lface_t );
+
+			// clearing lightdata
+			for( j = 0; j < MAXLIGHTMAPS; j++ )
+				mesh->faces[i].light->styles[j] = 255;
+			mesh->faces[i].light->lightofs = -1;
+		}
+	}
+
+	mesh->verts = (tvert_t *)meshdata;
+	meshdata += sizeof( tvert_t ) * numVerts;
+	mesh->numverts = numVerts;
+
+	// move vertexes into the world
+	for( i = 0; i < numVerts; i++ )
+	{
+		const tvert_t	*in = &shared->verts[i];
+		tvert_t		*out = &mesh->verts[i];
+		vec3_t		normal;
+
+		*out = *in;
+		Matrix3x4_VectorTransform( transform, in->point, out->point );
+		VectorCopy( in->normal, normal );
+		Matrix3x4_VectorRotate( transform, normal, normal );
+		VectorNormalize2( normal );
+		VectorCopy( normal, out->normal );
+	}
+
+	// setup additional lightdata if present
+	if( FBitSet( flags, FMESH_VERTEX_LIGHTING ))
+	{
+		for( i = 0; i < numVerts; i++ )
+		{
+			mesh->verts[i].light = (lvert_t *)meshdata;
+			meshdata += sizeof( lvert_t );
+			VectorCopy( mesh->verts[i].point, mesh->verts[i].light->pos );
+
+			VectorClear( mesh->verts[i].light->pos );
+		}
+	}
+
+	//move every vertex lighting pos closer to the face center to prevent selfshadowing in the corners
+	if( FBitSet( flags, FMESH_VERTEX_LIGHTING ))	
+	{
+		for( i = 0; i < mesh->numfaces; i++ )
+		{
+			vec3_t	origin, delta;
+			vec_t	dist, dot;
+			tvert_t	*tv[3];
+
+			tv[0] = &mesh->verts[mesh->faces[i].a];
+			tv[1] = &mesh->verts[mesh->faces[i].b];
+			tv[2] = &mesh->verts[mesh->faces[i].c];
+
+			//incenter seems to be better than centroid
+			TriangleIncenter( tv[0]->point, tv[1]->point, tv[2]->point, origin );
+
+			for( j = 0; j < 3; j++ )
+			{
+				VectorSubtract( origin, tv[j]->point, delta );
+
+				dist = VectorNormalize( delta );
+
+				dot = DotProduct( delta, tv[j]->normal );
+
+				if( dot < 0.0f )
+				{
+					VectorMA( delta, -dot, tv[j]->normal, delta );	//project offset vector to the tangent plane
+				}
+				
+				dist = Q_min( dist, 1.0f );
+				VectorMA( tv[j]->light->pos, dist, delta, tv[j]->light->pos );
+			}
+		}
+
+		for( i = 0; i < numVerts; i++ )
+		{
+			vec_t	dist;
+			dist = VectorNormalize( mesh->verts[i].light->pos );
+			dist = Q_min( dist, 1.0f );
+
+			VectorMA( mesh->verts[i].point, dist, mesh->verts[i].light->pos, mesh->verts[i].light->pos );
+		}
+	}
+
+	memcpy( mesh->vsubmodels, shared->vsubmodels, sizeof( mesh->vsubmodels ));
+	memcpy( mesh->fsubmodels, shared->fsubmodels, sizeof( mesh->fsubmodels ));
+
+	if( FBitSet( flags, FMESH_MODEL_LIGHTMAPS|FMESH_VERTEX_LIGHTING ))
+	{
+		mesh->vislight = (byte *)meshdata;
+		meshdata += (g_numworldlights + 7) / 8;
+	}
+
+	for( int l = 0; l < MAXLIGHTMAPS; l++ )
+		mesh->styles[l] = 255;
+
 	if( meshdata != meshend )
 		Msg( "%s memory corrupted\n", modname );
 
@@ -630,17 +702,18 @@ static int StudioCreateMeshFromTriangles( entity_t *ent, studiohdr_t *phdr, cons
 	for( i = 0; i < numFaces; i++ )
 		StudioSetupTriangle( mesh, i );
 
-	return numFaces;
+	Matrix3x4_Copy( mesh->transform, transform );
+
+	return mesh;
 }
 
-bool StudioConstructMesh( entity_t *ent, void *extradata, const char *modname, uint modelCRC, int flags )
+bool StudioConstructMesh( entity_t *ent, void *extradata, const char *modname, uint modelCRC, uint meshCRC, int flags )
 {
 	studiohdr_t	*phdr = (studiohdr_t *)extradata;
 	double		start = I_FloatTime();
 	vec3_t		origin, angles;
 	int		i;
 	int		body, skin;
-	int		numFaces;
 	vec3_t		xform;
 	float		scale;
 	
@@ -672,36 +745,46 @@ bool StudioConstructMesh( entity_t *ent, void *extradata, const char *modname, u
 	if( xform[1] > 16.0f ) xform[1] = 16.0f;
 	if( xform[2] > 16.0f ) xform[2] = 16.0f;
 
-	// compute default pose for building mesh from
-	mstudioseqdesc_t	*pseqdesc = (mstudioseqdesc_t *)((byte *)phdr + phdr->seqindex);
-	mstudioseqgroup_t	*pseqgroup = (mstudioseqgroup_t *)((byte *)phdr + phdr->seqgroupindex);
-	mstudioanim_t	*panim = (mstudioanim_t *)((byte *)phdr + pseqdesc->animindex);
-	mstudiobone_t	*pbone = (mstudiobone_t *)((byte *)phdr + phdr->boneindex);
-	static vec3_t	pos[MAXSTUDIOBONES];
-	static vec4_t	q[MAXSTUDIOBONES];
-
-	for( i = 0; i < phdr->numbones; i++, pbone++, panim++ ) 
-		StudioCalcBoneTransform( 0, pbone, panim, pos[i], q[i] );
-	pbone = (mstudiobone_t *)((byte *)phdr + phdr->boneindex);
-	matrix3x4	transform, bonematrix, bonetransform[MAXSTUDIOBONES];
-	Matrix3x4_CreateFromEntityScale3f( transform, angles, origin, xform );
+	tsharedmesh_t	*shared = FindSharedMesh( meshCRC, body, skin );
 
-	// compute bones for default anim
-	for( i = 0; i < phdr->numbones; i++ ) 
+	if( !shared )
 	{
-		// initialize bonematrix
-		Matrix3x4_FromOriginQuat( bonematrix, q[i], pos[i] );
+		// compute default pose for building mesh from
+		mstudioseqdesc_t	*pseqdesc = (mstudioseqdesc_t *)((byte *)phdr + phdr->seqindex);
+		mstudioanim_t	*panim = (mstudioanim_t *)((byte *)phdr + pseqdesc->animindex);
+		mstudiobone_t	*pbone = (mstudiobone_t *)((byte *)phdr + phdr->boneindex);
+		static vec3_t	pos[MAXSTUDIOBONES];
+		static vec4_t	q[MAXSTUDIOBONES];
+		matrix3x4		bonematrix, bonetransform[MAXSTUDIOBONES];
+
+		for( i = 0; i < phdr->numbones; i++, pbone++, panim++ ) 
+			StudioCalcBoneTransform( 0, pbone, panim, pos[i], q[i] );
+		pbone = (mstudiobone_t *)((byte *)phdr + phdr->boneindex);
+
+		// compute bones for default anim, the entity transform is applied to every instance
+		for( i = 0; i < phdr->numbones; i++ ) 
+		{
+			// initialize bonematrix
+			Matrix3x4_FromOriginQuat( bonematrix, q[i], pos[i] );
+
+			if( pbone[i].parent == -1 ) 
+				Matrix3x4_Copy( bonetransform[i], bonematrix );
+			else Matrix3x4_ConcatTransforms( bonetransform[i], bonetransform[pbone[i].parent], bonematrix );
+		}
+
+		tmesh_t	*posed = StudioCreateMeshFromTriangles( phdr, modname, body, skin, bonetransform );
 
-		if( pbone[i].parent == -1 ) 
-			Matrix3x4_ConcatTransforms( bonetransform[i], transform, bonematrix );
-		else Matrix3x4_ConcatTransforms( bonetransform[i], bonetransform[pbone[i].parent], bonematrix );
+		if( !posed ) return false;
+
+		shared = AddSharedMesh( meshCRC, body, skin, posed );
 	}
 
-	if(( numFaces = StudioCreateMeshFromTriangles( ent, phdr, modname, body, skin, flags, bonetransform )) == 0 )
-		return false;
+	matrix3x4	transform;
+	Matrix3x4_CreateFromEntityScale3f( transform, angles, origin, xform );
 
-	tmesh_t	*mesh = (tmesh_t *)ent->cache;
+	tmesh_t	*mesh = StudioCreateInstance( ent, shared->mesh, modname, flags, transform );
 	size_t	memsize = Mem_Size( ent->cache );
+	mesh->shared = shared;
 	ent->modtype = mod_studio; // now our mesh is valid and ready to trace
 	mesh->modelCRC = modelCRC;
 	VectorCopy( origin, mesh->origin );
@@ -719,6 +802,7 @@ void LoadStudio( entity_t *ent, void *extradata, int fileLength, int flags )
 {
 	const char *modname = ValueForKey( ent, "model" );
 	uint32_t modelCRC = 0;
+	uint32_t meshCRC;
 	studiohdr_t	*phdr;
 
 	if( !extradata )
@@ -747,11 +831,12 @@ void LoadStudio( entity_t *ent, void *extradata, int fileLength, int flags )
 	ClearBits( flags, FMESH_MODEL_LIGHTMAPS );
 #endif
 
-#if defined( HLRAD_VERTEXLIGHTING ) || defined( HLRAD_LIGHTMAPMODELS )
+	// also the key of the shared posed mesh
 	CRC32_Init( &modelCRC );
 	CRC32_ProcessBuffer( &modelCRC, extradata, phdr->length );
 	modelCRC = CRC32_Final( modelCRC );
-#endif
+	meshCRC = modelCRC;
+
 	// well the textures place in separate file (very stupid case)
 	if( phdr->numtextures == 0 )
 	{
@@ -802,9 +887,14 @@ void LoadStudio( entity_t *ent, void *extradata, int fileLength, int flags )
 
 		Mem_Free( moddata, C_FILESYSTEM );
 		Mem_Free( texdata, C_FILESYSTEM );
+
+		// the shared mesh depends on the textures too
+		CRC32_Init( &meshCRC );
+		CRC32_ProcessBuffer( &meshCRC, extradata, newhdr->length );
+		meshCRC = CRC32_Final( meshCRC );
 	}
 
-	StudioConstructMesh( ent, extradata, modname, modelCRC, flags );
+	StudioConstructMesh( ent, extradata, modname, modelCRC, meshCRC, flags );
 	Mem_Free( extradata, C_FILESYSTEM );
 }
 
@@ -27,6 +27,32 @@ typedef struct moveclip_s
 	tmesh_t		*mesh;		// mesh trace (may be NULL)
 } moveclip_t;
 
+// line prepared for the box tests
+typedef struct
+{
+	vec3_t		start, end;
+	vec3_t		invdir;		// zero on the axes the line doesn't move along
+} tlasray_t;
+
+typedef struct
+{
+	vec3_t		boxmins, boxmaxs;	// enclose all the lines
+	int		numlines;
+	int		lines[MAX_TRACE_BATCH];	// lines that wasn't stopped by world
+	const float	*start[MAX_TRACE_BATCH];
+	vec3_t		end[MAX_TRACE_BATCH];
+	tlasray_t		ray[MAX_TRACE_BATCH];	// the same lines prepared for the box tests
+	trace_t		trace[MAX_TRACE_BATCH];
+	bool		nomodels;
+	entity_t		*ignore;
+
+	// packet of lines for a single studio model
+	int		packet[MAX_TRACE_BATCH];
+	vec3_t		packet_start[MAX_TRACE_BATCH];
+	vec3_t		packet_end[MAX_TRACE_BATCH];
+	trace_t		packet_trace[MAX_TRACE_BATCH];
+} lineclip_t;
+
 typedef struct tnode_s
 {
 	int		type;
@@ -37,9 +63,36 @@ typedef struct tnode_s
 	word		numfaces;		// counting both sides
 } tnode_t;
 
+#define TLAS_LEAF_INSTANCES		2	// entities per leaf of the instance tree
+#define TLAS_STACK_SIZE		64	// balanced tree, depth is log2 of the entity count
+#define CHECKTRACE_RAYS		4096	// random rays per studio model for -checktrace
+
+// linked entity with the data that culling needs, so
+// the traversal doesn't touch the entity itself
+typedef struct
+{
+	vec3_t		absmin, absmax;
+	entity_t		*ent;
+	int		meshflags;	// FMESH_* for studio and alias models, 0 for bmodels
+	bool		mesh;
+} tinstance_t;
+
+// binary tree over the linked entities, children are allocated in pairs
+typedef struct
+{
+	vec3_t		mins, maxs;
+	int		firstchild;	// node index when numinstances is 0
+	int		firstinstance;
+	int		numinstances;	// > 0 for leafs
+} tlasnode_t;
+
 static tnode_t		*tnode_p;
 static aabb_tree_t		entity_tree;
 static int		numsolidedicts;
+static tinstance_t		*tlas_instances;
+static int		tlas_numinstances;
+static tlasnode_t		*tlas_nodes;
+static int		tlas_numnodes;
 static twface_t		*g_world_faces[MAX_MAP_FACES];	// polygons that turned into triangles
 
 /*
@@ -657,7 +710,11 @@ static void LinkEdict( entity_t *ent, modtype_t modtype, const char *modname, in
 		tmesh_t	*mesh = (tmesh_t *)ent->cache;
 
 		if( !g_studiolegacy )
-			mesh->rayBVH.BuildTree( mesh );
+		{
+			if( mesh->shared )
+				ShareMeshTree( mesh );
+			else mesh->rayBVH.BuildTree( mesh );
+		}
 		else
 		{	
 			for( int i = 0; i < mesh->numfaces; i++ )
@@ -803,6 +860,288 @@ void FreeWorldFaces( void )
 	}
 }
 
+/*
+===============================================================================
+
+INSTANCE TREE
+
+the world is traced through its own BSP first and the segment that
+left is clipped against the entities. Every linked entity is a leaf
+of one bounding volume tree, the models keep their own BVH and the
+bmodels their hulls, so a line visits only the entities it crosses
+===============================================================================
+*/
+static int CompareInstanceCentroidsX( const void *a, const void *b )
+{
+	const tinstance_t	*i1 = (const tinstance_t *)a;
+	const tinstance_t	*i2 = (const tinstance_t *)b;
+	vec_t	c1 = i1->absmin[0] + i1->absmax[0];
+	vec_t	c2 = i2->absmin[0] + i2->absmax[0];
+
+	return ( c1 > c2 ) - ( c1 < c2 );
+}
+
+static int CompareInstanceCentroidsY( const void *a, const void *b )
+{
+	const tinstance_t	*i1 = (const tinstance_t *)a;
+	const tinstance_t	*i2 = (const tinstance_t *)b;
+	vec_t	c1 = i1->absmin[1] + i1->absmax[1];
+	vec_t	c2 = i2->absmin[1] + i2->absmax[1];
+
+	return ( c1 > c2 ) - ( c1 < c2 );
+}
+
+static int CompareInstanceCentroidsZ( const void *a, const void *b )
+{
+	const tinstance_t	*i1 = (const tinstance_t *)a;
+	const tinstance_t	*i2 = (const tinstance_t *)b;
+	vec_t	c1 = i1->absmin[2] + i1->absmax[2];
+	vec_t	c2 = i2->absmin[2] + i2->absmax[2];
+
+	return ( c1 > c2 ) - ( c1 < c2 );
+}
+
+/*
+===============
+BuildInstanceNode_r
+
+split the instances by the median of the widest axis
+===============
+*/
+static void BuildInstanceNode_r( int nodenum, int first, int count )
+{
+	tlasnode_t	*node = &tlas_nodes[nodenum];
+	vec3_t		cmins, cmaxs, center;
+	int		i, axis;
+
+	ClearBounds( node->mins, node->maxs );
+	ClearBounds( cmins, cmaxs );
+
+	for( i = first; i < first + count; i++ )
+	{
+		AddPointToBounds( tlas_instances[i].absmin, node->mins, node->maxs );
+		AddPointToBounds( tlas_instances[i].absmax, node->mins, node->maxs );
+		VectorAverage( tlas_instances[i].absmin, tlas_instances[i].absmax, center );
+		AddPointToBounds( center, cmins, cmaxs );
+	}
+
+	if( count <= TLAS_LEAF_INSTANCES )
+	{
+		node->firstchild = 0;
+		node->firstinstance = first;
+		node->numinstances = count;
+		return;
+	}
+
+	axis = 0;
+	if( cmaxs[1] - cmins[1] > cmaxs[axis] - cmins[axis] )
+		axis = 1;
+	if( cmaxs[2] - cmins[2] > cmaxs[axis] - cmins[axis] )
+		axis = 2;
+
+	switch( axis )
+	{
+	case 0: qsort( &tlas_instances[first], count, sizeof( tinstance_t ), CompareInstanceCentroidsX ); break;
+	case 1: qsort( &tlas_instances[first], count, sizeof( tinstance_t ), CompareInstanceCentroidsY ); break;
+	case 2: qsort( &tlas_instances[first], count, sizeof( tinstance_t ), CompareInstanceCentroidsZ ); break;
+	}
+
+	node->firstchild = tlas_numnodes;
+	node->firstinstance = 0;
+	node->numinstances = 0;
+	tlas_numnodes += 2;
+
+	BuildInstanceNode_r( node->firstchild + 0, first, count / 2 );
+	BuildInstanceNode_r( node->firstchild + 1, first + count / 2, count - count / 2 );
+}
+
+/*
+===============
+BuildInstanceTree
+
+must be called when all the entities are linked
+===============
+*/
+static void BuildInstanceTree( void )
+{
+	int	i;
+
+	tlas_numinstances = tlas_numnodes = 0;
+
+	if( numsolidedicts <= 0 )
+		return;
+
+	tlas_instances = (tinstance_t *)Mem_Alloc( numsolidedicts * sizeof( tinstance_t ));
+	tlas_nodes = (tlasnode_t *)Mem_Alloc( numsolidedicts * 2 * sizeof( tlasnode_t ));
+
+	for( i = 1; i < g_numentities; i++ )
+	{
+		entity_t		*e = &g_entities[i];
+		tinstance_t	*in;
+
+		if( !e->area.prev )
+			continue; // not linked
+
+		in = &tlas_instances[tlas_numinstances++];
+		VectorCopy( e->absmin, in->absmin );
+		VectorCopy( e->absmax, in->absmax );
+		in->ent = e;
+
+		if( e->modtype == mod_studio || e->modtype == mod_alias )
+		{
+			in->meshflags = ((tmesh_t *)e->cache)->flags;
+			in->mesh = true;
+		}
+		else
+		{
+			in->meshflags = 0;
+			in->mesh = false;
+		}
+	}
+
+	tlas_numnodes = 1;
+	BuildInstanceNode_r( 0, 0, tlas_numinstances );
+
+	MsgDev( D_REPORT, "instance tree: %i entities, %i nodes\n", tlas_numinstances, tlas_numnodes );
+}
+
+static void FreeInstanceTree( void )
+{
+	Mem_Free( tlas_instances );
+	Mem_Free( tlas_nodes );
+	tlas_instances = NULL;
+	tlas_nodes = NULL;
+	tlas_numinstances = tlas_numnodes = 0;
+}
+
+static void SetupInstanceRay( tlasray_t *ray, const vec3_t start, const vec3_t end )
+{
+	VectorCopy( start, ray->start );
+	VectorCopy( end, ray->end );
+
+	for( int i = 0; i < 3; i++ )
+	{
+		vec_t	delta = end[i] - start[i];
+
+		if( fabs( delta ) > EQUAL_EPSILON )
+			ray->invdir[i] = 1.0f / delta;
+		else ray->invdir[i] = 0.0f;
+	}
+}
+
+/*
+===============
+RayIntersectBounds
+
+does the part of the line before maxfrac cross the box
+===============
+*/
+static bool RayIntersectBounds( const tlasray_t *ray, const vec3_t mins, const vec3_t maxs, vec_t maxfrac )
+{
+	vec_t	enter = 0.0f;
+	vec_t	leave = maxfrac;
+
+	for( int i = 0; i < 3; i++ )
+	{
+		if( ray->invdir[i] == 0.0f )
+		{
+			// the line barely moves along this axis
+			if( Q_max( ray->start[i], ray->end[i] ) < mins[i] || Q_min( ray->start[i], ray->end[i] ) > maxs[i] )
+				return false;
+			continue;
+		}
+
+		vec_t	t0 = ( mins[i] - ray->start[i] ) * ray->invdir[i];
+		vec_t	t1 = ( maxs[i] - ray->start[i] ) * ray->invdir[i];
+
+		if( t0 > t1 )
+		{
+			vec_t	t = t0;
+			t0 = t1;
+			t1 = t;
+		}
+
+		enter = Q_max( enter, t0 );
+		leave = Q_min( leave, t1 );
+
+		if( enter > leave )
+			return false;
+	}
+
+	return true;
+}
+
+/*
+===============
+InstanceCanBlock
+
+shadow flags of the entity against the line
+===============
+*/
+static inline bool InstanceCanBlock( const tinstance_t *in, bool nomodels, entity_t *ignore )
+{
+	if( in->mesh )
+	{
+		//hack for self shadowing without casting shadows
+		if( in->ent == ignore )
+		{
+			if( !FBitSet( in->meshflags, FMESH_SELF_SHADOW ))
+				return false;
+		}
+		else if( !FBitSet( in->meshflags, FMESH_CAST_SHADOW ))
+			return false;
+
+		return !nomodels;
+	}
+
+	return ( in->ent != ignore );
+}
+
+#ifdef HLRAD_RAYTRACE
+/*
+==================
+CheckStudioTraces
+
+compare the BVH traces of every studio model with
+the brute force test of all the triangles
+==================
+*/
+static void CheckStudioTraces( void )
+{
+	int	nummodels = 0, numfailed = 0;
+
+	if( g_studiolegacy )
+	{
+		Msg( "-checktrace: only BVH trees are checked, ignored with -studiolegacy\n" );
+		return;
+	}
+
+	for( int i = 1; i < g_numentities; i++ )
+	{
+		entity_t	*e = &g_entities[i];
+
+		if(( e->modtype != mod_studio && e->modtype != mod_alias ) || !e->cache )
+			continue;
+
+		tmesh_t *mesh = (tmesh_t *)e->cache;
+
+		if( mesh->rayBVH.NumTris() <= 0 )
+			continue;
+
+		int mismatches = mesh->rayBVH.CheckTree( CHECKTRACE_RAYS );
+
+		if( mismatches )
+		{
+			Msg( "^3Warning:^7 %s: %i of %i traces differ from brute force\n", ValueForKey( e, "model" ), mismatches, CHECKTRACE_RAYS );
+			numfailed++;
+		}
+		nummodels++;
+	}
+
+	Msg( "-checktrace: %i studio models checked, %i failed\n", nummodels, numfailed );
+}
+#endif
+
 /*
 ===============
 InitWorldTrace
@@ -816,6 +1155,7 @@ void InitWorldTrace( void )
 	memset( &entity_tree, 0, sizeof( entity_tree ));
 
 	CreateAreaNode( &entity_tree, 0, AREA_MIN_DEPTH, g_dmodels[0].mins, g_dmodels[0].maxs );
+	LoadMeshCache();			// posed studio meshes of the last run
 	BuildWorldFaces();			// init world faces
 	MakeTnodes( g_entities, g_dmodels );	// init world nodes
 
@@ -958,12 +1298,20 @@ void InitWorldTrace( void )
 #ifdef HLRAD_RAYTRACE
 	double end = I_FloatTime();
 	EndPacifier( end - start );
+#endif
+	SaveMeshCache();
+	BuildInstanceTree();
+#ifdef HLRAD_RAYTRACE
+	if( g_checktrace )
+		CheckStudioTraces();
 #endif
 }
 
 void FreeWorldTrace( void )
 {
+	FreeInstanceTree();
 	FreeWorldFaces();
+	FreeSharedMeshes();
 }
 
 /*
@@ -1044,71 +1392,54 @@ void ClipMoveToEntity( entity_t *ent, const vec3_t start, const vec3_t end, trac
 
 /*
 ====================
-ClipToLinks
+ClipToInstances
 
-Mins and maxs enclose the entire area swept by the move
+walk the instance tree along the line, the part of
+the line behind the nearest hit is not tested
 ====================
 */
-static void ClipToLinks( areanode_t *node, moveclip_t *clip, bool stop_on_first_solid = true )
+static void ClipToInstances( moveclip_t *clip, bool stop_on_first_solid = true )
 {
-	link_t	*l, *next;
-	entity_t	*touch;
-	trace_t	trace;
-loc0:
-	// touch linked edicts
-	for( l = node->solid_edicts.next; l != &node->solid_edicts; l = next )
-	{
-		next = l->next;
+	int		stack[TLAS_STACK_SIZE];	// every thread walks on its own stack
+	int		stackpos = 0;
+	const tlasnode_t	*node;
+	tlasray_t		ray;
+	trace_t		trace;
 
-		touch = ENTITY_FROM_AREA( l );
+	SetupInstanceRay( &ray, clip->start, clip->end );
+	stack[stackpos++] = 0;
 
-		//hack for self shadowing without casting shadows
-		if( touch->modtype == mod_studio || touch->modtype == mod_alias )
-		{
-			tmesh_t	*mesh = (tmesh_t *)touch->cache;
+	while( stackpos > 0 )
+	{
+		node = &tlas_nodes[stack[--stackpos]];
 
-			if( touch == clip->ignore )
-			{
-				if( !FBitSet( mesh->flags, FMESH_SELF_SHADOW ) )
-					continue;
-			}
-			else
-				if( !FBitSet( mesh->flags, FMESH_CAST_SHADOW ) )
-					continue;			
-		}
-		else
-			if( touch == clip->ignore )
-				continue;
+		if( !RayIntersectBounds( &ray, node->mins, node->maxs, clip->trace.fraction ))
+			continue;
 
-		if( !BoundsIntersect( clip->boxmins, clip->boxmaxs, touch->absmin, touch->absmax ))
+		if( !node->numinstances )
+		{
+			stack[stackpos++] = node->firstchild + 1;
+			stack[stackpos++] = node->firstchild + 0;
 			continue;
+		}
 
-		// might intersect, so do an exact clip
-		if(( clip->trace.contents == CONTENTS_SOLID )&&(stop_on_first_solid))
-			return;
+		for( int i = 0; i < node->numinstances; i++ )
+		{
+			const tinstance_t	*in = &tlas_instances[node->firstinstance + i];
 
-		if( clip->nomodels && ( touch->modtype == mod_studio || touch->modtype == mod_alias ))
-			continue;
+			if( !InstanceCanBlock( in, clip->nomodels, clip->ignore ))
+				continue;
 
-		ClipMoveToEntity( touch, clip->start, clip->end, &trace, stop_on_first_solid );
+			if( !RayIntersectBounds( &ray, in->absmin, in->absmax, clip->trace.fraction ))
+				continue;
 
-		clip->trace = CombineTraces( &clip->trace, &trace );
-	}
-	
-	// recurse down both sides
-	if( node->axis == -1 ) return;
+			ClipMoveToEntity( in->ent, clip->start, clip->end, &trace, stop_on_first_solid );
+			CombineTraces( &clip->trace, &trace );
 
-	if( clip->boxmaxs[node->axis] > node->dist)
-	{
-		if( clip->boxmins[node->axis] < node->dist )
-			ClipToLinks( node->children[1], clip, stop_on_first_solid );
-		node = node->children[0];
-		goto loc0;
-	}
-	else if( clip->boxmins[node->axis] < node->dist )
-	{
-		node = node->children[1];
-		goto loc0;
+			// any hit is enough for the shadow rays
+			if(( clip->trace.contents == CONTENTS_SOLID ) && stop_on_first_solid )
+				return;
+		}
 	}
 }
 
@@ -1129,7 +1460,7 @@ int TestLine( int threadnum, const vec3_t start, const vec3_t end, bool nomodels
 	TestLine_r( (tnode_t *)g_entities->cache, 0, 0.0f, 1.0f, start, end, &clip.trace );
 
 	// run through entities (bmodels, studiomodels)
-	if(( numsolidedicts > 0 ) && ( clip.trace.fraction != 0.0f ))
+	if(( tlas_numinstances > 0 ) && ( clip.trace.fraction != 0.0f ))
 	{
 		float	trace_fraction;
 		vec3_t	trace_endpos;
@@ -1142,8 +1473,7 @@ int TestLine( int threadnum, const vec3_t start, const vec3_t end, bool nomodels
 		clip.end = trace_endpos;
 		clip.ignore = ignoreent;
 
-		MoveBounds( start, trace_endpos, clip.boxmins, clip.boxmaxs );
-		ClipToLinks( entity_tree.areanodes, &clip );
+		ClipToInstances( &clip );
 
 		clip.trace.fraction *= trace_fraction;
 	}
@@ -1168,7 +1498,7 @@ void TestLine( int threadnum, const vec3_t start, const vec3_t stop, trace_t *tr
 	TestLine_r( (tnode_t *)g_entities->cache, 0, 0.0f, 1.0f, start, stop, trace );
 	
 	moveclip_t	clip;
-	if(( numsolidedicts > 0 ) && ( trace->fraction != 0.0f ))
+	if(( tlas_numinstances > 0 ) && ( trace->fraction != 0.0f ))
 	{
 		vec3_t	trace_endpos;
 
@@ -1181,8 +1511,7 @@ void TestLine( int threadnum, const vec3_t start, const vec3_t stop, trace_t *tr
 		clip.end = trace_endpos;
 		clip.ignore = ignoreent;
 
-		MoveBounds( start, trace_endpos, clip.boxmins, clip.boxmaxs );
-		ClipToLinks( entity_tree.areanodes, &clip, false );
+		ClipToInstances( &clip, false );
 
 		if( clip.trace.contents == CONTENTS_EMPTY )
 			return;
@@ -1201,6 +1530,167 @@ void TestLine( int threadnum, const vec3_t start, const vec3_t stop, trace_t *tr
 	}	
 }
 
+/*
+====================
+ClipLinesToInstances
+
+same as ClipToInstances without stop_on_first_solid, but for
+the batch of lines. The tree is walked with the box of all lines
+====================
+*/
+static void ClipLinesToInstances( lineclip_t *clip )
+{
+	int		stack[TLAS_STACK_SIZE];	// every thread walks on its own stack
+	int		stackpos = 0;
+	const tlasnode_t	*node;
+	trace_t		trace;
+	int		i, numlines;
+
+	stack[stackpos++] = 0;
+
+	while( stackpos > 0 )
+	{
+		node = &tlas_nodes[stack[--stackpos]];
+
+		if( !BoundsIntersect( clip->boxmins, clip->boxmaxs, node->mins, node->maxs ))
+			continue;
+
+		if( !node->numinstances )
+		{
+			stack[stackpos++] = node->firstchild + 1;
+			stack[stackpos++] = node->firstchild + 0;
+			continue;
+		}
+
+		for( int k = 0; k < node->numinstances; k++ )
+		{
+			const tinstance_t	*in = &tlas_instances[node->firstinstance + k];
+
+			if( !InstanceCanBlock( in, clip->nomodels, clip->ignore ))
+				continue;
+
+			if( !BoundsIntersect( clip->boxmins, clip->boxmaxs, in->absmin, in->absmax ))
+				continue;
+
+			// pick the lines that might intersect
+			for( i = numlines = 0; i < clip->numlines; i++ )
+			{
+				if( !RayIntersectBounds( &clip->ray[i], in->absmin, in->absmax, clip->trace[i].fraction ))
+					continue;
+				clip->packet[numlines++] = i;
+			}
+
+			if( !numlines )
+				continue;
+#ifdef HLRAD_RAYTRACE
+			if( in->mesh && !g_studiolegacy )
+			{
+				tmesh_t	*mesh = (tmesh_t *)in->ent->cache;
+
+				// trace them through studio triangles together
+				for( i = 0; i < numlines; i++ )
+				{
+					VectorCopy( clip->start[clip->packet[i]], clip->packet_start[i] );
+					VectorCopy( clip->end[clip->packet[i]], clip->packet_end[i] );
+					clip->packet_trace[i].contents = CONTENTS_EMPTY;
+					clip->packet_trace[i].fraction = 1.0f;
+					clip->packet_trace[i].surface = -1;
+				}
+
+				mesh->rayBVH.TraceRays( numlines, clip->packet_start, clip->packet_end, clip->packet_trace );
+
+				for( i = 0; i < numlines; i++ )
+					CombineTraces( &clip->trace[clip->packet[i]], &clip->packet_trace[i] );
+				continue;
+			}
+#endif
+			for( i = 0; i < numlines; i++ )
+			{
+				ClipMoveToEntity( in->ent, clip->start[clip->packet[i]], clip->end[clip->packet[i]], &trace );
+				CombineTraces( &clip->trace[clip->packet[i]], &trace );
+			}
+		}
+	}
+}
+
+/*
+==================
+TestLines
+
+trace the batch of lines, results are the same as
+calling TestLine for each of them. Entity tree is walked
+once per batch and studio models are traced by ray packets
+==================
+*/
+void TestLines( int threadnum, int numlines, const vec3_t *start, const vec3_t *stop, trace_t *trace, bool nomodels, entity_t *ignoreent )
+{
+	lineclip_t	clip;
+
+	for( int first = 0; first < numlines; first += MAX_TRACE_BATCH )
+	{
+		int	count = Q_min( numlines - first, MAX_TRACE_BATCH );
+
+		ClearBounds( clip.boxmins, clip.boxmaxs );
+		clip.numlines = 0;
+
+		// trace world first
+		for( int i = first; i < first + count; i++ )
+		{
+			trace[i].contents = CONTENTS_EMPTY;
+			trace[i].fraction = 0.0f;
+			trace[i].surface = -1;
+
+			TestLine_r( (tnode_t *)g_entities->cache, 0, 0.0f, 1.0f, start[i], stop[i], &trace[i] );
+
+			if(( tlas_numinstances <= 0 ) || ( trace[i].fraction == 0.0f ))
+				continue;
+
+			int	j = clip.numlines++;
+
+			clip.lines[j] = i;
+			clip.start[j] = start[i];
+			VectorLerp( start[i], trace[i].fraction, stop[i], clip.end[j] );
+			clip.trace[j].contents = CONTENTS_EMPTY;
+			clip.trace[j].surface = trace[i].surface;
+			clip.trace[j].fraction = 1.0f;
+
+			SetupInstanceRay( &clip.ray[j], start[i], clip.end[j] );
+			AddPointToBounds( start[i], clip.boxmins, clip.boxmaxs );
+			AddPointToBounds( clip.end[j], clip.boxmins, clip.boxmaxs );
+		}
+
+		if( !clip.numlines )
+			continue;
+
+		clip.nomodels = nomodels;
+		clip.ignore = ignoreent;
+
+		ClipLinesToInstances( &clip );
+
+		for( int j = 0; j < clip.numlines; j++ )
+		{
+			trace_t	*out = &trace[clip.lines[j]];
+			trace_t	*in = &clip.trace[j];
+
+			if( in->contents == CONTENTS_EMPTY )
+				continue;
+
+			out->contents = in->contents;
+			out->fraction *= in->fraction;
+			out->surface = in->surface;
+
+			//studio gi
+			if( in->surface == STUDIO_SURFACE_HIT )
+			{
+				for( int k = 0; k < MAXLIGHTMAPS; k++ )
+				{
+					out->styles[k] = in->styles[k];
+					VectorCopy( in->light[k], out->light[k] );
+				}
+			}
+		}
+	}
+}
 
 void BuildDiffuseNormals( void )
 {
@@ -0,0 +1,330 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*	
+*	This product contains software technology licensed from Id 
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc. 
+*	All Rights Reserved.
+*
+****/
+
+// transfers.c	// persistent cache for patch transfer lists
+
+#include "qrad.h"
+#include "model_trace.h"
+#include "crclib.h"
+
+#define TRANSFER_CACHE_IDENT		(('C'<<24)+('T'<<16)+('X'<<8)+'P')	// little-endian "PXTC"
+#define TRANSFER_CACHE_VERSION	1
+
+typedef struct
+{
+	int		ident;
+	int		version;
+	byte		hash[16];			// MD5 of all the inputs of MakeTransfers
+	uint		numpatches;
+	uint		indexsize;		// sizeof( transfer_index_t )
+	uint		datasize;			// sizeof( transfer_data_t )
+	uint		reserved;
+	uint64_t		numindexes;
+	uint64_t		numdata;
+} dtransferheader_t;
+
+typedef struct
+{
+	uint		iIndex;
+	uint		iData;
+	vec_t		trans_sum;
+	uint		reserved;
+	uint64_t		firstindex;
+	uint64_t		firstdata;
+} dtransferpatch_t;
+
+static byte	*g_transfercache;
+static size_t	g_transfercachesize;
+bool		g_notransfercache = false;
+
+/*
+=============
+HashTransferInputs
+
+everything that MakeTransfers depends on. Entity lights, styles and
+the lightmap data are not here, so changing them keeps the cache valid
+=============
+*/
+void HashTransferInputs( byte hash[16] )
+{
+	MD5Context_t	ctx;
+	int		value;
+
+	MD5Init( &ctx );
+
+	value = TRANSFER_CACHE_VERSION;
+	MD5Update( &ctx, (byte *)&value, sizeof( value ));
+#ifdef HLRAD_COMPRESS_TRANSFERS
+	value = MAX_COMPRESSED_TRANSFER_INDEX;
+	MD5Update( &ctx, (byte *)&value, sizeof( value ));
+#endif
+	// settings
+	MD5Update( &ctx, (byte *)&g_accurate_trans, sizeof( g_accurate_trans ));
+	MD5Update( &ctx, (byte *)&g_patchaa, sizeof( g_patchaa ));
+	MD5Update( &ctx, (byte *)&g_nomodelshadow, sizeof( g_nomodelshadow ));
+
+	// world geometry and visibility
+	MD5Update( &ctx, (byte *)g_dplanes, g_numplanes * sizeof( dplane_t ));
+	MD5Update( &ctx, (byte *)g_dnodes, g_numnodes * sizeof( dnode_t ));
+	MD5Update( &ctx, (byte *)g_dleafs, g_numleafs * sizeof( dleaf_t ));
+	MD5Update( &ctx, (byte *)g_dvertexes, g_numvertexes * sizeof( dvertex_t ));
+	MD5Update( &ctx, (byte *)g_dedges, g_numedges * sizeof( dedge_t ));
+	MD5Update( &ctx, (byte *)g_dsurfedges, g_numsurfedges * sizeof( dsurfedge_t ));
+	MD5Update( &ctx, (byte *)g_texinfo, g_numtexinfo * sizeof( dtexinfo_t ));
+	MD5Update( &ctx, (byte *)g_dmodels, g_nummodels * sizeof( dmodel_t ));
+	MD5Update( &ctx, (byte *)g_dvisdata, g_visdatasize );
+	MD5Update( &ctx, (byte *)g_dtexdata, g_texdatasize );	// fence textures
+
+	// faces without the lighting info
+	for( int i = 0; i < g_numfaces; i++ )
+	{
+		dface_t	*f = &g_dfaces[i];
+
+		MD5Update( &ctx, (byte *)&f->planenum, sizeof( f->planenum ));
+		MD5Update( &ctx, (byte *)&f->side, sizeof( f->side ));
+		MD5Update( &ctx, (byte *)&f->firstedge, sizeof( f->firstedge ));
+		MD5Update( &ctx, (byte *)&f->numedges, sizeof( f->numedges ));
+		MD5Update( &ctx, (byte *)&f->texinfo, sizeof( f->texinfo ));
+	}
+
+	// shadow casting entities
+	for( int i = 1; i < g_numentities; i++ )
+	{
+		entity_t	*e = &g_entities[i];
+
+		if( !*ValueForKey( e, "model" ))
+			continue;
+
+		for( epair_t *ep = e->epairs; ep; ep = ep->next )
+		{
+			MD5Update( &ctx, (byte *)ep->key, Q_strlen( ep->key ) + 1 );
+			MD5Update( &ctx, (byte *)ep->value, Q_strlen( ep->value ) + 1 );
+		}
+
+		if(( e->modtype == mod_studio || e->modtype == mod_alias ) && e->cache )
+		{
+			tmesh_t	*mesh = (tmesh_t *)e->cache;
+			MD5Update( &ctx, (byte *)&mesh->modelCRC, sizeof( mesh->modelCRC ));
+		}
+	}
+
+	// patch layout (already includes chop and texchop)
+	MD5Update( &ctx, (byte *)&g_num_patches, sizeof( g_num_patches ));
+
+	for( uint i = 0; i < g_num_patches; i++ )
+	{
+		patch_t	*p = &g_patches[i];
+
+		MD5Update( &ctx, (byte *)p->origin, sizeof( p->origin ));
+		MD5Update( &ctx, (byte *)&p->area, sizeof( p->area ));
+		MD5Update( &ctx, (byte *)&p->exposure, sizeof( p->exposure ));
+		MD5Update( &ctx, (byte *)&p->leafnum, sizeof( p->leafnum ));
+		MD5Update( &ctx, (byte *)&p->faceNumber, sizeof( p->faceNumber ));
+		MD5Update( &ctx, (byte *)&p->emitter_range, sizeof( p->emitter_range ));
+		MD5Update( &ctx, (byte *)&p->emitter_skylevel, sizeof( p->emitter_skylevel ));
+		MD5Update( &ctx, (byte *)p->trace_origins, sizeof( p->trace_origins ));
+		if( p->winding ) MD5Update( &ctx, (byte *)p->winding, WindingSize( p->winding ));
+	}
+
+	MD5Final( hash, &ctx );
+}
+
+static void GetTransferCacheName( char *out, size_t size )
+{
+	char	name[MAX_PATH];
+
+	Q_strncpy( name, source, sizeof( name ));
+	COM_StripExtension( name );
+	Q_snprintf( out, size, "%s.trc", name );
+}
+
+/*
+=============
+LoadTransferCache
+
+map transfer lists from disk. Patches are pointed directly
+into the mapped file so there is nothing to allocate or copy
+=============
+*/
+bool LoadTransferCache( void )
+{
+	const dtransferheader_t	*header;
+	const dtransferpatch_t	*in;
+	char			filename[MAX_PATH];
+	byte			hash[16];
+	size_t			filesize;
+
+	if( g_notransfercache )
+		return false;
+
+	GetTransferCacheName( filename, sizeof( filename ));
+	g_transfercache = COM_MapFile( filename, &filesize );
+
+	if( !g_transfercache )
+		return false;
+
+	g_transfercachesize = filesize;
+	header = (dtransferheader_t *)g_transfercache;
+	HashTransferInputs( hash );
+
+	if( filesize < sizeof( dtransferheader_t ) || header->ident != TRANSFER_CACHE_IDENT || header->version != TRANSFER_CACHE_VERSION )
+	{
+		MsgDev( D_WARN, "%s has wrong format, ignored\n", filename );
+		FreeTransferCache();
+		return false;
+	}
+
+	if( memcmp( header->hash, hash, sizeof( hash )) || header->numpatches != g_num_patches
+	|| header->indexsize != sizeof( transfer_index_t ) || header->datasize != sizeof( transfer_data_t ))
+	{
+		MsgDev( D_INFO, "transfer cache is outdated\n" );
+		FreeTransferCache();
+		return false;
+	}
+
+	size_t	indexofs = sizeof( dtransferheader_t ) + sizeof( dtransferpatch_t ) * header->numpatches;
+	size_t	dataofs = indexofs + sizeof( transfer_index_t ) * header->numindexes;
+
+	if( dataofs + sizeof( transfer_data_t ) * header->numdata != filesize )
+	{
+		MsgDev( D_WARN, "%s is truncated, ignored\n", filename );
+		FreeTransferCache();
+		return false;
+	}
+
+	transfer_index_t	*indexes = (transfer_index_t *)(g_transfercache + indexofs);
+	transfer_data_t	*data = (transfer_data_t *)(g_transfercache + dataofs);
+
+	in = (dtransferpatch_t *)(g_transfercache + sizeof( dtransferheader_t ));
+
+	for( uint i = 0; i < g_num_patches; i++, in++ )
+	{
+		patch_t	*p = &g_patches[i];
+
+		if( in->firstindex + in->iIndex > header->numindexes || in->firstdata + in->iData > header->numdata )
+			COM_FatalError( "%s: bad transfer list on patch %i\n", filename, i );
+
+		p->iIndex = in->iIndex;
+		p->iData = in->iData;
+		p->trans_sum = in->trans_sum;
+		p->tIndex = in->iIndex ? indexes + in->firstindex : NULL;
+		p->tData = in->iData ? data + in->firstdata : NULL;
+	}
+
+	memset( g_transfer_data_size, 0, sizeof( g_transfer_data_size ));
+	g_transfer_data_size[0] = header->numindexes * sizeof( transfer_index_t ) + header->numdata * sizeof( transfer_data_t );
+
+	Msg( "MakeTransfers:       (cached)\n" );
+	CalcTransferSize();
+
+	return true;
+}
+
+/*
+=============
+SaveTransferCache
+
+=============
+*/
+void SaveTransferCache( void )
+{
+	dtransferheader_t	header;
+	dtransferpatch_t	out;
+	char		filename[MAX_PATH];
+	uint64_t		numindexes = 0;
+	uint64_t		numdata = 0;
+	FILE		*f;
+
+	if( g_notransfercache )
+		return;
+
+	memset( &header, 0, sizeof( header ));
+	header.ident = TRANSFER_CACHE_IDENT;
+	header.version = TRANSFER_CACHE_VERSION;
+	header.numpatches = g_num_patches;
+	header.indexsize = sizeof( transfer_index_t );
+	header.datasize = sizeof( transfer_data_t );
+	HashTransferInputs( header.hash );
+
+	for( uint i = 0; i < g_num_patches; i++ )
+	{
+		header.numindexes += g_patches[i].iIndex;
+		header.numdata += g_patches[i].iData;
+	}
+
+	GetTransferCacheName( filename, sizeof( filename ));
+
+	if(( f = fopen( filename, "wb" )) == NULL )
+	{
+		MsgDev( D_WARN, "couldn't write %s\n", filename );
+		return;
+	}
+
+	bool	success = ( fwrite( &header, sizeof( header ), 1, f ) == 1 );
+
+	for( uint i = 0; i < g_num_patches && success; i++ )
+	{
+		patch_t	*p = &g_patches[i];
+
+		memset( &out, 0, sizeof( out ));
+		out.iIndex = p->iIndex;
+		out.iData = p->iData;
+		out.trans_sum = p->trans_sum;
+		out.firstindex = numindexes;
+		out.firstdata = numdata;
+		numindexes += p->iIndex;
+		numdata += p->iData;
+
+		success = ( fwrite( &out, sizeof( out ), 1, f ) == 1 );
+	}
+
+	for( uint i = 0; i < g_num_patches && success; i++ )
+	{
+		patch_t	*p = &g_patches[i];
+
+		if( p->iIndex && fwrite( p->tIndex, sizeof( transfer_index_t ), p->iIndex, f ) != p->iIndex )
+			success = false;
+	}
+
+	for( uint i = 0; i < g_num_patches && success; i++ )
+	{
+		patch_t	*p = &g_patches[i];
+
+		if( p->iData && fwrite( p->tData, sizeof( transfer_data_t ), p->iData, f ) != p->iData )
+			success = false;
+	}
+
+	fclose( f );
+
+	if( !success )
+	{
+		MsgDev( D_WARN, "couldn't write %s\n", filename );
+		remove( filename );
+	}
+}
+
+/*
+=============
+FreeTransferCache
+
+returns true if transfer lists were mapped from the cache
+=============
+*/
+bool FreeTransferCache( void )
+{
+	if( !g_transfercache )
+		return false;
+
+	COM_UnmapFile( g_transfercache, g_transfercachesize );
+	g_transfercache = NULL;
+	g_transfercachesize = 0;
+
+	return true;
+}
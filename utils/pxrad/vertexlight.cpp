@@ -891,7 +891,7 @@ static void AllocVertexLighting( void )
 	}
 
 	Msg( "total vertexlight data: %s\n", Q_memprint( totaldatasize ));
-	g_dvlightdata = (byte *)Mem_Realloc( g_dvlightdata, totaldatasize );
+	g_dvlightdata = ReallocBSPLump( g_dvlightdata, totaldatasize );
 
 	// now setup to get the miptex data (or just the headers if using -wadtextures) from the wadfile
 	l = (dvlightlump_t *)g_dvlightdata;
@@ -19,6 +19,7 @@ GNU General Public License for more details.
 #include "studio.h"
 #include "studiomdl.h"
 #include "iksolver.h"
+#include "threads.h"
 
 #define ANIM_COMPRESS_THRESHOLD	0	// more values compress animation but can skip frames (optimal range between 0-100)
 
@@ -1583,6 +1584,8 @@ void BuildVertexArrays( void )
 				}
 			}
 		}
+
+		FreeWeldHashes( pmodel );
 	}
 }
 
@@ -3687,6 +3690,177 @@ void MakeTransitions( void )
 	}
 }
 
+// commands that read other animations must see them in the same state as
+// the serial loop did, so these animations keep the original order
+static CUtlArray< bool >	g_serialanim;
+
+static int findAnimationIndex( const s_animation_t *panim )
+{
+	for( int i = 0; i < g_numani; i++ )
+	{
+		if( g_panimation[i] == panim )
+			return i;
+	}
+	return -1;
+}
+
+static void markSerialReference( int i, const s_animation_t *pref )
+{
+	if( !pref || pref == g_panimation[i] )
+		return;
+
+	int	ref = findAnimationIndex( pref );
+
+	g_serialanim[i] = true;
+	if( ref != -1 ) g_serialanim[ref] = true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: runs the $animation commands of a single animation
+//-----------------------------------------------------------------------------
+static void processAnimation( s_animation_t *panim )
+{
+	extractUnusedMotion( panim ); // FIXME: this should be part of LinearMotion()
+
+	setAnimationWeight( panim, 0 );
+
+	int startframe = 0;
+
+	if( panim->fudgeloop )
+	{
+		fixupMissingFrame( panim );
+	}
+
+	for( int j = 0; j < panim->numcmds; j++ )
+	{
+		s_animcmd_t *pcmd = &panim->cmds[j];
+
+		switch( pcmd->cmd )
+		{
+		case CMD_WEIGHTS:
+			setAnimationWeight( panim, pcmd->weightlist.index );
+			break;
+		case CMD_SUBTRACT:
+			panim->flags |= STUDIO_DELTA;
+			subtractBaseAnimations( pcmd->subtract.ref, panim, pcmd->subtract.frame, pcmd->subtract.flags );
+			break;
+		case CMD_AO:
+			{
+				int bone = g_rootIndex;
+				if( pcmd->ao.pBonename != NULL )
+				{
+					bone = findGlobalBone( pcmd->ao.pBonename );
+					if( bone == -1 )
+					{
+						COM_FatalError("unable to find bone %s to alignbone\n", pcmd->ao.pBonename );
+					}
+				}
+				processAutoorigin( pcmd->ao.ref, panim, pcmd->ao.motiontype, pcmd->ao.srcframe, pcmd->ao.destframe, bone );
+			}
+			break;
+		case CMD_MATCH:
+			processMatch( pcmd->match.ref, panim, false );
+			break;
+		case CMD_FIXUP:
+			fixupLoopingDiscontinuities( panim, pcmd->fixuploop.start, pcmd->fixuploop.end );
+			break;
+		case CMD_ANGLE:
+			makeAngle( panim, pcmd->angle.angle );
+			break;
+		case CMD_IKFIXUP:
+			break;
+		case CMD_IKRULE:
+			// processed later
+			break;
+		case CMD_MOTION:
+			extractLinearMotion( panim, pcmd->motion.motiontype, startframe, pcmd->motion.iEndFrame, pcmd->motion.iEndFrame, panim, startframe );
+			startframe = pcmd->motion.iEndFrame;
+			break;
+		case CMD_REFMOTION:
+			extractLinearMotion( panim, pcmd->motion.motiontype, startframe, pcmd->motion.iEndFrame, pcmd->motion.iSrcFrame, pcmd->motion.pRefAnim, pcmd->motion.iRefFrame );
+			startframe = pcmd->motion.iEndFrame;
+			break;
+		case CMD_DERIVATIVE:
+			createDerivative( panim, pcmd->derivative.scale );
+			break;
+		case CMD_NOANIMATION:
+			clearAnimations( panim );
+			break;
+		case CMD_LINEARDELTA:
+			panim->flags |= STUDIO_DELTA;
+			linearDelta( panim, panim, panim->numframes - 1, pcmd->linear.flags );
+			break;
+		case CMD_COMPRESS:
+			reencodeAnimation( panim, pcmd->compress.frames );
+			break;
+		case CMD_NUMFRAMES:
+			forceNumframes( panim, pcmd->numframes.frames );
+			break;
+		case CMD_COUNTERROTATE:
+			{
+				int bone = findGlobalBone( pcmd->counterrotate.pBonename );
+				if( bone != -1 )
+				{
+					Vector	target;
+
+					if( !pcmd->counterrotate.bHasTarget )
+					{
+						matrix3x4	rootxform = matrix3x4( g_vecZero, panim->rotation );
+						matrix3x4	defaultBoneToWorld;
+						defaultBoneToWorld = rootxform.ConcatTransforms( g_bonetable[bone].boneToPose );
+						target = defaultBoneToWorld.GetAngles();
+					}
+					else
+					{
+						target = Vector( pcmd->counterrotate.targetAngle );
+					}
+
+					counterRotateBone( panim, bone, target );
+				}
+				else
+				{
+					COM_FatalError( "unable to find bone %s to counterrotate\n", pcmd->counterrotate.pBonename );
+				}
+			}
+			break;
+		case CMD_WORLDSPACEBLEND:
+			worldspaceBlend( pcmd->world.ref, panim, pcmd->world.startframe, pcmd->world.loops );
+			break;
+		case CMD_MATCHBLEND:
+			matchBlend( panim, pcmd->match.ref, pcmd->match.srcframe, pcmd->match.destframe, pcmd->match.destpre, pcmd->match.destpost );
+			break;
+		}
+	}
+
+	if( panim->motiontype )
+	{
+		int	lastframe;
+
+		if( !FBitSet( panim->flags, STUDIO_LOOPING ))
+		{
+			// roll back 0.2 seconds to try to prevent popping
+			int frames = panim->fps * panim->motionrollback;
+			lastframe = Q_max( Q_min( startframe + 1, panim->numframes - 1 ), panim->numframes - frames - 1 );
+		}
+		else
+		{
+			lastframe = panim->numframes - 1;
+		}
+
+		extractLinearMotion( panim, panim->motiontype, startframe, lastframe, panim->numframes - 1, panim, startframe );
+		startframe = panim->numframes - 1;
+	}
+
+	realignLooping( panim );
+	forceAnimationLoop( panim );
+}
+
+static void processAnimationThread( int i, int threadnum )
+{
+	if( !g_serialanim[i] )
+		processAnimation( g_panimation[i] );
+}
+
 void processAnimations( void )
 {
 	int	i, j;
@@ -3700,145 +3874,51 @@ void processAnimations( void )
 
 	buildAnimationWeights( );
 
+	// delta animations read the base animation, so it always goes first
+	g_serialanim.SetCount( g_numani );
+	for( i = 0; i < g_numani; i++ )
+		g_serialanim[i] = ( i == 0 );
+
 	for( i = 0; i < g_numani; i++ )
 	{
 		s_animation_t *panim = g_panimation[i];
 
-		extractUnusedMotion( panim ); // FIXME: this should be part of LinearMotion()
-
-		setAnimationWeight( panim, 0 );
-
-		int startframe = 0;
-
-		if( panim->fudgeloop )
-		{
-			fixupMissingFrame( panim );
-		}
-
 		for( j = 0; j < panim->numcmds; j++ )
 		{
 			s_animcmd_t *pcmd = &panim->cmds[j];
 
 			switch( pcmd->cmd )
 			{
-			case CMD_WEIGHTS:
-				setAnimationWeight( panim, pcmd->weightlist.index );
-				break;
 			case CMD_SUBTRACT:
-				panim->flags |= STUDIO_DELTA;
-				subtractBaseAnimations( pcmd->subtract.ref, panim, pcmd->subtract.frame, pcmd->subtract.flags );
+				markSerialReference( i, pcmd->subtract.ref );
 				break;
 			case CMD_AO:
-				{
-					int bone = g_rootIndex;
-					if( pcmd->ao.pBonename != NULL )
-					{
-						bone = findGlobalBone( pcmd->ao.pBonename );
-						if( bone == -1 )
-						{
-							COM_FatalError("unable to find bone %s to alignbone\n", pcmd->ao.pBonename );
-						}
-					}
-					processAutoorigin( pcmd->ao.ref, panim, pcmd->ao.motiontype, pcmd->ao.srcframe, pcmd->ao.destframe, bone );
-				}
+				markSerialReference( i, pcmd->ao.ref );
 				break;
 			case CMD_MATCH:
-				processMatch( pcmd->match.ref, panim, false );
-				break;
-			case CMD_FIXUP:
-				fixupLoopingDiscontinuities( panim, pcmd->fixuploop.start, pcmd->fixuploop.end );
-				break;
-			case CMD_ANGLE:
-				makeAngle( panim, pcmd->angle.angle );
-				break;
-			case CMD_IKFIXUP:
-				break;
-			case CMD_IKRULE:
-				// processed later
-				break;
-			case CMD_MOTION:
-				extractLinearMotion( panim, pcmd->motion.motiontype, startframe, pcmd->motion.iEndFrame, pcmd->motion.iEndFrame, panim, startframe );
-				startframe = pcmd->motion.iEndFrame;
-				break;
-			case CMD_REFMOTION:
-				extractLinearMotion( panim, pcmd->motion.motiontype, startframe, pcmd->motion.iEndFrame, pcmd->motion.iSrcFrame, pcmd->motion.pRefAnim, pcmd->motion.iRefFrame );
-				startframe = pcmd->motion.iEndFrame;
-				break;
-			case CMD_DERIVATIVE:
-				createDerivative( panim, pcmd->derivative.scale );
-				break;
-			case CMD_NOANIMATION:
-				clearAnimations( panim );
-				break;
-			case CMD_LINEARDELTA:
-				panim->flags |= STUDIO_DELTA;
-				linearDelta( panim, panim, panim->numframes - 1, pcmd->linear.flags );
-				break;
-			case CMD_COMPRESS:
-				reencodeAnimation( panim, pcmd->compress.frames );
-				break;
-			case CMD_NUMFRAMES:
-				forceNumframes( panim, pcmd->numframes.frames );
-				break;
-			case CMD_COUNTERROTATE:
-				{
-					int bone = findGlobalBone( pcmd->counterrotate.pBonename );
-					if( bone != -1 )
-					{
-						Vector	target;
-
-						if( !pcmd->counterrotate.bHasTarget )
-						{
-							matrix3x4	rootxform = matrix3x4( g_vecZero, panim->rotation );
-							matrix3x4	defaultBoneToWorld;
-							defaultBoneToWorld = rootxform.ConcatTransforms( g_bonetable[bone].boneToPose );
-							target = defaultBoneToWorld.GetAngles();
-						}
-						else
-						{
-							target = Vector( pcmd->counterrotate.targetAngle );
-						}
-
-						counterRotateBone( panim, bone, target );
-					}
-					else
-					{
-						COM_FatalError( "unable to find bone %s to counterrotate\n", pcmd->counterrotate.pBonename );
-					}
-				}
+			case CMD_MATCHBLEND:
+				markSerialReference( i, pcmd->match.ref );
 				break;
 			case CMD_WORLDSPACEBLEND:
-				worldspaceBlend( pcmd->world.ref, panim, pcmd->world.startframe, pcmd->world.loops );
+				markSerialReference( i, pcmd->world.ref );
 				break;
-			case CMD_MATCHBLEND:
-				matchBlend( panim, pcmd->match.ref, pcmd->match.srcframe, pcmd->match.destframe, pcmd->match.destpre, pcmd->match.destpost );
+			case CMD_REFMOTION:
+				markSerialReference( i, pcmd->motion.pRefAnim );
 				break;
 			}
 		}
+	}
 
-		if( panim->motiontype )
-		{
-			int	lastframe;
-
-			if( !FBitSet( panim->flags, STUDIO_LOOPING ))
-			{
-				// roll back 0.2 seconds to try to prevent popping
-				int frames = panim->fps * panim->motionrollback;
-				lastframe = Q_max( Q_min( startframe + 1, panim->numframes - 1 ), panim->numframes - frames - 1 );
-			}
-			else
-			{
-				lastframe = panim->numframes - 1;
-			}
-
-			extractLinearMotion( panim, panim->motiontype, startframe, lastframe, panim->numframes - 1, panim, startframe );
-			startframe = panim->numframes - 1;
-		}
-
-		realignLooping( panim );
-		forceAnimationLoop( panim );
+	// linked animations first, they only depend on each other
+	for( i = 0; i < g_numani; i++ )
+	{
+		if( g_serialanim[i] )
+			processAnimation( g_panimation[i] );
 	}
 
+	RunThreadsOnIndividual( g_numani, false, processAnimationThread );
+	g_serialanim.Purge();
+
 	// merge weightlists
 	for( i = 0; i < g_numseq; i++ )
 	{
@@ -3861,210 +3941,232 @@ void processAnimations( void )
 //-----------------------------------------------------------------------------
 // CompressAnimations
 //-----------------------------------------------------------------------------
-static void CompressAnimations( void )
+static CUtlArray< int >	g_compresscounts;	// changes and total for each animation
+
+static void CompressBoneScales( int j, int threadnum )
 {
-	int	i, j, k, n, m;
+	int	i, k, n;
 	float	v;
 
-	// find scales for all bones
-	for( j = 0; j < g_numbones; j++ )
+	for( k = 0; k < 6; k++ )
 	{
-		for( k = 0; k < 6; k++ )
+		float	minv, maxv, scale;
+
+		if( k < 3 ) 
+		{
+			minv = -128.0f;
+			maxv = 128.0f;
+		}
+		else
 		{
-			float	minv, maxv, scale;
+			minv = -M_PI / 8.0;
+			maxv = M_PI / 8.0;
+		}
 
-			if( k < 3 ) 
-			{
-				minv = -128.0f;
-				maxv = 128.0f;
-			}
-			else
-			{
-				minv = -M_PI / 8.0;
-				maxv = M_PI / 8.0;
-			}
+		for( i = 0; i < g_numani; i++ )
+		{
+			s_animation_t *panim = g_panimation[i];
 
-			for( i = 0; i < g_numani; i++ )
+			for( n = 0; n < panim->numframes; n++ )
 			{
-				s_animation_t *panim = g_panimation[i];
-
-				for( n = 0; n < panim->numframes; n++ )
+				switch( k )
 				{
-					switch( k )
-					{
-					case 0: 
-					case 1: 
-					case 2: 
-						if( panim->flags & STUDIO_DELTA ) v = panim->sanim[n][j].pos[k]; 
-						else v = ( panim->sanim[n][j].pos[k] - g_bonetable[j].pos[k] ); 
-						break;
-					case 3:
-					case 4:
-					case 5:
-						if( panim->flags & STUDIO_DELTA ) v = panim->sanim[n][j].rot[k-3]; 
-						else v = ( panim->sanim[n][j].rot[k-3] - g_bonetable[j].rot[k-3] ); 
-						clip_rotations( v );
-						break;
-					}
-
-					minv = Q_min( v, minv );
-					maxv = Q_max( v, maxv );
+				case 0: 
+				case 1: 
+				case 2: 
+					if( panim->flags & STUDIO_DELTA ) v = panim->sanim[n][j].pos[k]; 
+					else v = ( panim->sanim[n][j].pos[k] - g_bonetable[j].pos[k] ); 
+					break;
+				case 3:
+				case 4:
+				case 5:
+					if( panim->flags & STUDIO_DELTA ) v = panim->sanim[n][j].rot[k-3]; 
+					else v = ( panim->sanim[n][j].rot[k-3] - g_bonetable[j].rot[k-3] ); 
+					clip_rotations( v );
+					break;
 				}
-			}
 
-			if( minv < maxv )
-			{
-				if( -minv > maxv )
-					scale = minv / -32768.0f;
-				else scale = maxv / 32767.0f;
-			}
-			else
-			{
-				scale = 1.0f / 32.0f;
+				minv = Q_min( v, minv );
+				maxv = Q_max( v, maxv );
 			}
+		}
 
-			switch( k )
-			{
-			case 0: 
-			case 1: 
-			case 2: 
-				g_bonetable[j].posscale[k] = scale;
-				break;
-			case 3:
-			case 4:
-			case 5:
-				g_bonetable[j].rotscale[k-3] = scale;
-				break;
-			}
+		if( minv < maxv )
+		{
+			if( -minv > maxv )
+				scale = minv / -32768.0f;
+			else scale = maxv / 32767.0f;
+		}
+		else
+		{
+			scale = 1.0f / 32.0f;
+		}
+
+		switch( k )
+		{
+		case 0: 
+		case 1: 
+		case 2: 
+			g_bonetable[j].posscale[k] = scale;
+			break;
+		case 3:
+		case 4:
+		case 5:
+			g_bonetable[j].rotscale[k-3] = scale;
+			break;
 		}
 	}
+}
 
+static void CompressAnimation( int i, int threadnum )
+{
+	s_animation_t *panim = g_panimation[i];
 	int	changes = 0;
 	int	total = 0;
+	int	j, k, n, m;
+	float	v;
 
-	// reduce animations
-	for( i = 0; i < g_numani; i++ )
+	for( j = 0; j < g_numbones; j++ )
 	{
-		s_animation_t *panim = g_panimation[i];
+		if( FBitSet( g_bonetable[j].flags, BONE_ALWAYS_PROCEDURAL ))
+			continue;
 
-		for( j = 0; j < g_numbones; j++ )
+		// skip bones that have no influence
+		if( panim->weight[j] < 0.001f )
+			continue;
+
+		for( k = 0; k < 6; k++ )
 		{
-			if( FBitSet( g_bonetable[j].flags, BONE_ALWAYS_PROCEDURAL ))
-				continue;
+			mstudioanimvalue_t data[MAXSTUDIOANIMATIONS];
+			mstudioanimvalue_t *pcount, *pvalue;
+			short value[MAXSTUDIOANIMATIONS] = {0};
+			auto checkAnimEpsilon = [&value](int32_t x, int32_t y) {
+				return abs(value[x] - value[y]) <= ANIM_COMPRESS_THRESHOLD;
+			};
 
-			// skip bones that have no influence
-			if( panim->weight[j] < 0.001f )
-				continue;
+			if( panim->numframes <= 0 )
+				COM_FatalError( "no animation frames: \"%s\"\n", panim->name );
 
-			for( k = 0; k < 6; k++ )
+			// find deltas from default pose
+			for( n = 0; n < panim->numframes; n++ )
 			{
-				mstudioanimvalue_t data[MAXSTUDIOANIMATIONS];
-				mstudioanimvalue_t *pcount, *pvalue;
-				short value[MAXSTUDIOANIMATIONS] = {0};
-				auto checkAnimEpsilon = [&value](int32_t x, int32_t y) {
-					return abs(value[x] - value[y]) <= ANIM_COMPRESS_THRESHOLD;
-				};
-
-				if( panim->numframes <= 0 )
-					COM_FatalError( "no animation frames: \"%s\"\n", panim->name );
-
-				// find deltas from default pose
-				for( n = 0; n < panim->numframes; n++ )
-				{
-					s_bone_t *psrcdata = &panim->sanim[n][j];
+				s_bone_t *psrcdata = &panim->sanim[n][j];
 
-					switch( k )
+				switch( k )
+				{
+				case 0: 
+				case 1: 
+				case 2: 
+					if( panim->flags & STUDIO_DELTA )
 					{
-					case 0: 
-					case 1: 
-					case 2: 
-						if( panim->flags & STUDIO_DELTA )
-						{
-							value[n] = psrcdata->pos[k] / g_bonetable[j].posscale[k]; 
-							// pre-scale pos delta since format only has room for "overall" weight
-							float r = panim->posweight[j] / panim->weight[j];
-							value[n] *= r;
-						}
-						else
-						{
-							v = ( psrcdata->pos[k] - g_bonetable[j].pos[k] );
-							value[n] = v / g_bonetable[j].posscale[k];
-						}
-						break;
-					case 3:
-					case 4:
-					case 5:
-						if( panim->flags & STUDIO_DELTA ) v = psrcdata->rot[k-3]; 
-						else v = ( psrcdata->rot[k-3] - g_bonetable[j].rot[k-3] ); 
-						clip_rotations( v );
-						value[n] = v / g_bonetable[j].rotscale[k-3]; 
-						break;
+						value[n] = psrcdata->pos[k] / g_bonetable[j].posscale[k]; 
+						// pre-scale pos delta since format only has room for "overall" weight
+						float r = panim->posweight[j] / panim->weight[j];
+						value[n] *= r;
+					}
+					else
+					{
+						v = ( psrcdata->pos[k] - g_bonetable[j].pos[k] );
+						value[n] = v / g_bonetable[j].posscale[k];
 					}
+					break;
+				case 3:
+				case 4:
+				case 5:
+					if( panim->flags & STUDIO_DELTA ) v = psrcdata->rot[k-3]; 
+					else v = ( psrcdata->rot[k-3] - g_bonetable[j].rot[k-3] ); 
+					clip_rotations( v );
+					value[n] = v / g_bonetable[j].rotscale[k-3]; 
+					break;
 				}
+			}
 
-				// FIXME: this compression algorithm needs work
+			// FIXME: this compression algorithm needs work
 
-				// initialize animation RLE block
-				panim->numanim[j][k] = 0;
+			// initialize animation RLE block
+			panim->numanim[j][k] = 0;
 
-				memset( data, 0, sizeof( data )); 
-				pcount = data; 
-				pvalue = pcount + 1;
+			memset( data, 0, sizeof( data )); 
+			pcount = data; 
+			pvalue = pcount + 1;
 
-				pcount->num.valid = 1;
-				pcount->num.total = 1;
-				pvalue->value = value[0];
-				pvalue++;
-				changes++;
-				total++;
+			pcount->num.valid = 1;
+			pcount->num.total = 1;
+			pvalue->value = value[0];
+			pvalue++;
+			changes++;
+			total++;
 
-				for( m = 1; m < n; m++ )
+			for( m = 1; m < n; m++ )
+			{
+				if( pcount->num.total == 255 )
+				{
+					// chain too long, force a new entry
+					pcount = pvalue;
+					pvalue = pcount + 1;
+					pcount->num.valid++;
+					pvalue->value = value[m];
+					pvalue++;
+					changes++;
+				} 
+
+				// insert value if they're not equal, 
+				// or if we're not on a run and the run is less than 3 units
+				else if( !checkAnimEpsilon( m, m - 1 ) || (( pcount->num.total == pcount->num.valid )
+				&& (( m < n - 1 ) && !checkAnimEpsilon( m, m + 1 ))))
 				{
-					if( pcount->num.total == 255 )
+					if( pcount->num.total != pcount->num.valid )
 					{
-						// chain too long, force a new entry
 						pcount = pvalue;
 						pvalue = pcount + 1;
-						pcount->num.valid++;
-						pvalue->value = value[m];
-						pvalue++;
-						changes++;
-					} 
-
-					// insert value if they're not equal, 
-					// or if we're not on a run and the run is less than 3 units
-					else if( !checkAnimEpsilon( m, m - 1 ) || (( pcount->num.total == pcount->num.valid )
-					&& (( m < n - 1 ) && !checkAnimEpsilon( m, m + 1 ))))
-					{
-						if( pcount->num.total != pcount->num.valid )
-						{
-							pcount = pvalue;
-							pvalue = pcount + 1;
-						}
-						pcount->num.valid++;
-						pvalue->value = value[m];
-						pvalue++;
-						changes++;
 					}
-					pcount->num.total++;
-					total++;
+					pcount->num.valid++;
+					pvalue->value = value[m];
+					pvalue++;
+					changes++;
 				}
+				pcount->num.total++;
+				total++;
+			}
 
-				panim->numanim[j][k] = pvalue - data;
-				if( panim->numanim[j][k] == 2 && value[0] == 0 )
-				{
-					panim->numanim[j][k] = 0;
-				}
-				else
-				{
-					size_t anim_size = ( pvalue - data ) * sizeof( mstudioanimvalue_t );
-					panim->anim[j][k] = (mstudioanimvalue_t *)Mem_Alloc( anim_size );
-					memmove( panim->anim[j][k], data, anim_size );
-				}
+			panim->numanim[j][k] = pvalue - data;
+			if( panim->numanim[j][k] == 2 && value[0] == 0 )
+			{
+				panim->numanim[j][k] = 0;
+			}
+			else
+			{
+				size_t anim_size = ( pvalue - data ) * sizeof( mstudioanimvalue_t );
+				panim->anim[j][k] = (mstudioanimvalue_t *)Mem_Alloc( anim_size );
+				memmove( panim->anim[j][k], data, anim_size );
 			}
 		}
 	}
 
+	g_compresscounts[i*2+0] = changes;
+	g_compresscounts[i*2+1] = total;
+}
+
+static void CompressAnimations( void )
+{
+	// find scales for all bones
+	RunThreadsOnIndividual( g_numbones, false, CompressBoneScales );
+
+	g_compresscounts.SetCount( g_numani * 2 );
+
+	// reduce animations
+	RunThreadsOnIndividual( g_numani, false, CompressAnimation );
+
+	int	changes = 0;
+	int	total = 0;
+
+	for( int i = 0; i < g_numani; i++ )
+	{
+		changes += g_compresscounts[i*2+0];
+		total += g_compresscounts[i*2+1];
+	}
+	g_compresscounts.Purge();
+
 	if (total != 0) 
 	{
 		float sizeRatio = changes / static_cast<float>(total);
@@ -4213,71 +4315,73 @@ static void CompressSingle( s_animationstream_t *pStream )
 	}
 }
 
-static void CalcSequenceBoundingBoxes( void )
+// find bounding box for each sequence
+static void CalcAnimationBoundingBox( int i, int threadnum )
 {
-	int	i, j, k;
+	s_animation_t *panim = g_panimation[i];
+	Vector	bmin, bmax;
+	int	j, k;
 	int	n, m;
 
-	// find bounding box for each sequence
-	for( i = 0; i < g_numseq; i++ )
+	// find intersection box volume for each bone
+	ClearBounds( bmin, bmax );
+
+	for( n = 0; n < panim->numframes; n++ )
 	{
-		Vector	bmin, bmax;
+		matrix3x4	bonetransform[MAXSTUDIOBONES];	// bone transformation matrix
+		matrix3x4	posetransform[MAXSTUDIOBONES];	// bone transformation matrix
+		matrix3x4	bonematrix;			// local transformation matrix
+		Vector pos, tmp;
 
-		// find intersection box volume for each bone
-		ClearBounds( bmin, bmax );
-
-		s_animation_t *panim = g_panimation[i];
-
-		for( n = 0; n < panim->numframes; n++ )
+		for( j = 0; j < g_numbones; j++ )
 		{
-			matrix3x4	bonetransform[MAXSTUDIOBONES];	// bone transformation matrix
-			matrix3x4	posetransform[MAXSTUDIOBONES];	// bone transformation matrix
-			matrix3x4	bonematrix;			// local transformation matrix
-			Vector pos, tmp;
+			bonematrix = matrix3x4( panim->sanim[n][j].pos, panim->sanim[n][j].rot );
+			if( g_bonetable[j].parent == -1 ) bonetransform[j] = bonematrix;
+			else bonetransform[j] = bonetransform[g_bonetable[j].parent].ConcatTransforms( bonematrix );
 
-			for( j = 0; j < g_numbones; j++ )
-			{
-				bonematrix = matrix3x4( panim->sanim[n][j].pos, panim->sanim[n][j].rot );
-				if( g_bonetable[j].parent == -1 ) bonetransform[j] = bonematrix;
-				else bonetransform[j] = bonetransform[g_bonetable[j].parent].ConcatTransforms( bonematrix );
+			bonematrix = g_bonetable[j].boneToPose.Invert();
+			posetransform[j] = bonetransform[j].ConcatTransforms( bonematrix );
+		}
 
-				bonematrix = g_bonetable[j].boneToPose.Invert();
-				posetransform[j] = bonetransform[j].ConcatTransforms( bonematrix );
-			}
+		// include bones as well.
+		for( k = 0; k < g_numbones; k++ )
+		{
+			Vector tmpMin, tmpMax;
+			TransformAABB( bonetransform[k], g_bonetable[k].bmin, g_bonetable[k].bmax, tmpMin, tmpMax );
+			AddPointToBounds( tmpMin, bmin, bmax );
+			AddPointToBounds( tmpMax, bmin, bmax );
+		}
 
-			// include bones as well.
-			for( k = 0; k < g_numbones; k++ )
+		// include vertices
+		for( k = 0; k < g_nummodels; k++ )
+		{
+			for( j = 0; j < g_model[k]->srcvert.Count(); j++ )
 			{
-				Vector tmpMin, tmpMax;
-				TransformAABB( bonetransform[k], g_bonetable[k].bmin, g_bonetable[k].bmax, tmpMin, tmpMax );
-				AddPointToBounds( tmpMin, bmin, bmax );
-				AddPointToBounds( tmpMax, bmin, bmax );
-			}
+				s_srcvertex_t *v = &g_model[k]->srcvert[j];
+				pos = g_vecZero;
 
-			// include vertices
-			for( k = 0; k < g_nummodels; k++ )
-			{
-				for( j = 0; j < g_model[k]->srcvert.Count(); j++ )
+				for( m = 0; m < v->globalWeight.numbones; m++ )
 				{
-					s_srcvertex_t *v = &g_model[k]->srcvert[j];
-					pos = g_vecZero;
-
-					for( m = 0; m < v->globalWeight.numbones; m++ )
-					{
-						if( has_boneweights )
-							tmp = posetransform[v->globalWeight.bone[m]].VectorTransform( v->vert );
-						else tmp = bonetransform[v->globalWeight.bone[m]].VectorTransform( v->vert );
-						pos += tmp * v->globalWeight.weight[m];
-					}
-					AddPointToBounds( pos, bmin, bmax );
+					if( has_boneweights )
+						tmp = posetransform[v->globalWeight.bone[m]].VectorTransform( v->vert );
+					else tmp = bonetransform[v->globalWeight.bone[m]].VectorTransform( v->vert );
+					pos += tmp * v->globalWeight.weight[m];
 				}
+				AddPointToBounds( pos, bmin, bmax );
 			}
 		}
-
-		panim->bmin = bmin;
-		panim->bmax = bmax;
 	}
 
+	panim->bmin = bmin;
+	panim->bmax = bmax;
+}
+
+static void CalcSequenceBoundingBoxes( void )
+{
+	int	i, j;
+
+	RunThreadsOnIndividual( g_numseq, false, CalcAnimationBoundingBox );
+
 	for( i = 0; i < g_numseq; i++ )
 	{
 		Vector	bmin, bmax;
@@ -4849,308 +4953,338 @@ static void LinkIKLocks( void )
 // Purpose: go through all the IK rules and calculate the animated path the IK'd 
 //			end point moves relative to its IK target.
 //-----------------------------------------------------------------------------
-static void ProcessIKRules( void )
+//-----------------------------------------------------------------------------
+// Purpose: builds the ik rules and their error streams for a single animation
+//-----------------------------------------------------------------------------
+static void ProcessAnimationIKRules( s_animation_t *panim )
 {
-	int i, j, k;
+	int j, k;
 
-	// copy source animations
-	for( i = 0; i < g_numani; i++ )
+	for( j = 0; j < panim->numcmds; j++ )
 	{
-		s_animation_t *panim = g_panimation[i];
-		const char *pAnimationName = g_panimation[i]->name;
+		if( panim->cmds[j].cmd == CMD_IKFIXUP )
+		{
+			fixupIKErrors( panim, panim->cmds[j].ikfixup.pRule );
+		}
 
-		for( j = 0; j < panim->numcmds; j++ )
+		if( panim->cmds[j].cmd != CMD_IKRULE )
+			continue;
+
+		if( panim->numikrules >= MAXSTUDIOIKRULES )
 		{
-			if( panim->cmds[j].cmd == CMD_IKFIXUP )
-			{
-				fixupIKErrors( panim, panim->cmds[j].ikfixup.pRule );
-			}
+			COM_FatalError("Too many IK rules in %s (%s)\n", panim->name, panim->filename );
+		}
 
-			if( panim->cmds[j].cmd != CMD_IKRULE )
-				continue;
+		s_ikrule_t *pRule = &panim->ikrule[panim->numikrules++];
 
-			if( panim->numikrules >= MAXSTUDIOIKRULES )
-			{
-				COM_FatalError("Too many IK rules in %s (%s)\n", panim->name, panim->filename );
-			}
+		// make a copy of the rule;
+		*pRule = *panim->cmds[j].ikrule.pRule;
+	}
 
-			s_ikrule_t *pRule = &panim->ikrule[panim->numikrules++];
+	for( j = 0; j < panim->numikrules; j++ )
+	{
+		s_ikrule_t *pRule = &panim->ikrule[j];
 
-			// make a copy of the rule;
-			*pRule = *panim->cmds[j].ikrule.pRule;
+		if( pRule->start == 0 && pRule->peak == 0 && pRule->tail == 0 && pRule->end == 0 )
+		{
+			pRule->tail = panim->numframes - 1;
+			pRule->end = panim->numframes - 1;
 		}
 
-		for( j = 0; j < panim->numikrules; j++ )
+		if( pRule->start != -1 && pRule->peak == -1 && pRule->tail == -1 && pRule->end != -1 )
 		{
-			s_ikrule_t *pRule = &panim->ikrule[j];
-
-			if( pRule->start == 0 && pRule->peak == 0 && pRule->tail == 0 && pRule->end == 0 )
-			{
-				pRule->tail = panim->numframes - 1;
-				pRule->end = panim->numframes - 1;
-			}
+			pRule->peak = (pRule->start + pRule->end) / 2;
+			pRule->tail = (pRule->start + pRule->end) / 2;
+		}
 
-			if( pRule->start != -1 && pRule->peak == -1 && pRule->tail == -1 && pRule->end != -1 )
-			{
-				pRule->peak = (pRule->start + pRule->end) / 2;
-				pRule->tail = (pRule->start + pRule->end) / 2;
-			}
+		if( pRule->start != -1 && pRule->peak == -1 && pRule->tail != -1 )
+		{
+			pRule->peak = (pRule->start + pRule->tail) / 2;
+		}
 
-			if( pRule->start != -1 && pRule->peak == -1 && pRule->tail != -1 )
-			{
-				pRule->peak = (pRule->start + pRule->tail) / 2;
-			}
+		if( pRule->peak != -1 && pRule->tail == -1 && pRule->end != -1 )
+		{
+			pRule->tail = (pRule->peak + pRule->end) / 2;
+		}
 
-			if( pRule->peak != -1 && pRule->tail == -1 && pRule->end != -1 )
-			{
-				pRule->tail = (pRule->peak + pRule->end) / 2;
-			}
+		if( pRule->peak == -1 )
+		{
+			pRule->start = 0;
+			pRule->peak = 0;
+		}
 
-			if( pRule->peak == -1 )
-			{
-				pRule->start = 0;
-				pRule->peak = 0;
-			}
+		if( pRule->tail == -1 )
+		{
+			pRule->tail = panim->numframes - 1;
+			pRule->end = panim->numframes - 1;
+		}
 
-			if( pRule->tail == -1 )
-			{
-				pRule->tail = panim->numframes - 1;
-				pRule->end = panim->numframes - 1;
-			}
+		if( pRule->contact == -1 )
+		{
+			pRule->contact = pRule->peak;
+		}
 
-			if( pRule->contact == -1 )
-			{
-				pRule->contact = pRule->peak;
-			}
+		// huh, make up start and end numbers
+		if( pRule->start == -1 )
+		{
+			s_ikrule_t *pPrev = FindPrevIKRule( panim, j );
 
-			// huh, make up start and end numbers
-			if( pRule->start == -1 )
+			if( pPrev->slot == pRule->slot )
 			{
-				s_ikrule_t *pPrev = FindPrevIKRule( panim, j );
-
-				if( pPrev->slot == pRule->slot )
+				if( pRule->peak < pPrev->tail )
 				{
-					if( pRule->peak < pPrev->tail )
-					{
-						pRule->start = pRule->peak + (pPrev->tail - pRule->peak) / 2;
-					}
-					else
-					{
-						pRule->start = pRule->peak + (pPrev->tail - pRule->peak + panim->numframes - 1) / 2;
-					}
-
-					pRule->start = (pRule->start + panim->numframes / 2) % (panim->numframes - 1);
-					pPrev->end = (pRule->start + panim->numframes - 1) % (panim->numframes - 1);
+					pRule->start = pRule->peak + (pPrev->tail - pRule->peak) / 2;
 				}
 				else
 				{
-					pRule->start = pPrev->tail;
-					pPrev->end = pRule->peak;
+					pRule->start = pRule->peak + (pPrev->tail - pRule->peak + panim->numframes - 1) / 2;
 				}
-			}
 
-			// huh, make up start and end numbers
-			if( pRule->end == -1 )
+				pRule->start = (pRule->start + panim->numframes / 2) % (panim->numframes - 1);
+				pPrev->end = (pRule->start + panim->numframes - 1) % (panim->numframes - 1);
+			}
+			else
 			{
-				s_ikrule_t *pNext = FindNextIKRule( panim, j );
+				pRule->start = pPrev->tail;
+				pPrev->end = pRule->peak;
+			}
+		}
 
-				if( pNext->slot == pRule->slot )
-				{
-					if( pNext->peak < pRule->tail )
-					{
-						pNext->start = pNext->peak + (pRule->tail - pNext->peak) / 2;
-					}
-					else
-					{
-						pNext->start = pNext->peak + (pRule->tail - pNext->peak + panim->numframes - 1) / 2;
-					}
+		// huh, make up start and end numbers
+		if( pRule->end == -1 )
+		{
+			s_ikrule_t *pNext = FindNextIKRule( panim, j );
 
-					pNext->start = (pNext->start + panim->numframes / 2) % (panim->numframes - 1);
-					pRule->end = (pNext->start + panim->numframes - 1) % (panim->numframes - 1);
+			if( pNext->slot == pRule->slot )
+			{
+				if( pNext->peak < pRule->tail )
+				{
+					pNext->start = pNext->peak + (pRule->tail - pNext->peak) / 2;
 				}
 				else
 				{
-					pNext->start = pRule->tail;
-					pRule->end = pNext->peak;
+					pNext->start = pNext->peak + (pRule->tail - pNext->peak + panim->numframes - 1) / 2;
 				}
-			}
 
-			// check for wrapping
-			if( pRule->peak < pRule->start )
-			{
-				pRule->peak += panim->numframes - 1;
+				pNext->start = (pNext->start + panim->numframes / 2) % (panim->numframes - 1);
+				pRule->end = (pNext->start + panim->numframes - 1) % (panim->numframes - 1);
 			}
-
-			if( pRule->tail < pRule->peak )
+			else
 			{
-				pRule->tail += panim->numframes - 1;
+				pNext->start = pRule->tail;
+				pRule->end = pNext->peak;
 			}
+		}
 
-			if( pRule->end < pRule->tail )
-			{
-				pRule->end += panim->numframes - 1;
-			}
+		// check for wrapping
+		if( pRule->peak < pRule->start )
+		{
+			pRule->peak += panim->numframes - 1;
+		}
 
-			if( pRule->contact < pRule->start )
-			{
-				pRule->contact += panim->numframes - 1;
-			}
+		if( pRule->tail < pRule->peak )
+		{
+			pRule->tail += panim->numframes - 1;
+		}
+
+		if( pRule->end < pRule->tail )
+		{
+			pRule->end += panim->numframes - 1;
+		}
+
+		if( pRule->contact < pRule->start )
+		{
+			pRule->contact += panim->numframes - 1;
+		}
 
-			pRule->errorData.numerror = pRule->end - pRule->start + 1;
-			if( pRule->end >= panim->numframes )
-				pRule->errorData.numerror = pRule->errorData.numerror + 2;
+		pRule->errorData.numerror = pRule->end - pRule->start + 1;
+		if( pRule->end >= panim->numframes )
+			pRule->errorData.numerror = pRule->errorData.numerror + 2;
 
-			pRule->errorData.pError = (s_streamdata_t *)Mem_Alloc( pRule->errorData.numerror * sizeof( s_streamdata_t ));
+		pRule->errorData.pError = (s_streamdata_t *)Mem_Alloc( pRule->errorData.numerror * sizeof( s_streamdata_t ));
 
-			int n = 0;
+		int n = 0;
 
-			if( pRule->usesequence )
+		if( pRule->usesequence )
+		{
+			// FIXME: bah, this is horrendously hacky, add a damn back pointer
+			for( n = 0; n < g_numseq; n++ )
 			{
-				// FIXME: bah, this is horrendously hacky, add a damn back pointer
-				for( n = 0; n < g_numseq; n++ )
-				{
-					if( g_sequence[n].panim[0] == panim )
-						break;
-				}
+				if( g_sequence[n].panim[0] == panim )
+					break;
 			}
+		}
 
-			switch( pRule->type )
+		switch( pRule->type )
+		{
+		case IK_SELF:
 			{
-			case IK_SELF:
+				matrix3x4	local;
+				matrix3x4	worldToBone;
+				CUtlArray<matrix3x4> boneToWorld;
+				boneToWorld.SetCount(MAXSTUDIOBONES);
+
+				if( !Q_strlen( pRule->bonename ))
 				{
-					matrix3x4	local;
-					matrix3x4	worldToBone;
-					CUtlArray<matrix3x4> boneToWorld;
-					boneToWorld.SetCount(MAXSTUDIOBONES);
+					pRule->bone = -1;
+				}
+				else
+				{
+					pRule->bone = findGlobalBone( pRule->bonename );
 
-					if( !Q_strlen( pRule->bonename ))
+					if( pRule->bone == -1 )
+						COM_FatalError( "unknown bone '%s' in ikrule\n", pRule->bonename );
+				}
+
+				for( k = 0; k < pRule->errorData.numerror; k++ )
+				{
+					if( pRule->usesequence )
 					{
-						pRule->bone = -1;
+						CalcSeqTransforms(n, k + pRule->start, &boneToWorld[0]);
 					}
-					else
+					else if( pRule->usesource )
 					{
-						pRule->bone = findGlobalBone( pRule->bonename );
-
-						if( pRule->bone == -1 )
-							COM_FatalError( "unknown bone '%s' in ikrule\n", pRule->bonename );
+						CUtlArray<matrix3x4> srcBoneToWorld;
+						srcBoneToWorld.SetCount(MAXSTUDIOSRCBONES);
+						BuildRawTransforms(panim, k + pRule->start + panim->startframe - panim->source.startframe, panim->adjust, panim->rotation, &srcBoneToWorld[0]);
+						TranslateAnimations(panim->boneGlobalToLocal, &srcBoneToWorld[0], &boneToWorld[0]);
+					}
+					else 
+					{
+						CalcBoneTransforms(panim, k + pRule->start, &boneToWorld[0]);
 					}
 
-					for( k = 0; k < pRule->errorData.numerror; k++ )
+					if( pRule->bone != -1 )
 					{
-						if( pRule->usesequence )
-						{
-							CalcSeqTransforms(n, k + pRule->start, &boneToWorld[0]);
-						}
-						else if( pRule->usesource )
-						{
-							CUtlArray<matrix3x4> srcBoneToWorld;
-							srcBoneToWorld.SetCount(MAXSTUDIOSRCBONES);
-							BuildRawTransforms(panim, k + pRule->start + panim->startframe - panim->source.startframe, panim->adjust, panim->rotation, &srcBoneToWorld[0]);
-							TranslateAnimations(panim->boneGlobalToLocal, &srcBoneToWorld[0], &boneToWorld[0]);
-						}
-						else 
-						{
-							CalcBoneTransforms(panim, k + pRule->start, &boneToWorld[0]);
-						}
+						worldToBone = boneToWorld[pRule->bone].Invert();
+						local = worldToBone.ConcatTransforms( boneToWorld[g_ikchain[pRule->chain].link[2].bone] );
+					}
+					else
+					{
+						local = boneToWorld[g_ikchain[pRule->chain].link[2].bone];
+					}
 
-						if( pRule->bone != -1 )
-						{
-							worldToBone = boneToWorld[pRule->bone].Invert();
-							local = worldToBone.ConcatTransforms( boneToWorld[g_ikchain[pRule->chain].link[2].bone] );
-						}
-						else
-						{
-							local = boneToWorld[g_ikchain[pRule->chain].link[2].bone];
-						}
+					pRule->errorData.pError[k].q = local.GetQuaternion();
+					pRule->errorData.pError[k].pos = local.GetOrigin();
+				}
+			}
+			break;
+		case IK_WORLD:
+			break;
+		case IK_ATTACHMENT:
+			{
+				matrix3x4	local;
+				matrix3x4	worldToBone;
+				CUtlArray<matrix3x4> boneToWorld;
+				boneToWorld.SetCount(MAXSTUDIOBONES);
+
+				int bone = g_ikchain[pRule->chain].link[2].bone;
+				CalcBoneTransforms(panim, pRule->contact, &boneToWorld[0]);
+				// FIXME: add in motion
 
-						pRule->errorData.pError[k].q = local.GetQuaternion();
-						pRule->errorData.pError[k].pos = local.GetOrigin();
+				if( !Q_strlen( pRule->bonename ))
+				{
+					if( pRule->bone != -1 )
+					{
+						pRule->bone = bone;
 					}
 				}
-				break;
-			case IK_WORLD:
-				break;
-			case IK_ATTACHMENT:
+				else
 				{
-					matrix3x4	local;
-					matrix3x4	worldToBone;
-					CUtlArray<matrix3x4> boneToWorld;
-					boneToWorld.SetCount(MAXSTUDIOBONES);
+					pRule->bone = findGlobalBone( pRule->bonename );
+					if( pRule->bone == -1 )
+					{
+						COM_FatalError( "unknown bone '%s' in ikrule\n", pRule->bonename );
+					}
+				}
 
-					int bone = g_ikchain[pRule->chain].link[2].bone;
+				if( pRule->bone != -1 )
+				{
+					// FIXME: look for local bones...
 					CalcBoneTransforms(panim, pRule->contact, &boneToWorld[0]);
-					// FIXME: add in motion
+					pRule->q = boneToWorld[pRule->bone].GetQuaternion();
+					pRule->pos = boneToWorld[pRule->bone].GetOrigin();
+				}
 
-					if( !Q_strlen( pRule->bonename ))
+				for( k = 0; k < pRule->errorData.numerror; k++ )
+				{
+					int t = k + pRule->start;
+
+					if( pRule->usesequence )
 					{
-						if( pRule->bone != -1 )
-						{
-							pRule->bone = bone;
-						}
+						CalcSeqTransforms(n, t, &boneToWorld[0]);
 					}
-					else
+					else if( pRule->usesource )
 					{
-						pRule->bone = findGlobalBone( pRule->bonename );
-						if( pRule->bone == -1 )
-						{
-							COM_FatalError( "unknown bone '%s' in ikrule\n", pRule->bonename );
-						}
+						CUtlArray<matrix3x4> srcBoneToWorld;
+						srcBoneToWorld.SetCount(MAXSTUDIOSRCBONES);
+						BuildRawTransforms(panim, t + panim->startframe - panim->source.startframe, g_vecZero, g_radZero, &srcBoneToWorld[0]);
+						TranslateAnimations(panim->boneGlobalToLocal, &srcBoneToWorld[0], &boneToWorld[0]);
 					}
-
-					if( pRule->bone != -1 )
+					else 
 					{
-						// FIXME: look for local bones...
-						CalcBoneTransforms(panim, pRule->contact, &boneToWorld[0]);
-						pRule->q = boneToWorld[pRule->bone].GetQuaternion();
-						pRule->pos = boneToWorld[pRule->bone].GetOrigin();
+						CalcBoneTransforms( panim, t, &boneToWorld[0] );
 					}
 
-					for( k = 0; k < pRule->errorData.numerror; k++ )
-					{
-						int t = k + pRule->start;
+					Vector pos = pRule->pos + calcMovement( panim, t, pRule->contact );
 
-						if( pRule->usesequence )
-						{
-							CalcSeqTransforms(n, t, &boneToWorld[0]);
-						}
-						else if( pRule->usesource )
-						{
-							CUtlArray<matrix3x4> srcBoneToWorld;
-							srcBoneToWorld.SetCount(MAXSTUDIOSRCBONES);
-							BuildRawTransforms(panim, t + panim->startframe - panim->source.startframe, g_vecZero, g_radZero, &srcBoneToWorld[0]);
-							TranslateAnimations(panim->boneGlobalToLocal, &srcBoneToWorld[0], &boneToWorld[0]);
-						}
-						else 
-						{
-							CalcBoneTransforms( panim, t, &boneToWorld[0] );
-						}
+					local = matrix3x4( pos, pRule->q );
+					worldToBone = local.Invert();
 
-						Vector pos = pRule->pos + calcMovement( panim, t, pRule->contact );
+					// calc position error
+					local = worldToBone.ConcatTransforms( boneToWorld[bone] );
+					pRule->errorData.pError[k].q = local.GetQuaternion();
+					pRule->errorData.pError[k].pos = local.GetOrigin();
+				}
+			}
+			break;
+		case IK_GROUND:
+			{
+				matrix3x4	local;
+				matrix3x4	worldToBone;
+				CUtlArray<matrix3x4> boneToWorld;
+				boneToWorld.SetCount(MAXSTUDIOBONES);
 
-						local = matrix3x4( pos, pRule->q );
-						worldToBone = local.Invert();
+				int bone = g_ikchain[pRule->chain].link[2].bone;
 
-						// calc position error
-						local = worldToBone.ConcatTransforms( boneToWorld[bone] );
-						pRule->errorData.pError[k].q = local.GetQuaternion();
-						pRule->errorData.pError[k].pos = local.GetOrigin();
-					}
+				if( pRule->usesequence )
+				{
+					CalcSeqTransforms(n, pRule->contact, &boneToWorld[0]);
 				}
-				break;
-			case IK_GROUND:
+				else if (pRule->usesource)
+				{
+					CUtlArray<matrix3x4> srcBoneToWorld;
+					srcBoneToWorld.SetCount(MAXSTUDIOSRCBONES);
+					BuildRawTransforms(panim, pRule->contact + panim->startframe, panim->adjust, panim->rotation, &srcBoneToWorld[0]);
+					TranslateAnimations(panim->boneGlobalToLocal, &srcBoneToWorld[0], &boneToWorld[0]);
+				}
+				else 
 				{
-					matrix3x4	local;
-					matrix3x4	worldToBone;
-					CUtlArray<matrix3x4> boneToWorld;
-					boneToWorld.SetCount(MAXSTUDIOBONES);
+					CalcBoneTransforms(panim, pRule->contact, &boneToWorld[0]);
+				}
+
+				// FIXME: add in motion
+
+				Vector footfall = boneToWorld[bone].VectorTransform( g_ikchain[pRule->chain].center );
+				footfall.z = pRule->floor;
 
-					int bone = g_ikchain[pRule->chain].link[2].bone;
+				local = matrix3x4( footfall, g_radZero );
+				worldToBone = local.Invert();
+
+				pRule->pos = footfall;
+				pRule->q = g_radZero;	// auto conversion Radian->Quaternion
+
+				float s;
+
+				for( k = 0; k < pRule->errorData.numerror; k++ )
+				{
+					int t = k + pRule->start;
 
 					if( pRule->usesequence )
 					{
-						CalcSeqTransforms(n, pRule->contact, &boneToWorld[0]);
+						CalcSeqTransforms(n, t, &boneToWorld[0]);
 					}
-					else if (pRule->usesource)
+					else if( pRule->usesource )
 					{
 						CUtlArray<matrix3x4> srcBoneToWorld;
 						srcBoneToWorld.SetCount(MAXSTUDIOSRCBONES);
@@ -5159,113 +5293,119 @@ static void ProcessIKRules( void )
 					}
 					else 
 					{
-						CalcBoneTransforms(panim, pRule->contact, &boneToWorld[0]);
+						CalcBoneTransforms(panim, t, &boneToWorld[0]);
 					}
 
-					// FIXME: add in motion
+					Vector pos = pRule->pos + calcMovement( panim, t, pRule->contact );
+					s = 0.0;
 
-					Vector footfall = boneToWorld[bone].VectorTransform( g_ikchain[pRule->chain].center );
-					footfall.z = pRule->floor;
+					Vector cur = boneToWorld[bone].VectorTransform( g_ikchain[pRule->chain].center );
+					cur.z = pos.z;
 
-					local = matrix3x4( footfall, g_radZero );
-					worldToBone = local.Invert();
+					if( t < pRule->start || t >= pRule->end )
+					{
+						pos = cur;
+					}
+					else if( t < pRule->peak )
+					{
+						s = (float)(pRule->peak - t) / (pRule->peak - pRule->start);
+						s = 3 * s * s - 2 * s * s * s;
+						pos = pos * (1 - s) + cur * s;
+					}
+					else if( t > pRule->tail )
+					{
+						s = (float)(t - pRule->tail) / (pRule->end - pRule->tail);
+						s = 3 * s * s - 2 * s * s * s;
+						pos = pos * (1 - s) + cur * s;
+					}
 
-					pRule->pos = footfall;
-					pRule->q = g_radZero;	// auto conversion Radian->Quaternion
+					local = matrix3x4( pos, pRule->q );
+					worldToBone = local.Invert();
 
-					float s;
+					// calc position error
+					local = worldToBone.ConcatTransforms( boneToWorld[bone] );
+					pRule->errorData.pError[k].q = local.GetQuaternion();
+					pRule->errorData.pError[k].pos = local.GetOrigin();
+				}
+			}
+			break;
+		case IK_RELEASE:
+		case IK_UNLATCH:
+			break;
+		}
+	}
 
-					for( k = 0; k < pRule->errorData.numerror; k++ )
-					{
-						int t = k + pRule->start;
+	if( FBitSet( panim->flags, STUDIO_DELTA ) || panim->noAutoIK )
+		return;
 
-						if( pRule->usesequence )
-						{
-							CalcSeqTransforms(n, t, &boneToWorld[0]);
-						}
-						else if( pRule->usesource )
-						{
-							CUtlArray<matrix3x4> srcBoneToWorld;
-							srcBoneToWorld.SetCount(MAXSTUDIOSRCBONES);
-							BuildRawTransforms(panim, pRule->contact + panim->startframe, panim->adjust, panim->rotation, &srcBoneToWorld[0]);
-							TranslateAnimations(panim->boneGlobalToLocal, &srcBoneToWorld[0], &boneToWorld[0]);
-						}
-						else 
-						{
-							CalcBoneTransforms(panim, t, &boneToWorld[0]);
-						}
+	// auto release ik chains that are moved but not referenced and have no explicit rules
+	int count[16];
 
-						Vector pos = pRule->pos + calcMovement( panim, t, pRule->contact );
-						s = 0.0;
+	for( j = 0; j < g_numikchains; j++ )
+	{
+		count[j] = 0;
+	}
 
-						Vector cur = boneToWorld[bone].VectorTransform( g_ikchain[pRule->chain].center );
-						cur.z = pos.z;
+	for( j = 0; j < panim->numikrules; j++ )
+	{
+		count[panim->ikrule[j].chain]++;
+	}
 
-						if( t < pRule->start || t >= pRule->end )
-						{
-							pos = cur;
-						}
-						else if( t < pRule->peak )
-						{
-							s = (float)(pRule->peak - t) / (pRule->peak - pRule->start);
-							s = 3 * s * s - 2 * s * s * s;
-							pos = pos * (1 - s) + cur * s;
-						}
-						else if( t > pRule->tail )
-						{
-							s = (float)(t - pRule->tail) / (pRule->end - pRule->tail);
-							s = 3 * s * s - 2 * s * s * s;
-							pos = pos * (1 - s) + cur * s;
-						}
+	for( j = 0; j < g_numikchains; j++ )
+	{
+		if( count[j] == 0 && panim->weight[g_ikchain[j].link[2].bone] > 0.0f )
+		{
+			k = panim->numikrules++;
+			panim->ikrule[k].chain = j;
+			panim->ikrule[k].slot = j;
+			panim->ikrule[k].type = IK_RELEASE;
+			panim->ikrule[k].start = 0;
+			panim->ikrule[k].peak = 0;
+			panim->ikrule[k].tail = panim->numframes - 1;
+			panim->ikrule[k].end = panim->numframes - 1;
+		}
+	}
+}
 
-						local = matrix3x4( pos, pRule->q );
-						worldToBone = local.Invert();
+static void ProcessAnimationIKRulesThread( int i, int threadnum )
+{
+	if( !g_serialanim[i] )
+		ProcessAnimationIKRules( g_panimation[i] );
+}
 
-						// calc position error
-						local = worldToBone.ConcatTransforms( boneToWorld[bone] );
-						pRule->errorData.pError[k].q = local.GetQuaternion();
-						pRule->errorData.pError[k].pos = local.GetOrigin();
-					}
-				}
-				break;
-			case IK_RELEASE:
-			case IK_UNLATCH:
-				break;
-			}
-		}
+static void ProcessIKRules( void )
+{
+	int i, j, k;
 
-		if( FBitSet( panim->flags, STUDIO_DELTA ) || panim->noAutoIK )
-			continue;
+	// ikfixup changes the frames that ikrules of the other animations read
+	// through the sequences (and delta animations through the base one)
+	g_serialanim.SetCount( g_numani );
+	for( i = 0; i < g_numani; i++ )
+	{
+		s_animation_t *panim = g_panimation[i];
 
-		// auto release ik chains that are moved but not referenced and have no explicit rules
-		int count[16];
+		g_serialanim[i] = ( i == 0 );
 
-		for( j = 0; j < g_numikchains; j++ )
+		for( j = 0; j < panim->numcmds; j++ )
 		{
-			count[j] = 0;
-		}
+			if( panim->cmds[j].cmd == CMD_IKFIXUP )
+				g_serialanim[i] = true;
 
-		for( j = 0; j < panim->numikrules; j++ )
-		{
-			count[panim->ikrule[j].chain]++;
+			if( panim->cmds[j].cmd == CMD_IKRULE && panim->cmds[j].ikrule.pRule->usesequence )
+				g_serialanim[i] = true;
 		}
+	}
 
-		for( j = 0; j < g_numikchains; j++ )
-		{
-			if( count[j] == 0 && panim->weight[g_ikchain[j].link[2].bone] > 0.0f )
-			{
-				k = panim->numikrules++;
-				panim->ikrule[k].chain = j;
-				panim->ikrule[k].slot = j;
-				panim->ikrule[k].type = IK_RELEASE;
-				panim->ikrule[k].start = 0;
-				panim->ikrule[k].peak = 0;
-				panim->ikrule[k].tail = panim->numframes - 1;
-				panim->ikrule[k].end = panim->numframes - 1;
-			}
-		}
+	// copy source animations
+	for( i = 0; i < g_numani; i++ )
+	{
+		if( g_serialanim[i] )
+			ProcessAnimationIKRules( g_panimation[i] );
 	}
 
+	RunThreadsOnIndividual( g_numani, false, ProcessAnimationIKRulesThread );
+	g_serialanim.Purge();
+
 	// realign IK across multiple animations
 	for( i = 0; i < g_numseq; i++ )
 	{
@@ -5324,78 +5464,80 @@ static void ProcessIKRules( void )
 //-----------------------------------------------------------------------------
 // Compress all the IK data
 //-----------------------------------------------------------------------------
-static void CompressIKErrors( void )
+static void CompressAnimationIKErrors( int i, int threadnum )
 {
-	// find scales for all bones
-	for( int i = 0; i < g_numani; i++ )
+	for( int j = 0; j < g_panimation[i]->numikrules; j++ )
 	{
-		for( int j = 0; j < g_panimation[i]->numikrules; j++ )
-		{
-			s_ikrule_t *pRule = &g_panimation[i]->ikrule[j];
+		s_ikrule_t *pRule = &g_panimation[i]->ikrule[j];
 
-			if( pRule->errorData.numerror == 0 )
-				continue;
+		if( pRule->errorData.numerror == 0 )
+			continue;
 
-			CompressSingle( &pRule->errorData );
-		}
+		CompressSingle( &pRule->errorData );
 	}
 }
 
+static void CompressIKErrors( void )
+{
+	// find scales for all bones
+	RunThreadsOnIndividual( g_numani, false, CompressAnimationIKErrors );
+}
+
 void SimplifyModel( void )
 {
 	if( g_numseq == 0 )
 		COM_FatalError( "model has no sequences\n" );
 
-	RemapBones( );
+	RunPhase( "RemapBones", RemapBones );
 
-	LinkIKChains();
+	RunPhase( "LinkIKChains", LinkIKChains );
 
-	LinkIKLocks();
+	RunPhase( "LinkIKLocks", LinkIKLocks );
 
-	RealignBones( );
+	RunPhase( "RealignBones", RealignBones );
 
-	RemapVertices( );
+	RunPhase( "RemapVertices", RemapVertices );
 
-	BuildVertexArrays( );
+	RunPhase( "BuildVertexArrays", BuildVertexArrays );
 
-	RemapAnimations( );
+	RunPhase( "RemapAnimations", RemapAnimations );
 
-	processAnimations( );
+	RunPhase( "processAnimations", processAnimations );
 
-	OptimizeAnimations( );	// FIXME: remove
+	RunPhase( "OptimizeAnimations", OptimizeAnimations );	// FIXME: remove
 
-	limitBoneRotations();
+	RunPhase( "limitBoneRotations", limitBoneRotations );
 
-	limitIKChainLength();
+	RunPhase( "limitIKChainLength", limitIKChainLength );
 
-	RemapProceduralBones( );
+	RunPhase( "RemapProceduralBones", RemapProceduralBones );
 
-	MakeTransitions( );
+	RunPhase( "MakeTransitions", MakeTransitions );
 
-	FindAutolayers();
+	RunPhase( "FindAutolayers", FindAutolayers );
 
-	LinkBoneControllers( );
+	RunPhase( "LinkBoneControllers", LinkBoneControllers );
 
 	// link screen aligned bones
-	TagScreenAlignedBones( );
+	RunPhase( "TagScreenAlignedBones", TagScreenAlignedBones );
 
-	LinkAttachments( );
+	RunPhase( "LinkAttachments", LinkAttachments );
 
 	// procedural bone needs to propagate its bone usage up its chain
 	// ensures runtime sets up dependent bone hierarchy
-	MarkProceduralBoneChain( );
+	RunPhase( "MarkProceduralBoneChain", MarkProceduralBoneChain );
 
-	ProcessIKRules();
+	RunPhase( "ProcessIKRules", ProcessIKRules );
 
-	CompressIKErrors( );
+	RunPhase( "CompressIKErrors", CompressIKErrors );
 
-	CalcPoseParameters();
+	RunPhase( "CalcPoseParameters", CalcPoseParameters );
 
-	SetupHitBoxes( );
+	RunPhase( "SetupHitBoxes", SetupHitBoxes );
 
-	CompressAnimations( );
+	RunPhase( "CompressAnimations", CompressAnimations );
 
-	CalcSequenceBoundingBoxes( );
+	RunPhase( "CalcSequenceBoundingBoxes", CalcSequenceBoundingBoxes );
 
 	// auto groups
 	if( g_numseqgroups == 1 && maxseqgroupsize < 1024 * 1024 ) 
@@ -27,16 +27,90 @@ GNU General Public License for more details.
 #include "crashhandler.h"
 #include "app_info.h"
 #include "build_info.h"
+#include "threads.h"
 
 CUtlArray< char >	g_KeyValueText;
-char		filename[1024];
-char		line[1024];
-int		linecount;
-FILE		*input;
+
+// .smd reader state is per thread so the animations can be prefetched in parallel
+thread_local char	filename[1024];
+thread_local char	line[1024];
+thread_local int	linecount;
+thread_local FILE	*input;
+static thread_local bool	smd_prefetch;	// set while prefetching
 
 //-----------------------------------------------------------------------------
 // Parsed data from a .qc file
 //-----------------------------------------------------------------------------
+/*
+=================
+RunPhase
+
+runs a single compile step and remembers
+how long it took for the -time report
+=================
+*/
+#define MAX_PHASES		32
+
+typedef struct
+{
+	const char	*name;
+	double		time;
+} s_phase_t;
+
+static s_phase_t	g_phases[MAX_PHASES];
+static int	g_numphases;
+
+void RunPhase( const char *name, void (*func)( void ))
+{
+	double	start = I_FloatTime();
+	int	i;
+
+	func();
+
+	if( !g_phase_times )
+		return;
+
+	for( i = 0; i < g_numphases; i++ )
+	{
+		if( !Q_strcmp( g_phases[i].name, name ))
+			break;
+	}
+
+	if( i == g_numphases )
+	{
+		if( g_numphases == MAX_PHASES )
+			return;
+		g_phases[g_numphases++].name = name;
+	}
+
+	g_phases[i].time += I_FloatTime() - start;
+}
+
+static void PrintPhaseTimes( void )
+{
+	double	total = 0.0;
+	int	i;
+
+	if( !g_phase_times || !g_numphases )
+		return;
+
+	for( i = 0; i < g_numphases; i++ )
+		total += g_phases[i].time;
+
+	Msg( "\n" );
+	Msg( "phase                      seconds       %%\n" );
+	Msg( "-----------------------------------------\n" );
+
+	for( i = 0; i < g_numphases; i++ )
+	{
+		double	frac = ( total > 0.0 ) ? ( g_phases[i].time * 100.0 / total ) : 0.0;
+		Msg( "%-25s %8.3f  %6.2f\n", g_phases[i].name, g_phases[i].time, frac );
+	}
+
+	Msg( "-----------------------------------------\n" );
+	Msg( "%-25s %8.3f\n", "total", total );
+}
+
 /*
 =================
 ClearModel
@@ -199,6 +273,15 @@ bool GetLineInput( void )
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: prefetched files must not print or stop the compiler. The readers
+// return SMD_ERROR instead and the file is dropped, the serial load will
+// report the problem in the right place
+//-----------------------------------------------------------------------------
+#define SMD_ERROR		-1
+#define SMD_CUTTED		0	// too many frames, the rest of the file is skipped
+#define SMD_OK		1
+
 bool IsEnd( char const *pLine )
 {
 	if( !Q_strncmp( "end", pLine, 3 )) 
@@ -560,20 +643,152 @@ s_trianglevert_t *LookupTriangle( s_mesh_t *pmesh, int index )
 	return pmesh->triangle[index];
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: welding hashes. Vertices are hashed on the exact position,
+// normals on a grid cell as wide as the blend tolerance so a match is
+// always found in the neighbour cells. Both include the bone weights
+//-----------------------------------------------------------------------------
+#define WELD_HASH_SIZE		65536	// must be power of two
+#define WELD_NORMAL_EPSILON	0.001f
+
+static uint WeldHash( const void *data, size_t size, uint hash )
+{
+	const byte	*p = (const byte *)data;
+
+	// FNV-1a
+	for( size_t i = 0; i < size; i++ )
+		hash = ( hash ^ p[i] ) * 16777619u;
+
+	return hash;
+}
+
+static int HashWeldVertex( const Vector &org, const s_boneweight_t *weight )
+{
+	// -0 and 0 compare as equal so they must hash the same
+	float	v[3] = { org.x != 0.0f ? org.x : 0.0f, org.y != 0.0f ? org.y : 0.0f, org.z != 0.0f ? org.z : 0.0f };
+	uint	hash = WeldHash( v, sizeof( v ), 2166136261u );
+
+	return WeldHash( weight, sizeof( *weight ), hash ) & ( WELD_HASH_SIZE - 1 );
+}
+
+static int HashWeldNormal( const int cell[3], int skinref, const s_boneweight_t *weight )
+{
+	uint	hash = WeldHash( cell, sizeof( int ) * 3, 2166136261u );
+
+	hash = WeldHash( &skinref, sizeof( skinref ), hash );
+
+	return WeldHash( weight, sizeof( *weight ), hash ) & ( WELD_HASH_SIZE - 1 );
+}
+
+// unit normals that pass the dot test are closer than this
+static float WeldNormalCellSize( void )
+{
+	float	dist = 2.0f * ( 1.0f + WELD_NORMAL_EPSILON ) - 2.0f * g_normal_blend;
+
+	return sqrt( Q_max( dist, 0.0f )) + WELD_NORMAL_EPSILON;
+}
+
+static void WeldNormalCell( const Vector &norm, float cellsize, int cell[3] )
+{
+	for( int i = 0; i < 3; i++ )
+		cell[i] = (int)floor( norm[i] / cellsize );
+}
+
+static void InitWeldHash( CUtlArray<int> &hash )
+{
+	if( hash.Count( ))
+		return;
+
+	hash.SetCount( WELD_HASH_SIZE );
+	for( int i = 0; i < WELD_HASH_SIZE; i++ )
+		hash[i] = -1;
+}
+
+void FreeWeldHashes( s_model_t *pmodel )
+{
+	pmodel->verthash.Purge();
+	pmodel->vertchain.Purge();
+	pmodel->normhash.Purge();
+	pmodel->normchain.Purge();
+	pmodel->normloose.Purge();
+}
+
+static bool CompareNormal( const s_normal_t *norm, const s_srcvertex_t *srcv )
+{
+	return DotProduct( norm->org, srcv->norm ) > g_normal_blend && norm->skinref == srcv->skinref
+		&& !memcmp( &norm->globalWeight, &srcv->globalWeight, sizeof( s_boneweight_t ));
+}
+
 int LookupNormal( s_model_t *pmodel, s_srcvertex_t *srcv )
 {
-	for (int i = 0; i < pmodel->norm.Count(); i++)
+	float	cellsize = WeldNormalCellSize();
+	int	cell[3], match = -1;
+
+	InitWeldHash( pmodel->normhash );
+
+	// only normals no longer than a unit are guaranteed to be in the neighbour cells
+	bool	loose = ( DotProduct( srcv->norm, srcv->norm ) > 1.0f + WELD_NORMAL_EPSILON );
+
+	if( loose )
 	{
-		if( DotProduct( pmodel->norm[i].org, srcv->norm ) > g_normal_blend && pmodel->norm[i].skinref == srcv->skinref
-			&& !memcmp( &pmodel->norm[i].globalWeight, &srcv->globalWeight, sizeof( s_boneweight_t ))) {
-			return i;
+		for( int i = 0; i < pmodel->norm.Count(); i++ )
+		{
+			if( CompareNormal( &pmodel->norm[i], srcv ))
+				return i;
+		}
+	}
+	else
+	{
+		// several normals can be in range, the first one wins
+		WeldNormalCell( srcv->norm, cellsize, cell );
+
+		for( int x = -1; x <= 1; x++ )
+		{
+			for( int y = -1; y <= 1; y++ )
+			{
+				for( int z = -1; z <= 1; z++ )
+				{
+					int	neighbor[3] = { cell[0] + x, cell[1] + y, cell[2] + z };
+					int	hash = HashWeldNormal( neighbor, srcv->skinref, &srcv->globalWeight );
+
+					for( int i = pmodel->normhash[hash]; i != -1; i = pmodel->normchain[i] )
+					{
+						if(( match == -1 || i < match ) && CompareNormal( &pmodel->norm[i], srcv ))
+							match = i;
+					}
+				}
+			}
+		}
+
+		for( int i = 0; i < pmodel->normloose.Count(); i++ )
+		{
+			int	j = pmodel->normloose[i];
+
+			if(( match == -1 || j < match ) && CompareNormal( &pmodel->norm[j], srcv ))
+				match = j;
 		}
+
+		if( match != -1 )
+			return match;
 	}
 	
 	int k = pmodel->norm.AddToTail();
 	pmodel->norm[k].org = srcv->norm;
 	pmodel->norm[k].globalWeight = srcv->globalWeight;
 	pmodel->norm[k].skinref = srcv->skinref;
+	pmodel->normchain.AddToTail( -1 );
+
+	if( loose )
+	{
+		pmodel->normloose.AddToTail( k );
+	}
+	else
+	{
+		int	hash = HashWeldNormal( cell, srcv->skinref, &srcv->globalWeight );
+
+		pmodel->normchain[k] = pmodel->normhash[hash];
+		pmodel->normhash[hash] = k;
+	}
 
 	if (k == MAXSTUDIOVERTS) {
 		MsgDev(D_WARN, "exceed MAXSTUDIOVERTS limit in model: \"%s\"\nModel may not work with some mods or software (except PrimeXT)\n", pmodel->name);
@@ -589,7 +804,12 @@ int LookupVertex( s_model_t *pmodel, s_srcvertex_t *srcv )
 	srcv->vert.y = (int)(srcv->vert.y * 1000) / 1000.0;
 	srcv->vert.z = (int)(srcv->vert.z * 1000) / 1000.0;
 
-	for (int i = 0; i < pmodel->vert.Count(); i++)
+	InitWeldHash( pmodel->verthash );
+
+	// vertices are unique, so the first match is the only one
+	int	hash = HashWeldVertex( srcv->vert, &srcv->globalWeight );
+
+	for( int i = pmodel->verthash[hash]; i != -1; i = pmodel->vertchain[i] )
 	{
 		if( pmodel->vert[i].org == srcv->vert && !memcmp( &pmodel->vert[i].globalWeight, &srcv->globalWeight, sizeof( s_boneweight_t )))
 			return i;
@@ -598,6 +818,8 @@ int LookupVertex( s_model_t *pmodel, s_srcvertex_t *srcv )
 	int k = pmodel->vert.AddToTail();
 	pmodel->vert[k].org = srcv->vert;
 	pmodel->vert[k].globalWeight = srcv->globalWeight;
+	pmodel->vertchain.AddToTail( pmodel->verthash[hash] );
+	pmodel->verthash[hash] = k;
 
 	if (k == MAXSTUDIOVERTS) {
 		MsgDev(D_WARN, "exceed MAXSTUDIOVERTS limit in model: \"%s\"\nModel may not work with some mods or software (except PrimeXT)\n", pmodel->name);
@@ -939,7 +1161,7 @@ void Grab_Triangles( s_model_t *pmodel )
 	if( vmin != 0.0 ) MsgDev( D_REPORT, "lowest vector at %f\n", vmin );
 }
 
-bool Grab_AnimFrames( s_animation_t *panim )
+int Grab_AnimFrames( s_animation_t *panim )
 {
 	Vector	pos;
 	Radian	rot;
@@ -956,7 +1178,10 @@ bool Grab_AnimFrames( s_animation_t *panim )
 		if( sscanf( line, "%d %f %f %f %f %f %f", &index, &pos[0], &pos[1], &pos[2], &rot[0], &rot[1], &rot[2] ) == 7 )
 		{
 			if( panim->source.startframe < 0 )
+			{
+				if( smd_prefetch ) return SMD_ERROR;
 				COM_FatalError( "missing frame start(%d) : %s\n", linecount, line );
+			}
 
 			panim->rawanim[t][index].pos = pos;
 			panim->rawanim[t][index].rot = rot;
@@ -965,6 +1190,7 @@ bool Grab_AnimFrames( s_animation_t *panim )
 
 		if( sscanf( line, "%1023s %d", cmd, &index ) == 0 )
 		{
+			if( smd_prefetch ) return SMD_ERROR;
 			COM_FatalError( "(%d) : %s", linecount, line );
 			continue;
 		}
@@ -977,7 +1203,10 @@ bool Grab_AnimFrames( s_animation_t *panim )
 				panim->source.startframe = t;
 
 			if( t < panim->source.startframe )
+			{
+				if( smd_prefetch ) return SMD_ERROR;
 				COM_FatalError( "frame error(%d) : %s\n", linecount, line );
+			}
 
 			if( t > panim->source.endframe )
 				panim->source.endframe = t;
@@ -986,10 +1215,11 @@ bool Grab_AnimFrames( s_animation_t *panim )
 
 			if( t > MAXSTUDIOANIMFRAMES )
 			{
+				if( smd_prefetch ) return SMD_ERROR;
 				MsgDev( D_ERROR, "animation %s has too many frames. Cutted at %d\n", panim->name, MAXSTUDIOANIMFRAMES );
 				panim->source.numframes = MAXSTUDIOANIMFRAMES - 1;
 				panim->source.endframe = MAXSTUDIOANIMFRAMES - 1;
-				return false;
+				return SMD_CUTTED;
 			}
 
 			if( panim->rawanim[t] != NULL )
@@ -1016,17 +1246,22 @@ bool Grab_AnimFrames( s_animation_t *panim )
 			for( t = 0; t < panim->source.numframes; t++ )
 			{
 				if( panim->rawanim[t] == NULL )
+				{
+					if( smd_prefetch ) return SMD_ERROR;
 					COM_FatalError( "%s is missing frame %d\n", panim->name, t + panim->source.startframe );
+				}
 			}
-			return true;
+			return SMD_OK;
 		}
 
+		if( smd_prefetch ) return SMD_ERROR;
 		COM_FatalError( "(%d) : %s", linecount, line );
 	}
 
+	if( smd_prefetch ) return SMD_ERROR;
 	COM_FatalError( "unexpected EOF: %s\n", panim->name );
 
-	return true;
+	return SMD_OK;
 }
 
 void Grab_Skeleton( s_model_t *pmodel )
@@ -1082,6 +1317,7 @@ int Grab_Nodes( s_node_t *pnodes )
 		}
 	}
 
+	if( smd_prefetch ) return SMD_ERROR;
 	COM_FatalError( "Unexpected EOF at line %d\n", linecount );
 
 	return 0;
@@ -1138,20 +1374,24 @@ void Grab_Studio( s_model_t *pmodel )
 	fclose( input );
 }
 
-void Grab_Animation( const char *name, s_animation_t *panim )
+static bool Load_Animation( s_animation_t *panim )
 {
 	char	cmd[1024];
-	int	option;
-
-	Q_snprintf( filename, sizeof( filename ), "%s/%s", cddir[numdirs], name );
-	COM_DefaultExtension( filename, ".smd" );
+	int	option, status;
 
 	if( !COM_FileExists( filename ))
+	{
+		if( smd_prefetch ) return false;
 		COM_FatalError ("%s doesn't exist\n", filename);
+	}
 
 	if(( input = fopen( filename, "r" )) == 0 )
+	{
+		if( smd_prefetch ) return false;
 		COM_FatalError( "%s couldn't be open\n", filename );
+	}
 	linecount = 0;
+	status = SMD_OK;
 
 	while( GetLineInput( ))
 	{
@@ -1159,22 +1399,42 @@ void Grab_Animation( const char *name, s_animation_t *panim )
 		if( !Q_strcmp( cmd, "version" ))
 		{
 			if( option != 1 )
+			{
+				if( smd_prefetch )
+				{
+					status = SMD_ERROR;
+					break;
+				}
 				COM_FatalError( "%s version %i should be 1\n", filename, option );
+			}
 		}
 		else if( !Q_strcmp( cmd, "nodes" ))
 		{
 			panim->numbones = Grab_Nodes( panim->localBone );
+			if( panim->numbones == SMD_ERROR )
+			{
+				status = SMD_ERROR;
+				break;
+			}
 		}
 		else if( !Q_strcmp( cmd, "skeleton" ))
 		{
-			if( !Grab_AnimFrames( panim ))
-				break; // animation was cutted
+			status = Grab_AnimFrames( panim );
+			if( status != SMD_OK )
+				break; // animation was cutted or prefetch failed
 		}
 		else 
 		{
 			// some artists use mesh reference as default animation
 			if( Q_strcmp( cmd, "triangles" ))
+			{
+				if( smd_prefetch )
+				{
+					status = SMD_ERROR;
+					break;
+				}
 				MsgDev( D_WARN, "unknown studio command\n" );
+			}
 
 			while( GetLineInput( ))
 			{
@@ -1185,6 +1445,289 @@ void Grab_Animation( const char *name, s_animation_t *panim )
 	}
 
 	fclose( input );
+	input = NULL;
+
+	return ( status != SMD_ERROR );
+}
+
+/*
+==============================================================================
+
+ANIMATION PREFETCH
+
+SMD parsing is the slowest part of loading the script, so before the script
+runs the .smd files of its $animation and $sequence commands are parsed on the
+thread pool. Grab_Animation takes the frames from there instead of reading the
+file again.
+The same parser runs in both cases so the frames are identical, files that
+would print anything are dropped and loaded the usual way
+==============================================================================
+*/
+typedef struct
+{
+	char		filename[1024];	// exactly as Grab_Animation builds it
+	bool		valid;
+	int		numbones;
+	s_node_t		*localBone;	// [MAXSTUDIOSRCBONES]
+	s_source_t	source;
+	int		numrawanim;
+	s_bone_t		**rawanim;
+} s_prefetch_t;
+
+static CUtlArray< s_prefetch_t >	g_prefetch;
+static char		g_prefetchscript[1024];	// empty for the autogenerated scripts
+static s_animation_t	*g_prefetchanim[MAX_THREADS];	// scratch animation for each thread
+
+static void PrefetchAnimationThread( int num, int threadnum )
+{
+	s_prefetch_t	*pf = &g_prefetch[num];
+	s_animation_t	*panim;
+	int		i;
+
+	if( !g_prefetchanim[threadnum] )
+		g_prefetchanim[threadnum] = (s_animation_t *)Mem_Alloc( sizeof( s_animation_t ));
+	panim = g_prefetchanim[threadnum];
+
+	Q_strncpy( filename, pf->filename, sizeof( filename ));
+
+	smd_prefetch = true;
+	bool loaded = Load_Animation( panim );
+	smd_prefetch = false;
+
+	if( !loaded )
+	{
+		for( i = 0; i < MAXSTUDIOANIMATIONS; i++ )
+			Mem_Free( panim->rawanim[i] );
+		memset( panim, 0, sizeof( *panim ));
+		return;
+	}
+
+	for( i = 0; i < MAXSTUDIOANIMATIONS; i++ )
+	{
+		if( panim->rawanim[i] )
+			pf->numrawanim = i + 1;
+	}
+
+	pf->rawanim = (s_bone_t **)Mem_Alloc( Q_max( pf->numrawanim, 1 ) * sizeof( s_bone_t* ));
+	memcpy( pf->rawanim, panim->rawanim, pf->numrawanim * sizeof( s_bone_t* ));
+	pf->localBone = (s_node_t *)Mem_Alloc( sizeof( panim->localBone ));
+	memcpy( pf->localBone, panim->localBone, sizeof( panim->localBone ));
+	pf->numbones = panim->numbones;
+	pf->source = panim->source;
+	pf->valid = true;
+
+	memset( panim, 0, sizeof( *panim ));
+}
+
+static void PrefetchFile( const char *dir, const char *name )
+{
+	char	path[1024];
+
+	Q_snprintf( path, sizeof( path ), "%s/%s", dir, name );
+	COM_DefaultExtension( path, ".smd" );
+
+	if( Q_stricmp( COM_FileExtension( path ), "smd" ))
+		return;
+
+	for( int i = 0; i < g_prefetch.Count(); i++ )
+	{
+		if( !Q_strcmp( g_prefetch[i].filename, path ))
+			return;
+	}
+
+	if( !COM_FileExists( path ))
+		return;
+
+	int i = g_prefetch.AddToTail();
+	memset( &g_prefetch[i], 0, sizeof( s_prefetch_t ));
+	Q_strncpy( g_prefetch[i].filename, path, sizeof( g_prefetch[0].filename ));
+}
+
+// reads the next token of a $sequence or $animation the way
+// ParseSequence does, braces let the command span several lines
+static bool PrefetchToken( int *depth )
+{
+	if( *depth > 0 )
+	{
+		if( !GetToken( true ) || endofscript )
+			return false;
+	}
+	else if( !TryToken( ))
+	{
+		return false;
+	}
+
+	if( !Q_stricmp( "{", token ))
+		(*depth)++;
+	else if( !Q_stricmp( "}", token ))
+		(*depth)--;
+
+	return true;
+}
+
+/*
+=================
+PrefetchAnimations
+
+walks the script with the same tokenizer as ParseScript, so $include'd
+files are followed and $cd, $pushd and $popd build the same paths.
+Only the file of each $animation and the animation references of each
+$sequence are prefetched, references to a previous $animation are not files
+=================
+*/
+static void PrefetchAnimations( void )
+{
+	typedef struct { char name[MAXSRCSTUDIONAME]; } animname_t;
+	CUtlArray< animname_t >	animnames;
+	char	dirs[32][256];
+	int	depth = 0;
+
+	if( g_numthreads <= 1 || !g_prefetchscript[0] )
+		return;
+
+	Q_strncpy( dirs[0], cddir[0], sizeof( dirs[0] ));
+
+	while( GetToken( true ))
+	{
+		if( endofscript )
+			break;
+
+		if( !Q_stricmp( token, "$cd" ))
+		{
+			if( TryToken( ))
+				Q_strncpy( dirs[0], COM_ExpandArg( token ), sizeof( dirs[0] ));
+		}
+		else if( !Q_stricmp( token, "$pushd" ))
+		{
+			if( TryToken( ) && depth < 31 )
+			{
+				Q_strncpy( dirs[depth+1], dirs[depth], sizeof( dirs[0] ));
+				Q_strncat( dirs[depth+1], token, sizeof( dirs[0] ));
+				Q_strncat( dirs[depth+1], "/", sizeof( dirs[0] ));
+				depth++;
+			}
+		}
+		else if( !Q_stricmp( token, "$popd" ))
+		{
+			if( depth > 0 )
+				depth--;
+		}
+		else if( !Q_stricmp( token, "$animation" ))
+		{
+			int	braces = 0;
+
+			// name, then the file
+			if( !TryToken( ))
+				continue;
+
+			int i = animnames.AddToTail();
+			Q_strncpy( animnames[i].name, token, sizeof( animnames[0].name ));
+
+			if( !TryToken( ))
+				continue;
+
+			PrefetchFile( dirs[depth], token );
+
+			while( PrefetchToken( &braces ));
+		}
+		else if( !Q_stricmp( token, "$sequence" ))
+		{
+			int	braces = 0;
+
+			// skip the sequence name
+			if( !TryToken( ))
+				continue;
+
+			// options and their arguments don't name .smd files, what's left are
+			// the animation references. Implied ones are loaded from the file
+			while( PrefetchToken( &braces ))
+			{
+				if( token[0] == '{' || token[0] == '}' )
+					continue;
+
+				int i;
+				for( i = 0; i < animnames.Count(); i++ )
+				{
+					if( !Q_stricmp( token, animnames[i].name ))
+						break;
+				}
+
+				if( i == animnames.Count( ))
+					PrefetchFile( dirs[depth], token );
+			}
+		}
+	}
+
+	animnames.Purge();
+
+	// rewind the script for ParseScript
+	LoadScriptFile( g_prefetchscript );
+
+	if( !g_prefetch.Count( ))
+		return;
+
+	RunThreadsOnIndividual( g_prefetch.Count(), false, PrefetchAnimationThread );
+
+	for( int i = 0; i < MAX_THREADS; i++ )
+	{
+		Mem_Free( g_prefetchanim[i] );
+		g_prefetchanim[i] = NULL;
+	}
+}
+
+// moves the prefetched frames into the animation, each file is given out only once
+static bool FetchAnimation( s_animation_t *panim )
+{
+	for( int i = 0; i < g_prefetch.Count(); i++ )
+	{
+		s_prefetch_t	*pf = &g_prefetch[i];
+
+		if( !pf->valid || Q_strcmp( pf->filename, filename ))
+			continue;
+
+		panim->numbones = pf->numbones;
+		memcpy( panim->localBone, pf->localBone, sizeof( panim->localBone ));
+		memcpy( panim->rawanim, pf->rawanim, pf->numrawanim * sizeof( s_bone_t* ));
+		panim->source = pf->source;
+
+		Mem_Free( pf->localBone );
+		Mem_Free( pf->rawanim );
+		pf->localBone = NULL;
+		pf->rawanim = NULL;
+		pf->valid = false;
+		return true;
+	}
+
+	return false;
+}
+
+static void FreePrefetchedAnimations( void )
+{
+	for( int i = 0; i < g_prefetch.Count(); i++ )
+	{
+		s_prefetch_t	*pf = &g_prefetch[i];
+
+		if( !pf->valid )
+			continue;
+
+		for( int j = 0; j < pf->numrawanim; j++ )
+			Mem_Free( pf->rawanim[j] );
+		Mem_Free( pf->localBone );
+		Mem_Free( pf->rawanim );
+	}
+
+	g_prefetch.Purge();
+}
+
+void Grab_Animation( const char *name, s_animation_t *panim )
+{
+	Q_snprintf( filename, sizeof( filename ), "%s/%s", cddir[numdirs], name );
+	COM_DefaultExtension( filename, ".smd" );
+
+	if( FetchAnimation( panim ))
+		return;
+
+	Load_Animation( panim );
 }
 
 void Cmd_Eyeposition( void )
@@ -5475,6 +6018,9 @@ static void PrintOptionsList()
 		"     ^5-a^7   : normal blend angle\n"
 		"     ^5-h^7   : dump hitboxes\n"
 		"     ^5-g^7   : dump transition graph\n"
+		"     ^5-time^7: print time spent in each compile phase\n"
+		"     ^5-threads^7: number of threads to use\n"
+		"     ^5-numa^7: pin threads to cpu cores spread over NUMA nodes\n"
 		"     ^5-ath^7 : alpha threshold for transparency (0.0 - 1.0, default is 0.5)\n"
 		"     ^5-dev^7 : set message verbose level (1-5, default is 3)\n"
 		"\n"
@@ -5599,6 +6145,19 @@ int main( int argc, char **argv )
 			{
 				g_dump_graph = true;
 			}
+			else if (!Q_stricmp(argv[i], "-time"))
+			{
+				g_phase_times = true;
+			}
+			else if (!Q_stricmp(argv[i], "-threads"))
+			{
+				i++;
+				g_numthreads = verify_atoi(argv[i]);
+			}
+			else if (!Q_stricmp(argv[i], "-numa"))
+			{
+				g_threadaffinity = true;
+			}
 			else if (!Q_stricmp(argv[i], "-ath"))
 			{
 				i++;
@@ -5613,6 +6172,8 @@ int main( int argc, char **argv )
 		return 1;
 	}
 
+	ThreadSetDefault();
+
 	Q_strcpy( g_sequencegroup[g_numseqgroups].label, "default" );
 	g_numseqgroups = 1;
 
@@ -5641,16 +6202,21 @@ int main( int argc, char **argv )
 	}
 	else {
 		LoadScriptFile(path);
+		Q_strncpy( g_prefetchscript, path, sizeof( g_prefetchscript ));
 	}
 
 	double start = I_FloatTime();
-	ParseScript ();
-	SetSkinValues ();
+	RunPhase( "PrefetchAnimations", PrefetchAnimations );
+	RunPhase( "ParseScript", ParseScript );
+	FreePrefetchedAnimations();
+	RunPhase( "SetSkinValues", SetSkinValues );
 	SimplifyModel ();
-	WriteFile ();
+	RunPhase( "WriteFile", WriteFile );
 	ClearModel ();
 	double end = I_FloatTime();
 
+	PrintPhaseTimes();
+
 	Q_timestring((int)(end - start), str);
 	MsgDev(D_INFO, "\n");
 	MsgDev(D_INFO, "%s elapsed\n", str);
@@ -45,6 +45,7 @@ EXTERN	float	g_normal_blend;
 EXTERN	float	g_alpha_threshold;
 EXTERN	bool	g_dump_hboxes;
 EXTERN	bool	g_dump_graph;
+EXTERN	bool	g_phase_times;
 EXTERN	Vector	eyeposition;
 EXTERN	int	gflags;
 EXTERN	Vector	bbox[2];
@@ -710,6 +711,13 @@ typedef struct s_model_s
 	CUtlArray<s_normal_t> norm;
 	CUtlArray<s_srcvertex_t> srcvert;
 
+	// welding hashes, used by BuildVertexArrays only
+	CUtlArray<int> verthash;
+	CUtlArray<int> vertchain;
+	CUtlArray<int> normhash;
+	CUtlArray<int> normchain;
+	CUtlArray<int> normloose;	// longer than a unit, always checked
+
 	int		nummesh;
 	s_mesh_t		*pmesh[MAXSTUDIOMESHES];
 
@@ -884,6 +892,8 @@ int findLocalBone( const s_animation_t *panim, const char *name );
 bool IsGlobalBoneXSI( const char *name, const char *bonename );
 int LookupVertex( s_model_t *pmodel, s_srcvertex_t *srcv );
 int LookupNormal( s_model_t *pmodel, s_srcvertex_t *srcv );
+void FreeWeldHashes( s_model_t *pmodel );
+void RunPhase( const char *name, void (*func)( void ));
 int LookupAttachment( const char *name );
 void clip_rotations( float &rot );
 void clip_rotations( Radian &rot );
@@ -11,17 +11,27 @@
 #include "qvis.h"
 #include "threads.h"
 
+#if defined( __SSE2__ ) || defined( _M_X64 ) || defined( _M_AMD64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define VIS_BITS_SSE2
+#include <emmintrin.h>
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#define VIS_BITS_NEON
+#include <arm_neon.h>
+#endif
+
 int	c_chains;
 int	c_portalskip, c_leafskip;
 int	c_vistest, c_mighttest;
 int	c_mightseeupdate;
 int	active;
 
+static pstackpool_t	g_stackpools[MAX_THREADS];
+
 static bool CheckStack(int leafnum, leaf_t *leaf, threaddata_t *thread)
 {
 	pstack_t *p, *p2;
 	bool recursionStatus = false;
-	for (p = thread->pstack_head.next; p != NULL; p = p->next)
+	for (p = thread->pstack_head->next; p != NULL; p = p->next)
 	{
 		if (p->leaf == leaf)
 		{
@@ -29,7 +39,7 @@ static bool CheckStack(int leafnum, leaf_t *leaf, threaddata_t *thread)
 			recursionStatus = true;
 		}
 
-		for (p2 = thread->pstack_head.next; p2 != p; p2 = p2->next)
+		for (p2 = thread->pstack_head->next; p2 != p; p2 = p2->next)
 		{
 			if (p2->leaf == p->leaf)
 			{
@@ -177,6 +187,108 @@ static winding_t *ClipToSeperators( winding_t *source, winding_t *pass, winding_
 	return target;
 }
 
+/*
+==================
+MightSeeAnd
+
+dst = a & b, returns true if dst has any bits that are not set in vis.
+Bit strings are always a multiple of 8 bytes long (see LoadPortals)
+==================
+*/
+static inline bool MightSeeAnd( byte *dst, const byte *a, const byte *b, const byte *vis )
+{
+	int	i = 0;
+#if defined( VIS_BITS_SSE2 )
+	__m128i	more = _mm_setzero_si128();
+
+	for( ; i + 16 <= g_bitbytes; i += 16 )
+	{
+		__m128i	might = _mm_and_si128( _mm_loadu_si128( (const __m128i *)(a + i) ), _mm_loadu_si128( (const __m128i *)(b + i) ));
+		_mm_storeu_si128( (__m128i *)(dst + i), might );
+		more = _mm_or_si128( more, _mm_andnot_si128( _mm_loadu_si128( (const __m128i *)(vis + i) ), might ));
+	}
+
+	uint64_t	tail = 0;
+	if( _mm_movemask_epi8( _mm_cmpeq_epi8( more, _mm_setzero_si128( ))) != 0xFFFF )
+		tail = 1;
+#elif defined( VIS_BITS_NEON )
+	uint8x16_t	more = vdupq_n_u8( 0 );
+
+	for( ; i + 16 <= g_bitbytes; i += 16 )
+	{
+		uint8x16_t	might = vandq_u8( vld1q_u8( a + i ), vld1q_u8( b + i ));
+		vst1q_u8( dst + i, might );
+		more = vorrq_u8( more, vbicq_u8( might, vld1q_u8( vis + i )));
+	}
+
+	uint64x2_t	more64 = vreinterpretq_u64_u8( more );
+	uint64_t		tail = vgetq_lane_u64( more64, 0 ) | vgetq_lane_u64( more64, 1 );
+#else
+	uint64_t	tail = 0;
+#endif
+	for( ; i < g_bitbytes; i += 8 )
+	{
+		uint64_t	x, y, v;
+
+		memcpy( &x, a + i, 8 );
+		memcpy( &y, b + i, 8 );
+		memcpy( &v, vis + i, 8 );
+		x &= y;
+		memcpy( dst + i, &x, 8 );
+		tail |= x & ~v;
+	}
+
+	return tail != 0;
+}
+
+/*
+==================
+GetStackFrame
+
+frames are allocated once per thread with the mightsee bits right behind
+them, deep recursion doesn't need a big thread stack anymore
+==================
+*/
+static pstack_t *GetStackFrame( pstackpool_t *pool, int depth )
+{
+	if( depth < pool->numframes )
+		return pool->frames[depth];
+
+	pool->frames = (pstack_t **)Mem_Realloc( pool->frames, ( depth + 1 ) * sizeof( pstack_t* ));
+
+	while( pool->numframes <= depth )
+	{
+		pstack_t	*frame = (pstack_t *)Mem_Alloc( sizeof( pstack_t ) + g_bitbytes + 15 );
+
+		frame->mightsee = (byte *)(((size_t)( frame + 1 ) + 15 ) & ~15 );
+		frame->depth = pool->numframes;
+		pool->frames[pool->numframes++] = frame;
+	}
+
+	return pool->frames[depth];
+}
+
+/*
+==================
+FreeStackPools
+
+==================
+*/
+void FreeStackPools( void )
+{
+	for( int i = 0; i < MAX_THREADS; i++ )
+	{
+		pstackpool_t	*pool = &g_stackpools[i];
+
+		for( int j = 0; j < pool->numframes; j++ )
+			Mem_Free( pool->frames[j] );
+		if( pool->frames ) Mem_Free( pool->frames );
+
+		pool->frames = NULL;
+		pool->numframes = 0;
+	}
+}
+
 /*
 ==================
 RecursiveLeafFlow
@@ -187,10 +299,9 @@ If src_portal is NULL, this is the originating leaf
 */
 inline static void RecursiveLeafFlow( int leafnum, threaddata_t *thread, pstack_t *prevstack )
 {
-	pstack_t	stack;
+	pstack_t	*stack;
 	plane_t	backplane;
-	int	*test, *might;
-	int	more, *vis;
+	byte	*test;
 	leaf_t 	*leaf;
 	portal_t	*p;
 	vec_t	d;
@@ -212,23 +323,21 @@ inline static void RecursiveLeafFlow( int leafnum, threaddata_t *thread, pstack_
 		thread->base->numcansee++;
 	}
 	
-	prevstack->next = &stack;
-	stack.head = prevstack->head;
-	stack.numseperators[0] = 0;
-	stack.numseperators[1] = 0;
-	stack.next = NULL;
-	stack.leaf = leaf;
-	stack.portal = NULL;
-
-	might = (int *)stack.mightsee;
-	vis = (int *)thread->leafvis;
+	stack = GetStackFrame( thread->pool, prevstack->depth + 1 );
+	prevstack->next = stack;
+	stack->head = prevstack->head;
+	stack->numseperators[0] = 0;
+	stack->numseperators[1] = 0;
+	stack->next = NULL;
+	stack->leaf = leaf;
+	stack->portal = NULL;
 	
 	// check all portals for flowing into other leafs	
 	for( int i = 0; i < leaf->numportals; i++ )
 	{
 		p = leaf->portals[i];
 
-		if( !CHECKVISBIT( stack.head->mightsee, p->leaf ))
+		if( !CHECKVISBIT( stack->head->mightsee, p->leaf ))
 		{
 			c_leafskip++;
 			continue;	// can't possibly see it
@@ -243,24 +352,16 @@ inline static void RecursiveLeafFlow( int leafnum, threaddata_t *thread, pstack_
 		// if the portal can't see anything we haven't allready seen, skip it
 		if( p->status == stat_done )
 		{
-			test = (int *)p->visbits;
+			test = p->visbits;
 			c_vistest++;
 		}
 		else
 		{
-			test = (int *)p->mightsee;
+			test = p->mightsee;
 			c_mighttest++;
 		}
 
-		more = 0;
-
-		for( int j = 0; j < g_bitlongs; j++ )
-		{
-			might[j] = ((int *)prevstack->mightsee)[j] & test[j];
-			more |= (might[j] & ~vis[j]);
-		}
-		
-		if( !more )
+		if( !MightSeeAnd( stack->mightsee, prevstack->mightsee, test, thread->leafvis ))
 		{	
 			// can't see anything new
 			c_portalskip++;
@@ -268,7 +369,7 @@ inline static void RecursiveLeafFlow( int leafnum, threaddata_t *thread, pstack_
 		}
 
 		// get plane of portal, point normal into the neighbor leaf
-		stack.portalplane = p->plane;
+		stack->portalplane = p->plane;
 		VectorNegate( p->plane.normal, backplane.normal );
 		backplane.dist = -p->plane.dist;
 			
@@ -277,15 +378,15 @@ inline static void RecursiveLeafFlow( int leafnum, threaddata_t *thread, pstack_
 	
 		c_portalcheck++;
 		
-		stack.portal = p;
-		stack.next = NULL;
+		stack->portal = p;
+		stack->next = NULL;
 
-		stack.freewindings[0] = 1;
-		stack.freewindings[1] = 1;
-		stack.freewindings[2] = 1;
+		stack->freewindings[0] = 1;
+		stack->freewindings[1] = 1;
+		stack->freewindings[2] = 1;
 
-		d = DotProduct( p->origin, thread->pstack_head.portalplane.normal );
-		d -= thread->pstack_head.portalplane.dist;
+		d = DotProduct( p->origin, thread->pstack_head->portalplane.normal );
+		d -= thread->pstack_head->portalplane.dist;
 
 		if( d < -p->radius )
 		{
@@ -293,12 +394,12 @@ inline static void RecursiveLeafFlow( int leafnum, threaddata_t *thread, pstack_
 		}
 		else if( d > p->radius )
 		{
-			stack.pass = p->winding;
+			stack->pass = p->winding;
 		}
 		else	
 		{
-			stack.pass = ChopWindingEpsilon( p->winding, &stack, &thread->pstack_head.portalplane, VIS_EPSILON );
-			if( !stack.pass ) continue;
+			stack->pass = ChopWindingEpsilon( p->winding, stack, &thread->pstack_head->portalplane, VIS_EPSILON );
+			if( !stack->pass ) continue;
 		}
 
 		d = DotProduct( thread->base->origin, p->plane.normal );
@@ -310,58 +411,58 @@ inline static void RecursiveLeafFlow( int leafnum, threaddata_t *thread, pstack_
 		}
 		else if( d < -thread->base->radius )
 		{
-			stack.source = prevstack->source;
+			stack->source = prevstack->source;
 		}
 		else	
 		{
-			stack.source = ChopWindingEpsilon( prevstack->source, &stack, &backplane, VIS_EPSILON );
+			stack->source = ChopWindingEpsilon( prevstack->source, stack, &backplane, VIS_EPSILON );
 			// FIXME: shouldn't we create a new source origin and radius for fast checks?
-			if( !stack.source ) continue;
+			if( !stack->source ) continue;
 		}
 
 		if( !prevstack->pass )
 		{	
 			// the second leaf can only be blocked if coplanar
-			RecursiveLeafFlow( p->leaf, thread, &stack );
+			RecursiveLeafFlow( p->leaf, thread, stack );
 			continue;
 		}
 
-		stack.pass = ChopWindingEpsilon( stack.pass, &stack, &prevstack->portalplane, VIS_EPSILON );
-		if( !stack.pass ) continue;
+		stack->pass = ChopWindingEpsilon( stack->pass, stack, &prevstack->portalplane, VIS_EPSILON );
+		if( !stack->pass ) continue;
 		
 		c_portaltest++;
 
-		if( stack.numseperators[0] )
+		if( stack->numseperators[0] )
 		{
 			int n;
-			for( n = 0; n < stack.numseperators[0]; n++ )
+			for( n = 0; n < stack->numseperators[0]; n++ )
 			{
-				stack.pass = ChopWindingEpsilon( stack.pass, &stack, &stack.seperators[0][n], VIS_EPSILON );
-				if( !stack.pass ) break; // target is not visible
+				stack->pass = ChopWindingEpsilon( stack->pass, stack, &stack->seperators[0][n], VIS_EPSILON );
+				if( !stack->pass ) break; // target is not visible
 			}
 
-			if( n < stack.numseperators[0] )
+			if( n < stack->numseperators[0] )
 				continue;
 		}
-		else stack.pass = ClipToSeperators( stack.source, prevstack->pass, stack.pass, false, &stack );
-		if( !stack.pass ) continue;
+		else stack->pass = ClipToSeperators( stack->source, prevstack->pass, stack->pass, false, stack );
+		if( !stack->pass ) continue;
 
-		if( stack.numseperators[1] )
+		if( stack->numseperators[1] )
 		{
-			for( int n = 0; n < stack.numseperators[1]; n++ )
+			for( int n = 0; n < stack->numseperators[1]; n++ )
 			{
-				stack.pass = ChopWindingEpsilon( stack.pass, &stack, &stack.seperators[1][n], VIS_EPSILON );
-				if( !stack.pass ) break; // target is not visible
+				stack->pass = ChopWindingEpsilon( stack->pass, stack, &stack->seperators[1][n], VIS_EPSILON );
+				if( !stack->pass ) break; // target is not visible
 			}
 		}
-		else stack.pass = ClipToSeperators( prevstack->pass, stack.source, stack.pass, true, &stack );
-		if( !stack.pass ) continue;
+		else stack->pass = ClipToSeperators( prevstack->pass, stack->source, stack->pass, true, stack );
+		if( !stack->pass ) continue;
 
 		c_portalpass++;
 
 		// flow through it for real
-		RecursiveLeafFlow( p->leaf, thread, &stack );
-		stack.next = NULL;
+		RecursiveLeafFlow( p->leaf, thread, stack );
+		stack->next = NULL;
 	}	
 }
 
@@ -465,32 +566,34 @@ static void PortalCompleted( portal_t *completed )
 
 /*
 ===============
-PortalFlow
+FlowPortal
 
 ===============
 */
-void PortalFlow( int portalnum, int threadnum )
+static void FlowPortal( portal_t *p, int threadnum )
 {
 	threaddata_t	data;
-	portal_t		*p;
+	pstack_t		*head;
 
-	p = g_sorted_portals[portalnum];
-	p->status = stat_working;
-	
 	p->visbits = (byte *)Mem_Alloc( g_bitbytes );
 	memset( &data, 0, sizeof( data ));
 	data.leafvis = p->visbits;
 	data.base = p;
-
-	data.pstack_head.head = &data.pstack_head;	
-	data.pstack_head.portal = p;
-	data.pstack_head.source = p->winding;
-	data.pstack_head.portalplane = p->plane;
-
-	for( int i = 0; i < g_bitlongs; i++ )
-		((int *)data.pstack_head.mightsee)[i] = ((int *)p->mightsee)[i];
-
-	RecursiveLeafFlow( p->leaf, &data, &data.pstack_head );
+	data.pool = &g_stackpools[threadnum];
+	data.pstack_head = head = GetStackFrame( data.pool, 0 );
+
+	head->head = head;
+	head->next = NULL;
+	head->leaf = NULL;
+	head->portal = p;
+	head->source = p->winding;
+	head->pass = NULL;
+	head->portalplane = p->plane;
+	head->numseperators[0] = 0;
+	head->numseperators[1] = 0;
+	memcpy( head->mightsee, p->mightsee, g_bitbytes );
+
+	RecursiveLeafFlow( p->leaf, &data, head );
 	p->status = stat_done;
 #ifdef HLVIS_MERGE_PORTALS
 	PortalCompleted( p );
@@ -503,31 +606,30 @@ PortalFlow
 
 ===============
 */
-void PortalFlow( portal_t *p )
+void PortalFlow( int portalnum, int threadnum )
 {
-	threaddata_t	data;
+	portal_t	*p;
 
-	if( p->status != stat_working )
-		COM_FatalError( "PortalFlow: reflowed\n" );
+	p = g_sorted_portals[portalnum];
+	if( p->status == stat_done )
+		return;	// reused from the vis cache
 
-	p->visbits = (byte *)Mem_Alloc( g_bitbytes );
-	memset( &data, 0, sizeof( data ));
-	data.leafvis = p->visbits;
-	data.base = p;
+	p->status = stat_working;
+	FlowPortal( p, threadnum );
+}
 
-	data.pstack_head.head = &data.pstack_head;	
-	data.pstack_head.portal = p;
-	data.pstack_head.source = p->winding;
-	data.pstack_head.portalplane = p->plane;
+/*
+===============
+PortalFlow
 
-	for( int i = 0; i < g_bitlongs; i++ )
-		((int *)data.pstack_head.mightsee)[i] = ((int *)p->mightsee)[i];
+===============
+*/
+void PortalFlow( portal_t *p, int threadnum )
+{
+	if( p->status != stat_working )
+		COM_FatalError( "PortalFlow: reflowed\n" );
 
-	RecursiveLeafFlow( p->leaf, &data, &data.pstack_head );
-	p->status = stat_done;
-#ifdef HLVIS_MERGE_PORTALS
-	PortalCompleted( p );
-#endif
+	FlowPortal( p, threadnum );
 }
 
 /*
@@ -582,6 +684,9 @@ void BasePortalVis( int threadnum )
 
 		p = &g_portals[i];
 
+		if( p->status == stat_done )
+			continue;	// reused from the vis cache
+
 		p->mightsee = (byte *)Mem_Alloc( g_bitbytes );
 		memset( portalsee, 0, g_numportals * 2 );
 		VectorNegate( p->plane.normal, backnormal );
@@ -108,7 +108,7 @@ static void LeafThread( int thread )
 	{
 		if(( p = GetNextPortal()) == NULL )
 			break;
-		PortalFlow( p );
+		PortalFlow( p, thread );
 	};
 }
 
@@ -228,7 +228,8 @@ void LeafFlow( int leafnum )
 		}
 	}
 
-	memset( outbuffer2, 0, diskbytes );
+	// the reuse check below compares g_bitbytes, which may be longer than diskbytes
+	memset( outbuffer2, 0, Q_max( diskbytes, g_bitbytes ));
 
 	for( i = 0; i < g_portalleafs; i++ )
 	{
@@ -298,6 +299,7 @@ static void CalcPortalVis( void )
 #else
 	RunThreadsOn( g_numportals * 2, true, LeafThread );
 #endif
+	FreeStackPools();
 	MsgDev( D_REPORT, "portalcheck: %i  portaltest: %i  portalpass: %i\n", c_portalcheck, c_portaltest, c_portalpass );
 	MsgDev( D_REPORT, "c_vistest: %i  c_mighttest: %i, c_merged %i\n", c_vistest, c_mighttest, c_mightseeupdate );
 }
@@ -562,10 +564,12 @@ static void PrintVisUsage( void )
 	Msg( "\n-= %s Options =-\n\n", APP_ABBREVIATION );
 	Msg( "    -dev #         : compile with developer message (1 - 4). default is %d\n", DEFAULT_DEVELOPER );
 	Msg( "    -threads #     : manually specify the number of threads to run\n" );
+	Msg( "    -numa          : pin threads to cpu cores spread over NUMA nodes\n" );
  	Msg( "    -fast          : only do first quick pass on vis calculations\n" );
 	Msg( "    -nosort        : don't sort portals (disable optimization)\n" );
 	Msg( "    -maxdistance   : limit visible distance (e.g. for fogged levels)\n" );
 	Msg( "    -compat <type> : enable compatibility mode (goldsrc/xashxt)\n" );
+	Msg( "    -noviscache    : don't reuse portal visibility from the previous run\n" );
 	Msg( "    bspfile        : The bspfile to compile\n\n" );
 }
 
@@ -617,6 +621,10 @@ int main( int argc, char **argv )
 			g_numthreads = atoi( argv[i+1] );
 			i++;
 		}
+		else if( !Q_strcmp( argv[i], "-numa" ))
+		{
+			g_threadaffinity = true;
+		}
 		else if( !Q_strcmp( argv[i], "-fast" ))
 		{
 			g_fastvis = true;
@@ -625,6 +633,10 @@ int main( int argc, char **argv )
 		{
 			g_nosort = true;
 		}
+		else if( !Q_strcmp( argv[i], "-noviscache" ))
+		{
+			g_noviscache = true;
+		}
 		else if( !Q_strcmp( argv[i], "-maxdistance" ))
 		{
 			g_farplane = atof( argv[i+1] );
@@ -691,11 +703,16 @@ int main( int argc, char **argv )
 
 	LoadBSPFile( source );
 	LoadPortals( portalfile );
+
+	// untouched portals keep their vis from the last run
+	if( !g_fastvis ) LoadVisCache( source );
 	
 	g_uncompressed = (byte *)Mem_Alloc( g_bitbytes * g_portalleafs );
 
 	CalcVis ();
 
+	if( !g_fastvis ) SaveVisCache( source );
+
 	MsgDev( D_REPORT, "c_chains: %i\n", c_chains );
 	g_visdatasize = vismap_p - g_dvisdata;	
 
@@ -73,27 +73,35 @@ typedef struct leaf_s
 	
 typedef struct pstack_s
 {
-	byte		mightsee[MAX_MAP_LEAFS/8];	// bit string
+	byte		*mightsee;		// bit string, g_bitbytes long
 	struct pstack_s	*head;
 	struct pstack_s	*next;
 	leaf_t		*leaf;
 	portal_t		*portal;			// portal exiting
 	winding_t		*source;
 	winding_t		*pass;
-
-	winding_t		windings[3];		// source, pass, temp in any order
+	int		depth;
 	int		freewindings[3];
-
+	int		numseperators[2];
 	plane_t		portalplane;
+
+	winding_t		windings[3];		// source, pass, temp in any order
 	plane_t		seperators[2][MAX_SEPERATORS];
-	int		numseperators[2];
 } pstack_t;
 
+// recursion frames of a thread, they are kept between the portals
+typedef struct
+{
+	pstack_t		**frames;
+	int		numframes;
+} pstackpool_t;
+
 typedef struct
 {
 	byte		*leafvis;		// bit string
 	portal_t		*base;
-	pstack_t		pstack_head;
+	pstackpool_t	*pool;
+	pstack_t		*pstack_head;
 } threaddata_t;
 
 extern int	g_numportals;
@@ -116,13 +124,21 @@ extern int	g_bitbytes;
 extern int	g_bitlongs;
 extern vec_t	g_farplane;
 extern size_t	g_compatibility_mode;
+extern bool	g_noviscache;
 
 void LeafFlow( int leafnum );
 void BasePortalVis( int threadnum );
-void PortalFlow( int portalnum, int threadnum = -1 );
-void PortalFlow( portal_t *p );
+void PortalFlow( int portalnum, int threadnum );
+void PortalFlow( portal_t *p, int threadnum );
+void FreeStackPools( void );
 void CalcAmbientSounds( void );
 
+//
+// viscache.c
+//
+int LoadVisCache( const char *source );
+void SaveVisCache( const char *source );
+
 //
 // winding.c
 //
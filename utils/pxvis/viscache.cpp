@@ -0,0 +1,487 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// viscache.c	// per-portal results of the previous run for incremental vis
+
+#include "qvis.h"
+#include "crclib.h"
+
+#define VIS_CACHE_IDENT		(('C'<<24)+('V'<<16)+('X'<<8)+'P')	// little-endian "PXVC"
+#define VIS_CACHE_VERSION		1
+
+/*
+==============================================================================
+
+mapname.vsc keeps mightsee and visbits of every portal from the last full vis.
+Leafs are identified by the windings of their portals, not by their numbers,
+because any change of the geometry renumbers the portal leafs. A portal is
+reused when it and every leaf of its old mightsee region came through the
+change untouched: the flood can't leave mightsee, so the result is the same.
+
+header, numportals * dvisportal_t, numportals * ( mightsee, visbits )
+==============================================================================
+*/
+typedef struct
+{
+	int		ident;
+	int		version;
+	int		portalleafs;
+	int		numportals;		// memory portals, twice the count in the .prt
+	int		bitbytes;
+	float		farplane;
+} dvisheader_t;
+
+typedef struct
+{
+	byte		hash[16];			// MD5 of the winding
+	int		fromleaf;
+	int		leaf;			// neighbor
+} dvisportal_t;
+
+// used to build leaf signatures from an unordered set of portals
+typedef struct
+{
+	int		leaf;
+	const byte	*hash;
+} leafportal_t;
+
+typedef struct
+{
+	byte		hash[16];
+	int		index;
+} hashindex_t;
+
+bool		g_noviscache = false;
+
+static void GetVisCacheName( const char *source, char *out, size_t size )
+{
+	char	name[MAX_PATH];
+
+	Q_strncpy( name, source, sizeof( name ));
+	COM_StripExtension( name );
+	Q_snprintf( out, size, "%s.vsc", name );
+}
+
+static void HashWinding( const winding_t *w, byte hash[16] )
+{
+	MD5Context_t	ctx;
+
+	MD5Init( &ctx );
+	MD5Update( &ctx, (byte *)&w->numpoints, sizeof( w->numpoints ));
+	MD5Update( &ctx, (byte *)w->p, w->numpoints * sizeof( vec3_t ));
+	MD5Final( hash, &ctx );
+}
+
+static int LeafPortalCompare( const void *a, const void *b )
+{
+	const leafportal_t	*pa = (const leafportal_t *)a;
+	const leafportal_t	*pb = (const leafportal_t *)b;
+
+	if( pa->leaf != pb->leaf )
+		return ( pa->leaf < pb->leaf ) ? -1 : 1;
+	return memcmp( pa->hash, pb->hash, 16 );
+}
+
+static int HashIndexCompare( const void *a, const void *b )
+{
+	const hashindex_t	*pa = (const hashindex_t *)a;
+	const hashindex_t	*pb = (const hashindex_t *)b;
+	int		cmp = memcmp( pa->hash, pb->hash, 16 );
+
+	if( cmp ) return cmp;
+	return ( pa->index < pb->index ) ? -1 : ( pa->index > pb->index );
+}
+
+/*
+=============
+LeafSignatures
+
+MD5 of the sorted portal hashes of each leaf, so the signature doesn't
+depend on the order portals were written into the .prt
+=============
+*/
+static void LeafSignatures( int numleafs, int numportals, const byte (*hashes)[16], const int *fromleaf, hashindex_t *out )
+{
+	leafportal_t	*list = (leafportal_t *)Mem_Alloc( numportals * sizeof( leafportal_t ));
+	int		i, j;
+
+	for( i = 0; i < numportals; i++ )
+	{
+		list[i].leaf = fromleaf[i];
+		list[i].hash = hashes[i];
+	}
+
+	qsort( list, numportals, sizeof( leafportal_t ), LeafPortalCompare );
+
+	for( i = j = 0; i < numleafs; i++ )
+	{
+		MD5Context_t	ctx;
+
+		MD5Init( &ctx );
+		for( ; j < numportals && list[j].leaf == i; j++ )
+			MD5Update( &ctx, list[j].hash, 16 );
+		MD5Final( out[i].hash, &ctx );
+		out[i].index = i;
+	}
+
+	Mem_Free( list );
+
+	qsort( out, numleafs, sizeof( hashindex_t ), HashIndexCompare );
+}
+
+/*
+=============
+FindUniqueHash
+
+binary search in the sorted list, hashes that occur
+more than once are ambiguous and never match
+=============
+*/
+static int FindUniqueHash( const hashindex_t *list, int count, const byte hash[16] )
+{
+	int	lo = 0, hi = count;
+
+	while( lo < hi )
+	{
+		int	mid = (lo + hi) >> 1;
+
+		if( memcmp( list[mid].hash, hash, 16 ) < 0 )
+			lo = mid + 1;
+		else hi = mid;
+	}
+
+	if( lo == count || memcmp( list[lo].hash, hash, 16 ))
+		return -1;
+
+	if( lo + 1 < count && !memcmp( list[lo+1].hash, hash, 16 ))
+		return -1;
+
+	return list[lo].index;
+}
+
+/*
+=============
+RemapVisBits
+
+translate a bit string from the cached leaf numbering into the current one,
+returns false if it refers to a leaf that doesn't exist anymore
+=============
+*/
+static bool RemapVisBits( const byte *in, int inbytes, const int *leafmap, const bool *cleanleaf, byte *out )
+{
+	for( int i = 0; i < inbytes; i++ )
+	{
+		if( !in[i] ) continue;
+
+		for( int bit = 0; bit < 8; bit++ )
+		{
+			if( !( in[i] & BIT( bit )))
+				continue;
+
+			int	leafnum = leafmap[(i << 3) + bit];
+
+			if( leafnum == -1 || ( cleanleaf && !cleanleaf[leafnum] ))
+				return false;
+			if( out ) SETVISBIT( out, leafnum );
+		}
+	}
+
+	return true;
+}
+
+/*
+=============
+VisBitsInRange
+
+bit strings are padded to 64 bits, the padding
+must be clear because leafmap ends at numleafs
+=============
+*/
+static bool VisBitsInRange( const byte *bits, int bitbytes, int numleafs )
+{
+	for( int i = numleafs; i < ( bitbytes << 3 ); i++ )
+	{
+		if( CHECKVISBIT( bits, i ))
+			return false;
+	}
+
+	return true;
+}
+
+static void GetPortalOwners( int *fromleaf )
+{
+	for( int i = 0; i < g_portalleafs; i++ )
+	{
+		for( int j = 0; j < g_leafs[i].numportals; j++ )
+			fromleaf[g_leafs[i].portals[j] - g_portals] = i;
+	}
+}
+
+/*
+=============
+LoadVisCache
+
+marks the portals that can be reused as stat_done and fills their
+mightsee and visbits. Returns the number of reused portals
+=============
+*/
+int LoadVisCache( const char *source )
+{
+	const dvisheader_t	*header;
+	const dvisportal_t	*in;
+	char		filename[MAX_PATH];
+	size_t		filesize;
+	byte		*cache;
+	int		i, numportals;
+	int		numreused = 0;
+
+	if( g_noviscache || !g_numportals )
+		return 0;
+
+	GetVisCacheName( source, filename, sizeof( filename ));
+	cache = COM_MapFile( filename, &filesize );
+
+	if( !cache )
+		return 0;
+
+	header = (dvisheader_t *)cache;
+
+	if( filesize < sizeof( dvisheader_t ) || header->ident != VIS_CACHE_IDENT || header->version != VIS_CACHE_VERSION )
+	{
+		MsgDev( D_WARN, "%s has wrong format, ignored\n", filename );
+		COM_UnmapFile( cache, filesize );
+		return 0;
+	}
+
+	if( header->farplane != g_farplane || header->portalleafs <= 0 || header->numportals <= 0
+	|| header->bitbytes != ((header->portalleafs + 63) & ~63) >> 3 )
+	{
+		MsgDev( D_INFO, "vis cache is outdated\n" );
+		COM_UnmapFile( cache, filesize );
+		return 0;
+	}
+
+	if( sizeof( dvisheader_t ) + (size_t)header->numportals * ( sizeof( dvisportal_t ) + header->bitbytes * 2 ) != filesize )
+	{
+		MsgDev( D_WARN, "%s is truncated, ignored\n", filename );
+		COM_UnmapFile( cache, filesize );
+		return 0;
+	}
+
+	numportals = g_numportals * 2;
+	in = (dvisportal_t *)(cache + sizeof( dvisheader_t ));
+	const byte *bits = (byte *)(in + header->numportals);
+
+	for( i = 0; i < header->numportals; i++ )
+	{
+		const byte *portalbits = bits + (size_t)i * header->bitbytes * 2;
+
+		if((uint)in[i].fromleaf >= (uint)header->portalleafs || (uint)in[i].leaf >= (uint)header->portalleafs
+		|| !VisBitsInRange( portalbits, header->bitbytes, header->portalleafs )
+		|| !VisBitsInRange( portalbits + header->bitbytes, header->bitbytes, header->portalleafs ))
+		{
+			MsgDev( D_WARN, "%s has bad portal %i, ignored\n", filename, i );
+			COM_UnmapFile( cache, filesize );
+			return 0;
+		}
+	}
+
+	// hash the current portals
+	byte		(*hashes)[16] = (byte (*)[16])Mem_Alloc( numportals * 16 );
+	int		*fromleaf = (int *)Mem_Alloc( numportals * sizeof( int ));
+	byte		(*oldhashes)[16] = (byte (*)[16])Mem_Alloc( header->numportals * 16 );
+	int		*oldfromleaf = (int *)Mem_Alloc( header->numportals * sizeof( int ));
+
+	for( i = 0; i < numportals; i++ )
+		HashWinding( g_portals[i].winding, hashes[i] );
+	GetPortalOwners( fromleaf );
+
+	for( i = 0; i < header->numportals; i++ )
+	{
+		memcpy( oldhashes[i], in[i].hash, 16 );
+		oldfromleaf[i] = in[i].fromleaf;
+	}
+
+	// match the leafs by signature
+	hashindex_t	*newleafs = (hashindex_t *)Mem_Alloc( g_portalleafs * sizeof( hashindex_t ));
+	hashindex_t	*oldleafs = (hashindex_t *)Mem_Alloc( header->portalleafs * sizeof( hashindex_t ));
+	int		*leafmap = (int *)Mem_Alloc( header->portalleafs * sizeof( int ));
+	bool		*cleanleaf = (bool *)Mem_Alloc( g_portalleafs * sizeof( bool ));
+
+	LeafSignatures( g_portalleafs, numportals, hashes, fromleaf, newleafs );
+	LeafSignatures( header->portalleafs, header->numportals, oldhashes, oldfromleaf, oldleafs );
+
+	for( i = 0; i < header->portalleafs; i++ )
+		leafmap[i] = -1;
+
+	for( i = 0; i < header->portalleafs; i++ )
+	{
+		if( FindUniqueHash( oldleafs, header->portalleafs, oldleafs[i].hash ) == -1 )
+			continue;
+		leafmap[oldleafs[i].index] = FindUniqueHash( newleafs, g_portalleafs, oldleafs[i].hash );
+	}
+
+	// match the portals by winding and mapped leafs
+	hashindex_t	*oldportals = (hashindex_t *)Mem_Alloc( header->numportals * sizeof( hashindex_t ));
+	int		*portalmap = (int *)Mem_Alloc( numportals * sizeof( int ));
+
+	for( i = 0; i < header->numportals; i++ )
+	{
+		memcpy( oldportals[i].hash, in[i].hash, 16 );
+		oldportals[i].index = i;
+	}
+	qsort( oldportals, header->numportals, sizeof( hashindex_t ), HashIndexCompare );
+
+	for( i = 0; i < numportals; i++ )
+	{
+		int	j = FindUniqueHash( oldportals, header->numportals, hashes[i] );
+
+		portalmap[i] = -1;
+		if( j == -1 ) continue;
+
+		if( leafmap[in[j].fromleaf] == fromleaf[i] && leafmap[in[j].leaf] == g_portals[i].leaf )
+			portalmap[i] = j;
+	}
+
+	// leaf is clean when all of its portals survived with the same neighbors
+	for( i = 0; i < header->portalleafs; i++ )
+	{
+		if( leafmap[i] != -1 )
+			cleanleaf[leafmap[i]] = true;
+	}
+
+	for( i = 0; i < numportals; i++ )
+	{
+		if( portalmap[i] == -1 )
+			cleanleaf[fromleaf[i]] = false;
+	}
+
+	// reuse portals whose whole mightsee region is clean
+	for( i = 0; i < numportals; i++ )
+	{
+		portal_t	*p = &g_portals[i];
+		int	j = portalmap[i];
+
+		if( j == -1 || !cleanleaf[fromleaf[i]] )
+			continue;
+
+		const byte *oldmightsee = bits + (size_t)j * header->bitbytes * 2;
+		const byte *oldvisbits = oldmightsee + header->bitbytes;
+
+		if( !RemapVisBits( oldmightsee, header->bitbytes, leafmap, cleanleaf, NULL ))
+			continue;
+
+		p->mightsee = (byte *)Mem_Alloc( g_bitbytes );
+		p->visbits = (byte *)Mem_Alloc( g_bitbytes );
+		RemapVisBits( oldmightsee, header->bitbytes, leafmap, NULL, p->mightsee );
+		RemapVisBits( oldvisbits, header->bitbytes, leafmap, NULL, p->visbits );
+
+		p->nummightsee = p->numcansee = 0;
+		for( int k = 0; k < g_portalleafs; k++ )
+		{
+			if( CHECKVISBIT( p->mightsee, k ))
+				p->nummightsee++;
+			if( CHECKVISBIT( p->visbits, k ))
+				p->numcansee++;
+		}
+
+		p->status = stat_done;
+		numreused++;
+	}
+
+	Mem_Free( portalmap );
+	Mem_Free( oldportals );
+	Mem_Free( cleanleaf );
+	Mem_Free( leafmap );
+	Mem_Free( oldleafs );
+	Mem_Free( newleafs );
+	Mem_Free( oldfromleaf );
+	Mem_Free( oldhashes );
+	Mem_Free( fromleaf );
+	Mem_Free( hashes );
+
+	COM_UnmapFile( cache, filesize );
+
+	Msg( "vis cache: %i of %i portals reused\n", numreused, numportals );
+
+	return numreused;
+}
+
+/*
+=============
+SaveVisCache
+
+=============
+*/
+void SaveVisCache( const char *source )
+{
+	dvisheader_t	header;
+	dvisportal_t	out;
+	char		filename[MAX_PATH];
+	int		numportals;
+	int		*fromleaf;
+	FILE		*f;
+
+	if( g_noviscache || !g_numportals )
+		return;
+
+	numportals = g_numportals * 2;
+
+	memset( &header, 0, sizeof( header ));
+	header.ident = VIS_CACHE_IDENT;
+	header.version = VIS_CACHE_VERSION;
+	header.portalleafs = g_portalleafs;
+	header.numportals = numportals;
+	header.bitbytes = g_bitbytes;
+	header.farplane = g_farplane;
+
+	GetVisCacheName( source, filename, sizeof( filename ));
+
+	if(( f = fopen( filename, "wb" )) == NULL )
+	{
+		MsgDev( D_WARN, "couldn't write %s\n", filename );
+		return;
+	}
+
+	fromleaf = (int *)Mem_Alloc( numportals * sizeof( int ));
+	GetPortalOwners( fromleaf );
+
+	bool	success = ( fwrite( &header, sizeof( header ), 1, f ) == 1 );
+
+	for( int i = 0; i < numportals && success; i++ )
+	{
+		memset( &out, 0, sizeof( out ));
+		HashWinding( g_portals[i].winding, out.hash );
+		out.fromleaf = fromleaf[i];
+		out.leaf = g_portals[i].leaf;
+
+		success = ( fwrite( &out, sizeof( out ), 1, f ) == 1 );
+	}
+
+	for( int i = 0; i < numportals && success; i++ )
+	{
+		portal_t	*p = &g_portals[i];
+
+		if( p->status != stat_done || !p->mightsee || !p->visbits )
+			COM_FatalError( "SaveVisCache: portal %i is not done\n", i );
+
+		if( fwrite( p->mightsee, g_bitbytes, 1, f ) != 1 || fwrite( p->visbits, g_bitbytes, 1, f ) != 1 )
+			success = false;
+	}
+
+	fclose( f );
+	Mem_Free( fromleaf );
+
+	if( !success )
+	{
+		MsgDev( D_WARN, "couldn't write %s\n", filename );
+		remove( filename );
+	}
+}
@@ -75,11 +75,13 @@ FreeStackWinding
 */
 static void FreeStackWinding( winding_t *w, pstack_t *stack )
 {
-	int	i = w - stack->windings;
-
-	if( i < 0 || i > 2 )
+	// compare the pointers before the subtraction, the frames are
+	// on the heap now and a portal winding may lie right before them
+	if( w < stack->windings || w > &stack->windings[2] )
 		return; // not from local
 
+	int	i = w - stack->windings;
+
 	if( stack->freewindings[i] )
 		COM_FatalError( "FreeStackWinding: allready free\n" );
 	stack->freewindings[i] = 1;